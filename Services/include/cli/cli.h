@@ -22,7 +22,9 @@
 #ifndef EX2_SERVICES_SERVICES_INCLUDE_CLI_H_
 #define EX2_SERVICES_SERVICES_INCLUDE_CLI_H_
 
-#define CLI_SVC_SIZE 1000
+#define CLI_SVC_SIZE 256
+/* Stack of each session task, which runs the commands */
+#define CLI_SESSION_SIZE 1000
 
 SAT_returnState start_cli_service(void);
 
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file cli_bench.h
+ * @date 2022-03-14
+ *
+ * The bench CLI command: micro-benchmarks timed on the OBC with the Cortex-R5
+ * cycle counter. Where a benchmark has a counterpart in the host suite
+ * (make bench) it has the same name, so the two can be compared.
+ */
+
+#ifndef CLI_BENCH_H
+#define CLI_BENCH_H
+
+#include "services.h"
+
+#define CLI_BENCH_DEFAULT_SAMPLES 11
+#define CLI_BENCH_MAX_SAMPLES 31
+/* Operations per sample are doubled until a sample takes at least this long */
+#define CLI_BENCH_SAMPLE_MS 2
+#define CLI_BENCH_MAX_OPS 65536
+/* Scratch file of the file system and housekeeping benchmarks, deleted after each */
+#define CLI_BENCH_FILE "VOL0:/cli_bench.tmp"
+#define CLI_BENCH_FILE_SIZE (64 * 1024)
+/* Port the CSP loopback benchmark sends to itself on */
+#define CLI_BENCH_CSP_PORT 30
+
+SAT_returnState cli_bench_init(void);
+
+void register_cli_bench(void);
+
+#endif /* CLI_BENCH_H */
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file cli_session.h
+ * @date 2022-03-14
+ *
+ * CLI sessions. Each CLI connection is served by a session of its own, which
+ * holds the command being run, the state that command keeps between calls
+ * and the buffer it writes its output into, so sessions can run commands at
+ * the same time. Commands are registered here rather than with FreeRTOS+CLI,
+ * whose interpreter remembers the running command in a static. Commands
+ * registered with FreeRTOS+CLI by other code still work: they are run through
+ * its interpreter by one session at a time.
+ */
+
+#ifndef CLI_SESSION_H
+#define CLI_SESSION_H
+
+#include <FreeRTOS.h>
+#include <FreeRTOS-Plus-CLI/FreeRTOS_CLI.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "services.h"
+
+/* Connections served at the same time, each by a task of its own */
+#define CLI_SESSION_COUNT 2
+#define CLI_MAX_COMMANDS 24
+/* Bytes a command can keep between calls in its session */
+#define CLI_SESSION_STATE_SIZE 32
+
+typedef struct cli_session cli_session_t;
+
+/**
+ * A command. It is called until it returns pdFALSE, each time writing the
+ * next part of its output to pcWriteBuffer, as with FreeRTOS+CLI.
+ */
+typedef BaseType_t (*cli_command_fn)(cli_session_t *session, char *pcWriteBuffer, size_t xWriteBufferLen,
+                                     const char *pcCommandString);
+
+typedef struct {
+    const char *command;
+    const char *help;
+    cli_command_fn function;
+    int8_t expected_parameters; // -1 for any number
+} cli_command_t;
+
+struct cli_session {
+    const cli_command_t *command; // being run, NULL between commands
+    bool first_call;              // the running command hasn't been called yet
+    bool fallback;                // the running command belongs to FreeRTOS+CLI
+    union {
+        void *align;
+        uint32_t align32;
+        uint8_t bytes[CLI_SESSION_STATE_SIZE];
+    } state;
+    char output[MAX_OUTPUT_SIZE];
+    uint8_t id;
+};
+
+SAT_returnState cli_register_command(const cli_command_t *command);
+
+void cli_session_init(cli_session_t *session, uint8_t id);
+
+BaseType_t cli_session_process(cli_session_t *session, const char *pcCommandInput, char *pcWriteBuffer,
+                               size_t xWriteBufferLen);
+
+void *cli_session_state(cli_session_t *session, size_t size);
+
+#endif /* CLI_SESSION_H */
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file diagnostics_service.h
+ * @date 2022-03-14
+ */
+
+#ifndef DIAGNOSTICS_SERVICE_H
+#define DIAGNOSTICS_SERVICE_H
+
+#include <FreeRTOS.h>
+#include <csp/csp.h>
+#include <stdint.h>
+
+#include "services.h"
+#include "util/service_stats.h"
+
+#define DIAG_MAX_TASKS 32      // size of the task snapshot, must cover every task in the system
+#define DIAG_TASK_NAME_LEN 16
+#define DIAG_HK_TASK_SLOTS 16  // per task stack headroom entries kept in each hk record
+/*
+ * Context switches are counted per task number. Tasks numbered past the last slot share it.
+ * The counts come from diag_trace_switched_in, which the platform's FreeRTOSConfig.h installs with
+ *   #define traceTASK_SWITCHED_IN() diag_trace_switched_in(pxCurrentTCB->uxTCBNumber)
+ * Without that line every switch count is 0.
+ */
+#define DIAG_SWITCH_SLOTS 64
+#define DIAG_PROFILE_DEFAULT_WINDOW_MS 1000
+#define DIAG_PROFILE_MAX_WINDOW_MS 10000
+#define DIAG_PROFILE_SLICE_MS 500 // the caller's watchdog counter is bumped this often while sampling
+
+typedef enum {
+    GET_SVC_STATS = 0,
+    RESET_SVC_STATS = 1,
+    GET_RESOURCE_STATS = 2,
+    GET_RESPONSE_STATS = 3,
+    GET_TASK_PROFILE = 4
+} Diagnostics_Subtype;
+
+/* One row of the GET_SVC_STATS report, sent in network byte order */
+typedef struct __attribute__((packed)) {
+    uint8_t service;
+    uint8_t subtype;
+    uint32_t calls;
+    uint32_t errors;
+    uint32_t total_time;
+    uint32_t max_time;
+    uint16_t histogram[SVC_STATS_HIST_BUCKETS];
+} svc_stats_report_t;
+
+/* Header of the GET_RESOURCE_STATS report, sent in network byte order */
+typedef struct __attribute__((packed)) {
+    uint32_t free_heap;          // bytes
+    uint32_t min_free_heap;      // bytes, lowest since boot
+    uint32_t largest_free_block; // bytes, 0 if the heap implementation can't report it
+    uint16_t csp_buffers_free;
+    uint16_t response_queue_depth;
+    uint8_t task_count;
+    uint8_t tasks_in_packet;
+} resource_report_t;
+
+/* One task of the GET_RESOURCE_STATS report, sent in network byte order */
+typedef struct __attribute__((packed)) {
+    uint8_t task_number;
+    char name[DIAG_TASK_NAME_LEN];
+    uint16_t stack_headroom; // words of stack never used
+} task_stack_report_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t task_number;
+    uint16_t stack_headroom;
+} task_stack_hk_t;
+
+/* Header of the GET_RESPONSE_STATS report, sent in network byte order */
+typedef struct __attribute__((packed)) {
+    uint16_t queue_len;
+    uint16_t queue_depth;
+    uint16_t queue_high_water;
+    uint8_t producers; // number of response_drops_report_t that follow
+} response_report_t;
+
+/* One service that had responses dropped, sent in network byte order */
+typedef struct __attribute__((packed)) {
+    uint8_t service;
+    uint32_t drops;
+} response_drops_report_t;
+
+/* Totals of a task profile window, in host byte order */
+typedef struct {
+    uint32_t window;   // ms actually sampled
+    uint32_t run_time; // run time counter ticks in the window, 0 if run time stats are off
+    uint32_t switches; // context switches in the window, 0 if the trace hook isn't installed
+    uint8_t task_count;
+} diag_profile_t;
+
+/* One task's share of a profile window, in host byte order */
+typedef struct {
+    uint8_t task_number;
+    char name[DIAG_TASK_NAME_LEN];
+    uint8_t priority;
+    uint16_t cpu_permille;   // of the window's run time
+    uint32_t switches;       // times switched in during the window
+    uint16_t stack_headroom; // words of stack never used
+} diag_task_profile_t;
+
+/* Header of the GET_TASK_PROFILE report, sent in network byte order */
+typedef struct __attribute__((packed)) {
+    uint32_t window;
+    uint32_t run_time;
+    uint32_t switches;
+    uint8_t task_count;
+    uint8_t tasks_in_packet;
+} task_profile_report_t;
+
+/* One task of the GET_TASK_PROFILE report, sent in network byte order */
+typedef struct __attribute__((packed)) {
+    uint8_t task_number;
+    char name[DIAG_TASK_NAME_LEN];
+    uint8_t priority;
+    uint16_t cpu_permille;
+    uint32_t switches;
+    uint16_t stack_headroom;
+} task_profile_entry_t;
+
+/* Resource usage sampled into every housekeeping record */
+typedef struct __attribute__((packed)) {
+    uint32_t free_heap;
+    uint32_t min_free_heap;
+    uint32_t largest_free_block;
+    uint16_t csp_buffers_free;
+    uint16_t response_queue_depth;
+    uint8_t task_count;
+    task_stack_hk_t tasks[DIAG_HK_TASK_SLOTS]; // lowest task numbers first
+} obc_resource_housekeeping;
+
+void diag_get_resource_hk(obc_resource_housekeeping *hk);
+
+void diag_resource_hk_convert_endianness(obc_resource_housekeeping *hk);
+
+void diag_trace_switched_in(UBaseType_t task_number);
+
+uint8_t diag_profile_tasks(uint32_t window_ms, diag_profile_t *profile, diag_task_profile_t *tasks,
+                           uint8_t max_tasks, uint32_t *wdt_counter);
+
+SAT_returnState diagnostics_service_app(csp_packet_t *packet);
+
+SAT_returnState start_diagnostics_service(void);
+
+#endif /* DIAGNOSTICS_SERVICE_H */
@@ -33,6 +33,7 @@
 #include "sband.h"
 #include "uhf.h"
 #include "dfgm.h"
+#include "diagnostics/diagnostics_service.h"
 
 /* Housekeeping service address & port*/
 
@@ -41,6 +42,20 @@
 
 #define ATHENA_TEMP_ARRAY_SIZE 2
 
+/* Archive of housekeeping records, record n at (n - 1) * get_size_of_housekeeping() */
+#define HK_ARCHIVE_FILE "VOL0:/tempHKdata.TMP"
+
+/* Most files SET_MAX_FILES allows: 7 days at a 30 second period */
+#define HK_MAX_FILES_LIMIT 20160
+
+/*
+ * Layout of the records in the archive and in GET_HK replies. Bump it
+ * whenever All_systems_housekeeping changes: an archive written with
+ * another layout is deleted at start up rather than misread.
+ * 2: obc_resource_hk added
+ */
+#define HK_RECORD_VERSION 2
+
 #define HK_PR_ERR -1
 #define HK_PR_OK 0
 
@@ -78,6 +93,7 @@ typedef struct __attribute__((packed)){
   charon_housekeeping charon_hk;         //Charon housekeeping
   //Payload_HouseKeeping payload_hk;       //Payload housekeeping
   DFGM_Housekeeping DFGM_hk;            //DFGM housekeeping struct
+  obc_resource_housekeeping obc_resource_hk; //OBC heap, queue and stack usage
 } All_systems_housekeeping;
 
 
@@ -91,5 +107,8 @@ uint16_t get_size_of_housekeeping(All_systems_housekeeping *all_hk_data);
 uint16_t get_file_id_from_timestamp(uint32_t timestamp);
 Result load_historic_hk_data(uint16_t file_num, All_systems_housekeeping *all_hk_data);
 Result set_max_files(uint16_t new_max);
+Result write_hk_to_file(const char *file, uint16_t filenumber, All_systems_housekeeping *all_hk_data);
+Result read_hk_from_file(const char *file, uint16_t filenumber, All_systems_housekeeping *all_hk_data);
+Result convert_hk_endianness(All_systems_housekeeping *hk);
 
 #endif /* HOUSEKEEPING_SERVICE_H */
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file binlog.h
+ * @date 2022-03-14
+ *
+ * Binary logging. Instead of a formatted line, each message is stored as a
+ * record holding its id from log_messages.def, the time and its raw
+ * argument words; the text is produced on the ground. Records are a few
+ * bytes where a text line is tens, and logging costs a handful of stores
+ * rather than a printf.
+ */
+
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#include <FreeRTOS.h>
+#include <os_task.h>
+#include <stdint.h>
+
+#include "logger/binlog_format.h"
+#include "services.h"
+
+#define BINLOG_FILE "VOL0:/syslog.bin"
+#define BINLOG_OLD_FILE "VOL0:/syslog_old.bin"
+/* syslog.bin is moved to syslog_old.bin once it grows past this */
+#define BINLOG_MAX_FILE_SIZE (32 * 1024)
+/* Records are collected in two buffers of this size and written to the file a buffer at a time */
+#define BINLOG_BUFFER_SIZE 512
+
+SAT_returnState binlog_init(void);
+
+void binlog_set_flush_task(TaskHandle_t task);
+
+void binlog(log_msg_id_t id, ...);
+
+void binlog_set_level(log_level_t level);
+
+SAT_returnState binlog_flush(void);
+
+SAT_returnState binlog_flush_full(void);
+
+uint32_t binlog_get_dropped(void);
+
+#endif /* BINLOG_H */
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file binlog_format.h
+ * @date 2022-03-14
+ *
+ * Message ids and record layout of the binary log (see binlog.h). This is
+ * shared with the ground decoder, so it must not depend on anything beyond
+ * the C library.
+ */
+
+#ifndef BINLOG_FORMAT_H
+#define BINLOG_FORMAT_H
+
+#include <stdint.h>
+
+typedef enum { LOG_DEBUG = 0, LOG_INFO = 1, LOG_WARN = 2, LOG_ERROR = 3 } log_level_t;
+
+#define LOG_MSG(name, level, nargs, format) name,
+typedef enum {
+#include "logger/log_messages.def"
+    LOG_MSG_COUNT
+} log_msg_id_t;
+#undef LOG_MSG
+
+#define BINLOG_MAX_ARGS 6
+
+/*
+ * Each record is a header followed by nargs argument words, all big endian:
+ *   uint16_t id
+ *   uint8_t  nargs
+ *   uint8_t  level
+ *   uint32_t unix timestamp
+ *   uint32_t args[nargs]
+ * nargs is stored so that a decoder with an older dictionary can skip
+ * messages it doesn't know.
+ */
+#define BINLOG_HEADER_SIZE 8
+#define BINLOG_MAX_RECORD_SIZE (BINLOG_HEADER_SIZE + BINLOG_MAX_ARGS * sizeof(uint32_t))
+
+#endif /* BINLOG_FORMAT_H */
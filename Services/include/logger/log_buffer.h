@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file log_buffer.h
+ * @date 2022-03-14
+ *
+ * Buffered text logging. Each task that logs gets its own ring of lines
+ * which only it writes to, so ex2_log never takes a lock or touches the
+ * file system. A low priority task drains the rings into the syslog.
+ * Lines are stored as "<unix_ts> <L> <message>", L being one of D I W E.
+ */
+
+#ifndef LOG_BUFFER_H
+#define LOG_BUFFER_H
+
+#include <stdarg.h>
+#include <stdint.h>
+
+#include "logger/binlog.h"
+#include "services.h"
+
+/* Tasks that can have a ring of their own. Others share one ring, reserving slots under a critical section */
+#define LOG_RING_COUNT 8
+/* Lines each ring holds. Must be a power of 2 */
+#define LOG_RING_SLOTS 16
+/* Longest line kept, newline included. Longer messages are cut short */
+#define LOG_LINE_MAX 96
+/* The flush task runs at least this often, and sooner when a ring is half full */
+#define LOG_FLUSH_PERIOD pdMS_TO_TICKS(1000)
+#define LOG_FLUSH_TASK_PRIO (tskIDLE_PRIORITY + 1)
+
+typedef struct {
+    uint32_t lines;    // lines written to the file
+    uint32_t dropped;  // lines lost because a ring was full or the file couldn't be written
+    uint32_t flushes;  // writes to the file
+    uint8_t rings_used; // of LOG_RING_COUNT
+} log_buffer_stats_t;
+
+void ex2_log_level(log_level_t level, const char *format, ...);
+
+void ex2_vlog(log_level_t level, const char *format, va_list args);
+
+SAT_returnState start_log_flush_task(void);
+
+SAT_returnState log_buffer_flush(void);
+
+void log_buffer_get_stats(log_buffer_stats_t *stats);
+
+#endif /* LOG_BUFFER_H */
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file log_query.h
+ * @date 2022-03-14
+ *
+ * Searches the logs on board so that only the entries wanted are
+ * downlinked. The old and current log are scanned oldest first in one
+ * pass and every entry that passes all of the filters is streamed back.
+ */
+
+#ifndef LOG_QUERY_H
+#define LOG_QUERY_H
+
+#include <csp/csp.h>
+#include <stdint.h>
+
+#include "services.h"
+
+/* Which logs a query searches */
+typedef enum { LOG_QUERY_TEXT = 0, LOG_QUERY_BINARY = 1 } log_query_source;
+
+/*
+ * Request, after the subservice, all big endian:
+ *   uint8_t  source     log_query_source
+ *   uint8_t  min_level  log_level_t; lower levels are skipped
+ *   uint32_t from       unix time of the first entry wanted, 0 for the start
+ *   uint32_t to         unix time of the last entry wanted, 0 for no limit
+ *   uint16_t msg_id     binary log message id, LOG_QUERY_ANY_ID for any
+ *   uint16_t limit      most entries to return, 0 for no limit
+ *   char     match[]    text logs: only lines containing this. The rest
+ *                       of the packet, may be empty
+ */
+#define LOG_QUERY_SOURCE_BYTE IN_DATA_BYTE
+#define LOG_QUERY_LEVEL_BYTE (LOG_QUERY_SOURCE_BYTE + 1)
+#define LOG_QUERY_FROM_BYTE (LOG_QUERY_LEVEL_BYTE + 1)
+#define LOG_QUERY_TO_BYTE (LOG_QUERY_FROM_BYTE + 4)
+#define LOG_QUERY_ID_BYTE (LOG_QUERY_TO_BYTE + 4)
+#define LOG_QUERY_LIMIT_BYTE (LOG_QUERY_ID_BYTE + 2)
+#define LOG_QUERY_MATCH_BYTE (LOG_QUERY_LIMIT_BYTE + 2)
+#define LOG_QUERY_MATCH_MAX 32
+#define LOG_QUERY_ANY_ID 0xFFFF
+
+/*
+ * Replies: subservice, status, a byte that is 1 on the last reply, the
+ * number of entries in this reply (uint16_t, big endian) and the entries
+ * back to back: whole lines, newline included, or binary log records as
+ * stored, which logdecode reads as they are.
+ */
+#define LOG_QUERY_FINAL_BYTE OUT_DATA_BYTE
+#define LOG_QUERY_COUNT_BYTE (LOG_QUERY_FINAL_BYTE + 1)
+#define LOG_QUERY_DATA_BYTE (LOG_QUERY_COUNT_BYTE + 2)
+
+SAT_returnState log_query(csp_conn_t *conn, csp_packet_t *packet);
+
+#endif /* LOG_QUERY_H */
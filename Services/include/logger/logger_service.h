@@ -22,8 +22,31 @@
 #define LOGGERSERVICE_H
 
 #include "services.h"
+#include <csp/csp.h>
 
-typedef enum { GET_FILE = 0, GET_OLD_FILE = 1, GET_FILE_SIZE = 2, SET_FILE_SIZE = 3 } logger_subservice;
+typedef enum {
+    GET_FILE = 0,
+    GET_OLD_FILE = 1,
+    GET_FILE_SIZE = 2,
+    SET_FILE_SIZE = 3,
+    STREAM_FILE = 4,
+    STREAM_OLD_FILE = 5,
+    GET_BIN_FILE = 6,
+    STREAM_BIN_FILE = 7,
+    QUERY_LOG = 8
+} logger_subservice;
+
+/*
+ * Log file replies: subservice, status, then the big endian file offset of
+ * the data and size of the whole file, then the data itself
+ */
+#define LOG_OFFSET_BYTE OUT_DATA_BYTE
+#define LOG_FILE_SIZE_BYTE (LOG_OFFSET_BYTE + sizeof(uint32_t))
+#define LOG_DATA_BYTE (LOG_FILE_SIZE_BYTE + sizeof(uint32_t))
+
+SAT_returnState get_file(const char *filename, csp_packet_t *packet);
+
+SAT_returnState logger_service_app(csp_conn_t *conn, csp_packet_t *packet);
 
 SAT_returnState start_logger_service(void);
 
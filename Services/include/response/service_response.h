@@ -15,11 +15,16 @@
 #ifndef SERVICE_RESPONSE_H
 #define SERVICE_RESPONSE_H
 
+#include <FreeRTOS.h>
 #include <csp/csp.h>
 
 #include "services.h"
 
 SAT_returnState queue_response(csp_packet_t *packet);
+SAT_returnState queue_response_timeout(csp_packet_t *packet, TickType_t ticks_to_wait);
 SAT_returnState start_service_response();
+uint16_t get_response_queue_depth(void);
+uint16_t get_response_queue_high_water(void);
+uint32_t get_response_drops(uint8_t port);
 
 #endif /* SERVICE_RESPONSE_H */
@@ -38,7 +38,9 @@
 
 #define NORMAL_TICKS_TO_WAIT 1
 #define SERVICE_QUEUE_LEN 3
-#define RESPONSE_QUEUE_LEN 3
+#ifndef RESPONSE_QUEUE_LEN
+#define RESPONSE_QUEUE_LEN 32 // must be a power of 2
+#endif
 #define CSP_PKT_QUEUE_SIZE sizeof(csp_packet_t *)
 
 /* SERVICE SOCKETS */
@@ -60,6 +62,8 @@
 #define TC_CLI_SERVICE 14
 // DFGM SERVICE
 #define TC_DFGM_SERVICE 19
+// DIAGNOSTICS SERVICE
+#define TC_DIAGNOSTICS_SERVICE 20
 
 #define DELAY_WAIT_TIMEOUT 8000
 
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file image_crc.h
+ * @date 2022-03-14
+ *
+ * CRCs of each IMAGE_CRC_BLOCK_SIZE block of the application image, worked
+ * out as the image is written rather than when it is verified. One table is
+ * kept for UPDATER_IMAGE_FILE as uploaded or patched, and one for the
+ * application as programmed to flash. The CRC of the whole image comes from
+ * combining the block CRCs, so verifying it reads no flash, and where the
+ * tables differ is the block that went wrong.
+ *
+ * GET_BLOCK_CRCS takes a uint8_t image_crc_source_t and a uint16_t first
+ * block, and replies with the uint16_t number of blocks, the uint16_t first
+ * block and as many uint16_t block CRCs from there as fit, big endian.
+ */
+
+#ifndef IMAGE_CRC_H
+#define IMAGE_CRC_H
+
+#include <csp/csp.h>
+#include <stdint.h>
+
+/* 512 blocks of 8 KiB cover the 4 MiB of flash in 1 KiB of table */
+#define IMAGE_CRC_BLOCK_SIZE 8192
+#define IMAGE_CRC_MAX_BLOCKS 512
+#define IMAGE_CRC_NO_BLOCK 0xFFFF
+
+#define IMAGE_CRC_FILE "VOL0:/application_image.crc"
+#define APP_CRC_FILE "VOL0:/application_flash.crc"
+
+typedef enum {
+    IMAGE_CRC_SOURCE_FILE, // IMAGE_CRC_FILE
+    IMAGE_CRC_SOURCE_FLASH // APP_CRC_FILE
+} image_crc_source_t;
+
+typedef struct {
+    uint32_t size;
+    uint16_t blocks;
+    uint16_t block_crc[IMAGE_CRC_MAX_BLOCKS];
+} image_crc_table_t;
+
+image_crc_table_t *image_crc_work_table(void);
+
+int8_t image_crc_reset(image_crc_table_t *table, uint32_t size);
+
+void image_crc_append(image_crc_table_t *table, uint32_t offset, const uint8_t *data, uint32_t len);
+
+uint16_t image_crc_prefix(const image_crc_table_t *table, uint32_t len);
+
+uint16_t image_crc_total(const image_crc_table_t *table);
+
+int8_t image_crc_save(const image_crc_table_t *table, const char *file);
+
+int8_t image_crc_save_block(const char *file, uint16_t block, uint16_t crc);
+
+int8_t image_crc_load(image_crc_table_t *table, const char *file);
+
+uint16_t image_crc_compare(const image_crc_table_t *table, const char *file);
+
+int8_t image_crc_get(csp_packet_t *packet);
+
+#endif /* IMAGE_CRC_H */
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file patch.h
+ * @date 2022-03-14
+ *
+ * Rebuilds a new application image from the installed one and a binary
+ * patch, so a release that changes a few kilobytes doesn't need the whole
+ * image uploaded. The patch is uploaded to UPDATER_PATCH_FILE (UPLOAD_START
+ * with UPLOAD_TARGET_PATCH) and APPLY_PATCH writes the new image to
+ * UPDATER_IMAGE_FILE, ready for FLASH_UPDATE. makepatch in
+ * ex2_demo_software/ground makes patches.
+ *
+ * A patch is a header followed by operations, all big endian:
+ *   uint32_t PATCH_MAGIC
+ *   uint32_t source size, uint16_t source CRC  (the installed image)
+ *   uint32_t target size, uint16_t target CRC  (the new image)
+ * then, until the target is complete:
+ *   PATCH_OP_COPY  uint32_t source offset, uint32_t length
+ *   PATCH_OP_ADD   uint32_t length, that many bytes
+ * CRCs are CRC-16/XMODEM (crc16.h), as in the EEPROM.
+ *
+ * APPLY_PATCH replies with the uint32_t target size and uint16_t target CRC.
+ * The EEPROM is left alone: the image is installed by FLASH_UPDATE and
+ * SET_APP_CRC as an uploaded one is, so a failed patch can be retried.
+ */
+
+#ifndef PATCH_H
+#define PATCH_H
+
+#include <csp/csp.h>
+#include <stdint.h>
+
+#define PATCH_MAGIC 0x45584450 // "EXDP"
+#define PATCH_HEADER_SIZE 16
+
+typedef enum { PATCH_OP_COPY, PATCH_OP_ADD } patch_op_t;
+
+int8_t apply_patch(csp_packet_t *packet, uint32_t *wdt_counter);
+
+#endif /* PATCH_H */
@@ -22,6 +22,16 @@
 
 #include "services.h"
 
+/* The image FLASH_UPDATE programs, and the one uploads are written to */
+#define UPDATER_IMAGE_FILE "VOL0:/application_image.bin"
+/* A patch against the installed image, see patch.h */
+#define UPDATER_PATCH_FILE "VOL0:/application_patch.bin"
+
+/* FLASH_UPDATE sends a progress packet each time this many more bytes are programmed */
+#define UPDATER_PROGRESS_INTERVAL (32 * 1024)
+/* Longest the programmer waits for a chunk of the image to be read */
+#define UPDATER_READ_TIMEOUT pdMS_TO_TICKS(5000)
+
 SAT_returnState start_updater_service(void);
 
 typedef enum {
@@ -32,7 +42,14 @@ typedef enum {
     SET_APP_CRC,
     ERASE_APP,
     VERIFY_APPLICATION_IMAGE,
-    VERIFY_GOLDEN_IMAGE
+    VERIFY_GOLDEN_IMAGE,
+    UPLOAD_START,
+    UPLOAD_CHUNK,
+    UPLOAD_MISSING,
+    UPLOAD_STATUS,
+    APPLY_PATCH,
+    GET_BLOCK_CRCS,
+    UPLOAD_DISCARD_BLOCK
 } updater_subtype; // shared with EPS!
 
 #endif /* UPDATER_H_ */
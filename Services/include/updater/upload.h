@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file upload.h
+ * @date 2022-03-14
+ *
+ * Uploads the application image in numbered chunks over as many passes as
+ * it takes. Chunks are written straight to their place in the image file
+ * and a bitmap of the chunks received is kept on the file system, so an
+ * upload survives a reboot and the ground only resends what is missing.
+ *
+ * Requests and replies, after the subservice (and status in replies), are
+ * big endian:
+ *   UPLOAD_START    uint32_t image size, uint16_t chunk size, uint16_t image CRC,
+ *                   optional uint8_t upload_target_t (UPLOAD_TARGET_IMAGE)
+ *                   -> uint16_t chunks, uint16_t chunks received
+ *                   Resumes the upload in progress if it has the same size,
+ *                   chunk size, CRC and target, otherwise starts over
+ *   UPLOAD_CHUNK    uint16_t sequence number, data
+ *                   -> uint16_t sequence number, uint16_t chunks received
+ *   UPLOAD_MISSING  uint16_t first sequence number to look from
+ *                   -> uint16_t where to look from next, UPLOAD_NO_MORE if
+ *                   done, then (uint16_t first, uint16_t count) ranges of
+ *                   missing chunks
+ *   UPLOAD_DISCARD_BLOCK  uint16_t block (see image_crc.h) of the image
+ *                   -> uint16_t first chunk forgotten, uint16_t how many
+ *   UPLOAD_STATUS   -> uint32_t image size, uint16_t chunk size,
+ *                   uint16_t chunks, uint16_t chunks received, uint16_t image CRC,
+ *                   uint8_t upload_target_t
+ */
+
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include <csp/csp.h>
+#include <stdint.h>
+
+#include "services.h"
+
+#define UPLOAD_STATE_FILE "VOL0:/upload_state.bin"
+/* Limits the bitmap to 1 KiB of RAM; with 256 byte chunks that is a 2 MiB image */
+#define UPLOAD_MAX_CHUNKS 8192
+#define UPLOAD_CHUNK_DATA_BYTE (IN_DATA_BYTE + sizeof(uint16_t))
+#define UPLOAD_NO_MORE 0xFFFF
+
+typedef enum {
+    UPLOAD_TARGET_IMAGE, // UPDATER_IMAGE_FILE
+    UPLOAD_TARGET_PATCH  // UPDATER_PATCH_FILE, see patch.h
+} upload_target_t;
+
+int8_t upload_start(csp_packet_t *packet);
+
+int8_t upload_chunk(csp_packet_t *packet);
+
+int8_t upload_missing(csp_packet_t *packet);
+
+int8_t upload_status(csp_packet_t *packet);
+
+int8_t upload_discard_block(csp_packet_t *packet);
+
+uint8_t upload_complete(upload_target_t target);
+
+#endif /* UPLOAD_H */
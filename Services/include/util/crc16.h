@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file crc16.h
+ * @date 2022-03-14
+ */
+
+#ifndef CRC16_H
+#define CRC16_H
+
+#include <stdint.h>
+
+/* CRC-16/XMODEM: polynomial 0x1021, no reflection, no final xor */
+#define CRC16_INIT 0x0000
+
+uint16_t crc16_update(uint16_t crc, const uint8_t *data, uint32_t len);
+
+uint16_t crc16_combine(uint16_t crc_a, uint16_t crc_b, uint32_t len_b);
+
+#endif /* CRC16_H */
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file service_stats.h
+ * @date 2022-03-14
+ */
+
+#ifndef SERVICE_STATS_H
+#define SERVICE_STATS_H
+
+#include <FreeRTOS.h>
+#include <csp/csp.h>
+#include <os_task.h>
+#include <stdint.h>
+
+#include "services.h"
+
+/* Number of distinct (service, subtype) pairs that can be tracked. Must be a power of 2 */
+#define SVC_STATS_MAX_ENTRIES 128
+/* Bucket i counts dispatches that took [2^(i-1), 2^i) timer units. Bucket 0 is < 1 unit */
+#define SVC_STATS_HIST_BUCKETS 16
+
+/*
+ * Timer used to measure handler latency. The run time stats counter is used
+ * when the kernel is configured to provide one since it is typically much
+ * finer than the tick. A platform may define its own (eg. a cycle counter).
+ */
+#ifndef SVC_STATS_TIMESTAMP
+#if (configGENERATE_RUN_TIME_STATS == 1)
+#define SVC_STATS_TIMER_IS_TICKS 0
+#define SVC_STATS_TIMESTAMP() ((uint32_t)portGET_RUN_TIME_COUNTER_VALUE())
+#else
+#define SVC_STATS_TIMER_IS_TICKS 1
+#define SVC_STATS_TIMESTAMP() ((uint32_t)xTaskGetTickCount())
+#endif
+#else
+#define SVC_STATS_TIMER_IS_TICKS 0
+#endif
+
+typedef struct {
+    uint8_t service; // CSP port of the service
+    uint8_t subtype;
+    uint32_t calls;
+    uint32_t errors;     // dispatches which did not return SATR_OK
+    uint32_t total_time; // sum of handler time in timer units
+    uint32_t max_time;
+    uint16_t histogram[SVC_STATS_HIST_BUCKETS];
+} svc_stats_entry_t;
+
+typedef struct {
+    uint8_t service;
+    uint8_t subtype;
+    uint32_t start;
+    uint32_t trace_id;
+} svc_dispatch_t;
+
+/*
+ * Optional observer of every dispatch, used by the simulator to capture
+ * packet traces. begin sees the request before the handler runs and returns
+ * an id which is passed to end once the handler has returned
+ */
+typedef uint32_t (*svc_trace_begin_t)(uint8_t service, const csp_packet_t *packet);
+typedef void (*svc_trace_end_t)(uint32_t trace_id, uint8_t service, uint8_t subtype, SAT_returnState result);
+
+void svc_dispatch_begin(svc_dispatch_t *dispatch, uint8_t service, const csp_packet_t *packet);
+
+void svc_dispatch_end(const svc_dispatch_t *dispatch, SAT_returnState result);
+
+uint16_t svc_stats_count(void);
+
+uint16_t svc_stats_get(uint16_t first, svc_stats_entry_t *entries, uint16_t max_entries);
+
+void svc_stats_reset(void);
+
+void svc_stats_set_trace(svc_trace_begin_t begin, svc_trace_end_t end);
+
+#endif /* SERVICE_STATS_H */
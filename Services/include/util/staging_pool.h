@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file staging_pool.h
+ * @date 2022-03-14
+ *
+ * A few fixed size blocks of RAM for file and flash I/O, borrowed and
+ * returned instead of allocated, so big transfers never depend on how
+ * fragmented the FreeRTOS heap has become. A borrower holds a token rather
+ * than a pointer: a token that has been returned, or belongs to a block
+ * since lent to someone else, is refused.
+ */
+
+#ifndef STAGING_POOL_H
+#define STAGING_POOL_H
+
+#include <FreeRTOS.h>
+#include <stdint.h>
+
+#include "services.h"
+
+#define STAGING_BLOCK_SIZE 4096
+#define STAGING_BLOCK_COUNT 4
+/* A cache line of the Cortex-R5, so blocks can be handed to DMA */
+#define STAGING_BLOCK_ALIGN 32
+/* How long the services wait for a block before giving up */
+#define STAGING_TIMEOUT pdMS_TO_TICKS(1000)
+
+/* Token of no block */
+#define STAGING_NO_TOKEN 0
+
+typedef uint16_t staging_token_t;
+
+typedef enum {
+    STAGING_FREE,
+    STAGING_UPDATER,
+    STAGING_LOGGER,
+    STAGING_HOUSEKEEPING,
+    STAGING_CLI
+} staging_owner_t;
+
+SAT_returnState staging_pool_init(void);
+
+staging_token_t staging_get(staging_owner_t owner, TickType_t timeout);
+
+uint8_t *staging_data(staging_token_t token);
+
+void staging_put(staging_token_t token);
+
+staging_owner_t staging_owner(uint8_t block);
+
+#endif /* STAGING_POOL_H */
@@ -19,6 +19,7 @@
 
 #include "adcs/adcs_service.h"
 #include "task_manager/task_manager.h"
+#include "util/service_stats.h"
 
 static uint32_t svc_wdt_counter = 0;
 static uint32_t get_svc_wdt_counter() { return svc_wdt_counter; }
@@ -1386,7 +1387,12 @@ void adcs_service(void *param) {
 
         // read packets. timeout is 50ms
         while ((packet = csp_read(conn, 50)) != NULL) {
-            if (adcs_service_app(packet) != SATR_OK) {
+            svc_dispatch_t dispatch;
+            svc_dispatch_begin(&dispatch, TC_ADCS_SERVICE, packet);
+            SAT_returnState state = adcs_service_app(packet);
+            svc_dispatch_end(&dispatch, state);
+
+            if (state != SATR_OK) {
                 // something went wrong in the service
                 ex2_log("Error");
                 csp_buffer_free(packet);
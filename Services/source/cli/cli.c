@@ -20,6 +20,7 @@
  */
 
 #include <FreeRTOS.h>
+#include <os_queue.h>
 #include <os_task.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -28,26 +29,57 @@
 #include <FreeRTOS-Plus-CLI/FreeRTOS_CLI.h>
 #include "services.h"
 #include "cli/cli.h"
+#include "cli/cli_bench.h"
+#include "cli/cli_session.h"
 #include "system.h"
+#include "util/service_stats.h"
 #include "util/service_utilities.h"
 #include "task_manager/task_manager.h"
 #include "printf.h"
 #include "rtcmk.h"
 #include <stdlib.h>
+#include <string.h>
 #include "cli/fs_utils.h"
+#include "diagnostics/diagnostics_service.h"
+#include "util/staging_pool.h"
 
 static uint32_t svc_wdt_counter = 0;
 
 static uint32_t get_svc_wdt_counter() { return svc_wdt_counter; }
 
+static cli_session_t sessions[CLI_SESSION_COUNT];
+/* Accepted connections waiting for a session task */
+static QueueHandle_t session_conns = NULL;
+
+static uint32_t session_wdt_counter[CLI_SESSION_COUNT] = {0};
+
+static uint32_t get_session_wdt_counter(uint8_t id) { return session_wdt_counter[id]; }
+
+/*
+ * The task manager's getter takes no session, so every session task reports
+ * the session that has made the least progress; any session stalling shows up
+ */
+static uint32_t get_sessions_wdt_counter() {
+    uint32_t least = get_session_wdt_counter(0);
+    uint8_t i;
+
+    for (i = 1; i < CLI_SESSION_COUNT; i++) {
+        if (get_session_wdt_counter(i) < least) {
+            least = get_session_wdt_counter(i);
+        }
+    }
+    return least;
+}
+
 /*
  * Command Implementations
  *
  * These functions are the implementations of all the commands registered with the
- *  FreeRTOS+CLI controller
+ *  CLI sessions
  */
 
-static BaseType_t prvTimeCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+static BaseType_t prvTimeCommand(cli_session_t *session, char *pcWriteBuffer, size_t xWriteBufferLen,
+                                 const char *pcCommandString) {
     const char *parameter;
     BaseType_t parameter_len, xReturn;
     time_t unix_time;
@@ -96,25 +128,27 @@ static BaseType_t prvTimeCommand(char *pcWriteBuffer, size_t xWriteBufferLen, co
     return xReturn;
 }
 
-static BaseType_t prvHelloCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+static BaseType_t prvHelloCommand(cli_session_t *session, char *pcWriteBuffer, size_t xWriteBufferLen,
+                                  const char *pcCommandString) {
     snprintf(pcWriteBuffer, xWriteBufferLen, "Hello\r\n");
     return pdFALSE;
 }
 
-static BaseType_t prvEchoCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+static BaseType_t prvEchoCommand(cli_session_t *session, char *pcWriteBuffer, size_t xWriteBufferLen,
+                                 const char *pcCommandString) {
     const char *parameter;
     BaseType_t parameter_len, xReturn;
 
-    /* Note that the use of the static parameter means this function is not reentrant. */
-    static BaseType_t parameter_num = 0;
+    /* The next parameter to echo is kept in the session */
+    UBaseType_t *parameter_num = cli_session_state(session, sizeof(UBaseType_t));
 
-    if (parameter_num == 0) {
-        /* parameter_number is 0, so this is the first time the function has been
-        called since the command was entered. */
+    if (session->first_call) {
+        /* This is the first time the function has been called since the
+        command was entered. */
 
         /* Next time the function is called the first parameter will be echoed
         back. */
-        parameter_num = 1;
+        *parameter_num = 1;
 
         /* There is more data to be returned as no parameters have been echoed
         back yet, so set xReturn to pdPASS so the function will be called again. */
@@ -126,7 +160,7 @@ static BaseType_t prvEchoCommand(char *pcWriteBuffer, size_t xWriteBufferLen, co
             /* The command string itself. */
             pcCommandString,
             /* Return the next parameter. */
-            parameter_num,
+            *parameter_num,
             /* Store the parameter string length. */
             &parameter_len);
 
@@ -137,7 +171,7 @@ static BaseType_t prvEchoCommand(char *pcWriteBuffer, size_t xWriteBufferLen, co
             /* There might be more parameters to return after this one, so again
             set xReturn to pdTRUE. */
             xReturn = pdTRUE;
-            parameter_num++;
+            (*parameter_num)++;
         } else {
             /* No more parameters were found.  Make sure the write buffer does
             not contain a valid string to prevent junk being printed out. */
@@ -147,81 +181,230 @@ static BaseType_t prvEchoCommand(char *pcWriteBuffer, size_t xWriteBufferLen, co
             /* There is no more data to return, so this time set xReturn to
             pdFALSE. */
             xReturn = pdFALSE;
-
-            /* Start over the next time this command is executed. */
-            parameter_num = 0;
         }
     }
 
     return xReturn;
 }
 
+/* State of the top command between calls, kept in the session */
+typedef struct {
+    staging_token_t token; // block holding the profile, then its tasks
+    uint8_t next;          // next task to print
+    uint8_t count;         // tasks in the profile
+} top_state_t;
+
+/**
+ * @brief
+ *      Profile the tasks over a window, then print a line per task
+ * @details
+ *      The profile is kept in a staging block until the last line is printed
+ */
+static BaseType_t prvTopCommand(cli_session_t *session, char *pcWriteBuffer, size_t xWriteBufferLen,
+                                const char *pcCommandString) {
+    top_state_t *state = cli_session_state(session, sizeof(top_state_t));
+    diag_profile_t *profile;
+    diag_task_profile_t *tasks;
+    diag_task_profile_t *task;
+    const char *parameter;
+    BaseType_t parameter_len;
+    uint32_t window = 0;
+
+    if (session->first_call) {
+        parameter = FreeRTOS_CLIGetParameter(pcCommandString, 1, &parameter_len);
+        if (parameter != NULL) {
+            window = strtoul(parameter, NULL, 0);
+        }
+        state->token = staging_get(STAGING_CLI, STAGING_TIMEOUT);
+        if (state->token == STAGING_NO_TOKEN) {
+            snprintf(pcWriteBuffer, xWriteBufferLen, "No buffer free for the profile\n");
+            return pdFALSE;
+        }
+    }
+    profile = (diag_profile_t *)staging_data(state->token);
+    tasks = (diag_task_profile_t *)&profile[1];
+
+    if (session->first_call) {
+        state->count = diag_profile_tasks(window, profile, tasks,
+                                          (STAGING_BLOCK_SIZE - sizeof(*profile)) / sizeof(*tasks),
+                                          &session_wdt_counter[session->id]);
+        state->next = 0;
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                 "%lu ms, %lu context switches\n  # name             pri  cpu%%  switches stack\n",
+                 (unsigned long)profile->window, (unsigned long)profile->switches);
+    } else {
+        task = &tasks[state->next++];
+        if (profile->run_time == 0) {
+            snprintf(pcWriteBuffer, xWriteBufferLen, "%3u %-16.16s %3u     - %9lu %5u\n", task->task_number,
+                     task->name, task->priority, (unsigned long)task->switches, task->stack_headroom);
+        } else {
+            snprintf(pcWriteBuffer, xWriteBufferLen, "%3u %-16.16s %3u %3u.%u %9lu %5u\n", task->task_number,
+                     task->name, task->priority, task->cpu_permille / 10, task->cpu_permille % 10,
+                     (unsigned long)task->switches, task->stack_headroom);
+        }
+    }
+
+    if (state->next == state->count) {
+        staging_put(state->token);
+        return pdFALSE;
+    }
+    return pdTRUE;
+}
+
 /*
  * Command Struct Definitions
  *
  * These structs store the definitions for each command implemented in the CLI
- *  to be registered to the FreeRTOS+CLI controller
+ *  to be registered with the CLI sessions
  */
 
-static const CLI_Command_Definition_t xEchoCommand = {"echo", "echo:\n\tEchoes all parameters back\n",
-                                                      prvEchoCommand, -1};
-static const CLI_Command_Definition_t xHelloCommand = {"hello", "hello:\n\tSays hello :)\n", prvHelloCommand, 0};
-static const CLI_Command_Definition_t xTimeCommand = {
+static const cli_command_t xEchoCommand = {"echo", "echo:\n\tEchoes all parameters back\n", prvEchoCommand,
+                                           -1};
+static const cli_command_t xHelloCommand = {"hello", "hello:\n\tSays hello :)\n", prvHelloCommand, 0};
+static const cli_command_t xTimeCommand = {
     "time", "time:\n\tNo parameter: get time\n\tWith parameter: set time to parameter\n", prvTimeCommand, -1};
+static const cli_command_t xTopCommand = {
+    "top",
+    "top:\n\ttop [window ms]\n\tCPU share, context switches and stack headroom (words) of each task over the "
+    "window\n",
+    prvTopCommand, -1};
+
+/**
+ * @brief
+ *      Send the output collected in a reply packet
+ * @param csp_conn_t *conn
+ *      Connection to reply on
+ * @param csp_packet_t *packet
+ *      Reply packet holding used bytes of output at OUT_DATA_BYTE
+ * @param uint16_t used
+ *      Number of output bytes in the packet
+ * @param BaseType_t more
+ *      pdTRUE if further reply packets will follow this one
+ * @return SAT_returnState
+ *      SATR_OK if the packet was sent. The packet is freed either way
+ */
+static SAT_returnState prv_send_output(csp_conn_t *conn, csp_packet_t *packet, uint16_t used, BaseType_t more) {
+    packet->data[STATUS_BYTE] = (more == pdFALSE) ? 0 : 1;
+    packet->data[OUT_DATA_BYTE + used] = '\0'; // keep the output a C string for the ground station
+    set_packet_length(packet, OUT_DATA_BYTE + used + 1);
+    if (!csp_send(conn, packet, 50)) {
+        csp_buffer_free(packet);
+        return SATR_ERROR;
+    }
+    return SATR_OK;
+}
 
 /**
  * @brief
  *      Handle incoming csp_packet_t
  * @details
- *      Takes a csp packet destined for the cli service,
- *              and returns its string return value.
+ *      Takes a csp packet destined for the cli service, runs the command
+ *      and replies with its output. The command's output chunks are packed
+ *      into each reply packet until the next one would not fit, so the
+ *      output spans as few packets as it can. Every reply but the last has
+ *      1 in its status byte; the output follows at OUT_DATA_BYTE and is
+ *      NUL terminated.
+ * @param cli_session_t *session
+ *              Session of the connection the packet came on
  * @param csp_packet_t *packet
  *              Incoming CSP packet - we can be sure that this packet is
- *              valid and destined for this service.
+ *              valid and destined for this service. It is always consumed
  * @return SAT_returnState
  *      success report
  */
-SAT_returnState cli_app(csp_packet_t *packet, csp_conn_t *conn) {
+SAT_returnState cli_app(cli_session_t *session, csp_packet_t *packet, csp_conn_t *conn) {
     uint8_t size = (uint8_t)packet->data[IN_DATA_BYTE]; // reusing subservice byte to store string length
-    bool xMoreDataToFollow;
-    char pcOutputString[MAX_OUTPUT_SIZE];
+    BaseType_t xMoreDataToFollow;
+    char *pcOutputString = session->output;
     char pcInputString[MAX_INPUT_SIZE] = {0};
-    memcpy(&pcInputString, (char *)&packet->data[IN_DATA_BYTE + 1], size);
+    // one byte of each packet is kept for the terminating NUL
+    uint16_t capacity = csp_buffer_data_size() - OUT_DATA_BYTE - 1;
+    uint16_t used = 0;
+    size_t len;
 
-    // store the original packet so we can reuse it later
-    csp_packet_t *original = csp_buffer_clone(packet);
+    if (size > MAX_INPUT_SIZE - 1) {
+        size = MAX_INPUT_SIZE - 1;
+    }
+    memcpy(&pcInputString, (char *)&packet->data[IN_DATA_BYTE + 1], size);
 
+    // the request packet becomes the first reply
     do {
-        memset(pcOutputString, 0x00, MAX_OUTPUT_SIZE);
+        pcOutputString[0] = '\0';
         /* Send the command string to the command interpreter.  Any
-        output generated by the command interpreter will be placed in the        pcOutputString buffer. */
-        xMoreDataToFollow = FreeRTOS_CLIProcessCommand((char *)&pcInputString,  /* The command string.*/
-                                                       (char *)&pcOutputString, /* The output buffer. */
-                                                       MAX_OUTPUT_SIZE /* The size of the output buffer. */
+        output generated by the command interpreter will be placed in the
+        pcOutputString buffer. */
+        xMoreDataToFollow = cli_session_process(session,
+                                                (char *)&pcInputString, /* The command string.*/
+                                                pcOutputString,         /* The output buffer. */
+                                                MAX_OUTPUT_SIZE         /* The size of the output buffer. */
         );
-        memcpy(&packet->data[IN_DATA_BYTE + 1], &pcOutputString, MAX_OUTPUT_SIZE);
-        memcpy(&packet->data[STATUS_BYTE], &xMoreDataToFollow, sizeof(int8_t));
-        if (!csp_send(conn, packet, 50)) {
-            csp_buffer_free(original);
-            csp_buffer_free(packet);
-            return SATR_ERROR;
+        if (packet == NULL) {
+            // a send failed; run the command to the end so it resets its state
+            continue;
         }
-        if (xMoreDataToFollow == pdTRUE) {
-            // csp_send frees the packet for some reason. get a new one
-            packet = csp_buffer_clone(original);
+        pcOutputString[MAX_OUTPUT_SIZE - 1] = '\0';
+        len = strlen(pcOutputString);
+        if (len > capacity) {
+            len = capacity;
         }
-
+        if (used + len > capacity) {
+            if (prv_send_output(conn, packet, used, pdTRUE) != SATR_OK ||
+                (packet = csp_buffer_get(csp_buffer_data_size())) == NULL) {
+                packet = NULL;
+                continue;
+            }
+            used = 0;
+        }
+        memcpy(&packet->data[OUT_DATA_BYTE + used], pcOutputString, len);
+        used += len;
     } while (xMoreDataToFollow != pdFALSE);
 
-    csp_buffer_free(original);
-    return SATR_OK;
+    if (packet == NULL) {
+        return SATR_ERROR;
+    }
+    return prv_send_output(conn, packet, used, pdFALSE);
+}
+
+/**
+ * @brief
+ *      CLI session task
+ * @details
+ *      Serves the connections handed to it by the cli server task, one at a
+ *      time, running their commands in its session
+ * @param void* param
+ *      The task's session
+ * @return None
+ */
+static void cli_session_task(void *param) {
+    cli_session_t *session = (cli_session_t *)param;
+    csp_conn_t *conn;
+    csp_packet_t *packet;
+
+    for (;;) {
+        session_wdt_counter[session->id]++;
+        if (xQueueReceive(session_conns, &conn, DELAY_WAIT_TIMEOUT) != pdPASS) {
+            continue;
+        }
+        while ((packet = csp_read(conn, 50)) != NULL) {
+            svc_dispatch_t dispatch;
+            svc_dispatch_begin(&dispatch, TC_CLI_SERVICE, packet);
+            SAT_returnState status = cli_app(session, packet, conn);
+            svc_dispatch_end(&dispatch, status);
+            if (status != SATR_OK) {
+                ex2_log("CLI error %d", status);
+            }
+            session_wdt_counter[session->id]++;
+        }
+        csp_close(conn);
+    }
 }
 
 /**
  * @brief
  *      FreeRTOS cli server task
  * @details
- *      Accepts incoming cli service packets and executes the application
+ *      Accepts incoming cli connections and hands each to the next free
+ *      session task. Connections wait in the queue while every session is busy
  * @param void* param
  * @return None
  */
@@ -234,29 +417,25 @@ void cli_service(void *param) {
     for (;;) {
         svc_wdt_counter++;
         csp_conn_t *conn;
-        csp_packet_t *packet;
         if ((conn = csp_accept(sock, DELAY_WAIT_TIMEOUT)) == NULL) {
             svc_wdt_counter++;
             /* timeout */
             continue;
         }
         svc_wdt_counter++;
-        while ((packet = csp_read(conn, 50)) != NULL) {
-            SAT_returnState status = cli_app(packet, conn);
-            if (status != SATR_OK) {
-                csp_buffer_free(packet);
-                ex2_log("CLI error %d", status);
-            }
+        while (xQueueSendToBack(session_conns, &conn, DELAY_WAIT_TIMEOUT) != pdPASS) {
+            svc_wdt_counter++;
         }
-        csp_close(conn);
     }
 }
 
 void register_commands() {
-    FreeRTOS_CLIRegisterCommand(&xEchoCommand);
-    FreeRTOS_CLIRegisterCommand(&xHelloCommand);
-    FreeRTOS_CLIRegisterCommand(&xTimeCommand);
+    cli_register_command(&xEchoCommand);
+    cli_register_command(&xHelloCommand);
+    cli_register_command(&xTimeCommand);
+    cli_register_command(&xTopCommand);
     register_fs_utils();
+    register_cli_bench();
 }
 
 /**
@@ -264,7 +443,8 @@ void register_commands() {
  *      Start the cli server task
  * @details
  *      Starts the FreeRTOS task responsible for accepting incoming
- *      cli packets and registers cli commands
+ *      cli connections and a task per session to serve them, and
+ *      registers cli commands
  * @param None
  * @return SAT_returnState
  *      success report
@@ -272,6 +452,31 @@ void register_commands() {
 SAT_returnState start_cli_service(void) {
     TaskHandle_t svc_tsk;
     taskFunctions svc_funcs = {0};
+    uint8_t i;
+
+    if (cli_bench_init() != SATR_OK) {
+        ex2_log("FAILED TO START cli bench timer\n");
+        return SATR_ERROR;
+    }
+    register_commands();
+    session_conns = xQueueCreate(CLI_SESSION_COUNT, sizeof(csp_conn_t *));
+    if (session_conns == NULL) {
+        ex2_log("FAILED TO CREATE cli session queue\n");
+        return SATR_ERROR;
+    }
+    for (i = 0; i < CLI_SESSION_COUNT; i++) {
+        cli_session_init(&sessions[i], i);
+    }
+    svc_funcs.getCounterFunction = get_sessions_wdt_counter;
+    for (i = 0; i < CLI_SESSION_COUNT; i++) {
+        if (xTaskCreate((TaskFunction_t)cli_session_task, "cli_session", CLI_SESSION_SIZE, &sessions[i],
+                        NORMAL_SERVICE_PRIO, &svc_tsk) != pdPASS) {
+            ex2_log("FAILED TO CREATE TASK cli_session\n");
+            return SATR_ERROR;
+        }
+        ex2_register(svc_tsk, svc_funcs);
+    }
+
     svc_funcs.getCounterFunction = get_svc_wdt_counter;
     if (xTaskCreate((TaskFunction_t)cli_service, "cli_svc", CLI_SVC_SIZE, NULL, NORMAL_SERVICE_PRIO, &svc_tsk) !=
         pdPASS) {
@@ -279,6 +484,5 @@ SAT_returnState start_cli_service(void) {
         return SATR_ERROR;
     }
     ex2_register(svc_tsk, svc_funcs);
-    register_commands();
     return SATR_OK;
 }
@@ -0,0 +1,545 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file cli_bench.c
+ * @date 2022-03-14
+ */
+
+#include "cli/cli_bench.h"
+
+#include <FreeRTOS.h>
+#include <FreeRTOS-Plus-CLI/FreeRTOS_CLI.h>
+#include <HL_sys_pmu.h>
+#include <csp/csp.h>
+#include <csp/csp_endian.h>
+#include <os_semphr.h>
+#include <redposix.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cli/cli_session.h"
+#include "housekeeping/housekeeping_service.h"
+#include "printf.h"
+#include "rtcmk.h"
+#include "util/crc16.h"
+#include "util/service_utilities.h"
+#include "util/staging_pool.h"
+
+#define CLI_BENCH_KERNEL_BYTES 1024
+#define CLI_BENCH_FS_CHUNK 4096
+#define CLI_BENCH_FS_RECORD 512
+/* Timestamps looked up by get_file_id_from_timestamp, must be a power of 2 */
+#define CLI_BENCH_QUERIES 64
+#define CLI_BENCH_FILTER_LEN 32
+
+typedef struct {
+    const char *name;
+    bool (*setup)(void);     // not timed, false if the benchmark can't run now
+    void (*run)(uint32_t n); // does n operations
+    void (*teardown)(void);  // undoes setup, NULL if there's nothing to undo
+    uint32_t bytes;          // per operation, 0 if throughput means nothing for it
+} cli_bench_t;
+
+typedef struct {
+    staging_token_t token; // scratch block of the benchmarks
+    uint8_t next;          // next benchmark to run
+    uint8_t samples;       // per benchmark
+    uint32_t overhead;     // cycles it takes to read the counter twice
+    uint32_t matches;      // bit i set if benchmarks[i] matched the filter, so 32 benchmarks at most
+} bench_state_t;
+
+/* Held by the session running the command, benchmarks share the statics below */
+static SemaphoreHandle_t bench_lock = NULL;
+static uint8_t *scratch;
+static int32_t bench_fd = -1;
+static uint32_t fs_offset;
+static uint32_t rand_state = 1;
+static csp_socket_t *loopback;
+static volatile uint32_t sink;
+
+static uint32_t prv_rand(void) {
+    rand_state = rand_state * 1103515245 + 12345;
+    return rand_state >> 8;
+}
+
+static void prv_fill_scratch(uint32_t len) {
+    uint32_t i;
+    for (i = 0; i < len; i++) {
+        scratch[i] = (uint8_t)prv_rand();
+    }
+}
+
+/*
+ * Byte order and buffer kernels
+ */
+
+static bool setup_kernel(void) {
+    prv_fill_scratch(2 * CLI_BENCH_KERNEL_BYTES);
+    return true;
+}
+
+static void bench_cnv32_8(uint32_t n) {
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        cnv32_8(csp_hton32(i), &scratch[(i & 63) * 4]);
+    }
+}
+
+static void bench_cnv8_32(uint32_t n) {
+    uint32_t i, value;
+    for (i = 0; i < n; i++) {
+        cnv8_32(&scratch[(i & 63) * 4], &value);
+        sink += csp_ntoh32(value);
+    }
+}
+
+static void bench_cnv16_8(uint32_t n) {
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        cnv16_8(csp_hton16((uint16_t)i), &scratch[(i & 63) * 2]);
+    }
+}
+
+static void bench_cnv8_16(uint32_t n) {
+    uint32_t i;
+    uint16_t value;
+    for (i = 0; i < n; i++) {
+        cnv8_16(&scratch[(i & 63) * 2], &value);
+        sink += csp_ntoh16(value);
+    }
+}
+
+static void bench_crc16(uint32_t n) {
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        sink += crc16_update(CRC16_INIT, scratch, CLI_BENCH_KERNEL_BYTES);
+    }
+}
+
+static void bench_memcpy(uint32_t n) {
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        memcpy(&scratch[CLI_BENCH_KERNEL_BYTES], scratch, CLI_BENCH_KERNEL_BYTES);
+    }
+    sink += scratch[CLI_BENCH_KERNEL_BYTES];
+}
+
+/*
+ * Housekeeping
+ */
+
+static bool setup_hk_record(void) {
+    if (sizeof(All_systems_housekeeping) > STAGING_BLOCK_SIZE) {
+        return false;
+    }
+    prv_fill_scratch(sizeof(All_systems_housekeeping));
+    return true;
+}
+
+static void bench_convert_hk_endianness(uint32_t n) {
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        convert_hk_endianness((All_systems_housekeeping *)scratch);
+    }
+}
+
+/* The satellite's archive is left alone; records go to the file system benchmarks' scratch file */
+static bool setup_hk_file(void) {
+    if (!setup_hk_record()) {
+        return false;
+    }
+    if (write_hk_to_file(CLI_BENCH_FILE, 1, (All_systems_housekeeping *)scratch) != SUCCESS) {
+        red_unlink(CLI_BENCH_FILE);
+        return false;
+    }
+    return true;
+}
+
+static void teardown_hk_file(void) { red_unlink(CLI_BENCH_FILE); }
+
+static void bench_write_hk_to_file(uint32_t n) {
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        write_hk_to_file(CLI_BENCH_FILE, 1, (All_systems_housekeeping *)scratch);
+    }
+}
+
+static void bench_read_hk_from_file(uint32_t n) {
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        read_hk_from_file(CLI_BENCH_FILE, 1, (All_systems_housekeeping *)scratch);
+    }
+}
+
+/* Times from the last day, where ground usually asks for housekeeping */
+static bool setup_timestamps(void) {
+    uint32_t *queries = (uint32_t *)scratch;
+    uint32_t now = 0;
+    uint32_t i;
+
+    RTCMK_GetUnix(&now);
+    for (i = 0; i < CLI_BENCH_QUERIES; i++) {
+        queries[i] = now - prv_rand() % (24 * 60 * 60);
+    }
+    return true;
+}
+
+static void bench_get_file_id_from_timestamp(uint32_t n) {
+    const uint32_t *queries = (const uint32_t *)scratch;
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        sink += get_file_id_from_timestamp(queries[i & (CLI_BENCH_QUERIES - 1)]);
+    }
+}
+
+/*
+ * Reliance Edge, on a scratch file that is deleted after each benchmark
+ */
+
+static bool prv_open_scratch_file(bool fill) {
+    uint32_t written;
+
+    bench_fd = red_open(CLI_BENCH_FILE, RED_O_CREAT | RED_O_TRUNC | RED_O_RDWR);
+    if (bench_fd < 0) {
+        return false;
+    }
+    prv_fill_scratch(CLI_BENCH_FS_CHUNK);
+    if (fill) {
+        for (written = 0; written < CLI_BENCH_FILE_SIZE; written += CLI_BENCH_FS_CHUNK) {
+            if (red_write(bench_fd, scratch, CLI_BENCH_FS_CHUNK) != CLI_BENCH_FS_CHUNK) {
+                red_close(bench_fd);
+                red_unlink(CLI_BENCH_FILE);
+                bench_fd = -1;
+                return false;
+            }
+        }
+        red_lseek(bench_fd, 0, RED_SEEK_SET);
+    }
+    fs_offset = 0;
+    return true;
+}
+
+static bool setup_fs_empty(void) { return prv_open_scratch_file(false); }
+
+static bool setup_fs_filled(void) { return prv_open_scratch_file(true); }
+
+static void teardown_fs(void) {
+    red_close(bench_fd);
+    red_unlink(CLI_BENCH_FILE);
+    bench_fd = -1;
+}
+
+/* Sequential benchmarks go back to the start of the file at its end */
+static void prv_fs_next_chunk(void) {
+    if (fs_offset == CLI_BENCH_FILE_SIZE) {
+        red_lseek(bench_fd, 0, RED_SEEK_SET);
+        fs_offset = 0;
+    }
+    fs_offset += CLI_BENCH_FS_CHUNK;
+}
+
+static void bench_fs_seq_write(uint32_t n) {
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        prv_fs_next_chunk();
+        red_write(bench_fd, scratch, CLI_BENCH_FS_CHUNK);
+    }
+}
+
+static void bench_fs_seq_read(uint32_t n) {
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        prv_fs_next_chunk();
+        red_read(bench_fd, scratch, CLI_BENCH_FS_CHUNK);
+    }
+}
+
+static void prv_fs_seek_random(void) {
+    uint32_t record = prv_rand() % (CLI_BENCH_FILE_SIZE / CLI_BENCH_FS_RECORD);
+    red_lseek(bench_fd, (int64_t)record * CLI_BENCH_FS_RECORD, RED_SEEK_SET);
+}
+
+static void bench_fs_rand_write(uint32_t n) {
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        prv_fs_seek_random();
+        red_write(bench_fd, scratch, CLI_BENCH_FS_RECORD);
+    }
+}
+
+static void bench_fs_rand_read(uint32_t n) {
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        prv_fs_seek_random();
+        red_read(bench_fd, scratch, CLI_BENCH_FS_RECORD);
+    }
+}
+
+/*
+ * CSP, a packet sent to our own address and received again
+ */
+
+static bool setup_csp_loopback(void) {
+    loopback = csp_socket(CSP_SO_CONN_LESS);
+    if (loopback == NULL) {
+        return false;
+    }
+    if (csp_bind(loopback, CLI_BENCH_CSP_PORT) != CSP_ERR_NONE) {
+        csp_socket_close(loopback);
+        return false;
+    }
+    return true;
+}
+
+static void teardown_csp_loopback(void) { csp_socket_close(loopback); }
+
+static void bench_csp_loopback(uint32_t n) {
+    csp_packet_t *packet;
+    uint32_t i;
+
+    for (i = 0; i < n; i++) {
+        packet = csp_buffer_get(1);
+        if (packet == NULL) {
+            continue;
+        }
+        packet->data[0] = (uint8_t)i;
+        packet->length = 1;
+        if (csp_sendto(CSP_PRIO_NORM, csp_get_address(), CLI_BENCH_CSP_PORT, CLI_BENCH_CSP_PORT, CSP_O_NONE,
+                       packet, 0) != CSP_ERR_NONE) {
+            csp_buffer_free(packet);
+            continue;
+        }
+        packet = csp_recvfrom(loopback, 100);
+        if (packet != NULL) {
+            csp_buffer_free(packet);
+        }
+    }
+}
+
+static const cli_bench_t benchmarks[] = {
+    {"cnv32_8", setup_kernel, bench_cnv32_8, NULL, 0},
+    {"cnv8_32", setup_kernel, bench_cnv8_32, NULL, 0},
+    {"cnv16_8", setup_kernel, bench_cnv16_8, NULL, 0},
+    {"cnv8_16", setup_kernel, bench_cnv8_16, NULL, 0},
+    {"crc16/1k", setup_kernel, bench_crc16, NULL, CLI_BENCH_KERNEL_BYTES},
+    {"memcpy/1k", setup_kernel, bench_memcpy, NULL, CLI_BENCH_KERNEL_BYTES},
+    {"hk/convert_hk_endianness", setup_hk_record, bench_convert_hk_endianness, NULL, 0},
+    {"hk/write_hk_to_file", setup_hk_file, bench_write_hk_to_file, teardown_hk_file,
+     sizeof(All_systems_housekeeping)},
+    {"hk/read_hk_from_file", setup_hk_file, bench_read_hk_from_file, teardown_hk_file,
+     sizeof(All_systems_housekeeping)},
+    {"hk/get_file_id_from_timestamp", setup_timestamps, bench_get_file_id_from_timestamp, NULL, 0},
+    {"fs/seq_write/4k", setup_fs_empty, bench_fs_seq_write, teardown_fs, CLI_BENCH_FS_CHUNK},
+    {"fs/seq_read/4k", setup_fs_filled, bench_fs_seq_read, teardown_fs, CLI_BENCH_FS_CHUNK},
+    {"fs/rand_write/512", setup_fs_filled, bench_fs_rand_write, teardown_fs, CLI_BENCH_FS_RECORD},
+    {"fs/rand_read/512", setup_fs_filled, bench_fs_rand_read, teardown_fs, CLI_BENCH_FS_RECORD},
+    {"csp/loopback", setup_csp_loopback, bench_csp_loopback, teardown_csp_loopback, 0},
+};
+
+#define CLI_BENCH_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+/**
+ * @brief
+ *      Start the cycle counter the benchmarks are timed with
+ * @details
+ *      Configuring the PMU needs a privileged mode, so this is called while
+ *      the CLI service starts, before the scheduler runs
+ * @return SAT_returnState
+ *      SATR_ERROR if the command's lock can't be created
+ */
+SAT_returnState cli_bench_init(void) {
+    _pmuInit_();
+    _pmuEnableCountersGlobal_();
+    _pmuStartCounters_(pmuCYCLE_COUNTER);
+    bench_lock = xSemaphoreCreateMutex();
+    if (bench_lock == NULL) {
+        return SATR_ERROR;
+    }
+    return SATR_OK;
+}
+
+/* Cycles n operations take, less the cost of reading the counter */
+static uint32_t prv_time(const cli_bench_t *bench, uint32_t n, uint32_t overhead) {
+    uint32_t start, cycles;
+
+    start = _pmuGetCycleCount_();
+    bench->run(n);
+    cycles = _pmuGetCycleCount_() - start;
+    return (cycles > overhead) ? cycles - overhead : 0;
+}
+
+/* Bit i set if the name of benchmarks[i] contains the filter */
+static uint32_t prv_match(const char *filter) {
+    uint32_t matches = 0;
+    uint8_t i;
+    for (i = 0; i < CLI_BENCH_COUNT; i++) {
+        if (filter[0] == '\0' || strstr(benchmarks[i].name, filter) != NULL) {
+            matches |= 1UL << i;
+        }
+    }
+    return matches;
+}
+
+/* Index of the first matching benchmark from first */
+static uint8_t prv_next_match(uint8_t first, uint32_t matches) {
+    uint8_t i;
+    for (i = first; i < CLI_BENCH_COUNT; i++) {
+        if (matches & (1UL << i)) {
+            break;
+        }
+    }
+    return i;
+}
+
+/**
+ * @brief
+ *      Time a benchmark and write its line of results
+ * @details
+ *      Operations per sample are doubled until a sample takes at least
+ *      CLI_BENCH_SAMPLE_MS, so the counter's resolution doesn't matter.
+ *      Other tasks can preempt a sample; the median is the figure to go by.
+ */
+static void prv_run_benchmark(const cli_bench_t *bench, bench_state_t *state, char *pcWriteBuffer,
+                              size_t xWriteBufferLen) {
+    uint32_t tenths[CLI_BENCH_MAX_SAMPLES]; // cycles per operation, in tenths
+    const uint32_t target = configCPU_CLOCK_HZ / 1000 * CLI_BENCH_SAMPLE_MS;
+    uint32_t n = 1;
+    char rate[12] = "-"; // KiB/s at the median
+    uint32_t value;
+    uint8_t i, j, median;
+
+    if (bench->setup != NULL && !bench->setup()) {
+        snprintf(pcWriteBuffer, xWriteBufferLen, "%-30s skipped\n", bench->name);
+        return;
+    }
+    while (n < CLI_BENCH_MAX_OPS && prv_time(bench, n, state->overhead) < target) {
+        n *= 2;
+    }
+    for (i = 0; i < state->samples; i++) {
+        value = (uint32_t)((uint64_t)prv_time(bench, n, state->overhead) * 10 / n);
+        // insertion sort, there are few samples
+        for (j = i; j > 0 && tenths[j - 1] > value; j--) {
+            tenths[j] = tenths[j - 1];
+        }
+        tenths[j] = value;
+    }
+    if (bench->teardown != NULL) {
+        bench->teardown();
+    }
+
+    median = state->samples / 2;
+    if (bench->bytes != 0 && tenths[median] != 0) {
+        snprintf(rate, sizeof(rate), "%lu",
+                 (unsigned long)((uint64_t)bench->bytes * configCPU_CLOCK_HZ * 10 / tenths[median] / 1024));
+    }
+    snprintf(pcWriteBuffer, xWriteBufferLen, "%-30s %6lu %8lu.%lu %8lu.%lu %8lu.%lu %8s\n", bench->name,
+             (unsigned long)n, (unsigned long)(tenths[0] / 10), (unsigned long)(tenths[0] % 10),
+             (unsigned long)(tenths[median] / 10), (unsigned long)(tenths[median] % 10),
+             (unsigned long)(tenths[state->samples - 1] / 10), (unsigned long)(tenths[state->samples - 1] % 10),
+             rate);
+}
+
+/* Copies parameter 1 into filter, empty if it's not given */
+static void prv_get_filter(const char *pcCommandString, char *filter) {
+    const char *parameter;
+    BaseType_t parameter_len = 0;
+
+    parameter = FreeRTOS_CLIGetParameter(pcCommandString, 1, &parameter_len);
+    if (parameter == NULL || parameter_len >= CLI_BENCH_FILTER_LEN) {
+        parameter_len = (parameter == NULL) ? 0 : CLI_BENCH_FILTER_LEN - 1;
+    }
+    if (parameter_len > 0) {
+        memcpy(filter, parameter, parameter_len);
+    }
+    filter[parameter_len] = '\0';
+}
+
+/**
+ * @brief
+ *      Run the benchmarks whose names contain the filter, one per call
+ * @details
+ *      Only one session can benchmark at a time, so the figures aren't
+ *      skewed by a second run
+ */
+static BaseType_t prvBenchCommand(cli_session_t *session, char *pcWriteBuffer, size_t xWriteBufferLen,
+                                  const char *pcCommandString) {
+    bench_state_t *state = cli_session_state(session, sizeof(bench_state_t));
+    char filter[CLI_BENCH_FILTER_LEN];
+    const char *parameter;
+    BaseType_t parameter_len;
+    uint32_t start, cycles;
+    uint32_t samples = CLI_BENCH_DEFAULT_SAMPLES;
+    uint8_t i;
+
+    if (session->first_call) {
+        // the filter is matched once, the later calls only need the result
+        prv_get_filter(pcCommandString, filter);
+        parameter = FreeRTOS_CLIGetParameter(pcCommandString, 2, &parameter_len);
+        if (parameter != NULL) {
+            samples = strtoul(parameter, NULL, 0);
+        }
+        if (samples == 0 || samples > CLI_BENCH_MAX_SAMPLES) {
+            snprintf(pcWriteBuffer, xWriteBufferLen, "Samples must be 1 to %d\n", CLI_BENCH_MAX_SAMPLES);
+            return pdFALSE;
+        }
+        state->matches = prv_match(filter);
+        state->next = prv_next_match(0, state->matches);
+        if (state->next == CLI_BENCH_COUNT) {
+            snprintf(pcWriteBuffer, xWriteBufferLen, "No benchmark matches %s\n", filter);
+            return pdFALSE;
+        }
+        if (bench_lock == NULL || xSemaphoreTake(bench_lock, 0) != pdTRUE) {
+            snprintf(pcWriteBuffer, xWriteBufferLen, "bench already running\n");
+            return pdFALSE;
+        }
+        state->token = staging_get(STAGING_CLI, STAGING_TIMEOUT);
+        if (state->token == STAGING_NO_TOKEN) {
+            xSemaphoreGive(bench_lock);
+            snprintf(pcWriteBuffer, xWriteBufferLen, "No buffer free for the benchmarks\n");
+            return pdFALSE;
+        }
+        state->samples = (uint8_t)samples;
+        state->overhead = UINT32_MAX;
+        for (i = 0; i < 16; i++) {
+            start = _pmuGetCycleCount_();
+            cycles = _pmuGetCycleCount_() - start;
+            if (cycles < state->overhead) {
+                state->overhead = cycles;
+            }
+        }
+        snprintf(pcWriteBuffer, xWriteBufferLen, "%-30s %6s %10s %10s %10s %8s\n", "cycles/op", "ops", "min",
+                 "median", "max", "KiB/s");
+        return pdTRUE;
+    }
+
+    scratch = staging_data(state->token);
+    prv_run_benchmark(&benchmarks[state->next], state, pcWriteBuffer, xWriteBufferLen);
+    scratch = NULL;
+    state->next = prv_next_match(state->next + 1, state->matches);
+    if (state->next == CLI_BENCH_COUNT) {
+        staging_put(state->token);
+        xSemaphoreGive(bench_lock);
+        return pdFALSE;
+    }
+    return pdTRUE;
+}
+
+static const cli_command_t xBenchCommand = {
+    "bench",
+    "bench:\n\tbench [filter [samples]]\n\tCycles per operation (min, median, max) of the benchmarks whose "
+    "names contain the filter\n",
+    prvBenchCommand, -1};
+
+void register_cli_bench(void) { cli_register_command(&xBenchCommand); }
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file cli_session.c
+ * @date 2022-03-14
+ */
+
+#include "cli/cli_session.h"
+
+#include <FreeRTOS.h>
+#include <os_semphr.h>
+#include <string.h>
+
+#include "printf.h"
+#include "util/service_utilities.h"
+
+static BaseType_t prvHelpCommand(cli_session_t *session, char *pcWriteBuffer, size_t xWriteBufferLen,
+                                 const char *pcCommandString);
+
+static const cli_command_t xHelpCommand = {"help", "help:\n\tLists all the registered commands\n", prvHelpCommand,
+                                           0};
+
+/* Written only while the CLI service starts, before any session runs */
+static const cli_command_t *commands[CLI_MAX_COMMANDS] = {&xHelpCommand};
+static uint8_t command_count = 1;
+
+/* Held by the session running a FreeRTOS+CLI command, from its first call to its last */
+static SemaphoreHandle_t fallback_lock = NULL;
+
+/**
+ * @brief
+ *      Add a command to those the sessions run
+ * @param const cli_command_t *command
+ *      Command, which must stay valid for as long as the CLI runs
+ * @return SAT_returnState
+ *      SATR_ERROR if there's no room for it
+ */
+SAT_returnState cli_register_command(const cli_command_t *command) {
+    if (command_count == CLI_MAX_COMMANDS) {
+        ex2_log("CLI command %s not registered, table full", command->command);
+        return SATR_ERROR;
+    }
+    commands[command_count++] = command;
+    return SATR_OK;
+}
+
+/**
+ * @brief
+ *      Make a session ready for its first command
+ * @details
+ *      Must be called for every session before any of them run commands
+ */
+void cli_session_init(cli_session_t *session, uint8_t id) {
+    memset(session, 0, sizeof(*session));
+    session->id = id;
+    if (fallback_lock == NULL) {
+        fallback_lock = xSemaphoreCreateMutex();
+    }
+}
+
+/**
+ * @brief
+ *      The state the session's running command keeps between calls
+ * @details
+ *      It is zeroed before the command's first call
+ * @param size_t size
+ *      Size of the state the command keeps
+ * @return void *
+ *      The state, or NULL if it doesn't fit in a session
+ */
+void *cli_session_state(cli_session_t *session, size_t size) {
+    if (size > sizeof(session->state)) {
+        return NULL;
+    }
+    return &session->state;
+}
+
+static const cli_command_t *prv_find_command(const char *pcCommandInput) {
+    size_t len;
+    uint8_t i;
+
+    for (i = 0; i < command_count; i++) {
+        len = strlen(commands[i]->command);
+        // the command is the whole of the first word
+        if (strncmp(pcCommandInput, commands[i]->command, len) == 0 &&
+            (pcCommandInput[len] == ' ' || pcCommandInput[len] == '\0')) {
+            return commands[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief
+ *      Run a command with the FreeRTOS+CLI interpreter
+ * @details
+ *      The interpreter keeps the running command in a static, so only one
+ *      session can use it at once. The lock is held until the command is done.
+ */
+static BaseType_t prv_fallback(cli_session_t *session, const char *pcCommandInput, char *pcWriteBuffer,
+                               size_t xWriteBufferLen) {
+    BaseType_t xReturn;
+
+    if (!session->fallback) {
+        xSemaphoreTake(fallback_lock, portMAX_DELAY);
+        session->fallback = true;
+    }
+    xReturn = FreeRTOS_CLIProcessCommand(pcCommandInput, pcWriteBuffer, xWriteBufferLen);
+    if (xReturn == pdFALSE) {
+        session->fallback = false;
+        xSemaphoreGive(fallback_lock);
+    }
+    return xReturn;
+}
+
+/**
+ * @brief
+ *      Run the next step of a command in a session
+ * @details
+ *      Works as FreeRTOS_CLIProcessCommand does: it is called with the same
+ *      input until it returns pdFALSE, each time writing the next part of
+ *      the command's output
+ * @param cli_session_t *session
+ *      Session the command runs in
+ * @param const char *pcCommandInput
+ *      The command and its parameters
+ * @return BaseType_t
+ *      pdFALSE once the command is done
+ */
+BaseType_t cli_session_process(cli_session_t *session, const char *pcCommandInput, char *pcWriteBuffer,
+                               size_t xWriteBufferLen) {
+    const cli_command_t *command;
+    int8_t expected;
+    BaseType_t xReturn;
+
+    pcWriteBuffer[0] = '\0';
+    if (session->command == NULL) {
+        command = session->fallback ? NULL : prv_find_command(pcCommandInput);
+        if (command == NULL) {
+            // not one of ours, it may have been registered with FreeRTOS+CLI
+            return prv_fallback(session, pcCommandInput, pcWriteBuffer, xWriteBufferLen);
+        }
+        expected = command->expected_parameters;
+        if (expected >= 0 && prvGetNumberOfParameters(pcCommandInput) != expected) {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                     "Incorrect command parameter(s).  Enter \"help\" to view a list of available "
+                     "commands.\r\n\r\n");
+            return pdFALSE;
+        }
+        memset(&session->state, 0, sizeof(session->state));
+        session->command = command;
+        session->first_call = true;
+    }
+
+    xReturn = session->command->function(session, pcWriteBuffer, xWriteBufferLen, pcCommandInput);
+    session->first_call = false;
+    if (xReturn == pdFALSE) {
+        session->command = NULL;
+    }
+    return xReturn;
+}
+
+/**
+ * @brief
+ *      Check whether a FreeRTOS+CLI help entry is for a command the sessions run
+ * @details
+ *      Help entries start with the command's name and a colon, after any
+ *      leading line breaks. FreeRTOS+CLI has its own help, and commands may
+ *      be registered in both tables, so these would be listed twice
+ */
+static bool prv_lists_session_command(const char *help) {
+    size_t len;
+    uint8_t i;
+
+    help += strspn(help, " \r\n");
+    for (i = 0; i < command_count; i++) {
+        len = strlen(commands[i]->command);
+        if (strncmp(help, commands[i]->command, len) == 0 && help[len] == ':') {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Lists the session commands, then has FreeRTOS+CLI list any registered with it */
+static BaseType_t prvHelpCommand(cli_session_t *session, char *pcWriteBuffer, size_t xWriteBufferLen,
+                                 const char *pcCommandString) {
+    uint8_t *next = cli_session_state(session, sizeof(uint8_t));
+    BaseType_t xReturn;
+
+    if (*next < command_count) {
+        snprintf(pcWriteBuffer, xWriteBufferLen, "%s", commands[*next]->help);
+        (*next)++;
+        return pdTRUE;
+    }
+    xReturn = prv_fallback(session, "help", pcWriteBuffer, xWriteBufferLen);
+    if (prv_lists_session_command(pcWriteBuffer)) {
+        // already listed above; cli_app joins the parts, so an empty one is dropped
+        pcWriteBuffer[0] = '\0';
+    }
+    return xReturn;
+}
@@ -23,10 +23,29 @@
 #include <FreeRTOS-Plus-CLI/FreeRTOS_CLI.h>
 #include <redposix.h>
 #include "printf.h"
+#include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
+#include "cli/cli_session.h"
+#include "util/staging_pool.h"
 
 #define str(s) #s
 
+/* read prints this many bytes per line of hex, behind the line's file offset */
+#define READ_HEX_PER_LINE 16
+#define READ_HEX_OFFSET_LEN 9 // "%08lX:"
+
+/* State of the read command between calls, kept in the session */
+typedef struct {
+    int32_t fd;              // open file
+    staging_token_t token;   // block the file is read ahead into
+    uint16_t start;          // first byte of the block not yet printed
+    uint16_t buffered;       // bytes of the block not yet printed
+    uint32_t offset;         // file offset of the next byte to print
+    uint32_t remaining;      // bytes still to print
+    bool hex;
+} read_state_t;
+
 void createErrorOutput(char *pcWriteBuffer, size_t xWriteBufferLen) {
     const char *errorMsg;
     switch (red_errno) {
@@ -103,7 +122,8 @@ void createErrorOutput(char *pcWriteBuffer, size_t xWriteBufferLen) {
     red_errno = 0;
 }
 
-static BaseType_t prvPWDCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+static BaseType_t prvPWDCommand(cli_session_t *session, char *pcWriteBuffer, size_t xWriteBufferLen,
+                                const char *pcCommandString) {
     char pszBuffer[REDCONF_NAME_MAX];
     char *cwd = red_getcwd(pszBuffer, REDCONF_NAME_MAX);
 
@@ -115,7 +135,8 @@ static BaseType_t prvPWDCommand(char *pcWriteBuffer, size_t xWriteBufferLen, con
     return pdFALSE;
 }
 
-static BaseType_t prvCDCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+static BaseType_t prvCDCommand(cli_session_t *session, char *pcWriteBuffer, size_t xWriteBufferLen,
+                               const char *pcCommandString) {
     // We can guarantee there will be one parameter because FreeRTOS+CLI won't call this function unless it has
     // exactly one parameter
     BaseType_t parameterLen;
@@ -133,10 +154,11 @@ static BaseType_t prvCDCommand(char *pcWriteBuffer, size_t xWriteBufferLen, cons
     return pdFALSE;
 }
 
-static BaseType_t prvLSCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
-    static bool firstRun = true;
-    static REDDIR *dir;
-    if (firstRun) {
+static BaseType_t prvLSCommand(cli_session_t *session, char *pcWriteBuffer, size_t xWriteBufferLen,
+                               const char *pcCommandString) {
+    /* The open directory is kept in the session */
+    REDDIR **dir = cli_session_state(session, sizeof(REDDIR *));
+    if (session->first_call) {
         red_errno = 0;
         char pszBuffer[REDCONF_NAME_MAX];
         char *cwd = red_getcwd(pszBuffer, REDCONF_NAME_MAX);
@@ -144,23 +166,21 @@ static BaseType_t prvLSCommand(char *pcWriteBuffer, size_t xWriteBufferLen, cons
             createErrorOutput(pcWriteBuffer, xWriteBufferLen);
             return pdFALSE;
         }
-        dir = red_opendir(cwd);
-        if (dir == NULL) {
+        *dir = red_opendir(cwd);
+        if (*dir == NULL) {
             createErrorOutput(pcWriteBuffer, xWriteBufferLen);
             return pdFALSE;
         }
-        firstRun = false;
     }
     red_errno = 0;
-    REDDIRENT *current = red_readdir(dir);
+    REDDIRENT *current = red_readdir(*dir);
     if (current == NULL) {
         if (red_errno == 0) {
             snprintf(pcWriteBuffer, xWriteBufferLen, "\n");
         } else {
             createErrorOutput(pcWriteBuffer, xWriteBufferLen);
         }
-        red_closedir(dir);
-        firstRun = true;
+        red_closedir(*dir);
         return pdFALSE;
     } else {
         snprintf(pcWriteBuffer, xWriteBufferLen, "%s\n", current->d_name);
@@ -168,7 +188,8 @@ static BaseType_t prvLSCommand(char *pcWriteBuffer, size_t xWriteBufferLen, cons
     }
 }
 
-static BaseType_t prvMKDIRCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+static BaseType_t prvMKDIRCommand(cli_session_t *session, char *pcWriteBuffer, size_t xWriteBufferLen,
+                                  const char *pcCommandString) {
     // We can guarantee there will be one parameter because FreeRTOS+CLI won't call this function unless it has
     // exactly one parameter
     BaseType_t parameterLen;
@@ -186,7 +207,8 @@ static BaseType_t prvMKDIRCommand(char *pcWriteBuffer, size_t xWriteBufferLen, c
     return pdFALSE;
 }
 
-static BaseType_t prvRMDIRCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+static BaseType_t prvRMDIRCommand(cli_session_t *session, char *pcWriteBuffer, size_t xWriteBufferLen,
+                                  const char *pcCommandString) {
     // We can guarantee there will be one parameter because FreeRTOS+CLI won't call this function unless it has
     // exactly one parameter
     BaseType_t parameterLen;
@@ -204,7 +226,8 @@ static BaseType_t prvRMDIRCommand(char *pcWriteBuffer, size_t xWriteBufferLen, c
     return pdFALSE;
 }
 
-static BaseType_t prvMKCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+static BaseType_t prvMKCommand(cli_session_t *session, char *pcWriteBuffer, size_t xWriteBufferLen,
+                               const char *pcCommandString) {
     // We can guarantee there will be one parameter because FreeRTOS+CLI won't call this function unless it has
     // exactly one parameter
     BaseType_t parameterLen;
@@ -224,7 +247,8 @@ static BaseType_t prvMKCommand(char *pcWriteBuffer, size_t xWriteBufferLen, cons
     return pdFALSE;
 }
 
-static BaseType_t prvRMCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+static BaseType_t prvRMCommand(cli_session_t *session, char *pcWriteBuffer, size_t xWriteBufferLen,
+                               const char *pcCommandString) {
     // We can guarantee there will be one parameter because FreeRTOS+CLI won't call this function unless it has
     // exactly one parameter
     BaseType_t parameterLen;
@@ -242,43 +266,221 @@ static BaseType_t prvRMCommand(char *pcWriteBuffer, size_t xWriteBufferLen, cons
     return pdFALSE;
 }
 
-static BaseType_t prvSTATCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+static BaseType_t prvSTATCommand(cli_session_t *session, char *pcWriteBuffer, size_t xWriteBufferLen,
+                                 const char *pcCommandString) {
     // We can guarantee there will be one parameter because FreeRTOS+CLI won't call this function unless it has
     // exactly one parameter
-    static bool firstRun;
-    static REDSTAT pStat;
+    // The whole output fits in one call, so nothing is kept between calls
+    REDSTAT pStat;
     BaseType_t parameterLen;
-    if (firstRun == true) {
-        const char *parameter = FreeRTOS_CLIGetParameter(
-            /* The command string itself. */
-            pcCommandString,
-            /* Return the first parameter. */
-            1,
-            /* Store the parameter string length. */
-            &parameterLen);
-        int fd = red_open(parameter, RED_O_RDONLY);
-        if (fd < 0) {
-            createErrorOutput(pcWriteBuffer, xWriteBufferLen);
-            return pdFALSE;
+    const char *parameter = FreeRTOS_CLIGetParameter(
+        /* The command string itself. */
+        pcCommandString,
+        /* Return the first parameter. */
+        1,
+        /* Store the parameter string length. */
+        &parameterLen);
+    int fd = red_open(parameter, RED_O_RDONLY);
+    if (fd < 0) {
+        createErrorOutput(pcWriteBuffer, xWriteBufferLen);
+        return pdFALSE;
+    }
+    int error = red_fstat(fd, &pStat);
+    if (error < 0) {
+        createErrorOutput(pcWriteBuffer, xWriteBufferLen);
+        red_close(fd);
+        return pdFALSE;
+    }
+    red_close(fd);
+    const char *fmt = "dev %d\nino %d\nmode %X\nnlink %d\nsize %d\nblocks %d\n";
+    snprintf(pcWriteBuffer, xWriteBufferLen, fmt, pStat.st_dev, pStat.st_ino, pStat.st_mode, pStat.st_nlink,
+             pStat.st_size, pStat.st_blocks);
+    return pdFALSE;
+}
+
+static void prvReadFinish(read_state_t *state) {
+    if (state->fd >= 0) {
+        red_close(state->fd);
+    }
+    staging_put(state->token);
+    state->fd = -1;
+    state->token = STAGING_NO_TOKEN;
+}
+
+/**
+ * @brief
+ *      Open the file named by a read command and seek to where it starts
+ * @details
+ *      Parameters after the file name are the offset and then the length to
+ *      print, either of which may be left off, and "hex" anywhere among them
+ * @return bool
+ *      true if the file is open, false if pcWriteBuffer holds the error
+ */
+static bool prvReadStart(read_state_t *state, char *pcWriteBuffer, size_t xWriteBufferLen,
+                         const char *pcCommandString) {
+    char path[MAX_INPUT_SIZE];
+    const char *parameter;
+    BaseType_t parameterLen;
+    UBaseType_t parameter_num;
+    uint8_t numbers = 0;
+    char *end;
+    uint32_t value;
+
+    state->start = 0;
+    state->buffered = 0;
+    state->offset = 0;
+    state->remaining = UINT32_MAX; // up to the end of the file
+    state->hex = false;
+
+    parameter = FreeRTOS_CLIGetParameter(pcCommandString, 1, &parameterLen);
+    if (parameter == NULL || parameterLen >= sizeof(path)) {
+        snprintf(pcWriteBuffer, xWriteBufferLen, "Usage: read <file> [offset] [length] [hex]\n");
+        return false;
+    }
+    // parameters aren't terminated, the rest of the command follows them
+    memcpy(path, parameter, parameterLen);
+    path[parameterLen] = '\0';
+
+    for (parameter_num = 2;
+         (parameter = FreeRTOS_CLIGetParameter(pcCommandString, parameter_num, &parameterLen)) != NULL;
+         parameter_num++) {
+        if (parameterLen == 3 && strncmp(parameter, "hex", 3) == 0) {
+            state->hex = true;
+            continue;
         }
-        int error = red_fstat(fd, &pStat);
-        if (error < 0) {
+        value = strtoul(parameter, &end, 0);
+        if (end != parameter + parameterLen || numbers == 2) {
+            snprintf(pcWriteBuffer, xWriteBufferLen, "Usage: read <file> [offset] [length] [hex]\n");
+            return false;
+        }
+        if (numbers++ == 0) {
+            state->offset = value;
+        } else {
+            state->remaining = value;
+        }
+    }
+
+    state->fd = red_open(path, RED_O_RDONLY);
+    if (state->fd < 0) {
+        createErrorOutput(pcWriteBuffer, xWriteBufferLen);
+        return false;
+    }
+    if (red_lseek(state->fd, state->offset, RED_SEEK_SET) < 0) {
+        createErrorOutput(pcWriteBuffer, xWriteBufferLen);
+        prvReadFinish(state);
+        return false;
+    }
+    state->token = staging_get(STAGING_CLI, STAGING_TIMEOUT);
+    if (state->token == STAGING_NO_TOKEN) {
+        snprintf(pcWriteBuffer, xWriteBufferLen, "No buffer free to read into\n");
+        prvReadFinish(state);
+        return false;
+    }
+    return true;
+}
+
+/* Print as much of the block as fits, non printing bytes as '.' */
+static uint16_t prvReadPrintRaw(read_state_t *state, const uint8_t *data, char *pcWriteBuffer,
+                                size_t xWriteBufferLen) {
+    uint16_t count = state->buffered;
+    uint16_t i;
+
+    if (count > xWriteBufferLen - 1) {
+        count = xWriteBufferLen - 1;
+    }
+    for (i = 0; i < count; i++) {
+        uint8_t c = data[i];
+        pcWriteBuffer[i] = ((c >= ' ' && c <= '~') || c == '\n' || c == '\r' || c == '\t') ? c : '.';
+    }
+    pcWriteBuffer[count] = '\0';
+    return count;
+}
+
+/* Print as many whole lines of hex as fit, each behind its file offset */
+static uint16_t prvReadPrintHex(read_state_t *state, const uint8_t *data, char *pcWriteBuffer,
+                                size_t xWriteBufferLen) {
+    static const char digits[] = "0123456789ABCDEF";
+    uint16_t per_line = READ_HEX_PER_LINE;
+    uint16_t count = 0;
+    uint16_t line;
+    size_t used = 0;
+
+    // a line is the offset, then " XX" per byte and a newline
+    if (xWriteBufferLen < READ_HEX_OFFSET_LEN + 3 * per_line + 2) {
+        per_line = (xWriteBufferLen - READ_HEX_OFFSET_LEN - 2) / 3;
+    }
+    while (count < state->buffered && used + READ_HEX_OFFSET_LEN + 3 * per_line + 2 <= xWriteBufferLen) {
+        used += snprintf(&pcWriteBuffer[used], xWriteBufferLen - used, "%08lX:",
+                         (unsigned long)(state->offset + count));
+        for (line = 0; line < per_line && count < state->buffered; line++, count++) {
+            pcWriteBuffer[used++] = ' ';
+            pcWriteBuffer[used++] = digits[data[count] >> 4];
+            pcWriteBuffer[used++] = digits[data[count] & 0x0F];
+        }
+        pcWriteBuffer[used++] = '\n';
+    }
+    pcWriteBuffer[used] = '\0';
+    return count;
+}
+
+/**
+ * @brief
+ *      Print a file one output buffer at a time
+ * @details
+ *      The file stays open between calls. It is read ahead a staging block
+ *      at a time, so a large file is paged through without being held in RAM
+ *      and without a filesystem read per output buffer.
+ */
+static BaseType_t prvREADCommand(cli_session_t *session, char *pcWriteBuffer, size_t xWriteBufferLen,
+                                 const char *pcCommandString) {
+    read_state_t *state = cli_session_state(session, sizeof(read_state_t));
+    uint8_t *block;
+    uint16_t count;
+    int32_t bytes_read;
+
+    if (state == NULL) {
+        snprintf(pcWriteBuffer, xWriteBufferLen, "read state doesn't fit in a session\n");
+        return pdFALSE;
+    }
+    if (session->first_call && !prvReadStart(state, pcWriteBuffer, xWriteBufferLen, pcCommandString)) {
+        return pdFALSE;
+    }
+    block = staging_data(state->token);
+
+    if (state->buffered == 0 && state->remaining != 0) {
+        bytes_read = red_read(state->fd, block,
+                              (state->remaining < STAGING_BLOCK_SIZE) ? state->remaining : STAGING_BLOCK_SIZE);
+        if (bytes_read < 0) {
             createErrorOutput(pcWriteBuffer, xWriteBufferLen);
+            prvReadFinish(state);
             return pdFALSE;
         }
-        firstRun = false;
+        if (bytes_read == 0) {
+            state->remaining = 0; // end of the file
+        }
+        state->start = 0;
+        state->buffered = bytes_read;
     }
-    const char *fmt = "dev %d\nino %d\nmode %X\nnlink %d\nsize %d\nblocks %d\n";
-    int written = snprintf(pcWriteBuffer, xWriteBufferLen, fmt, pStat.st_dev, pStat.st_ino, pStat.st_mode,
-                           pStat.st_nlink, pStat.st_size, pStat.st_blocks);
-    firstRun = true;
-    memset(&pStat, 0, sizeof(REDSTAT));
-    return pdFALSE;
-}
 
-static BaseType_t prvREADCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {}
+    if (state->hex) {
+        count = prvReadPrintHex(state, &block[state->start], pcWriteBuffer, xWriteBufferLen);
+    } else {
+        count = prvReadPrintRaw(state, &block[state->start], pcWriteBuffer, xWriteBufferLen);
+    }
+    state->start += count;
+    state->buffered -= count;
+    state->offset += count;
+    state->remaining -= count;
+
+    if (state->buffered == 0 && state->remaining == 0) {
+        prvReadFinish(state);
+        return pdFALSE;
+    }
+    return pdTRUE;
+}
 
-static BaseType_t prvTRANSACTCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
+static BaseType_t prvTRANSACTCommand(cli_session_t *session, char *pcWriteBuffer, size_t xWriteBufferLen,
+                                     const char *pcCommandString) {
     // We can guarantee there will be one parameter because FreeRTOS+CLI won't call this function unless it has
     // exactly one parameter
     BaseType_t parameterLen;
@@ -296,35 +498,35 @@ static BaseType_t prvTRANSACTCommand(char *pcWriteBuffer, size_t xWriteBufferLen
     return pdFALSE;
 }
 
-static const CLI_Command_Definition_t xPWDCommand = {"pwd", "pwd:\n\tGet current working directory\n",
-                                                     prvPWDCommand, 0};
-static const CLI_Command_Definition_t xLSCommand = {"ls", "ls:\n\tGet list of tiles in cwd\n", prvLSCommand, 0};
-static const CLI_Command_Definition_t xCDCommand = {"cd", "cd:\n\tChange current working directory\n",
-                                                    prvCDCommand, 1};
-static const CLI_Command_Definition_t xMKDIRCommand = {"mkdir", "mkdir:\n\tMake a new directory\n",
-                                                       prvMKDIRCommand, 1};
-static const CLI_Command_Definition_t xRMDIRCommand = {
-    "rmdir", "rmdir:\n\tRemove a directory only if it is empty\n", prvRMDIRCommand, 1};
-static const CLI_Command_Definition_t xMKCommand = {"mk", "mk:\n\tCreate a new empty file\n", prvMKCommand, 1};
-static const CLI_Command_Definition_t xRMCommand = {
-    "rm", "rm:\n\tDelete files. Can take any number of file parameters\n", prvRMCommand, -1};
-static const CLI_Command_Definition_t xSTATCommand = {"stat", "stat:\n\tStat a file\n", prvSTATCommand, 1};
-static const CLI_Command_Definition_t xREADCommand = {"read", "read:\n\tRead contents of a file\n", prvREADCommand,
-                                                      1};
-static const CLI_Command_Definition_t xTRANSACTCommand = {
+static const cli_command_t xPWDCommand = {"pwd", "pwd:\n\tGet current working directory\n", prvPWDCommand, 0};
+static const cli_command_t xLSCommand = {"ls", "ls:\n\tGet list of tiles in cwd\n", prvLSCommand, 0};
+static const cli_command_t xCDCommand = {"cd", "cd:\n\tChange current working directory\n", prvCDCommand, 1};
+static const cli_command_t xMKDIRCommand = {"mkdir", "mkdir:\n\tMake a new directory\n", prvMKDIRCommand, 1};
+static const cli_command_t xRMDIRCommand = {"rmdir", "rmdir:\n\tRemove a directory only if it is empty\n",
+                                            prvRMDIRCommand, 1};
+static const cli_command_t xMKCommand = {"mk", "mk:\n\tCreate a new empty file\n", prvMKCommand, 1};
+static const cli_command_t xRMCommand = {"rm", "rm:\n\tDelete files. Can take any number of file parameters\n",
+                                         prvRMCommand, -1};
+static const cli_command_t xSTATCommand = {"stat", "stat:\n\tStat a file\n", prvSTATCommand, 1};
+static const cli_command_t xREADCommand = {
+    "read",
+    "read:\n\tread <file> [offset] [length] [hex]\n\tPrint a file, or length bytes of it from offset, as text or "
+    "hex\n",
+    prvREADCommand, -1};
+static const cli_command_t xTRANSACTCommand = {
     "transact",
     "transact:\n\tTell Reliance-edge to transact the filesystem.\n\tMust include volume prefix to transact\n",
     prvTRANSACTCommand, 1};
 
 void register_fs_utils() {
-    FreeRTOS_CLIRegisterCommand(&xPWDCommand);
-    FreeRTOS_CLIRegisterCommand(&xLSCommand);
-    FreeRTOS_CLIRegisterCommand(&xCDCommand);
-    FreeRTOS_CLIRegisterCommand(&xMKDIRCommand);
-    FreeRTOS_CLIRegisterCommand(&xRMDIRCommand);
-    FreeRTOS_CLIRegisterCommand(&xMKCommand);
-    FreeRTOS_CLIRegisterCommand(&xRMCommand);
-    FreeRTOS_CLIRegisterCommand(&xSTATCommand);
-    FreeRTOS_CLIRegisterCommand(&xREADCommand);
-    FreeRTOS_CLIRegisterCommand(&xTRANSACTCommand);
+    cli_register_command(&xPWDCommand);
+    cli_register_command(&xLSCommand);
+    cli_register_command(&xCDCommand);
+    cli_register_command(&xMKDIRCommand);
+    cli_register_command(&xRMDIRCommand);
+    cli_register_command(&xMKCommand);
+    cli_register_command(&xRMCommand);
+    cli_register_command(&xSTATCommand);
+    cli_register_command(&xREADCommand);
+    cli_register_command(&xTRANSACTCommand);
 }
@@ -28,6 +28,7 @@
 #include "services.h"
 #include "task_manager/task_manager.h"
 #include "uhf.h"
+#include "util/service_stats.h"
 #include "util/service_utilities.h"
 
 #define CHAR_LEN 1 // If using Numpy unicode string, change to 4
@@ -73,7 +74,12 @@ void communication_service(void *param) {
         svc_wdt_counter++;
 
         while ((packet = csp_read(conn, 50)) != NULL) {
-            if (communication_service_app(packet) != SATR_OK) {
+            svc_dispatch_t dispatch;
+            svc_dispatch_begin(&dispatch, TC_COMMUNICATION_SERVICE, packet);
+            SAT_returnState state = communication_service_app(packet);
+            svc_dispatch_end(&dispatch, state);
+
+            if (state != SATR_OK) {
                 // something went wrong in the service
                 csp_buffer_free(packet);
             } else {
@@ -27,6 +27,7 @@
 #include "dfgm.h"
 #include "services.h"
 #include "task_manager/task_manager.h"
+#include "util/service_stats.h"
 #include "util/service_utilities.h"
 
 #include <limits.h>
@@ -68,7 +69,12 @@ void dfgm_service(void *param) {
 
         // read and process packets
         while ((packet = csp_read(conn, 50)) != NULL) {
-            if (dfgm_service_app(packet) != SATR_OK) {
+            svc_dispatch_t dispatch;
+            svc_dispatch_begin(&dispatch, TC_DFGM_SERVICE, packet);
+            SAT_returnState state = dfgm_service_app(packet);
+            svc_dispatch_end(&dispatch, state);
+
+            if (state != SATR_OK) {
                 // something went wrong in the subservice
                 csp_buffer_free(packet);
             } else {
@@ -0,0 +1,583 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file diagnostics_service.c
+ * @date 2022-03-14
+ */
+
+#include "diagnostics/diagnostics_service.h"
+
+#include <FreeRTOS.h>
+#include <csp/csp.h>
+#include <csp/csp_endian.h>
+#include <main/system.h>
+#include <os_task.h>
+
+#include "response/service_response.h"
+#include "services.h"
+#include "task_manager/task_manager.h"
+#include "util/service_stats.h"
+#include "util/service_utilities.h"
+
+#define DIAGNOSTICS_SVC_SIZE 512
+#define SVC_STATS_REPORT_HEADER 4 // total entries, entries in packet, timer type
+#define SVC_STATS_MAX_PER_PACKET 8
+
+static uint32_t svc_wdt_counter = 0;
+static uint32_t get_svc_wdt_counter() { return svc_wdt_counter; }
+
+#if (configUSE_TRACE_FACILITY == 1)
+/* Shared by the service and housekeeping. Only touched with the scheduler suspended */
+static TaskStatus_t task_snapshot[DIAG_MAX_TASKS];
+#endif
+
+/* Times each task number was switched in, counted by diag_trace_switched_in */
+static volatile uint32_t switch_counts[DIAG_SWITCH_SLOTS];
+
+/* The last GET_TASK_PROFILE sample, which later pages of the report come from */
+static diag_profile_t last_profile;
+static diag_task_profile_t last_tasks[DIAG_MAX_TASKS];
+
+/**
+ * @brief
+ *      FreeRTOS diagnostics server task
+ * @details
+ *      Accepts incoming diagnostics service packets and executes
+ *      the application
+ * @param void* param
+ * @return None
+ */
+void diagnostics_service(void *param) {
+    csp_socket_t *sock;
+    sock = csp_socket(CSP_SO_RDPREQ);
+    csp_bind(sock, TC_DIAGNOSTICS_SERVICE);
+    csp_listen(sock, SERVICE_BACKLOG_LEN);
+
+    svc_wdt_counter++;
+
+    for (;;) {
+        csp_packet_t *packet;
+        csp_conn_t *conn;
+        if ((conn = csp_accept(sock, DELAY_WAIT_TIMEOUT)) == NULL) {
+            svc_wdt_counter++;
+            /* timeout */
+            continue;
+        }
+        svc_wdt_counter++;
+
+        while ((packet = csp_read(conn, 50)) != NULL) {
+            svc_dispatch_t dispatch;
+            svc_dispatch_begin(&dispatch, TC_DIAGNOSTICS_SERVICE, packet);
+            SAT_returnState state = diagnostics_service_app(packet);
+            svc_dispatch_end(&dispatch, state);
+
+            if (state != SATR_OK) {
+                csp_buffer_free(packet);
+            } else {
+                if (!csp_send(conn, packet, 50)) {
+                    csp_buffer_free(packet);
+                }
+            }
+        }
+        csp_close(conn);
+    }
+}
+
+/**
+ * @brief
+ *      Starts the diagnostics server task
+ * @details
+ *      Starts the FreeRTOS task responsible for accepting incoming
+ *      diagnostics service requests
+ * @param None
+ * @return SAT_returnState
+ *      Success report
+ */
+SAT_returnState start_diagnostics_service(void) {
+    TaskHandle_t svc_tsk;
+    taskFunctions svc_funcs = {0};
+    svc_funcs.getCounterFunction = get_svc_wdt_counter;
+
+    if (xTaskCreate((TaskFunction_t)diagnostics_service, "diagnostics_service", DIAGNOSTICS_SVC_SIZE, NULL,
+                    NORMAL_SERVICE_PRIO, &svc_tsk) != pdPASS) {
+        ex2_log("FAILED TO CREATE TASK start_diagnostics_service\n");
+        return SATR_ERROR;
+    }
+    ex2_register(svc_tsk, svc_funcs);
+    ex2_log("Diagnostics service started\n");
+    return SATR_OK;
+}
+
+/**
+ * @brief
+ *      Fill the packet with a page of the per subtype handler statistics
+ * @param packet
+ *      Request packet. IN_DATA_BYTE holds the index of the first entry wanted
+ * @return int8_t
+ *      status
+ */
+static int8_t prv_get_svc_stats(csp_packet_t *packet) {
+    svc_stats_entry_t entries[SVC_STATS_MAX_PER_PACKET];
+    svc_stats_report_t report;
+    uint16_t first;
+    uint16_t total = svc_stats_count();
+    uint16_t max_entries;
+    uint16_t copied;
+    uint16_t i;
+    int j;
+
+    cnv8_16(&packet->data[IN_DATA_BYTE], &first);
+    first = csp_ntoh16(first);
+
+    max_entries = (csp_buffer_data_size() - OUT_DATA_BYTE - SVC_STATS_REPORT_HEADER) / sizeof(report);
+    if (max_entries > SVC_STATS_MAX_PER_PACKET) {
+        max_entries = SVC_STATS_MAX_PER_PACKET;
+    }
+    copied = svc_stats_get(first, entries, max_entries);
+
+    total = csp_hton16(total);
+    memcpy(&packet->data[OUT_DATA_BYTE], &total, sizeof(total));
+    packet->data[OUT_DATA_BYTE + 2] = (uint8_t)copied;
+    packet->data[OUT_DATA_BYTE + 3] = SVC_STATS_TIMER_IS_TICKS;
+
+    for (i = 0; i < copied; i++) {
+        report.service = entries[i].service;
+        report.subtype = entries[i].subtype;
+        report.calls = csp_hton32(entries[i].calls);
+        report.errors = csp_hton32(entries[i].errors);
+        report.total_time = csp_hton32(entries[i].total_time);
+        report.max_time = csp_hton32(entries[i].max_time);
+        for (j = 0; j < SVC_STATS_HIST_BUCKETS; j++) {
+            report.histogram[j] = csp_hton16(entries[i].histogram[j]);
+        }
+        memcpy(&packet->data[OUT_DATA_BYTE + SVC_STATS_REPORT_HEADER + i * sizeof(report)], &report,
+               sizeof(report));
+    }
+    set_packet_length(packet, sizeof(int8_t) + SVC_STATS_REPORT_HEADER + copied * sizeof(report) + 1);
+    return 0;
+}
+
+/**
+ * @brief
+ *      Get the state of the FreeRTOS heap
+ * @param free_heap
+ *      Bytes currently free
+ * @param min_free_heap
+ *      Lowest number of free bytes since boot
+ * @param largest_free_block
+ *      Largest single allocation that could currently succeed. 0 if the
+ *      kernel is too old to report it
+ */
+static void prv_get_heap_stats(uint32_t *free_heap, uint32_t *min_free_heap, uint32_t *largest_free_block) {
+    *free_heap = (uint32_t)xPortGetFreeHeapSize();
+    *min_free_heap = (uint32_t)xPortGetMinimumEverFreeHeapSize();
+#if (tskKERNEL_VERSION_MAJOR > 10) || ((tskKERNEL_VERSION_MAJOR == 10) && (tskKERNEL_VERSION_MINOR >= 2))
+    HeapStats_t heap_stats;
+    vPortGetHeapStats(&heap_stats);
+    *largest_free_block = (uint32_t)heap_stats.xSizeOfLargestFreeBlockInBytes;
+#else
+    *largest_free_block = 0;
+#endif
+}
+
+/**
+ * @brief
+ *      Take a snapshot of every task in the system, ordered by task number
+ * @attention
+ *      Must be called with the scheduler suspended, and task_snapshot may
+ *      only be read until the scheduler is resumed
+ * @param total_run_time
+ *      Set to the run time counter, if not NULL
+ * @return UBaseType_t
+ *      Number of tasks in task_snapshot. 0 if the snapshot is too small
+ */
+static UBaseType_t prv_snapshot_tasks(uint32_t *total_run_time) {
+#if (configUSE_TRACE_FACILITY == 1)
+    UBaseType_t count = uxTaskGetSystemState(task_snapshot, DIAG_MAX_TASKS, total_run_time);
+    UBaseType_t i, j;
+    TaskStatus_t tmp;
+
+    // insertion sort so that tasks keep the same order between reports
+    for (i = 1; i < count; i++) {
+        tmp = task_snapshot[i];
+        for (j = i; j > 0 && task_snapshot[j - 1].xTaskNumber > tmp.xTaskNumber; j--) {
+            task_snapshot[j] = task_snapshot[j - 1];
+        }
+        task_snapshot[j] = tmp;
+    }
+    return count;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief
+ *      Sample heap, CSP, queue and stack usage for the housekeeping record
+ * @param hk
+ *      Filled with the current resource usage in host byte order
+ */
+void diag_get_resource_hk(obc_resource_housekeeping *hk) {
+    uint32_t free_heap, min_free_heap, largest_free_block;
+    UBaseType_t count;
+#if (configUSE_TRACE_FACILITY == 1)
+    UBaseType_t i;
+#endif
+
+    memset(hk, 0, sizeof(*hk));
+    prv_get_heap_stats(&free_heap, &min_free_heap, &largest_free_block);
+    hk->free_heap = free_heap;
+    hk->min_free_heap = min_free_heap;
+    hk->largest_free_block = largest_free_block;
+    hk->csp_buffers_free = (uint16_t)csp_buffer_remaining();
+    hk->response_queue_depth = get_response_queue_depth();
+
+    vTaskSuspendAll();
+    count = prv_snapshot_tasks(NULL);
+    hk->task_count = (uint8_t)count;
+#if (configUSE_TRACE_FACILITY == 1)
+    for (i = 0; i < count && i < DIAG_HK_TASK_SLOTS; i++) {
+        hk->tasks[i].task_number = (uint8_t)task_snapshot[i].xTaskNumber;
+        hk->tasks[i].stack_headroom = task_snapshot[i].usStackHighWaterMark;
+    }
+#endif
+    xTaskResumeAll();
+}
+
+/**
+ * @brief
+ *      Convert the resource housekeeping to network byte order
+ */
+void diag_resource_hk_convert_endianness(obc_resource_housekeeping *hk) {
+    int i;
+    hk->free_heap = csp_hton32(hk->free_heap);
+    hk->min_free_heap = csp_hton32(hk->min_free_heap);
+    hk->largest_free_block = csp_hton32(hk->largest_free_block);
+    hk->csp_buffers_free = csp_hton16(hk->csp_buffers_free);
+    hk->response_queue_depth = csp_hton16(hk->response_queue_depth);
+    for (i = 0; i < DIAG_HK_TASK_SLOTS; i++) {
+        hk->tasks[i].stack_headroom = csp_hton16(hk->tasks[i].stack_headroom);
+    }
+}
+
+/**
+ * @brief
+ *      Fill the packet with the heap, CSP and queue usage, followed by the
+ *      stack headroom of as many tasks as fit
+ * @param packet
+ *      Request packet. IN_DATA_BYTE holds the index of the first task wanted
+ * @return int8_t
+ *      status. -1 if the task snapshot is too small for the system
+ */
+static int8_t prv_get_resource_stats(csp_packet_t *packet) {
+    resource_report_t report;
+    task_stack_report_t task;
+    uint32_t free_heap, min_free_heap, largest_free_block;
+    uint8_t first = packet->data[IN_DATA_BYTE];
+    uint16_t max_tasks = (csp_buffer_data_size() - OUT_DATA_BYTE - sizeof(report)) / sizeof(task);
+    uint16_t copied = 0;
+    UBaseType_t count;
+#if (configUSE_TRACE_FACILITY == 1)
+    UBaseType_t i;
+#endif
+
+    prv_get_heap_stats(&free_heap, &min_free_heap, &largest_free_block);
+    report.free_heap = csp_hton32(free_heap);
+    report.min_free_heap = csp_hton32(min_free_heap);
+    report.largest_free_block = csp_hton32(largest_free_block);
+    report.csp_buffers_free = csp_hton16((uint16_t)csp_buffer_remaining());
+    report.response_queue_depth = csp_hton16(get_response_queue_depth());
+
+    vTaskSuspendAll();
+    count = prv_snapshot_tasks(NULL);
+#if (configUSE_TRACE_FACILITY == 1)
+    for (i = first; i < count && copied < max_tasks; i++, copied++) {
+        task.task_number = (uint8_t)task_snapshot[i].xTaskNumber;
+        strncpy(task.name, task_snapshot[i].pcTaskName, DIAG_TASK_NAME_LEN - 1);
+        task.name[DIAG_TASK_NAME_LEN - 1] = '\0';
+        task.stack_headroom = csp_hton16(task_snapshot[i].usStackHighWaterMark);
+        memcpy(&packet->data[OUT_DATA_BYTE + sizeof(report) + copied * sizeof(task)], &task, sizeof(task));
+    }
+#endif
+    xTaskResumeAll();
+
+    report.task_count = (uint8_t)count;
+    report.tasks_in_packet = (uint8_t)copied;
+    memcpy(&packet->data[OUT_DATA_BYTE], &report, sizeof(report));
+    set_packet_length(packet, sizeof(int8_t) + sizeof(report) + copied * sizeof(task) + 1);
+    return (count == 0) ? -1 : 0;
+}
+
+/**
+ * @brief
+ *      Count a context switch
+ * @details
+ *      Called by the kernel each time it switches a task in, once the
+ *      platform's FreeRTOSConfig.h installs it as traceTASK_SWITCHED_IN (see
+ *      DIAG_SWITCH_SLOTS). It needs configUSE_TRACE_FACILITY. Until it is
+ *      installed every task profile reports no switches.
+ * @param task_number
+ *      Number of the task switched in
+ */
+void diag_trace_switched_in(UBaseType_t task_number) {
+    switch_counts[(task_number < DIAG_SWITCH_SLOTS) ? task_number : DIAG_SWITCH_SLOTS - 1]++;
+}
+
+static uint32_t prv_switch_count(UBaseType_t task_number) {
+    return switch_counts[(task_number < DIAG_SWITCH_SLOTS) ? task_number : DIAG_SWITCH_SLOTS - 1];
+}
+
+/**
+ * @brief
+ *      Measure what each task did over a window of time
+ * @details
+ *      Snapshots every task, waits out the window, then reports the run
+ *      time and context switches of each task between the snapshots, and its
+ *      stack headroom. The CPU share needs configGENERATE_RUN_TIME_STATS and
+ *      the switches need diag_trace_switched_in; either is 0 without them.
+ *      Blocks the calling task for the window, in slices of
+ *      DIAG_PROFILE_SLICE_MS so that its watchdog counter keeps moving.
+ * @param window_ms
+ *      How long to sample. 0 for DIAG_PROFILE_DEFAULT_WINDOW_MS, and no more
+ *      than DIAG_PROFILE_MAX_WINDOW_MS
+ * @param profile
+ *      Filled with the totals of the window
+ * @param tasks
+ *      Filled with the tasks alive at the end of the window, by task number
+ * @param max_tasks
+ *      Size of tasks
+ * @param wdt_counter
+ *      The calling task's watchdog counter, bumped after each slice
+ * @return uint8_t
+ *      Number of tasks in tasks. 0 if the task snapshot is too small
+ */
+uint8_t diag_profile_tasks(uint32_t window_ms, diag_profile_t *profile, diag_task_profile_t *tasks,
+                           uint8_t max_tasks, uint32_t *wdt_counter) {
+    struct {
+        UBaseType_t task_number;
+        uint32_t run_time;
+        uint32_t switches;
+    } start[DIAG_MAX_TASKS];
+    uint32_t start_run_time = 0, end_run_time = 0;
+    uint32_t start_switches = 0, end_switches = 0;
+    uint32_t slice_ms;
+    TickType_t start_tick;
+    UBaseType_t start_count, count;
+    UBaseType_t i, j = 0;
+    uint8_t copied = 0;
+
+    if (window_ms == 0) {
+        window_ms = DIAG_PROFILE_DEFAULT_WINDOW_MS;
+    } else if (window_ms > DIAG_PROFILE_MAX_WINDOW_MS) {
+        window_ms = DIAG_PROFILE_MAX_WINDOW_MS;
+    }
+    memset(profile, 0, sizeof(*profile));
+
+    vTaskSuspendAll();
+    start_tick = xTaskGetTickCount();
+    start_count = prv_snapshot_tasks(&start_run_time);
+#if (configUSE_TRACE_FACILITY == 1)
+    for (i = 0; i < start_count; i++) {
+        start[i].task_number = task_snapshot[i].xTaskNumber;
+        start[i].run_time = task_snapshot[i].ulRunTimeCounter;
+        start[i].switches = prv_switch_count(task_snapshot[i].xTaskNumber);
+    }
+#endif
+    for (i = 0; i < DIAG_SWITCH_SLOTS; i++) {
+        start_switches += switch_counts[i];
+    }
+    xTaskResumeAll();
+
+    while (window_ms > 0) {
+        slice_ms = (window_ms < DIAG_PROFILE_SLICE_MS) ? window_ms : DIAG_PROFILE_SLICE_MS;
+        vTaskDelay(pdMS_TO_TICKS(slice_ms));
+        window_ms -= slice_ms;
+        (*wdt_counter)++;
+    }
+
+    vTaskSuspendAll();
+    count = prv_snapshot_tasks(&end_run_time);
+    profile->window = (xTaskGetTickCount() - start_tick) * portTICK_PERIOD_MS;
+    profile->run_time = end_run_time - start_run_time;
+#if (configUSE_TRACE_FACILITY == 1)
+    // both snapshots are ordered by task number
+    for (i = 0; i < count && copied < max_tasks; i++, copied++) {
+        diag_task_profile_t *task = &tasks[copied];
+        uint32_t run_time = task_snapshot[i].ulRunTimeCounter;
+        uint32_t switches = prv_switch_count(task_snapshot[i].xTaskNumber);
+
+        while (j < start_count && start[j].task_number < task_snapshot[i].xTaskNumber) {
+            j++;
+        }
+        if (j < start_count && start[j].task_number == task_snapshot[i].xTaskNumber) {
+            run_time -= start[j].run_time;
+            switches -= start[j].switches;
+        } // else it started during the window
+        task->task_number = (uint8_t)task_snapshot[i].xTaskNumber;
+        strncpy(task->name, task_snapshot[i].pcTaskName, DIAG_TASK_NAME_LEN - 1);
+        task->name[DIAG_TASK_NAME_LEN - 1] = '\0';
+        task->priority = (uint8_t)task_snapshot[i].uxCurrentPriority;
+        task->cpu_permille =
+            (profile->run_time == 0) ? 0 : (uint16_t)(((uint64_t)run_time * 1000) / profile->run_time);
+        task->switches = switches;
+        task->stack_headroom = task_snapshot[i].usStackHighWaterMark;
+    }
+#endif
+    for (i = 0; i < DIAG_SWITCH_SLOTS; i++) {
+        end_switches += switch_counts[i];
+    }
+    xTaskResumeAll();
+
+    profile->switches = end_switches - start_switches;
+    profile->task_count = (uint8_t)count;
+    return copied;
+}
+
+/**
+ * @brief
+ *      Fill the packet with a page of a task profile
+ * @param packet
+ *      Request packet. IN_DATA_BYTE holds the window to sample in ms as a
+ *      uint16, and IN_DATA_BYTE + 2 the index of the first task wanted. A
+ *      request for the first task samples a new window; the later pages come
+ *      from the same sample
+ * @return int8_t
+ *      status. -1 if the task snapshot is too small for the system
+ */
+static int8_t prv_get_task_profile(csp_packet_t *packet) {
+    task_profile_report_t report;
+    task_profile_entry_t entry;
+    uint16_t window;
+    uint8_t first = packet->data[IN_DATA_BYTE + 2];
+    uint16_t max_tasks = (csp_buffer_data_size() - OUT_DATA_BYTE - sizeof(report)) / sizeof(entry);
+    uint16_t copied = 0;
+    uint16_t i;
+
+    cnv8_16(&packet->data[IN_DATA_BYTE], &window);
+    window = csp_ntoh16(window);
+    if (first == 0) {
+        diag_profile_tasks(window, &last_profile, last_tasks, DIAG_MAX_TASKS, &svc_wdt_counter);
+    }
+
+    for (i = first; i < last_profile.task_count && i < DIAG_MAX_TASKS && copied < max_tasks; i++, copied++) {
+        entry.task_number = last_tasks[i].task_number;
+        memcpy(entry.name, last_tasks[i].name, DIAG_TASK_NAME_LEN);
+        entry.priority = last_tasks[i].priority;
+        entry.cpu_permille = csp_hton16(last_tasks[i].cpu_permille);
+        entry.switches = csp_hton32(last_tasks[i].switches);
+        entry.stack_headroom = csp_hton16(last_tasks[i].stack_headroom);
+        memcpy(&packet->data[OUT_DATA_BYTE + sizeof(report) + copied * sizeof(entry)], &entry, sizeof(entry));
+    }
+
+    report.window = csp_hton32(last_profile.window);
+    report.run_time = csp_hton32(last_profile.run_time);
+    report.switches = csp_hton32(last_profile.switches);
+    report.task_count = last_profile.task_count;
+    report.tasks_in_packet = (uint8_t)copied;
+    memcpy(&packet->data[OUT_DATA_BYTE], &report, sizeof(report));
+    set_packet_length(packet, sizeof(int8_t) + sizeof(report) + copied * sizeof(entry) + 1);
+    return (last_profile.task_count == 0) ? -1 : 0;
+}
+
+/**
+ * @brief
+ *      Fill the packet with the response queue usage, followed by the drop
+ *      count of every service which had responses dropped
+ * @param packet
+ *      Request packet
+ * @return int8_t
+ *      status
+ */
+static int8_t prv_get_response_stats(csp_packet_t *packet) {
+    response_report_t report;
+    response_drops_report_t drops;
+    uint16_t max_producers = (csp_buffer_data_size() - OUT_DATA_BYTE - sizeof(report)) / sizeof(drops);
+    uint8_t producers = 0;
+    uint16_t port;
+
+    for (port = 0; port < MAX_SERVICES && producers < max_producers; port++) {
+        drops.drops = get_response_drops((uint8_t)port);
+        if (drops.drops == 0) {
+            continue;
+        }
+        drops.service = (uint8_t)port;
+        drops.drops = csp_hton32(drops.drops);
+        memcpy(&packet->data[OUT_DATA_BYTE + sizeof(report) + producers * sizeof(drops)], &drops, sizeof(drops));
+        producers++;
+    }
+
+    report.queue_len = csp_hton16(RESPONSE_QUEUE_LEN);
+    report.queue_depth = csp_hton16(get_response_queue_depth());
+    report.queue_high_water = csp_hton16(get_response_queue_high_water());
+    report.producers = producers;
+    memcpy(&packet->data[OUT_DATA_BYTE], &report, sizeof(report));
+    set_packet_length(packet, sizeof(int8_t) + sizeof(report) + producers * sizeof(drops) + 1);
+    return 0;
+}
+
+/**
+ * @brief
+ *      Takes a CSP packet and switches based on the subservice command
+ * @details
+ *      Reports on-board performance and resource statistics
+ * @param *packet
+ *      The CSP packet
+ * @return SAT_returnState
+ *      Success or failure
+ */
+SAT_returnState diagnostics_service_app(csp_packet_t *packet) {
+    uint8_t ser_subtype = (uint8_t)packet->data[SUBSERVICE_BYTE];
+    int8_t status;
+    SAT_returnState return_state = SATR_OK;
+
+    switch (ser_subtype) {
+    case GET_SVC_STATS: {
+        status = prv_get_svc_stats(packet);
+        memcpy(&packet->data[STATUS_BYTE], &status, sizeof(int8_t));
+        break;
+    }
+
+    case RESET_SVC_STATS: {
+        svc_stats_reset();
+        status = 0;
+        memcpy(&packet->data[STATUS_BYTE], &status, sizeof(int8_t));
+        set_packet_length(packet, sizeof(int8_t) + 1);
+        break;
+    }
+
+    case GET_RESOURCE_STATS: {
+        status = prv_get_resource_stats(packet);
+        memcpy(&packet->data[STATUS_BYTE], &status, sizeof(int8_t));
+        break;
+    }
+
+    case GET_RESPONSE_STATS: {
+        status = prv_get_response_stats(packet);
+        memcpy(&packet->data[STATUS_BYTE], &status, sizeof(int8_t));
+        break;
+    }
+
+    case GET_TASK_PROFILE: {
+        status = prv_get_task_profile(packet);
+        memcpy(&packet->data[STATUS_BYTE], &status, sizeof(int8_t));
+        break;
+    }
+
+    default:
+        ex2_log("No such subservice\n");
+        return_state = SATR_PKT_ILLEGAL_SUBSERVICE;
+    }
+
+    return return_state;
+}
@@ -23,6 +23,7 @@
 #include "privileged_functions.h"
 #include "services.h"
 #include "task_manager/task_manager.h"
+#include "util/service_stats.h"
 #include "util/service_utilities.h"
 #include <FreeRTOS.h>
 #include <csp/csp.h>
@@ -92,7 +93,12 @@ void general_service(void *param) {
         svc_wdt_counter++;
 
         while ((packet = csp_read(conn, 50)) != NULL) {
-            if (general_app(conn, packet) != SATR_OK) {
+            svc_dispatch_t dispatch;
+            svc_dispatch_begin(&dispatch, TC_GENERAL_SERVICE, packet);
+            SAT_returnState state = general_app(conn, packet);
+            svc_dispatch_end(&dispatch, state);
+
+            if (state != SATR_OK) {
                 ex2_log("Error responding to packet");
             }
         }
@@ -24,18 +24,22 @@
 #include "rtcmk.h"    //to get time from RTC
 #include "services.h"
 #include "task_manager/task_manager.h"
+#include "util/service_stats.h"
 #include "util/service_utilities.h"
+#include "util/staging_pool.h"
 #include "csp/csp_endian.h"
+#include "logger/binlog.h"
 
 uint16_t MAX_FILES = 20160; // value is 20160 (7 days) based on 30 second period
-char fileName[] = "VOL0:/tempHKdata.TMP";
+char fileName[] = HK_ARCHIVE_FILE;
 uint16_t current_file = 1; // Increments after file write. loops back at MAX_FILES
                            // 1 indexed
 char hk_config[] = "VOL0:/HKconfig.TMP";
+char hk_version[] = "VOL0:/HKversion.TMP"; // layout of the records in fileName
 static uint8_t config_loaded = 0; // set to 1 after config is loaded
 
-uint32_t *timestamps = 0;             // This is a dynamic array to handle file search by timestamp
-uint16_t hk_timestamp_array_size = 0; // NOT BYTES. stored as number of items. 1 indexed. 0 element unused
+uint32_t timestamps[HK_MAX_FILES_LIMIT + 1]; // This array handles file search by timestamp
+uint16_t hk_timestamp_array_size = 0;        // NOT BYTES. stored as number of items. 1 indexed. 0 element unused
 
 SemaphoreHandle_t f_count_lock = NULL;
 
@@ -60,7 +64,7 @@ uint16_t get_file_id_from_timestamp(uint32_t timestamp) {
     uint32_t right;
     uint32_t middle;
     uint32_t offset = 0;
-    if (timestamps == NULL) {
+    if (hk_timestamp_array_size == 0) {
         return 0;
     }
     if (timestamps[current_file] == 0) { // haven't made full loop of storage
@@ -114,39 +118,27 @@ uint16_t get_file_id_from_timestamp(uint32_t timestamp) {
 
 /**
  * @brief
- *      Handles malloc, realloc, and free for array holding hk timestamps
+ *      Sizes the array holding hk timestamps
+ * @details
+ *      The array is static, sized for HK_MAX_FILES_LIMIT files, so only the
+ *      entries in use change. Entries past the old size are cleared when
+ *      growing and everything is cleared when shrinking
  * @param num_items
- *      This is how many items should have space malloced
+ *      This is how many items should be in use
  * @return Result
  *      FAILURE or SUCCESS
  */
 Result dynamic_timestamp_array_handler(uint16_t num_items) {
-    if (num_items == 0) {
-        if (timestamps != NULL) {
-            vPortFree(timestamps);
-        }
-        hk_timestamp_array_size = 0;
-        return SUCCESS;
+    if (num_items > HK_MAX_FILES_LIMIT) {
+        return FAILURE;
     }
-    if (num_items != hk_timestamp_array_size) {
-        uint32_t size = sizeof(*timestamps) * (num_items + 1); //+1 to allow non-zero index room
-        uint32_t *tmp = (uint32_t *)pvPortMalloc(size);
-        if (tmp == NULL) {
-            return FAILURE;
-        }
-        if (timestamps != NULL &&
-            hk_timestamp_array_size < num_items) { // check if growing because we delete everything if shrinking
-            memcpy(tmp, timestamps, sizeof(*timestamps) * hk_timestamp_array_size);
-            vPortFree(timestamps);
-        }
-        timestamps = tmp;
-
-        uint16_t i;
-        for (i = (hk_timestamp_array_size + 1); i <= num_items; i++) { // ensure new entries are clean
-            timestamps[i] = 0;
-        }
-        hk_timestamp_array_size = num_items;
+    if (num_items < hk_timestamp_array_size) {
+        memset(timestamps, 0, sizeof(timestamps));
+    } else if (num_items > hk_timestamp_array_size) { // ensure new entries are clean
+        memset(&timestamps[hk_timestamp_array_size + 1], 0,
+               sizeof(*timestamps) * (num_items - hk_timestamp_array_size));
     }
+    hk_timestamp_array_size = num_items;
     return SUCCESS;
 }
 
@@ -429,6 +421,8 @@ Result collect_hk_from_devices(All_systems_housekeeping *all_hk_data) {
     DFGM_return DFGM_return_code = HAL_DFGM_get_HK(&all_hk_data->DFGM_hk);  /* DFGM Housekeeping */
 #endif /* DFGM_IS_STUBBED */
 
+    diag_get_resource_hk(&all_hk_data->obc_resource_hk);                 /* OBC resource usage */
+
     /*consider if struct should hold error codes returned from these functions*/
     return SUCCESS;
 }
@@ -504,6 +498,41 @@ Result load_config() {
     return SUCCESS;
 }
 
+/**
+ * @brief
+ *      Delete the archive if its records have another layout than this build's
+ * @details
+ *      Records are found by their offset in the file, so records of another
+ *      size would be misread. The config that indexes them goes too. An
+ *      archive from before the version file existed is treated as different.
+ */
+static void check_archive_version(void) {
+    uint16_t stored[2] = {0, 0}; // version, record size
+    uint16_t current[2] = {HK_RECORD_VERSION, sizeof(All_systems_housekeeping)};
+    int32_t fd;
+
+    fd = red_open(hk_version, RED_O_RDONLY);
+    if (fd != -1) {
+        red_read(fd, stored, sizeof(stored));
+        red_close(fd);
+    }
+    if (memcmp(stored, current, sizeof(stored)) == 0) {
+        return;
+    }
+    if (exists(fileName) == FILE_EXISTS) {
+        red_unlink(fileName);
+        red_unlink(hk_config);
+        binlog(LOG_HK_ARCHIVE_RESET, (uint32_t)current[0], (uint32_t)current[1]);
+    }
+    fd = red_open(hk_version, RED_O_CREAT | RED_O_TRUNC | RED_O_RDWR);
+    if (fd == -1) {
+        ex2_log("Failed to open or create file to write: '%s'\n", hk_version);
+        return;
+    }
+    red_write(fd, current, sizeof(current));
+    red_close(fd);
+}
+
 /**
  * @brief
  *    get the size of the entire housekeeping struct
@@ -522,7 +551,8 @@ uint16_t get_size_of_housekeeping(All_systems_housekeeping *all_hk_data) {
                            sizeof(all_hk_data->adcs_hk) +      // currently 178U
                            sizeof(all_hk_data->hyperion_hk) + // currently 188U
                            sizeof(all_hk_data->charon_hk) +
-                           sizeof(all_hk_data->DFGM_hk)
+                           sizeof(all_hk_data->DFGM_hk) +
+                           sizeof(all_hk_data->obc_resource_hk)
                            //sizeof(all_hk_data->payload_hk)
                            ;
     return needed_size;
@@ -534,6 +564,8 @@ uint16_t get_size_of_housekeeping(All_systems_housekeeping *all_hk_data) {
  * @details
  *      Writes one struct to file for each subsystem present
  *      Order of writes must match the appropriate read function
+ * @param file
+ *      Archive to write to, normally HK_ARCHIVE_FILE
  * @param filenumber
  *     uint16_t number to seek to in file
  * @param all_hk_data
@@ -542,11 +574,11 @@ uint16_t get_size_of_housekeeping(All_systems_housekeeping *all_hk_data) {
  *      FAILURE or SUCCESS
  */
 
-Result write_hk_to_file(uint16_t filenumber, All_systems_housekeeping *all_hk_data) {
-    int32_t fout = red_open(fileName, RED_O_CREAT | RED_O_RDWR); // open or create file to write binary
+Result write_hk_to_file(const char *file, uint16_t filenumber, All_systems_housekeeping *all_hk_data) {
+    int32_t fout = red_open(file, RED_O_CREAT | RED_O_RDWR); // open or create file to write binary
     if (fout == -1) {
         printf("Unexpected error %d from red_open()\r\n", (int)red_errno);
-        ex2_log("Failed to open or create file to write: '%s'\n", fileName);
+        ex2_log("Failed to open or create file to write: '%s'\n", file);
         return FAILURE;
     }
     uint16_t needed_size = get_size_of_housekeeping(all_hk_data);
@@ -565,9 +597,10 @@ Result write_hk_to_file(uint16_t filenumber, All_systems_housekeeping *all_hk_da
     red_write(fout, &all_hk_data->charon_hk, sizeof(all_hk_data->charon_hk));
     //red_write(fout, &all_hk_data->payload_hk, sizeof(all_hk_data->payload_hk));
     red_write(fout, &all_hk_data->DFGM_hk, sizeof(all_hk_data->DFGM_hk));
+    red_write(fout, &all_hk_data->obc_resource_hk, sizeof(all_hk_data->obc_resource_hk));
 
     if (red_errno != 0) {
-        ex2_log("Failed to write to file: '%s'\n", fileName);
+        ex2_log("Failed to write to file: '%s'\n", file);
         red_close(fout);
         return FAILURE;
     }
@@ -581,6 +614,8 @@ Result write_hk_to_file(uint16_t filenumber, All_systems_housekeeping *all_hk_da
  * @details
  *      Reads one struct from file for each subsystem present
  *      Order of reads must match the appropriate write function
+ * @param file
+ *      Archive to read from, normally HK_ARCHIVE_FILE
  * @param filenumber
  *      uint16_t position to seek to in file
  * @param all_hk_data
@@ -588,40 +623,61 @@ Result write_hk_to_file(uint16_t filenumber, All_systems_housekeeping *all_hk_da
  * @return Result
  *      FAILURE or SUCCESS
  */
-Result read_hk_from_file(uint16_t filenumber, All_systems_housekeeping *all_hk_data) {
-    if (exists(fileName) == FILE_NOT_EXIST) {
-        ex2_log("Attempted to read file that doesn't exist: '%s'\n", fileName);
+Result read_hk_from_file(const char *file, uint16_t filenumber, All_systems_housekeeping *all_hk_data) {
+    if (exists(file) == FILE_NOT_EXIST) {
+        ex2_log("Attempted to read file that doesn't exist: '%s'\n", file);
         return FAILURE;
     }
-    int32_t fin = red_open(fileName, RED_O_RDONLY); // open file to read binary
+    int32_t fin = red_open(file, RED_O_RDONLY); // open file to read binary
     if (fin == -1) {
-        ex2_log("Failed to open file to read: '%c'\n", fileName);
+        ex2_log("Failed to open file to read: '%s'\n", file);
         return FAILURE;
     }
 
     uint16_t needed_size = get_size_of_housekeeping(all_hk_data);
+    staging_token_t token = staging_get(STAGING_HOUSEKEEPING, STAGING_TIMEOUT);
+    uint8_t *record = staging_data(token);
+    if (record == NULL) {
+        ex2_log("No staging block to read: '%s'\n", file);
+        red_close(fin);
+        return FAILURE;
+    }
 
     red_lseek(fin, (filenumber - 1) * needed_size, RED_SEEK_SET);
 
-    red_errno = 0;
-    /*The order of writes and subsequent reads must match*/
-    red_read(fin, &all_hk_data->hk_timeorder, sizeof(all_hk_data->hk_timeorder));
-    red_read(fin, &all_hk_data->adcs_hk, sizeof(all_hk_data->adcs_hk));
-    red_read(fin, &all_hk_data->Athena_hk, sizeof(all_hk_data->Athena_hk));
-    red_read(fin, &all_hk_data->EPS_hk, sizeof(all_hk_data->EPS_hk));
-    red_read(fin, &all_hk_data->UHF_hk, sizeof(all_hk_data->UHF_hk));
-    red_read(fin, &all_hk_data->S_band_hk, sizeof(all_hk_data->S_band_hk));
-    red_read(fin, &all_hk_data->hyperion_hk, sizeof(all_hk_data->hyperion_hk));
-    red_read(fin, &all_hk_data->charon_hk, sizeof(all_hk_data->charon_hk));
-    // red_read(fin, &all_hk_data->payload_hk, sizeof(all_hk_data->payload_hk));
-    red_read(fin, &all_hk_data->DFGM_hk, sizeof(all_hk_data->DFGM_hk));
-
-    if (red_errno != 0) {
-        ex2_log("Failed to read: '%c'\n", fileName);
+    // one read of the whole record rather than one per subsystem
+    if (red_read(fin, record, needed_size) != needed_size) {
+        ex2_log("Failed to read: '%s'\n", file);
+        staging_put(token);
         red_close(fin);
         return FAILURE;
     }
     red_close(fin);
+
+    /*The order of writes and subsequent reads must match*/
+    uint16_t used = 0;
+    memcpy(&all_hk_data->hk_timeorder, &record[used], sizeof(all_hk_data->hk_timeorder));
+    used += sizeof(all_hk_data->hk_timeorder);
+    memcpy(&all_hk_data->adcs_hk, &record[used], sizeof(all_hk_data->adcs_hk));
+    used += sizeof(all_hk_data->adcs_hk);
+    memcpy(&all_hk_data->Athena_hk, &record[used], sizeof(all_hk_data->Athena_hk));
+    used += sizeof(all_hk_data->Athena_hk);
+    memcpy(&all_hk_data->EPS_hk, &record[used], sizeof(all_hk_data->EPS_hk));
+    used += sizeof(all_hk_data->EPS_hk);
+    memcpy(&all_hk_data->UHF_hk, &record[used], sizeof(all_hk_data->UHF_hk));
+    used += sizeof(all_hk_data->UHF_hk);
+    memcpy(&all_hk_data->S_band_hk, &record[used], sizeof(all_hk_data->S_band_hk));
+    used += sizeof(all_hk_data->S_band_hk);
+    memcpy(&all_hk_data->hyperion_hk, &record[used], sizeof(all_hk_data->hyperion_hk));
+    used += sizeof(all_hk_data->hyperion_hk);
+    memcpy(&all_hk_data->charon_hk, &record[used], sizeof(all_hk_data->charon_hk));
+    used += sizeof(all_hk_data->charon_hk);
+    // memcpy(&all_hk_data->payload_hk, &record[used], sizeof(all_hk_data->payload_hk));
+    memcpy(&all_hk_data->DFGM_hk, &record[used], sizeof(all_hk_data->DFGM_hk));
+    used += sizeof(all_hk_data->DFGM_hk);
+    memcpy(&all_hk_data->obc_resource_hk, &record[used], sizeof(all_hk_data->obc_resource_hk));
+
+    staging_put(token);
     return SUCCESS;
 }
 
@@ -656,7 +712,7 @@ Result populate_and_store_hk_data(void) {
     All_systems_housekeeping temp_hk_data;
 
     if (collect_hk_from_devices(&temp_hk_data) == FAILURE) {
-        ex2_log("Error collecting hk data from peripherals\n");
+        binlog(LOG_HK_COLLECT_FAILED);
     }
 
     // RTC_get_unix_time(&temp_hk_data.hk_timeorder.UNIXtimestamp);
@@ -664,8 +720,9 @@ Result populate_and_store_hk_data(void) {
     prv_get_lock(&f_count_lock); // lock
 
     if (config_loaded == 0) {
+        check_archive_version();
         if (load_config() == FAILURE) {
-            ex2_log("couldn't load config");
+            binlog(LOG_HK_CONFIG_FAILED);
         }
     }
     config_loaded = 1;
@@ -675,8 +732,8 @@ Result populate_and_store_hk_data(void) {
 
     temp_hk_data.hk_timeorder.dataPosition = current_file;
 
-    if (write_hk_to_file(current_file, &temp_hk_data) != SUCCESS) {
-        ex2_log("Housekeeping data lost\n");
+    if (write_hk_to_file(fileName, current_file, &temp_hk_data) != SUCCESS) {
+        binlog(LOG_HK_LOST, (uint32_t)current_file);
         prv_give_lock(&f_count_lock); // unlock
         return FAILURE;
     }
@@ -684,11 +741,11 @@ Result populate_and_store_hk_data(void) {
     if (dynamic_timestamp_array_handler(MAX_FILES) == SUCCESS) {
         timestamps[current_file] = temp_hk_data.hk_timeorder.UNIXtimestamp;
     } else {
-        ex2_log("Warning, failed to malloc for secondary data structure\n");
+        binlog(LOG_HK_TIMESTAMPS_FAILED, (uint32_t)MAX_FILES);
     }
     store_config(0);
 
-    ex2_log("%zu written to disk", current_file);
+    binlog(LOG_HK_WRITTEN, (uint32_t)current_file);
 
     ++current_file;
     if (current_file > MAX_FILES) {
@@ -711,7 +768,7 @@ Result populate_and_store_hk_data(void) {
  *      enum for SUCCESS or FAILURE
  */
 Result load_historic_hk_data(uint16_t file_num, All_systems_housekeeping *all_hk_data) {
-    if (read_hk_from_file(file_num, all_hk_data) != SUCCESS) {
+    if (read_hk_from_file(fileName, file_num, all_hk_data) != SUCCESS) {
         ex2_log("Housekeeping data could not be retrieved\n");
         return FAILURE;
     }
@@ -734,7 +791,7 @@ Result load_historic_hk_data(uint16_t file_num, All_systems_housekeeping *all_hk
  */
 Result set_max_files(uint16_t new_max) {
     // ensure number requested isn't garbage
-    if (new_max < 1 || new_max > 20160)
+    if (new_max < 1 || new_max > HK_MAX_FILES_LIMIT)
         return FAILURE;
 
     prv_get_lock(&f_count_lock); // lock
@@ -795,6 +852,9 @@ Result convert_hk_endianness(All_systems_housekeeping *hk) {
     /*Sband_Housekeeping*/
     HAL_S_hk_convert_endianness(&hk->S_band_hk);
 
+    /*obc_resource_housekeeping*/
+    diag_resource_hk_convert_endianness(&hk->obc_resource_hk);
+
     /* The endianness converters for ADCS and Hyperion were never created */
 
     return SUCCESS;
@@ -885,6 +945,9 @@ Result fetch_historic_hk_and_transmit(csp_conn_t *conn, uint16_t limit, uint16_t
         memcpy(&packet->data[OUT_DATA_BYTE + used_size], &all_hk_data.charon_hk,
                sizeof(all_hk_data.charon_hk));
         used_size += sizeof(all_hk_data.charon_hk);
+        memcpy(&packet->data[OUT_DATA_BYTE + used_size], &all_hk_data.obc_resource_hk,
+               sizeof(all_hk_data.obc_resource_hk));
+        used_size += sizeof(all_hk_data.obc_resource_hk);
 
         set_packet_length(packet, used_size + 2);
 
@@ -998,7 +1061,12 @@ void housekeeping_service(void *param) {
         svc_wdt_counter++;
 
         while ((packet = csp_read(conn, 50)) != NULL) {
-            if (hk_service_app(conn, packet) != SATR_OK) {
+            svc_dispatch_t dispatch;
+            svc_dispatch_begin(&dispatch, TC_HOUSEKEEPING_SERVICE, packet);
+            SAT_returnState state = hk_service_app(conn, packet);
+            svc_dispatch_end(&dispatch, state);
+
+            if (state != SATR_OK) {
                 ex2_log("Error responding to packet");
             }
         }
@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file binlog.c
+ * @date 2022-03-14
+ */
+#include "logger/binlog.h"
+
+#include <FreeRTOS.h>
+#include <csp/csp_endian.h>
+#include <os_semphr.h>
+#include <os_task.h>
+#include <redposix.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "rtcmk.h"
+#include "util/service_utilities.h"
+
+#define LOG_MSG(name, level, nargs, format) nargs,
+static const uint8_t msg_nargs[LOG_MSG_COUNT] = {
+#include "logger/log_messages.def"
+};
+#undef LOG_MSG
+
+#define LOG_MSG(name, level, nargs, format) level,
+static const uint8_t msg_level[LOG_MSG_COUNT] = {
+#include "logger/log_messages.def"
+};
+#undef LOG_MSG
+
+/*
+ * Records are added to the active buffer inside a short critical section.
+ * When it fills up the other buffer becomes active and the flush task is
+ * woken to write the full one out, so logging never waits on the file
+ * system. If both are full the record is dropped.
+ */
+typedef struct {
+    uint8_t data[BINLOG_BUFFER_SIZE];
+    uint16_t used;
+    uint16_t records;
+} binlog_buffer_t;
+
+static binlog_buffer_t binlog_buffers[2];
+static volatile uint8_t binlog_active = 0;
+static SemaphoreHandle_t binlog_flush_lock = NULL; // held while a buffer is written out
+static TaskHandle_t binlog_flush_task = NULL;       // woken when a buffer fills
+static log_level_t binlog_level = LOG_INFO;
+static uint32_t binlog_dropped = 0;
+static uint32_t binlog_unreported = 0;
+
+/* Reading the RTC is a bus transfer, so it's only done on flush and the tick is used in between */
+static uint32_t base_unix = 0;
+static TickType_t base_tick = 0;
+
+static void prv_sync_time(void) {
+    uint32_t unix_time;
+    if (RTCMK_GetUnix(&unix_time) == 0) {
+        base_unix = unix_time;
+        base_tick = xTaskGetTickCount();
+    }
+}
+
+static void prv_put32(uint8_t *to, uint32_t value) {
+    value = csp_hton32(value);
+    memcpy(to, &value, sizeof(value));
+}
+
+/**
+ * @brief
+ *      Append a buffer to syslog.bin, moving the file to syslog_old.bin
+ *      first if it is full, and empty the buffer
+ * @attention
+ *      binlog_flush_lock must be held, and the buffer must not be active
+ */
+static SAT_returnState prv_write_buffer(binlog_buffer_t *buffer) {
+    SAT_returnState state = SATR_OK;
+    REDSTAT stat;
+    int32_t file;
+
+    file = red_open(BINLOG_FILE, RED_O_WRONLY | RED_O_CREAT | RED_O_APPEND);
+    if (file >= 0 && red_fstat(file, &stat) == 0 && stat.st_size + buffer->used > BINLOG_MAX_FILE_SIZE) {
+        red_close(file);
+        red_unlink(BINLOG_OLD_FILE);
+        red_rename(BINLOG_FILE, BINLOG_OLD_FILE);
+        file = red_open(BINLOG_FILE, RED_O_WRONLY | RED_O_CREAT | RED_O_APPEND);
+    }
+    if (file < 0 || red_write(file, buffer->data, buffer->used) != buffer->used) {
+        taskENTER_CRITICAL();
+        binlog_dropped += buffer->records;
+        binlog_unreported += buffer->records;
+        taskEXIT_CRITICAL();
+        state = SATR_ERROR;
+    }
+    if (file >= 0) {
+        red_close(file);
+    }
+    buffer->records = 0;
+    buffer->used = 0; // last: a producer may now make this buffer active
+    return state;
+}
+
+/**
+ * @brief
+ *      Set up the binary log. Must be called after the file system is mounted
+ * @return SAT_returnState
+ *      SATR_OK, or SATR_ERROR if the lock couldn't be created
+ */
+SAT_returnState binlog_init(void) {
+    if (binlog_flush_lock == NULL) {
+        binlog_flush_lock = xSemaphoreCreateMutex();
+        if (binlog_flush_lock == NULL) {
+            return SATR_ERROR;
+        }
+    }
+    prv_sync_time();
+    binlog(LOG_BOOT);
+    return SATR_OK;
+}
+
+/**
+ * @brief
+ *      Set the task to wake when a buffer fills. It should call
+ *      binlog_flush_full when woken
+ */
+void binlog_set_flush_task(TaskHandle_t task) { binlog_flush_task = task; }
+
+/**
+ * @brief
+ *      Log a message from log_messages.def
+ * @details
+ *      Nothing is formatted: the record is copied into a RAM buffer which
+ *      is written out by the flush task when full, or when binlog_flush is
+ *      called. Without a flush task a full buffer waits for binlog_flush.
+ * @param id
+ *      the message to log
+ * @param ...
+ *      the message's arguments, as many as the dictionary says. Each must
+ *      be a 32 bit integer
+ */
+void binlog(log_msg_id_t id, ...) {
+    uint8_t record[BINLOG_MAX_RECORD_SIZE];
+    binlog_buffer_t *buffer;
+    uint8_t full = 0;
+    uint16_t size;
+    uint8_t nargs;
+    uint8_t i;
+    va_list args;
+
+    if ((unsigned)id >= LOG_MSG_COUNT || msg_level[id] < binlog_level) {
+        return;
+    }
+    nargs = msg_nargs[id];
+
+    record[0] = (uint8_t)(id >> 8);
+    record[1] = (uint8_t)id;
+    record[2] = nargs;
+    record[3] = msg_level[id];
+    prv_put32(&record[4], base_unix + (xTaskGetTickCount() - base_tick) / configTICK_RATE_HZ);
+    va_start(args, id);
+    for (i = 0; i < nargs; i++) {
+        prv_put32(&record[BINLOG_HEADER_SIZE + i * sizeof(uint32_t)], va_arg(args, uint32_t));
+    }
+    va_end(args);
+    size = BINLOG_HEADER_SIZE + nargs * sizeof(uint32_t);
+
+    taskENTER_CRITICAL();
+    buffer = &binlog_buffers[binlog_active];
+    if (buffer->used + size > BINLOG_BUFFER_SIZE && binlog_buffers[!binlog_active].used == 0) {
+        binlog_active = !binlog_active;
+        buffer = &binlog_buffers[binlog_active];
+        full = 1;
+    }
+    if (buffer->used + size <= BINLOG_BUFFER_SIZE) {
+        memcpy(&buffer->data[buffer->used], record, size);
+        buffer->used += size;
+        buffer->records++;
+    } else {
+        binlog_dropped++;
+        binlog_unreported++;
+    }
+    taskEXIT_CRITICAL();
+
+    if (full && binlog_flush_task != NULL) {
+        xTaskNotifyGive(binlog_flush_task);
+    }
+}
+
+/**
+ * @brief
+ *      Only log messages of at least the given level
+ */
+void binlog_set_level(log_level_t level) { binlog_level = level; }
+
+/**
+ * @brief
+ *      Get the buffer waiting to be written out, handing the active one
+ *      over first if asked to and the other is empty
+ * @return binlog_buffer_t*
+ *      NULL if there is nothing to write. Otherwise no producer will touch
+ *      the buffer until prv_write_buffer empties it
+ */
+static binlog_buffer_t *prv_take_buffer(uint8_t hand_over) {
+    binlog_buffer_t *buffer;
+
+    taskENTER_CRITICAL();
+    if (hand_over && binlog_buffers[!binlog_active].used == 0) {
+        binlog_active = !binlog_active;
+    }
+    buffer = &binlog_buffers[!binlog_active];
+    if (buffer->used == 0) {
+        buffer = NULL;
+    }
+    taskEXIT_CRITICAL();
+    return buffer;
+}
+
+/**
+ * @brief
+ *      Write out the buffer handed over when the active one filled and,
+ *      if all is set, then the active one too
+ */
+static SAT_returnState prv_flush(uint8_t all) {
+    SAT_returnState state = SATR_OK;
+    binlog_buffer_t *buffer;
+    uint32_t unreported;
+
+    if (binlog_flush_lock == NULL || xSemaphoreTake(binlog_flush_lock, portMAX_DELAY) != pdTRUE) {
+        return SATR_ERROR;
+    }
+    buffer = prv_take_buffer(0);
+    if (buffer != NULL && prv_write_buffer(buffer) != SATR_OK) {
+        state = SATR_ERROR;
+    }
+    if (all) {
+        buffer = prv_take_buffer(1);
+        if (buffer != NULL && prv_write_buffer(buffer) != SATR_OK) {
+            state = SATR_ERROR;
+        }
+    }
+    prv_sync_time();
+
+    taskENTER_CRITICAL();
+    unreported = binlog_unreported;
+    binlog_unreported = 0;
+    taskEXIT_CRITICAL();
+    xSemaphoreGive(binlog_flush_lock);
+
+    if (unreported != 0) {
+        binlog(LOG_BINLOG_DROPPED, unreported);
+    }
+    return state;
+}
+
+/**
+ * @brief
+ *      Write every buffered record to syslog.bin
+ * @return SAT_returnState
+ *      SATR_ERROR if records couldn't be written; they are dropped
+ */
+SAT_returnState binlog_flush(void) { return prv_flush(1); }
+
+/**
+ * @brief
+ *      Write out a buffer that has filled up, if there is one, leaving the
+ *      active one alone
+ * @return SAT_returnState
+ *      SATR_ERROR if records couldn't be written; they are dropped
+ */
+SAT_returnState binlog_flush_full(void) { return prv_flush(0); }
+
+/**
+ * @brief
+ *      Number of records lost since boot because they couldn't be buffered
+ *      or written
+ */
+uint32_t binlog_get_dropped(void) { return binlog_dropped; }
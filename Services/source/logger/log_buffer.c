@@ -0,0 +1,399 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file log_buffer.c
+ * @date 2022-03-14
+ */
+#include "logger/log_buffer.h"
+
+#include <FreeRTOS.h>
+#include <os_semphr.h>
+#include <os_task.h>
+#include <redposix.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "logger/logger.h"
+#include "rtcmk.h"
+#include "task_manager/task_manager.h"
+#include "util/service_utilities.h"
+
+/* Lines are gathered here so the file is written in large pieces */
+#define LOG_WRITE_BUFFER_SIZE 1024
+/* A ring's owner is named in drop notices, so the name is kept in case the task is deleted */
+#define LOG_RING_NAME_LEN 16
+
+/*
+ * A ring has one producer, its task, and one consumer, the flusher, so the
+ * indices need no lock. The line must be in memory before head moves on,
+ * and read out before tail does. The shared ring's producers reserve a
+ * slot under a critical section and format the line outside it; head only
+ * passes lines that are finished.
+ */
+#if defined(__GNUC__)
+#define LOG_RING_BARRIER() __sync_synchronize()
+#else
+#define LOG_RING_BARRIER()
+#endif
+
+typedef struct {
+    volatile uint8_t ready; // shared ring only: formatted, waiting for head to pass it
+    uint8_t len;
+    char text[LOG_LINE_MAX];
+} log_line_t;
+
+typedef struct {
+    TaskHandle_t owner;
+    char name[LOG_RING_NAME_LEN];
+    volatile uint32_t head;    // written by the owner only
+    volatile uint32_t tail;    // written by the flusher only
+    volatile uint32_t dropped; // written by the owner only
+    uint32_t reserved;         // shared ring only: next slot handed out
+    uint32_t reported;         // dropped lines already logged, flusher only
+    log_line_t lines[LOG_RING_SLOTS];
+} log_ring_t;
+
+static log_ring_t rings[LOG_RING_COUNT];
+static volatile uint8_t rings_used = 0;
+static log_ring_t shared_ring; // producers serialised by a critical section
+
+static char write_buffer[LOG_WRITE_BUFFER_SIZE];
+static uint16_t write_used = 0;
+static uint16_t write_lines = 0;
+static SemaphoreHandle_t flush_lock = NULL; // there can only be one consumer at a time
+static TaskHandle_t flush_task = NULL;
+static log_buffer_stats_t stats = {0};
+
+static const char level_letter[] = {'D', 'I', 'W', 'E'};
+
+/* Reading the RTC is a bus transfer, so it's only done on flush and the tick is used in between */
+static uint32_t base_unix = 0;
+static TickType_t base_tick = 0;
+
+static uint32_t svc_wdt_counter = 0;
+static uint32_t get_svc_wdt_counter() { return svc_wdt_counter; }
+
+static void prv_sync_time(void) {
+    uint32_t unix_time;
+    if (RTCMK_GetUnix(&unix_time) == 0) {
+        base_unix = unix_time;
+        base_tick = xTaskGetTickCount();
+    }
+}
+
+/**
+ * @brief
+ *      Find the calling task's ring, claiming one the first time it logs.
+ *      A ring stays with its task, and keeps its name, for good
+ */
+static log_ring_t *prv_get_ring(TaskHandle_t self) {
+    log_ring_t *ring = &shared_ring;
+    const char *name;
+    uint8_t used = rings_used;
+    uint8_t i;
+
+    for (i = 0; i < used; i++) {
+        if (rings[i].owner == self) {
+            return &rings[i];
+        }
+    }
+    name = (self != NULL) ? pcTaskGetName(self) : "boot";
+    taskENTER_CRITICAL();
+    if (rings_used < LOG_RING_COUNT) {
+        ring = &rings[rings_used];
+        ring->owner = self;
+        strncpy(ring->name, name, LOG_RING_NAME_LEN - 1);
+        rings_used++;
+    }
+    taskEXIT_CRITICAL();
+    return ring;
+}
+
+static void prv_format_line(log_line_t *line, log_level_t level, const char *format, va_list args) {
+    int len;
+    int msg_len;
+
+    len = snprintf(line->text, LOG_LINE_MAX, "%u %c ",
+                   (unsigned)(base_unix + (xTaskGetTickCount() - base_tick) / configTICK_RATE_HZ),
+                   level_letter[level & 3]);
+    msg_len = vsnprintf(&line->text[len], LOG_LINE_MAX - len, format, args);
+    len += (msg_len > 0) ? msg_len : 0;
+    if (len > LOG_LINE_MAX - 1) {
+        len = LOG_LINE_MAX - 1;
+    }
+    // one line per message, whether or not the caller ended it with a newline
+    while (len > 0 && (line->text[len - 1] == '\n' || line->text[len - 1] == '\r')) {
+        len--;
+    }
+    line->text[len++] = '\n';
+    line->len = (uint8_t)len;
+}
+
+/* Wake the flush task as the ring passes half full */
+static void prv_check_fill(log_ring_t *ring, uint32_t old_head, uint32_t new_head) {
+    uint32_t tail = ring->tail;
+
+    if (old_head - tail < LOG_RING_SLOTS / 2 && new_head - tail >= LOG_RING_SLOTS / 2 && flush_task != NULL) {
+        xTaskNotifyGive(flush_task);
+    }
+}
+
+static void prv_put_line(log_ring_t *ring, log_level_t level, const char *format, va_list args) {
+    uint32_t head = ring->head;
+
+    if (head - ring->tail >= LOG_RING_SLOTS) {
+        ring->dropped++;
+        return;
+    }
+    prv_format_line(&ring->lines[head & (LOG_RING_SLOTS - 1)], level, format, args);
+    LOG_RING_BARRIER();
+    ring->head = head + 1;
+    prv_check_fill(ring, head, head + 1);
+}
+
+static void prv_put_shared_line(log_level_t level, const char *format, va_list args) {
+    uint32_t slot;
+    uint32_t old_head;
+    uint32_t head;
+
+    taskENTER_CRITICAL();
+    slot = shared_ring.reserved;
+    if (slot - shared_ring.tail >= LOG_RING_SLOTS) {
+        shared_ring.dropped++;
+        taskEXIT_CRITICAL();
+        return;
+    }
+    shared_ring.reserved = slot + 1;
+    taskEXIT_CRITICAL();
+
+    prv_format_line(&shared_ring.lines[slot & (LOG_RING_SLOTS - 1)], level, format, args);
+    LOG_RING_BARRIER();
+
+    taskENTER_CRITICAL();
+    shared_ring.lines[slot & (LOG_RING_SLOTS - 1)].ready = 1;
+    old_head = shared_ring.head;
+    head = old_head;
+    // a task that reserved an earlier slot may still be formatting it
+    while (head != shared_ring.reserved && shared_ring.lines[head & (LOG_RING_SLOTS - 1)].ready) {
+        shared_ring.lines[head & (LOG_RING_SLOTS - 1)].ready = 0;
+        head++;
+    }
+    shared_ring.head = head;
+    taskEXIT_CRITICAL();
+    prv_check_fill(&shared_ring, old_head, head);
+}
+
+/**
+ * @brief
+ *      Log a message at the given level
+ * @details
+ *      The line is formatted into the calling task's ring and written to
+ *      the syslog later by the flush task. If the ring is full the line is
+ *      dropped and counted. Not for use from interrupts.
+ */
+void ex2_vlog(log_level_t level, const char *format, va_list args) {
+    log_ring_t *ring = prv_get_ring(xTaskGetCurrentTaskHandle());
+
+    if (ring == &shared_ring) {
+        prv_put_shared_line(level, format, args);
+    } else {
+        prv_put_line(ring, level, format, args);
+    }
+}
+
+void ex2_log_level(log_level_t level, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    ex2_vlog(level, format, args);
+    va_end(args);
+}
+
+void ex2_log(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    ex2_vlog(LOG_INFO, format, args);
+    va_end(args);
+}
+
+/**
+ * @brief
+ *      Append the write buffer to the syslog, moving the syslog to the old
+ *      log first if it would grow past the configured size
+ * @attention
+ *      flush_lock must be held
+ */
+static SAT_returnState prv_write_out(void) {
+    SAT_returnState state = SATR_OK;
+    uint32_t max_size = 0;
+    REDSTAT stat;
+    int32_t file;
+
+    if (write_used == 0) {
+        return SATR_OK;
+    }
+    file = red_open(get_logger_file(), RED_O_WRONLY | RED_O_CREAT | RED_O_APPEND);
+    if (file >= 0 && get_logger_file_size(&max_size) == 0 && red_fstat(file, &stat) == 0 &&
+        stat.st_size + write_used > max_size) {
+        red_close(file);
+        red_unlink(get_logger_old_file());
+        red_rename(get_logger_file(), get_logger_old_file());
+        file = red_open(get_logger_file(), RED_O_WRONLY | RED_O_CREAT | RED_O_APPEND);
+    }
+    if (file < 0 || red_write(file, write_buffer, write_used) != write_used) {
+        stats.dropped += write_lines;
+        state = SATR_ERROR;
+    } else {
+        stats.lines += write_lines;
+        stats.flushes++;
+    }
+    if (file >= 0) {
+        red_close(file);
+    }
+    write_used = 0;
+    write_lines = 0;
+    return state;
+}
+
+static SAT_returnState prv_append(const char *text, uint16_t len) {
+    SAT_returnState state = SATR_OK;
+    if (write_used + len > LOG_WRITE_BUFFER_SIZE) {
+        state = prv_write_out();
+    }
+    memcpy(&write_buffer[write_used], text, len);
+    write_used += len;
+    write_lines++;
+    return state;
+}
+
+static SAT_returnState prv_drain(log_ring_t *ring, const char *name) {
+    SAT_returnState state = SATR_OK;
+    uint32_t tail = ring->tail;
+    uint32_t dropped;
+    char notice[LOG_LINE_MAX];
+    int len;
+
+    while (tail != ring->head) {
+        log_line_t *line = &ring->lines[tail & (LOG_RING_SLOTS - 1)];
+        LOG_RING_BARRIER();
+        if (prv_append(line->text, line->len) != SATR_OK) {
+            state = SATR_ERROR;
+        }
+        LOG_RING_BARRIER();
+        ring->tail = ++tail;
+    }
+
+    dropped = ring->dropped;
+    if (dropped != ring->reported) {
+        stats.dropped += dropped - ring->reported;
+        len = snprintf(notice, sizeof(notice), "%u W %u log lines dropped by %s\n",
+                       (unsigned)(base_unix + (xTaskGetTickCount() - base_tick) / configTICK_RATE_HZ),
+                       (unsigned)(dropped - ring->reported), name);
+        ring->reported = dropped;
+        if (len > 0 && prv_append(notice, (len < sizeof(notice)) ? len : sizeof(notice) - 1) != SATR_OK) {
+            state = SATR_ERROR;
+        }
+    }
+    return state;
+}
+
+/**
+ * @brief
+ *      Write every buffered line to the syslog
+ * @return SAT_returnState
+ *      SATR_ERROR if lines couldn't be written; they are dropped
+ */
+SAT_returnState log_buffer_flush(void) {
+    SAT_returnState state = SATR_OK;
+    uint8_t used = rings_used;
+    uint8_t i;
+
+    if (flush_lock == NULL || xSemaphoreTake(flush_lock, portMAX_DELAY) != pdTRUE) {
+        return SATR_ERROR;
+    }
+    for (i = 0; i < used; i++) {
+        if (prv_drain(&rings[i], rings[i].name) != SATR_OK) {
+            state = SATR_ERROR;
+        }
+    }
+    if (prv_drain(&shared_ring, "shared") != SATR_OK) {
+        state = SATR_ERROR;
+    }
+    if (prv_write_out() != SATR_OK) {
+        state = SATR_ERROR;
+    }
+    prv_sync_time();
+    xSemaphoreGive(flush_lock);
+    return state;
+}
+
+/**
+ * @brief
+ *      FreeRTOS task that writes buffered log lines out
+ * @details
+ *      Runs every LOG_FLUSH_PERIOD, or sooner when a ring is half full or
+ *      a binary log buffer fills. The binary log is flushed along with the
+ *      text one, but only a full buffer is written when woken early.
+ * @param void* param
+ * @return None
+ */
+static void log_flush(void *param) {
+    for (;;) {
+        uint32_t woken = ulTaskNotifyTake(pdTRUE, LOG_FLUSH_PERIOD);
+        log_buffer_flush();
+        if (woken != 0) {
+            binlog_flush_full();
+        } else {
+            binlog_flush();
+        }
+        svc_wdt_counter++;
+    }
+}
+
+/**
+ * @brief
+ *      Start the task that writes buffered log lines to the syslog
+ * @return SAT_returnState
+ *      success report
+ */
+SAT_returnState start_log_flush_task(void) {
+    taskFunctions svc_funcs = {0};
+
+    if (flush_lock == NULL) {
+        flush_lock = xSemaphoreCreateMutex();
+        if (flush_lock == NULL) {
+            return SATR_ERROR;
+        }
+    }
+    prv_sync_time();
+    svc_funcs.getCounterFunction = get_svc_wdt_counter;
+    if (xTaskCreate((TaskFunction_t)log_flush, "log_flush", 256, NULL, LOG_FLUSH_TASK_PRIO, &flush_task) !=
+        pdPASS) {
+        flush_task = NULL;
+        return SATR_ERROR;
+    }
+    binlog_set_flush_task(flush_task);
+    ex2_register(flush_task, svc_funcs);
+    return SATR_OK;
+}
+
+/**
+ * @brief
+ *      Get the buffered logging counters
+ */
+void log_buffer_get_stats(log_buffer_stats_t *stats_out) {
+    taskENTER_CRITICAL();
+    *stats_out = stats;
+    stats_out->rings_used = rings_used;
+    taskEXIT_CRITICAL();
+}
@@ -0,0 +1,345 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file log_query.c
+ * @date 2022-03-14
+ */
+#include "logger/log_query.h"
+
+#include <csp/csp_endian.h>
+#include <redposix.h>
+#include <string.h>
+
+#include "logger/binlog.h"
+#include "logger/log_buffer.h"
+#include "logger/logger.h"
+#include "util/service_utilities.h"
+#include "util/staging_pool.h"
+
+typedef struct {
+    uint8_t source;
+    uint8_t min_level;
+    uint32_t from;
+    uint32_t to;
+    uint16_t msg_id;
+    uint16_t limit;
+    char match[LOG_QUERY_MATCH_MAX];
+    uint8_t match_len;
+} log_query_t;
+
+/* Matching entries are packed into replies here */
+typedef struct {
+    csp_conn_t *conn;
+    csp_packet_t *packet;
+    uint8_t subtype;
+    uint16_t used;
+    uint16_t count;
+    uint32_t matched;
+    uint8_t failed;
+} log_query_out_t;
+
+static uint32_t prv_get32(const uint8_t *from) {
+    uint32_t value;
+    memcpy(&value, from, sizeof(value));
+    return csp_ntoh32(value);
+}
+
+static uint16_t prv_get16(const uint8_t *from) {
+    uint16_t value;
+    memcpy(&value, from, sizeof(value));
+    return csp_ntoh16(value);
+}
+
+static void prv_send(log_query_out_t *out, uint8_t final) {
+    uint16_t count = csp_hton16(out->count);
+    int8_t status = 0;
+
+    out->packet->data[SUBSERVICE_BYTE] = out->subtype;
+    memcpy(&out->packet->data[STATUS_BYTE], &status, sizeof(status));
+    out->packet->data[LOG_QUERY_FINAL_BYTE] = final;
+    memcpy(&out->packet->data[LOG_QUERY_COUNT_BYTE], &count, sizeof(count));
+    set_packet_length(out->packet, LOG_QUERY_DATA_BYTE + out->used);
+    if (!csp_send(out->conn, out->packet, 50)) {
+        csp_buffer_free(out->packet);
+        out->failed = 1;
+    }
+    out->packet = NULL;
+    out->used = 0;
+    out->count = 0;
+}
+
+/**
+ * @brief
+ *      Add a matching entry to the reply, sending the reply first if the
+ *      entry doesn't fit
+ */
+static void prv_emit(log_query_out_t *out, const uint8_t *entry, uint16_t len) {
+    uint16_t capacity = csp_buffer_data_size() - LOG_QUERY_DATA_BYTE;
+
+    if (len > capacity) {
+        len = capacity;
+    }
+    if (out->packet != NULL && out->used + len > capacity) {
+        prv_send(out, 0);
+    }
+    if (out->packet == NULL && !out->failed) {
+        out->packet = csp_buffer_get(csp_buffer_data_size());
+        if (out->packet == NULL) {
+            out->failed = 1;
+        }
+    }
+    if (out->failed) {
+        return;
+    }
+    memcpy(&out->packet->data[LOG_QUERY_DATA_BYTE + out->used], entry, len);
+    out->used += len;
+    out->count++;
+    out->matched++;
+}
+
+static uint8_t prv_contains(const uint8_t *text, uint16_t len, const char *needle, uint8_t needle_len) {
+    uint16_t i;
+    if (needle_len == 0) {
+        return 1;
+    }
+    for (i = 0; i + needle_len <= len; i++) {
+        if (text[i] == (uint8_t)needle[0] && memcmp(&text[i], needle, needle_len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static uint8_t prv_in_window(const log_query_t *query, uint32_t timestamp) {
+    return timestamp >= query->from && (query->to == 0 || timestamp <= query->to);
+}
+
+/**
+ * @brief
+ *      Filter one "<unix_ts> <L> <message>" line. Lines not in that form
+ *      are taken to be at time 0 and level INFO
+ */
+static void prv_match_line(const log_query_t *query, log_query_out_t *out, const uint8_t *line, uint16_t len) {
+    static const char levels[] = {'D', 'I', 'W', 'E'};
+    uint32_t timestamp = 0;
+    uint8_t level = LOG_INFO;
+    uint16_t i = 0;
+    uint8_t l;
+
+    while (i < len && line[i] >= '0' && line[i] <= '9') {
+        timestamp = timestamp * 10 + (line[i] - '0');
+        i++;
+    }
+    if (i > 0 && i + 2 < len && line[i] == ' ' && line[i + 2] == ' ') {
+        for (l = 0; l < sizeof(levels); l++) {
+            if (line[i + 1] == levels[l]) {
+                level = l;
+            }
+        }
+    } else {
+        timestamp = 0;
+    }
+
+    if (level >= query->min_level && prv_in_window(query, timestamp) &&
+        prv_contains(line, len, query->match, query->match_len)) {
+        prv_emit(out, line, len);
+    }
+}
+
+static void prv_match_record(const log_query_t *query, log_query_out_t *out, const uint8_t *record, uint16_t len) {
+    uint16_t id = prv_get16(&record[0]);
+    uint8_t level = record[3];
+
+    if (level >= query->min_level && prv_in_window(query, prv_get32(&record[4])) &&
+        (query->msg_id == LOG_QUERY_ANY_ID || query->msg_id == id)) {
+        prv_emit(out, record, len);
+    }
+}
+
+/**
+ * @brief
+ *      Find the length of the entry at the start of the data
+ * @return uint16_t
+ *      the length, or 0 if the data holds only part of an entry
+ */
+static uint16_t prv_entry_length(uint8_t source, const uint8_t *data, uint16_t available) {
+    uint16_t len;
+    if (source == LOG_QUERY_BINARY) {
+        if (available < BINLOG_HEADER_SIZE) {
+            return 0;
+        }
+        len = BINLOG_HEADER_SIZE + data[2] * sizeof(uint32_t);
+        return (len <= available) ? len : 0;
+    }
+    for (len = 0; len < available; len++) {
+        if (data[len] == '\n') {
+            return len + 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief
+ *      Pass every entry in a log through the filters
+ * @details
+ *      The file is read into a staging block. An entry cut off at the end
+ *      of the block is moved to the front and completed by the next read.
+ *      A text line too long for the block is skipped.
+ */
+static void prv_scan(const log_query_t *query, log_query_out_t *out, const char *filename, uint8_t *scan_buffer) {
+    uint16_t have = 0;
+    uint16_t pos;
+    uint16_t len;
+    uint8_t skipping = 0;
+    int32_t got;
+    int32_t file = red_open(filename, RED_O_RDONLY);
+
+    if (file < 0) {
+        return; // nothing logged yet, or not rotated yet
+    }
+    do {
+        got = red_read(file, &scan_buffer[have], STAGING_BLOCK_SIZE - have);
+        if (got > 0) {
+            have += got;
+        }
+
+        pos = 0;
+        while (pos < have && !out->failed && (query->limit == 0 || out->matched < query->limit)) {
+            len = prv_entry_length(query->source, &scan_buffer[pos], have - pos);
+            if (len == 0) {
+                if (got > 0 && (pos != 0 || have < STAGING_BLOCK_SIZE)) {
+                    break; // the rest comes with the next read
+                }
+                // at the end of the file, or a line longer than the buffer: take what there is
+                len = have - pos;
+                if (query->source == LOG_QUERY_BINARY) {
+                    pos = have;
+                    break;
+                }
+                if (got > 0) {
+                    skipping = 1;
+                    pos = have;
+                    break;
+                }
+            }
+            if (skipping) {
+                skipping = 0;
+            } else if (query->source == LOG_QUERY_BINARY) {
+                prv_match_record(query, out, &scan_buffer[pos], len);
+            } else {
+                prv_match_line(query, out, &scan_buffer[pos], len);
+            }
+            pos += len;
+        }
+        if (out->failed || (query->limit != 0 && out->matched >= query->limit)) {
+            break;
+        }
+        memmove(scan_buffer, &scan_buffer[pos], have - pos);
+        have -= pos;
+    } while (got > 0);
+
+    red_close(file);
+}
+
+/**
+ * @brief
+ *      Answer a query that can't be run with a failed, final, empty reply
+ */
+static SAT_returnState prv_refuse(csp_conn_t *conn, csp_packet_t *packet) {
+    int8_t status = -1;
+
+    memcpy(&packet->data[STATUS_BYTE], &status, sizeof(status));
+    packet->data[LOG_QUERY_FINAL_BYTE] = 1;
+    memset(&packet->data[LOG_QUERY_COUNT_BYTE], 0, sizeof(uint16_t));
+    set_packet_length(packet, LOG_QUERY_DATA_BYTE);
+    if (!csp_send(conn, packet, 50)) {
+        csp_buffer_free(packet);
+    }
+    return SATR_ERROR;
+}
+
+/**
+ * @brief
+ *      Run a log query and stream the matching entries back
+ * @param conn
+ *      connection to send the replies on
+ * @param packet
+ *      the request, which is used for the first reply. It is always
+ *      consumed
+ * @return SAT_returnState
+ *      SATR_OK if every reply was sent
+ */
+SAT_returnState log_query(csp_conn_t *conn, csp_packet_t *packet) {
+    log_query_out_t out = {0};
+    log_query_t query = {0};
+    staging_token_t token;
+    const char *files[2];
+    uint16_t match_len;
+    uint8_t i;
+
+    out.conn = conn;
+    out.packet = packet;
+    out.subtype = packet->data[SUBSERVICE_BYTE];
+
+    if (packet->length < LOG_QUERY_MATCH_BYTE || packet->data[LOG_QUERY_SOURCE_BYTE] > LOG_QUERY_BINARY) {
+        return prv_refuse(conn, packet);
+    }
+    query.source = packet->data[LOG_QUERY_SOURCE_BYTE];
+    query.min_level = packet->data[LOG_QUERY_LEVEL_BYTE];
+    query.from = prv_get32(&packet->data[LOG_QUERY_FROM_BYTE]);
+    query.to = prv_get32(&packet->data[LOG_QUERY_TO_BYTE]);
+    query.msg_id = prv_get16(&packet->data[LOG_QUERY_ID_BYTE]);
+    query.limit = prv_get16(&packet->data[LOG_QUERY_LIMIT_BYTE]);
+    // capped before it is narrowed, so a long request can't wrap
+    match_len = packet->length - LOG_QUERY_MATCH_BYTE;
+    if (match_len > LOG_QUERY_MATCH_MAX) {
+        match_len = LOG_QUERY_MATCH_MAX;
+    }
+    query.match_len = (uint8_t)match_len;
+    memcpy(query.match, &packet->data[LOG_QUERY_MATCH_BYTE], query.match_len);
+
+    if (query.source == LOG_QUERY_BINARY) {
+        binlog_flush();
+        files[0] = BINLOG_OLD_FILE;
+        files[1] = BINLOG_FILE;
+    } else {
+        log_buffer_flush();
+        files[0] = get_logger_old_file();
+        files[1] = get_logger_file();
+    }
+
+    token = staging_get(STAGING_LOGGER, STAGING_TIMEOUT);
+    if (token == STAGING_NO_TOKEN) {
+        ex2_log("Log query found no staging block");
+        return prv_refuse(conn, packet);
+    }
+    for (i = 0; i < 2 && !out.failed; i++) {
+        prv_scan(&query, &out, files[i], staging_data(token));
+    }
+    staging_put(token);
+
+    if (out.packet == NULL && !out.failed) {
+        out.packet = csp_buffer_get(csp_buffer_data_size());
+        if (out.packet == NULL) {
+            return SATR_ERROR;
+        }
+    }
+    if (out.failed) {
+        csp_buffer_free(out.packet); // buffers ran out, or the ground went away
+        return SATR_ERROR;
+    }
+    prv_send(&out, 1);
+    return out.failed ? SATR_ERROR : SATR_OK;
+}
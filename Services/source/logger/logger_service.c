@@ -19,105 +19,211 @@
  */
 
 #include "logger/logger_service.h"
+#include "logger/binlog.h"
+#include "logger/log_buffer.h"
+#include "logger/log_query.h"
 #include "logger/logger.h"
 #include "services.h"
 #include "task_manager/task_manager.h"
+#include "util/service_stats.h"
 #include "util/service_utilities.h" //for setting csp packet length
 #include <csp/csp.h>
+#include <csp/csp_endian.h>
 #include <redposix.h>
 
-const char log_file[] = "VOL0:/syslog.log";         // replace with getter in logger.c
-const char old_log_file[] = "VOL0:/syslog_old.log"; // replace with getter
-uint32_t max_file_size = 500;                       // repalce with getter
-
-uint32_t max_string_length = 500;
-
 static uint32_t svc_wdt_counter = 0;
 static uint32_t get_svc_wdt_counter() { return svc_wdt_counter; }
 
-/* @brief
- *      Check if file with given name exists
+/**
+ * @brief
+ *      Fill in the header of a log file reply: the file offset of the data
+ *      that follows and the size of the whole file
+ */
+static void prv_set_chunk_header(csp_packet_t *packet, int8_t status, uint32_t offset, uint32_t file_size,
+                                 uint16_t data_size) {
+    memcpy(&packet->data[STATUS_BYTE], &status, sizeof(int8_t));
+    cnv32_8(csp_hton32(offset), &packet->data[LOG_OFFSET_BYTE]);
+    cnv32_8(csp_hton32(file_size), &packet->data[LOG_FILE_SIZE_BYTE]);
+    set_packet_length(packet, LOG_DATA_BYTE + data_size);
+}
+
+/**
+ * @brief
+ *      Open a log file for reading and find its size
+ * @return int32_t
+ *      file descriptor, or -1 with red_errno set
+ */
+static int32_t prv_open_log(const char *filename, uint32_t *file_size) {
+    REDSTAT stat;
+    int32_t file = red_open(filename, RED_O_RDONLY);
+    if (file < 0) {
+        return -1;
+    }
+    if (red_fstat(file, &stat) < 0) {
+        red_close(file);
+        return -1;
+    }
+    *file_size = (uint32_t)stat.st_size;
+    return file;
+}
+
+/**
+ * @brief
+ *      Read a window of a log file into a reply packet
+ * @details
+ *      The request holds the offset to read from and the number of bytes
+ *      wanted, both big endian. The data is read straight into the packet,
+ *      so no more than fits in one CSP buffer is returned; a shorter reply
+ *      means the end of the file or of the buffer was reached. A request
+ *      with no parameters reads from the start of the file.
  * @param filename
- *      const char * to name of file to check
- * @return 0 if exists, 1 otherwise
+ *      the name of the log file to read
+ * @param packet
+ *      the request, which is filled with the reply
+ * @return SAT_returnState
+ *      state to define success of the operation
  */
-int file_exists(const char *filename) {
+SAT_returnState get_file(const char *filename, csp_packet_t *packet) {
+    uint32_t offset = 0;
+    uint16_t length = UINT16_MAX;
+    uint32_t file_size = 0;
+    uint16_t max_data = csp_buffer_data_size() - LOG_DATA_BYTE;
     int32_t file;
-    if (file = red_open(filename, RED_O_CREAT | RED_O_EXCL | RED_O_RDWR) == -1) { // open file to read binary
-        if (red_errno == RED_EEXIST) {
-            red_close(file);
-            return 0;
-        }
+    int32_t data_size;
+
+    if (packet->length >= IN_DATA_BYTE + sizeof(offset)) {
+        cnv8_32(&packet->data[IN_DATA_BYTE], &offset);
+        offset = csp_ntoh32(offset);
+    }
+    if (packet->length >= IN_DATA_BYTE + sizeof(offset) + sizeof(length)) {
+        cnv8_16LE(&packet->data[IN_DATA_BYTE + sizeof(offset)], &length);
+        length = csp_ntoh16(length);
+    }
+    if (length > max_data) {
+        length = max_data;
+    }
+
+    file = prv_open_log(filename, &file_size);
+    if (file < 0) {
+        prv_set_chunk_header(packet, -1, offset, 0, 0);
+        return SATR_OK;
+    }
+    data_size = 0;
+    if (offset < file_size && red_lseek(file, offset, RED_SEEK_SET) >= 0) {
+        data_size = red_read(file, &packet->data[LOG_DATA_BYTE], length);
     }
     red_close(file);
-    red_unlink(filename);
-    return 1;
+
+    if (data_size < 0) {
+        prv_set_chunk_header(packet, -1, offset, file_size, 0);
+    } else {
+        prv_set_chunk_header(packet, 0, offset, file_size, (uint16_t)data_size);
+    }
+    return SATR_OK;
 }
 
 /**
  * @brief
- *      generic file to open and read any file that would contain text data.
- *      primarily designed to handle either of the 2 log files that may be read
- *
+ *      Send a log file from the given offset to its end
+ * @details
+ *      Each packet has the same layout as a GET_FILE reply, so the ground
+ *      puts the file back together from the offsets and knows it has all
+ *      of it once offset plus length reaches the file size. The request
+ *      packet carries the first chunk and each following chunk is a new CSP
+ *      buffer, so no memory is needed in proportion to the file size. The
+ *      file size is taken when the stream starts; lines logged after that
+ *      are left for the next request.
+ * @param conn
+ *      connection to stream the file on
  * @param filename
- *      the name of the file to be opened and read
+ *      the name of the log file to send
  * @param packet
-        the packet that holds the service subtype and will be filled with the log data
+ *      the request. It is always consumed
  * @return SAT_returnState
-        state to define success of the operation
+ *      SATR_OK if the whole file was sent
  */
-SAT_returnState get_file(char *filename, csp_packet_t *packet) {
-    uint32_t max_file_size;
+static SAT_returnState stream_file(csp_conn_t *conn, const char *filename, csp_packet_t *packet) {
+    uint8_t ser_subtype = packet->data[SUBSERVICE_BYTE];
+    uint32_t offset = 0;
+    uint32_t file_size = 0;
+    uint16_t max_data = csp_buffer_data_size() - LOG_DATA_BYTE;
     int8_t status;
     int32_t file;
-    uint32_t data_size;
-    char *log_data;
-    get_logger_file_size(&max_file_size);
-    log_data = (char *)pvPortMalloc(max_file_size);
-    if (log_data == NULL) {
-        status = -2;
-    } else if (file_exists(filename) == 0) {
-        file = red_open(filename, RED_O_RDONLY);
-        if (file > -1) {
-            data_size = red_read(file, log_data, max_file_size);
-            if (data_size == 0) {
+    int32_t data_size;
+
+    if (packet->length >= IN_DATA_BYTE + sizeof(offset)) {
+        cnv8_32(&packet->data[IN_DATA_BYTE], &offset);
+        offset = csp_ntoh32(offset);
+    }
+
+    file = prv_open_log(filename, &file_size);
+    if (file < 0 || (offset < file_size && red_lseek(file, offset, RED_SEEK_SET) < 0)) {
+        if (file >= 0) {
+            red_close(file);
+        }
+        prv_set_chunk_header(packet, -1, offset, file_size, 0);
+        if (!csp_send(conn, packet, 50)) {
+            csp_buffer_free(packet);
+        }
+        return SATR_ERROR;
+    }
+
+    do {
+        if (packet == NULL) {
+            packet = csp_buffer_get(csp_buffer_data_size());
+            if (packet == NULL) {
+                ex2_log("Log stream stopped at %u: out of CSP buffers\n", offset);
+                red_close(file);
+                return SATR_ERROR;
+            }
+            packet->data[SUBSERVICE_BYTE] = ser_subtype;
+        }
+
+        status = 0;
+        data_size = 0;
+        if (offset < file_size) {
+            uint32_t remaining = file_size - offset;
+            data_size =
+                red_read(file, &packet->data[LOG_DATA_BYTE], (remaining < max_data) ? remaining : max_data);
+            if (data_size <= 0) {
+                // read error, or the file was rotated under us: end the stream here
                 status = -1;
-                data_size = sprintf(log_data, "Log file %s is empty\n", filename);
-            } else {
-                status = 0;
+                data_size = 0;
+                file_size = offset;
             }
-        } else {
-            status = -1;
-            data_size = sprintf(log_data, "Can't open log file. red_errno: %d\n", red_errno);
         }
-    } else {
-        status = -1;
-        data_size = sprintf(log_data, "Log file %s does not exist\n", filename);
-    }
-    for (uint32_t i = data_size; i < max_file_size; i++) {
-        log_data[i] = '\0';
-    }
-    memcpy(&packet->data[STATUS_BYTE], &status, 1);
-    memcpy(&packet->data[OUT_DATA_BYTE], log_data, max_string_length);
-    set_packet_length(packet, max_string_length + 2);
-    vPortFree(log_data);
+        prv_set_chunk_header(packet, status, offset, file_size, (uint16_t)data_size);
+
+        if (!csp_send(conn, packet, 50)) {
+            csp_buffer_free(packet);
+            red_close(file);
+            return SATR_ERROR;
+        }
+        packet = NULL;
+        offset += data_size;
+        svc_wdt_counter++;
+    } while (offset < file_size);
+
+    red_close(file);
     return SATR_OK;
 }
 
 /**
  * @brief
  *      logger service app to perform operations based on the given service subtype
-
+ * @param conn
+ *      the connection the request came in on, replies are sent on it
  * @param packet
         the packet that holds the service subtype and will be filled with the log data
  * @return SAT_returnState
-        state to define success of the operation
+        state to define success of the operation. The packet has been sent
+        or freed unless SATR_PKT_ILLEGAL_SUBSERVICE is returned
  */
-SAT_returnState logger_service_app(csp_packet_t *packet) {
+SAT_returnState logger_service_app(csp_conn_t *conn, csp_packet_t *packet) {
     uint8_t ser_subtype = (uint8_t)packet->data[SUBSERVICE_BYTE];
     int8_t status;
     uint32_t *data32;
-    int32_t file_size;
+    uint32_t file_size;
     char *log_file;
 
     switch (ser_subtype) {
@@ -136,6 +242,7 @@ SAT_returnState logger_service_app(csp_packet_t *packet) {
         set_packet_length(packet, sizeof(int8_t) + sizeof(file_size) + 1);
         break;
     case GET_FILE:
+        log_buffer_flush();
         log_file = get_logger_file();
         get_file(log_file, packet);
         break;
@@ -143,11 +250,28 @@ SAT_returnState logger_service_app(csp_packet_t *packet) {
         log_file = get_logger_old_file();
         get_file(log_file, packet);
         break;
+    case STREAM_FILE:
+        log_buffer_flush();
+        return stream_file(conn, get_logger_file(), packet);
+    case STREAM_OLD_FILE:
+        return stream_file(conn, get_logger_old_file(), packet);
+    case GET_BIN_FILE:
+        binlog_flush();
+        get_file(BINLOG_FILE, packet);
+        break;
+    case STREAM_BIN_FILE:
+        binlog_flush();
+        return stream_file(conn, BINLOG_FILE, packet);
+    case QUERY_LOG:
+        return log_query(conn, packet);
     default:
         ex2_log("No such subservice\n");
         return SATR_PKT_ILLEGAL_SUBSERVICE;
     }
 
+    if (!csp_send(conn, packet, 50)) {
+        csp_buffer_free(packet);
+    }
     return SATR_OK;
 }
 
@@ -179,13 +303,13 @@ void logger_service(void *param) {
         svc_wdt_counter++;
 
         while ((packet = csp_read(conn, 50)) != NULL) {
-            if (logger_service_app(packet) != SATR_OK) {
-                // something went wrong, this shouldn't happen
+            svc_dispatch_t dispatch;
+            svc_dispatch_begin(&dispatch, TC_LOGGER_SERVICE, packet);
+            SAT_returnState state = logger_service_app(conn, packet);
+            svc_dispatch_end(&dispatch, state);
+
+            if (state == SATR_PKT_ILLEGAL_SUBSERVICE) {
                 csp_buffer_free(packet);
-            } else {
-                if (!csp_send(conn, packet, 50)) {
-                    csp_buffer_free(packet);
-                }
             }
         }
         csp_close(conn); // frees buffers used
@@ -213,6 +337,9 @@ SAT_returnState start_logger_service(void) {
     }
     ex2_register(svc_tsk, svc_funcs);
 
+    if (binlog_init() != SATR_OK || start_log_flush_task() != SATR_OK) {
+        ex2_log("Log buffering could not be started\n");
+    }
     ex2_log("Logger service started\n");
     return SATR_OK;
 }
@@ -20,14 +20,151 @@
 
 #include <FreeRTOS.h>
 #include <csp/csp.h>
-#include <os_queue.h>
+#include <os_semphr.h>
 #include <os_task.h>
 #include <stdint.h>
 
 #include "services.h"
 #include "util/service_utilities.h"
 
-xQueueHandle response_queue;
+#define RESPONSE_CONN_POOL_SIZE 4
+#define RESPONSE_CONN_IDLE_TIMEOUT 5000 // ms an unused connection is kept open
+#define RESPONSE_CONNECT_TIMEOUT 1000   // ms
+#define RESPONSE_SEND_TIMEOUT 1000      // ms
+#define RESPONSE_BATCH_SIZE 8           // packets taken off the ring at a time
+
+#if (RESPONSE_QUEUE_LEN & (RESPONSE_QUEUE_LEN - 1)) != 0
+#error "RESPONSE_QUEUE_LEN must be a power of 2"
+#endif
+
+typedef struct {
+    csp_conn_t *conn;
+    uint8_t dst;
+    uint8_t dport;
+    TickType_t last_used;
+} response_conn_t;
+
+/*
+ * Ring of responses waiting to be sent. The response task is the only
+ * consumer. Producers take a slot from response_free_slots before writing,
+ * so the ring never overflows
+ */
+static csp_packet_t *response_ring[RESPONSE_QUEUE_LEN];
+static uint16_t ring_head = 0; // next slot to write
+static uint16_t ring_tail = 0; // next slot to read
+static uint16_t ring_high_water = 0;
+static SemaphoreHandle_t response_free_slots = NULL;
+static TaskHandle_t response_task_handle = NULL;
+
+/* Responses dropped, indexed by the port of the service that produced them */
+static uint32_t response_drops[MAX_SERVICES];
+
+/* Open connections, reused across responses to the same destination. Only touched by the response task */
+static response_conn_t conn_pool[RESPONSE_CONN_POOL_SIZE];
+
+/**
+ * @brief
+ * 		Get an open connection to a destination, connecting if needed
+ * @details
+ * 		When the pool is full the least recently used connection is
+ * 		closed to make room
+ * @param dst
+ * 		CSP address to connect to
+ * @param dport
+ * 		CSP port to connect to
+ * @return csp_conn_t *
+ * 		The connection or NULL if one could not be made
+ */
+static csp_conn_t *prv_get_conn(uint8_t dst, uint8_t dport) {
+    TickType_t now = xTaskGetTickCount();
+    response_conn_t *victim = &conn_pool[0];
+    int i;
+
+    for (i = 0; i < RESPONSE_CONN_POOL_SIZE; i++) {
+        response_conn_t *entry = &conn_pool[i];
+        if (entry->conn != NULL && entry->dst == dst && entry->dport == dport) {
+            entry->last_used = now;
+            return entry->conn;
+        }
+        // prefer an empty slot, otherwise the one unused the longest
+        if (victim->conn != NULL &&
+            (entry->conn == NULL || (now - entry->last_used) > (now - victim->last_used))) {
+            victim = entry;
+        }
+    }
+
+    if (victim->conn != NULL) {
+        csp_close(victim->conn);
+    }
+    // Connect with a connection-oriented method.
+    // We're assuming that packet responses should be returned to sender.
+    victim->conn = csp_connect(CSP_PRIO_NORM,            // priority
+                               dst,                      // destination address
+                               dport,                    // destination port
+                               RESPONSE_CONNECT_TIMEOUT, // timeout (ms)
+                               CSP_O_RDP                 // options
+    );
+    victim->dst = dst;
+    victim->dport = dport;
+    victim->last_used = now;
+    return victim->conn;
+}
+
+/**
+ * @brief
+ * 		Close a pooled connection, eg. after the remote end went away
+ */
+static void prv_drop_conn(csp_conn_t *conn) {
+    int i;
+    for (i = 0; i < RESPONSE_CONN_POOL_SIZE; i++) {
+        if (conn_pool[i].conn == conn) {
+            csp_close(conn);
+            conn_pool[i].conn = NULL;
+        }
+    }
+}
+
+/**
+ * @brief
+ * 		Close every pooled connection that has not been used recently
+ */
+static void prv_close_idle_conns(void) {
+    TickType_t now = xTaskGetTickCount();
+    int i;
+    for (i = 0; i < RESPONSE_CONN_POOL_SIZE; i++) {
+        if (conn_pool[i].conn != NULL &&
+            (now - conn_pool[i].last_used) >= pdMS_TO_TICKS(RESPONSE_CONN_IDLE_TIMEOUT)) {
+            csp_close(conn_pool[i].conn);
+            conn_pool[i].conn = NULL;
+        }
+    }
+}
+
+/**
+ * @brief
+ * 		Send one response to its sender over a pooled connection
+ * @details
+ * 		A pooled connection may have been closed by the other end since
+ * 		it was last used, so a failed send is retried once on a fresh
+ * 		connection
+ * @param packet
+ * 		The response. Always consumed
+ */
+static void prv_send_response(csp_packet_t *packet) {
+    int attempt;
+    for (attempt = 0; attempt < 2; attempt++) {
+        csp_conn_t *conn = prv_get_conn(packet->id.src, packet->id.dport);
+        if (conn == NULL) {
+            csp_log_error("Failed to get CSP CONNECTION");
+            break;
+        }
+        if (csp_send(conn, packet, RESPONSE_SEND_TIMEOUT)) {
+            return;
+        }
+        prv_drop_conn(conn);
+    }
+    csp_buffer_free(packet);
+}
 
 /**
  * @brief
@@ -35,7 +172,9 @@ xQueueHandle response_queue;
  *              (usually the ground)
  * @details
  * 		CSP client server will wake when data is in the queue for
- *              downlink (telemetery)
+ *              downlink (telemetery). Everything already queued is sent
+ *              before idle connections are closed, so bursts to the same
+ *              destination share one connection
  * @param void * param
  * 		Not used
  * @return
@@ -43,59 +182,135 @@ xQueueHandle response_queue;
  *              in connecting. Not typically used for anything.
  */
 void service_response_task(void *param) {
-    TC_TM_app_id my_address = SYSTEM_APP_ID;
-    csp_packet_t *packet;
-    uint32_t data;
+    csp_packet_t *batch[RESPONSE_BATCH_SIZE];
+    uint16_t count;
+    uint16_t i;
     for (;;) {
-        if (xQueueReceive(response_queue, &packet, NORMAL_TICKS_TO_WAIT) == pdPASS) {
-            // Connect with a connection-oriented method.
-            // We're assuming that packet responses should be returned to sender.
-            csp_conn_t *conn = csp_connect(CSP_PRIO_NORM,    // priority
-                                           packet->id.src,   // destination address
-                                           packet->id.dport, // destination port
-                                           1000,             // timeout (ms)
-                                           CSP_O_RDP         // options
-            );
-
-            if (conn == NULL) {
-                csp_log_error("Failed to get CSP CONNECTION");
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(RESPONSE_CONN_IDLE_TIMEOUT));
+        do {
+            count = 0;
+            taskENTER_CRITICAL();
+            while (count < RESPONSE_BATCH_SIZE && ring_tail != ring_head) {
+                batch[count++] = response_ring[ring_tail & (RESPONSE_QUEUE_LEN - 1)];
+                ring_tail++;
             }
+            taskEXIT_CRITICAL();
 
-            // Send packet to ground
-            if (!csp_send(conn, packet, 1000)) {
-                csp_buffer_free(packet);
+            for (i = 0; i < count; i++) {
+                xSemaphoreGive(response_free_slots);
             }
+            for (i = 0; i < count; i++) {
+                prv_send_response(batch[i]);
+            }
+        } while (count == RESPONSE_BATCH_SIZE);
+        prv_close_idle_conns();
+    }
+}
 
-            // Close connection
-            csp_close(conn);
-        }
+/**
+ * @brief
+ * 		Count a response that could not be queued
+ */
+static void prv_count_drop(const csp_packet_t *packet) {
+    uint8_t port = packet->id.dport;
+    if (port >= MAX_SERVICES) {
+        return;
     }
+    taskENTER_CRITICAL();
+    response_drops[port]++;
+    taskEXIT_CRITICAL();
 }
 
-SAT_returnState queue_response(csp_packet_t *packet) {
-    if (xQueueSendToBack(response_queue, (void *)&packet, NORMAL_TICKS_TO_WAIT) != pdPASS) {
+/**
+ * @brief
+ * 		Write a packet to the ring and wake the response task
+ * @attention
+ * 		The caller must own a free slot
+ */
+static void prv_ring_push(csp_packet_t *packet) {
+    uint16_t depth;
+    taskENTER_CRITICAL();
+    response_ring[ring_head & (RESPONSE_QUEUE_LEN - 1)] = packet;
+    ring_head++;
+    depth = ring_head - ring_tail;
+    if (depth > ring_high_water) {
+        ring_high_water = depth;
+    }
+    taskEXIT_CRITICAL();
+    xTaskNotifyGive(response_task_handle);
+}
+
+/**
+ * @brief
+ * 		Queue a response, waiting for space if the queue is full
+ * @param packet
+ * 		The response. Ownership passes to the response task on success
+ * @param ticks_to_wait
+ * 		How long to wait for space
+ * @return SAT_returnState
+ * 		SATR_ERROR if the queue stayed full. The packet still belongs to
+ * 		the caller and the drop is counted against its service
+ */
+SAT_returnState queue_response_timeout(csp_packet_t *packet, TickType_t ticks_to_wait) {
+    if (xSemaphoreTake(response_free_slots, ticks_to_wait) != pdPASS) {
+        prv_count_drop(packet);
         return SATR_ERROR;
     }
+    prv_ring_push(packet);
     return SATR_OK;
 }
 
+SAT_returnState queue_response(csp_packet_t *packet) {
+    return queue_response_timeout(packet, NORMAL_TICKS_TO_WAIT);
+}
+
+/**
+ * @brief
+ * 		Number of responses waiting to be sent
+ */
+uint16_t get_response_queue_depth(void) {
+    uint16_t depth;
+    taskENTER_CRITICAL();
+    depth = ring_head - ring_tail;
+    taskEXIT_CRITICAL();
+    return depth;
+}
+
+/**
+ * @brief
+ * 		Highest number of responses that were waiting at once since boot
+ */
+uint16_t get_response_queue_high_water(void) { return ring_high_water; }
+
+/**
+ * @brief
+ * 		Number of responses from a service which were dropped since boot
+ * @param port
+ * 		CSP port of the service
+ */
+uint32_t get_response_drops(uint8_t port) {
+    if (port >= MAX_SERVICES) {
+        return 0;
+    }
+    return response_drops[port];
+}
+
 /**
  * @brief
  * 		Start the response_queue, and response task
  * @details
- * 		intitializes the FreeRTOS queue and task
+ * 		intitializes the response ring and task
  * @param void
  * @return SAT_returnState
  * 		success or failure
  */
 SAT_returnState start_service_response() {
-    if (!(response_queue = xQueueCreate((unsigned portBASE_TYPE)RESPONSE_QUEUE_LEN,
-                                        (unsigned portBASE_TYPE)CSP_PKT_QUEUE_SIZE))) {
+    if (!(response_free_slots = xSemaphoreCreateCounting(RESPONSE_QUEUE_LEN, RESPONSE_QUEUE_LEN))) {
         return SATR_ERROR;
     }
 
     if (xTaskCreate((TaskFunction_t)service_response_task, "RESPONSE SERVER", 500, NULL, configMAX_PRIORITIES - 1,
-                    NULL) != pdPASS) {
+                    &response_task_handle) != pdPASS) {
         return SATR_ERROR;
     }
     return SATR_OK;
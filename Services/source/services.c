@@ -32,6 +32,9 @@
 #include "util/service_utilities.h"
 #include "cli/cli.h"
 #include "dfgm/dfgm_service.h"
+#include "diagnostics/diagnostics_service.h"
+#include "util/service_stats.h"
+#include "util/staging_pool.h"
 
 void csp_server(void *parameters);
 SAT_returnState start_service_server(void);
@@ -46,6 +49,10 @@ SAT_returnState start_service_server(void);
  *      success or failure
  */
 SAT_returnState start_service_server(void) {
+    // the services borrow staging blocks from their first request
+    if (staging_pool_init() != SATR_OK) {
+        return SATR_ERROR;
+    }
     if (xTaskCreate((TaskFunction_t)csp_server, "csp_server THREAD", 256, NULL, NORMAL_SERVICE_PRIO, NULL) !=
         pdPASS) {
         return SATR_ERROR;
@@ -54,7 +61,7 @@ SAT_returnState start_service_server(void) {
     if (start_communication_service() != SATR_OK || start_time_management_service() != SATR_OK ||
         start_housekeeping_service() != SATR_OK || start_general_service() != SATR_OK ||
         start_updater_service() != SATR_OK || start_logger_service() != SATR_OK ||
-        start_dfgm_service() != SATR_OK) {
+        start_dfgm_service() != SATR_OK || start_diagnostics_service() != SATR_OK) {
         return SATR_ERROR;
     }
     return SATR_OK;
@@ -94,7 +101,11 @@ void csp_server(void *parameters) {
         }
 
         while ((packet = csp_read(conn, 50)) != NULL) {
+            svc_dispatch_t dispatch;
+            svc_dispatch_begin(&dispatch, csp_conn_dport(conn), packet);
+            dispatch.subtype = 0; // CSP services have no subtype
             csp_service_handler(conn, packet);
+            svc_dispatch_end(&dispatch, SATR_OK);
         }
         csp_close(conn);
     }
@@ -26,6 +26,7 @@
 #include "skytraq_gps.h"
 #include "task_manager/task_manager.h"
 #include "time_management/time_management_service.h"
+#include "util/service_stats.h"
 #include "util/service_utilities.h"
 #include <csp/csp.h>
 #include <csp/csp_endian.h>
@@ -141,7 +142,12 @@ void time_management_service(void *param) {
         }
         svc_wdt_counter++;
         while ((packet = csp_read(conn, 50)) != NULL) {
-            if (time_management_app(packet) != SATR_OK) {
+            svc_dispatch_t dispatch;
+            svc_dispatch_begin(&dispatch, TC_TIME_MANAGEMENT_SERVICE, packet);
+            SAT_returnState state = time_management_app(packet);
+            svc_dispatch_end(&dispatch, state);
+
+            if (state != SATR_OK) {
                 // something went wrong, this shouldn't happen
                 csp_buffer_free(packet);
             } else {
@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file image_crc.c
+ * @date 2022-03-14
+ */
+
+#include "updater/image_crc.h"
+#include "redposix.h"
+#include "services.h"
+#include "util/crc16.h"
+#include "util/service_utilities.h"
+#include <csp/csp_endian.h>
+#include <string.h>
+
+#define IMAGE_CRC_MAGIC 0x42435243 // "BCRC"
+/* Block CRCs compared per file read */
+#define IMAGE_CRC_READ_BLOCKS 32
+
+/* Head of a table file, followed by the block CRCs. It never leaves the OBC so it is in host order */
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint32_t size;
+    uint16_t blocks;
+} image_crc_header_t;
+
+/* Only the updater task builds tables, one at a time */
+static image_crc_table_t work_table;
+
+image_crc_table_t *image_crc_work_table(void) { return &work_table; }
+
+static uint32_t prv_block_length(const image_crc_table_t *table, uint16_t block) {
+    uint32_t left = table->size - (uint32_t)block * IMAGE_CRC_BLOCK_SIZE;
+    return (left < IMAGE_CRC_BLOCK_SIZE) ? left : IMAGE_CRC_BLOCK_SIZE;
+}
+
+/**
+ * @brief
+ *      Empty a table for an image of the given size
+ * @return int8_t
+ *      0, or -1 if the image is bigger than the table covers
+ */
+int8_t image_crc_reset(image_crc_table_t *table, uint32_t size) {
+    uint32_t blocks = (size + IMAGE_CRC_BLOCK_SIZE - 1) / IMAGE_CRC_BLOCK_SIZE;
+
+    if (blocks > IMAGE_CRC_MAX_BLOCKS) {
+        return -1;
+    }
+    table->size = size;
+    table->blocks = (uint16_t)blocks;
+    memset(table->block_crc, 0, sizeof(table->block_crc));
+    return 0;
+}
+
+/**
+ * @brief
+ *      Add data written in order to the block CRCs
+ * @param offset
+ *      where the data starts in the image, which must follow the last data added
+ */
+void image_crc_append(image_crc_table_t *table, uint32_t offset, const uint8_t *data, uint32_t len) {
+    uint32_t block, take;
+
+    while (len > 0 && offset < table->size) {
+        block = offset / IMAGE_CRC_BLOCK_SIZE;
+        take = IMAGE_CRC_BLOCK_SIZE - offset % IMAGE_CRC_BLOCK_SIZE;
+        if (take > len) {
+            take = len;
+        }
+        table->block_crc[block] = crc16_update(
+            (offset % IMAGE_CRC_BLOCK_SIZE) ? table->block_crc[block] : CRC16_INIT, data, take);
+        offset += take;
+        data += take;
+        len -= take;
+    }
+}
+
+/**
+ * @brief
+ *      CRC of the start of the image, from the block CRCs
+ * @param len
+ *      bytes from the start, all of which must have been added
+ */
+uint16_t image_crc_prefix(const image_crc_table_t *table, uint32_t len) {
+    uint16_t crc = CRC16_INIT;
+    uint32_t block_len;
+    uint16_t block;
+
+    for (block = 0; block < table->blocks && len > 0; block++) {
+        block_len = prv_block_length(table, block);
+        if (block_len > len) {
+            block_len = len;
+        }
+        crc = crc16_combine(crc, table->block_crc[block], block_len);
+        len -= block_len;
+    }
+    return crc;
+}
+
+/**
+ * @brief
+ *      CRC of the whole image, as in the EEPROM, from the block CRCs
+ */
+uint16_t image_crc_total(const image_crc_table_t *table) { return image_crc_prefix(table, table->size); }
+
+int8_t image_crc_save(const image_crc_table_t *table, const char *file) {
+    image_crc_header_t header = {IMAGE_CRC_MAGIC, table->size, table->blocks};
+    uint32_t len = table->blocks * sizeof(uint16_t);
+    int8_t status = 0;
+    int32_t fd;
+
+    fd = red_open(file, RED_O_CREAT | RED_O_TRUNC | RED_O_WRONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (red_write(fd, &header, sizeof(header)) != sizeof(header) ||
+        red_write(fd, table->block_crc, len) != (int32_t)len) {
+        status = -1;
+    }
+    red_close(fd);
+    return status;
+}
+
+/**
+ * @brief
+ *      Update one block's CRC in a saved table
+ */
+int8_t image_crc_save_block(const char *file, uint16_t block, uint16_t crc) {
+    int8_t status = 0;
+    int32_t fd;
+
+    fd = red_open(file, RED_O_WRONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (red_lseek(fd, sizeof(image_crc_header_t) + block * sizeof(uint16_t), RED_SEEK_SET) < 0 ||
+        red_write(fd, &crc, sizeof(crc)) != sizeof(crc)) {
+        status = -1;
+    }
+    red_close(fd);
+    return status;
+}
+
+static int32_t prv_open_table(const char *file, image_crc_header_t *header) {
+    int32_t fd = red_open(file, RED_O_RDONLY);
+
+    if (fd < 0) {
+        return -1;
+    }
+    if (red_read(fd, header, sizeof(*header)) != sizeof(*header) || header->magic != IMAGE_CRC_MAGIC ||
+        header->blocks > IMAGE_CRC_MAX_BLOCKS) {
+        red_close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @return int8_t
+ *      0, or -1 if there is no table or it is damaged
+ */
+int8_t image_crc_load(image_crc_table_t *table, const char *file) {
+    image_crc_header_t header;
+    uint32_t len;
+    int8_t status = 0;
+    int32_t fd;
+
+    fd = prv_open_table(file, &header);
+    if (fd < 0) {
+        return -1;
+    }
+    table->size = header.size;
+    table->blocks = header.blocks;
+    len = header.blocks * sizeof(uint16_t);
+    if (red_read(fd, table->block_crc, len) != (int32_t)len) {
+        status = -1;
+    }
+    red_close(fd);
+    return status;
+}
+
+/**
+ * @brief
+ *      Find the first block where a table and a saved table differ
+ * @return uint16_t
+ *      the block, or IMAGE_CRC_NO_BLOCK if they agree or the saved table
+ *      is for an image of a different size
+ */
+uint16_t image_crc_compare(const image_crc_table_t *table, const char *file) {
+    image_crc_header_t header;
+    uint16_t saved[IMAGE_CRC_READ_BLOCKS];
+    uint16_t block = 0, i, count;
+    uint16_t differs = IMAGE_CRC_NO_BLOCK;
+    int32_t fd;
+
+    fd = prv_open_table(file, &header);
+    if (fd < 0) {
+        return IMAGE_CRC_NO_BLOCK;
+    }
+    if (header.size == table->size && header.blocks == table->blocks) {
+        while (block < table->blocks && differs == IMAGE_CRC_NO_BLOCK) {
+            count = table->blocks - block;
+            if (count > IMAGE_CRC_READ_BLOCKS) {
+                count = IMAGE_CRC_READ_BLOCKS;
+            }
+            if (red_read(fd, saved, count * sizeof(uint16_t)) != count * sizeof(uint16_t)) {
+                break;
+            }
+            for (i = 0; i < count; i++) {
+                if (saved[i] != table->block_crc[block + i]) {
+                    differs = block + i;
+                    break;
+                }
+            }
+            block += count;
+        }
+    }
+    red_close(fd);
+    return differs;
+}
+
+/**
+ * @brief
+ *      Send block CRCs so the ground can find blocks that don't match its image
+ * @param packet
+ *      Request, replaced by the number of blocks, the first block sent and
+ *      the block CRCs
+ * @return int8_t
+ *      0 on success, -1 if there is no such table
+ */
+int8_t image_crc_get(csp_packet_t *packet) {
+    image_crc_header_t header;
+    uint16_t first = 0, count, i, value;
+    uint32_t out = OUT_DATA_BYTE + 2 * sizeof(uint16_t);
+    int32_t fd;
+
+    if (packet->length >= IN_DATA_BYTE + sizeof(uint8_t) + sizeof(uint16_t)) {
+        memcpy(&first, &packet->data[IN_DATA_BYTE + 1], sizeof(uint16_t));
+        first = csp_ntoh16(first);
+    }
+    fd = prv_open_table((packet->data[IN_DATA_BYTE] == IMAGE_CRC_SOURCE_FLASH) ? APP_CRC_FILE : IMAGE_CRC_FILE,
+                        &header);
+    if (fd < 0) {
+        return -1;
+    }
+    count = 0;
+    if (first < header.blocks) {
+        count = (csp_buffer_data_size() - out) / sizeof(uint16_t);
+        if (count > header.blocks - first) {
+            count = header.blocks - first;
+        }
+        if (red_lseek(fd, sizeof(header) + first * sizeof(uint16_t), RED_SEEK_SET) < 0 ||
+            red_read(fd, &packet->data[out], count * sizeof(uint16_t)) != count * sizeof(uint16_t)) {
+            red_close(fd);
+            return -1;
+        }
+    }
+    red_close(fd);
+
+    for (i = 0; i < count; i++) {
+        memcpy(&value, &packet->data[out + i * sizeof(uint16_t)], sizeof(uint16_t));
+        value = csp_hton16(value);
+        memcpy(&packet->data[out + i * sizeof(uint16_t)], &value, sizeof(uint16_t));
+    }
+    value = csp_hton16(header.blocks);
+    memcpy(&packet->data[OUT_DATA_BYTE], &value, sizeof(uint16_t));
+    value = csp_hton16(first);
+    memcpy(&packet->data[OUT_DATA_BYTE + sizeof(uint16_t)], &value, sizeof(uint16_t));
+    set_packet_length(packet, out + count * sizeof(uint16_t));
+    return 0;
+}
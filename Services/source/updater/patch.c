@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file patch.c
+ * @date 2022-03-14
+ */
+
+#include "updater/patch.h"
+#include "bl_eeprom.h"
+#include "updater/image_crc.h"
+#include "redposix.h"
+#include "services.h"
+#include "updater/updater.h"
+#include "updater/upload.h"
+#include "util/crc16.h"
+#include "util/service_utilities.h"
+#include "util/staging_pool.h"
+#include <csp/csp_endian.h>
+#include <string.h>
+
+/* The new image is built here and renamed over UPDATER_IMAGE_FILE once its CRC checks out */
+#define PATCH_OUTPUT_FILE "VOL0:/application_image.tmp"
+
+typedef struct {
+    int32_t fd;
+    staging_token_t token;
+    uint8_t *buf;
+    uint32_t pos;
+    uint32_t len;
+} patch_reader_t;
+
+typedef struct {
+    int32_t fd;
+    staging_token_t token;
+    uint8_t *buf;
+    uint32_t len;
+    uint32_t written; // bytes of the target emitted so far
+    uint32_t size;    // target size
+    image_crc_table_t *table;
+    uint32_t *wdt_counter;
+} image_writer_t;
+
+/**
+ * @brief
+ *      Make sure the patch buffer has unread bytes
+ * @return int8_t
+ *      0, or -1 at the end of the patch or if it couldn't be read
+ */
+static int8_t prv_fill(patch_reader_t *reader) {
+    int32_t got;
+
+    if (reader->pos < reader->len) {
+        return 0;
+    }
+    got = red_read(reader->fd, reader->buf, STAGING_BLOCK_SIZE);
+    if (got <= 0) {
+        return -1;
+    }
+    reader->pos = 0;
+    reader->len = (uint32_t)got;
+    return 0;
+}
+
+static int8_t prv_read(patch_reader_t *reader, uint8_t *to, uint32_t len) {
+    uint32_t take;
+
+    while (len > 0) {
+        if (prv_fill(reader) != 0) {
+            return -1;
+        }
+        take = reader->len - reader->pos;
+        if (take > len) {
+            take = len;
+        }
+        memcpy(to, &reader->buf[reader->pos], take);
+        reader->pos += take;
+        to += take;
+        len -= take;
+    }
+    return 0;
+}
+
+static int8_t prv_read32(patch_reader_t *reader, uint32_t *value) {
+    if (prv_read(reader, (uint8_t *)value, sizeof(uint32_t)) != 0) {
+        return -1;
+    }
+    *value = csp_ntoh32(*value);
+    return 0;
+}
+
+static int8_t prv_flush(image_writer_t *writer) {
+    if (writer->len == 0) {
+        return 0;
+    }
+    if (red_write(writer->fd, writer->buf, writer->len) != (int32_t)writer->len) {
+        ex2_log("Patched image write failure %d", red_errno);
+        return -1;
+    }
+    writer->len = 0;
+    (*writer->wdt_counter)++;
+    return 0;
+}
+
+/**
+ * @brief
+ *      Append bytes to the new image
+ * @return int8_t
+ *      0, or -1 if they would run past the target size or couldn't be written
+ */
+static int8_t prv_emit(image_writer_t *writer, const uint8_t *from, uint32_t len) {
+    uint32_t take;
+
+    if (len > writer->size - writer->written) {
+        ex2_log("Patch runs past the end of the image");
+        return -1;
+    }
+    image_crc_append(writer->table, writer->written, from, len);
+    writer->written += len;
+    while (len > 0) {
+        take = STAGING_BLOCK_SIZE - writer->len;
+        if (take > len) {
+            take = len;
+        }
+        memcpy(&writer->buf[writer->len], from, take);
+        writer->len += take;
+        from += take;
+        len -= take;
+        if (writer->len == STAGING_BLOCK_SIZE && prv_flush(writer) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief
+ *      Copy literal bytes from the patch to the new image without an extra buffer
+ */
+static int8_t prv_add(patch_reader_t *reader, image_writer_t *writer, uint32_t len) {
+    uint32_t take;
+
+    while (len > 0) {
+        if (prv_fill(reader) != 0) {
+            return -1;
+        }
+        take = reader->len - reader->pos;
+        if (take > len) {
+            take = len;
+        }
+        if (prv_emit(writer, &reader->buf[reader->pos], take) != 0) {
+            return -1;
+        }
+        reader->pos += take;
+        len -= take;
+    }
+    return 0;
+}
+
+/**
+ * @brief
+ *      Build the new image from the installed one and UPDATER_PATCH_FILE
+ * @details
+ *      The installed image is read straight from flash. The patch and the
+ *      new image go through one STAGING_BLOCK_SIZE buffer each, whatever
+ *      the size of either, and the new image only replaces
+ *      UPDATER_IMAGE_FILE once its size and CRC match the patch's. Its
+ *      block CRCs are kept as for an uploaded image.
+ * @param packet
+ *      the request, filled with the target size and CRC
+ * @param wdt_counter
+ *      the updater's watchdog counter, bumped as the image is written
+ * @return int8_t
+ *      0 if the new image is in place, -1 otherwise
+ */
+int8_t apply_patch(csp_packet_t *packet, uint32_t *wdt_counter) {
+    image_info app_info = priv_eeprom_get_app_info();
+    patch_reader_t reader = {.fd = -1};
+    image_writer_t writer = {.fd = -1, .table = image_crc_work_table(), .wdt_counter = wdt_counter};
+    uint8_t header[PATCH_HEADER_SIZE];
+    uint32_t magic, source_size, offset, len;
+    uint16_t source_crc, target_crc, crc = CRC16_INIT;
+    uint8_t op;
+    int8_t status = -1;
+
+    if (!upload_complete(UPLOAD_TARGET_PATCH)) {
+        ex2_log("FAILED Attempt to apply a patch that is still being uploaded");
+        return -1;
+    }
+    reader.fd = red_open(UPDATER_PATCH_FILE, RED_O_RDONLY);
+    if (reader.fd < 0) {
+        ex2_log("Patch open failure %d", red_errno);
+        return -1;
+    }
+    reader.token = staging_get(STAGING_UPDATER, STAGING_TIMEOUT);
+    writer.token = staging_get(STAGING_UPDATER, STAGING_TIMEOUT);
+    reader.buf = staging_data(reader.token);
+    writer.buf = staging_data(writer.token);
+    if (reader.buf == NULL || writer.buf == NULL) {
+        ex2_log("Buffer get failure");
+        goto cleanup;
+    }
+
+    if (prv_read(&reader, header, PATCH_HEADER_SIZE) != 0) {
+        ex2_log("Patch too short");
+        goto cleanup;
+    }
+    cnv8_32(&header[0], &magic);
+    cnv8_32(&header[4], &source_size);
+    memcpy(&source_crc, &header[8], sizeof(uint16_t));
+    cnv8_32(&header[10], &writer.size);
+    memcpy(&target_crc, &header[14], sizeof(uint16_t));
+    magic = csp_ntoh32(magic);
+    source_size = csp_ntoh32(source_size);
+    source_crc = csp_ntoh16(source_crc);
+    writer.size = csp_ntoh32(writer.size);
+    target_crc = csp_ntoh16(target_crc);
+
+    if (magic != PATCH_MAGIC) {
+        ex2_log("Not a patch");
+        goto cleanup;
+    }
+    // a patch only makes sense against the image it was made from
+    if (!app_info.exists || app_info.size != source_size || app_info.crc != source_crc) {
+        ex2_log("Patch is for image %u bytes CRC %04x, installed is %u bytes CRC %04x", source_size, source_crc,
+                app_info.size, app_info.crc);
+        goto cleanup;
+    }
+
+    if (image_crc_reset(writer.table, writer.size) != 0) {
+        ex2_log("Patched image too big");
+        goto cleanup;
+    }
+    writer.fd = red_open(PATCH_OUTPUT_FILE, RED_O_CREAT | RED_O_TRUNC | RED_O_WRONLY);
+    if (writer.fd < 0) {
+        ex2_log("Patched image open failure %d", red_errno);
+        goto cleanup;
+    }
+
+    while (writer.written < writer.size) {
+        if (prv_read(&reader, &op, sizeof(op)) != 0 || prv_read32(&reader, &len) != 0) {
+            ex2_log("Patch ends at %u of %u bytes", writer.written, writer.size);
+            goto cleanup;
+        }
+        if (op == PATCH_OP_COPY) {
+            offset = len;
+            if (prv_read32(&reader, &len) != 0 || offset > source_size || len > source_size - offset) {
+                ex2_log("Bad patch copy");
+                goto cleanup;
+            }
+            if (prv_emit(&writer, (const uint8_t *)(uintptr_t)(app_info.addr + offset), len) != 0) {
+                goto cleanup;
+            }
+        } else if (op == PATCH_OP_ADD) {
+            if (prv_add(&reader, &writer, len) != 0) {
+                goto cleanup;
+            }
+        } else {
+            ex2_log("Bad patch op %u", op);
+            goto cleanup;
+        }
+    }
+    if (prv_flush(&writer) != 0) {
+        goto cleanup;
+    }
+    // the block CRCs give the whole image's without reading it back
+    crc = image_crc_total(writer.table);
+    if (crc != target_crc) {
+        ex2_log("Patched image CRC %04x, expected %04x", crc, target_crc);
+        goto cleanup;
+    }
+    red_close(writer.fd);
+    writer.fd = -1;
+    if (red_rename(PATCH_OUTPUT_FILE, UPDATER_IMAGE_FILE) != 0) {
+        ex2_log("Patched image rename failure %d", red_errno);
+        goto cleanup;
+    }
+    if (image_crc_save(writer.table, IMAGE_CRC_FILE) != 0) {
+        ex2_log("Patched image block CRCs not saved");
+    }
+    status = 0;
+
+cleanup:
+    if (writer.fd >= 0) {
+        red_close(writer.fd);
+        red_unlink(PATCH_OUTPUT_FILE);
+    }
+    red_close(reader.fd);
+    staging_put(reader.token);
+    staging_put(writer.token);
+    if (status != 0) {
+        crc = image_crc_prefix(writer.table, writer.written);
+    }
+
+    cnv32_8(csp_hton32(writer.size), &packet->data[OUT_DATA_BYTE]);
+    cnv16_8(csp_hton16(crc), &packet->data[OUT_DATA_BYTE + sizeof(uint32_t)]);
+    set_packet_length(packet, OUT_DATA_BYTE + sizeof(uint32_t) + sizeof(uint16_t));
+    return status;
+}
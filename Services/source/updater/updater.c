@@ -18,44 +18,294 @@
  */
 
 #include "updater/updater.h"
+#include "updater/image_crc.h"
+#include "updater/patch.h"
+#include "updater/upload.h"
 #include "bl_eeprom.h"
 #include "bl_flash.h"
 #include "privileged_functions.h"
 #include "redposix.h"
 #include "services.h"
 #include "task_manager/task_manager.h"
+#include "util/crc16.h"
+#include "util/service_stats.h"
 #include "util/service_utilities.h"
+#include "util/staging_pool.h"
 #include <FreeRTOS.h>
 #include <csp/csp.h>
 #include <csp/csp_endian.h>
 #include <main/system.h>
+#include <os_queue.h>
+#include <os_semphr.h>
 #include <os_task.h>
 
 static uint32_t svc_wdt_counter = 0;
 uint32_t get_svc_wdt_counter() { return svc_wdt_counter; }
 
+#ifdef GOLDEN_IMAGE
+/* One chunk of the image on its way from the file system to flash */
+typedef struct {
+    staging_token_t token;
+    uint8_t *data;
+    uint32_t size;  // capacity
+    uint32_t len;   // bytes read into it, 0 at the end of the file
+    int32_t error;  // red_errno if the read failed
+} staging_buffer_t;
+
+typedef struct {
+    int32_t fp;
+    uint32_t remaining;
+    QueueHandle_t empty;     // staging_buffer_t * to be filled
+    QueueHandle_t full;      // staging_buffer_t * to be programmed
+    SemaphoreHandle_t done;  // given when the reader task has finished
+} flash_reader_t;
+
 /**
  * @brief
- *      Attempts to malloc a buffer
- * @detail
- *      This function will try to malloc smaller and smaller buffers until it succeeds
- *      In this case, having any buffer at all is more important than size
- * @param buf
- *      Pointer to the pointer to malloc the buffer in to
- * @return
- *      size of buffer that was allocated for
+ *      Reads the image into whichever staging buffer is free
+ * @details
+ *      Runs above the updater so that it gets the CPU back as soon as a
+ *      read completes; while it waits on the file system the updater
+ *      programs the other buffer. Stops after the end of the file, a read
+ *      error or being handed a NULL buffer.
+ */
+static void flash_reader_task(void *param) {
+    flash_reader_t *reader = param;
+    staging_buffer_t *buffer;
+    int32_t bytes_read;
+
+    for (;;) {
+        xQueueReceive(reader->empty, &buffer, portMAX_DELAY);
+        if (buffer == NULL) {
+            break;
+        }
+        buffer->len = 0;
+        buffer->error = 0;
+        if (reader->remaining > 0) {
+            bytes_read = red_read(reader->fp, buffer->data,
+                                  (reader->remaining < buffer->size) ? reader->remaining : buffer->size);
+            if (bytes_read < 0) {
+                buffer->error = red_errno;
+            } else {
+                buffer->len = (uint32_t)bytes_read;
+                reader->remaining -= bytes_read;
+            }
+        }
+        xQueueSendToBack(reader->full, &buffer, portMAX_DELAY);
+        if (buffer->len == 0) {
+            break;
+        }
+    }
+    xSemaphoreGive(reader->done);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief
+ *      Tell the ground how far an update has got
+ */
+static void send_flash_progress(csp_conn_t *conn, uint32_t programmed, uint32_t total) {
+    csp_packet_t *progress = csp_buffer_get(OUT_DATA_BYTE + 2 * sizeof(uint32_t));
+    int8_t status = 0;
+
+    if (progress == NULL) {
+        return; // progress is nice to have; the update carries on
+    }
+    progress->data[SUBSERVICE_BYTE] = FLASH_UPDATE;
+    memcpy(&progress->data[STATUS_BYTE], &status, sizeof(int8_t));
+    cnv32_8(csp_hton32(programmed), &progress->data[OUT_DATA_BYTE]);
+    cnv32_8(csp_hton32(total), &progress->data[OUT_DATA_BYTE + sizeof(uint32_t)]);
+    set_packet_length(progress, OUT_DATA_BYTE + 2 * sizeof(uint32_t));
+    if (!csp_send(conn, progress, 50)) {
+        csp_buffer_free(progress);
+    }
+}
+
+/**
+ * @brief
+ *      Program the application image from UPDATER_IMAGE_FILE
+ * @details
+ *      Two staging buffers are used so that reading chunk N+1 overlaps
+ *      programming chunk N. Each chunk is read back from flash into the
+ *      block CRCs once programmed, and the CRC of the whole image made from
+ *      them is checked against the application CRC in the EEPROM. The
+ *      block CRCs are saved to APP_CRC_FILE for VERIFY_APPLICATION_IMAGE. Progress packets of the bytes
+ *      programmed and the image size go out every UPDATER_PROGRESS_INTERVAL
+ *      bytes; the final reply adds the CRC of what was programmed.
+ * @param conn
+ *      connection the update was requested on
+ * @param packet
+ *      the request, filled with the final reply
+ * @return int8_t
+ *      status: 0 if the image was programmed and its CRC matches
  */
-uint32_t get_buffer(void **buf) {
-    *buf = NULL;
-    uint32_t attempts[] = {4096, 2048, 1024, 512, 256, 128, 64, 32, 16, 8};
+static int8_t flash_application(csp_conn_t *conn, csp_packet_t *packet) {
+    staging_buffer_t buffers[2] = {{0}};
+    staging_buffer_t *buffer = NULL;
+    flash_reader_t reader = {0};
+    image_crc_table_t *table = image_crc_work_table();
+    image_info app_info = priv_eeprom_get_app_info();
+    REDSTAT file_info;
+    uint32_t flash_destination = app_info.addr;
+    uint32_t programmed = 0;
+    uint32_t next_progress = UPDATER_PROGRESS_INTERVAL;
+    uint32_t total;
+    uint16_t crc = CRC16_INIT;
+    int8_t status = -1;
     int i;
-    for (i = 0; i < sizeof(attempts) / sizeof(uint32_t); i++) {
-        *buf = pvPortMalloc(attempts[i]);
-        if (*buf != NULL) {
-            return attempts[i];
+
+    reader.fp = red_open(UPDATER_IMAGE_FILE, RED_O_RDONLY);
+    if (reader.fp == -1) {
+        ex2_log("Update binary open failure %d", red_errno);
+        return -1;
+    }
+    if (red_fstat(reader.fp, &file_info) == -1) {
+        ex2_log("STAT failure on update binary %d", red_errno);
+        red_close(reader.fp);
+        return -1;
+    }
+    total = (uint32_t)file_info.st_size;
+    reader.remaining = total;
+    if (!BLInternalFlashStartAddrCheck(app_info.addr, total)) {
+        ex2_log("Flash addr invalid");
+        red_close(reader.fp);
+        return -1;
+    }
+    if (image_crc_reset(table, total) != 0) {
+        ex2_log("Update binary too big");
+        red_close(reader.fp);
+        return -1;
+    }
+
+    // everything is in hand before the application is erased
+    for (i = 0; i < 2; i++) {
+        buffers[i].token = staging_get(STAGING_UPDATER, STAGING_TIMEOUT);
+        buffers[i].data = staging_data(buffers[i].token);
+        buffers[i].size = (buffers[i].data != NULL) ? STAGING_BLOCK_SIZE : 0;
+    }
+    reader.empty = xQueueCreate(2, sizeof(staging_buffer_t *));
+    reader.full = xQueueCreate(2, sizeof(staging_buffer_t *));
+    reader.done = xSemaphoreCreateBinary();
+    if (buffers[0].size == 0 || buffers[1].size == 0 || reader.empty == NULL || reader.full == NULL ||
+        reader.done == NULL) {
+        ex2_log("Buffer get failure");
+        goto cleanup;
+    }
+
+    // the table for what was in flash is no good from here on
+    red_unlink(APP_CRC_FILE);
+    if (priv_Fapi_BlockErase(app_info.addr, total)) {
+        ex2_log("could not erase block");
+        goto cleanup;
+    }
+    for (i = 0; i < 2; i++) {
+        buffer = &buffers[i];
+        xQueueSendToBack(reader.empty, &buffer, 0);
+    }
+    if (xTaskCreate(flash_reader_task, "flash_reader", 256, &reader, NORMAL_SERVICE_PRIO + 1, NULL) != pdPASS) {
+        ex2_log("FAILED TO CREATE TASK flash_reader");
+        goto cleanup;
+    }
+
+    while (programmed < total) {
+        if (xQueueReceive(reader.full, &buffer, UPDATER_READ_TIMEOUT) != pdTRUE) {
+            ex2_log("Update binary read timed out");
+            break;
+        }
+        if (buffer->len == 0) {
+            ex2_log("Update binary read failure %d", buffer->error);
+            break;
+        }
+        if (priv_Fapi_BlockProgram(1, flash_destination, (unsigned long)buffer->data, buffer->len)) {
+            ex2_log("Failed to write to block");
+            break;
+        }
+        // check what actually landed in flash, not what was meant to
+        image_crc_append(table, programmed, (const uint8_t *)(uintptr_t)flash_destination, buffer->len);
+        flash_destination += buffer->len;
+        programmed += buffer->len;
+        xQueueSendToBack(reader.empty, &buffer, 0);
+        svc_wdt_counter++;
+
+        if (programmed >= next_progress && programmed < total) {
+            send_flash_progress(conn, programmed, total);
+            next_progress += UPDATER_PROGRESS_INTERVAL;
+        }
+    }
+
+    // the reader stops by itself at the end of the file; otherwise stop it
+    buffer = NULL;
+    xQueueSendToBack(reader.empty, &buffer, 0);
+    xSemaphoreTake(reader.done, portMAX_DELAY);
+
+    crc = image_crc_prefix(table, programmed);
+    if (programmed == total) {
+        if (image_crc_save(table, APP_CRC_FILE) != 0) {
+            ex2_log("Programmed image block CRCs not saved");
         }
+        if (crc == app_info.crc) {
+            status = 0;
+        } else {
+            ex2_log("Programmed image CRC %04x, expected %04x", crc, app_info.crc);
+        }
+    }
+
+cleanup:
+    if (reader.done != NULL) {
+        vSemaphoreDelete(reader.done);
+    }
+    if (reader.full != NULL) {
+        vQueueDelete(reader.full);
+    }
+    if (reader.empty != NULL) {
+        vQueueDelete(reader.empty);
+    }
+    staging_put(buffers[0].token);
+    staging_put(buffers[1].token);
+    red_close(reader.fp);
+
+    cnv32_8(csp_hton32(programmed), &packet->data[OUT_DATA_BYTE]);
+    cnv32_8(csp_hton32(total), &packet->data[OUT_DATA_BYTE + sizeof(uint32_t)]);
+    cnv16_8(csp_hton16(crc), &packet->data[OUT_DATA_BYTE + 2 * sizeof(uint32_t)]);
+    set_packet_length(packet, OUT_DATA_BYTE + 2 * sizeof(uint32_t) + sizeof(uint16_t));
+    return status;
+}
+#endif
+
+/**
+ * @brief
+ *      Check the application in flash against the CRC in the EEPROM
+ * @details
+ *      Uses the block CRCs saved when the application was programmed, so no
+ *      flash is read. If they don't add up to the EEPROM's CRC, the first
+ *      block where they differ from those of UPDATER_IMAGE_FILE is reported.
+ *      Without saved block CRCs, or if a nonzero byte asks for it, the whole
+ *      application is read as before, which catches flash that has changed
+ *      since it was programmed.
+ * @param packet
+ *      the request, filled with the first bad block or IMAGE_CRC_NO_BLOCK
+ * @return int8_t
+ *      status: 0 if the application checks out
+ */
+static int8_t verify_application(csp_packet_t *packet) {
+    image_crc_table_t *table = image_crc_work_table();
+    image_info app_info = priv_eeprom_get_app_info();
+    uint16_t bad_block = IMAGE_CRC_NO_BLOCK;
+    int8_t status = 0;
+
+    if ((packet->length > IN_DATA_BYTE && packet->data[IN_DATA_BYTE] != 0) ||
+        image_crc_load(table, APP_CRC_FILE) != 0) {
+        status = (priv_verify_application() == true) ? 0 : -1;
+    } else if (image_crc_total(table) != app_info.crc) {
+        bad_block = image_crc_compare(table, IMAGE_CRC_FILE);
+        ex2_log("Application CRC %04x, expected %04x, block %u differs from the image", image_crc_total(table),
+                app_info.crc, bad_block);
+        status = -1;
     }
-    return 0;
+
+    cnv16_8(csp_hton16(bad_block), &packet->data[OUT_DATA_BYTE]);
+    set_packet_length(packet, OUT_DATA_BYTE + sizeof(uint16_t));
+    return status;
 }
 
 /**
@@ -68,7 +318,7 @@ uint32_t get_buffer(void **buf) {
  * @return
  *      enum for return state
  */
-SAT_returnState updater_app(csp_packet_t *packet) {
+SAT_returnState updater_app(csp_conn_t *conn, csp_packet_t *packet) {
     uint8_t ser_subtype = (uint8_t)packet->data[SUBSERVICE_BYTE];
     int8_t status;
 
@@ -76,54 +326,19 @@ SAT_returnState updater_app(csp_packet_t *packet) {
         switch (ser_subtype) {
         case FLASH_UPDATE:
 #ifdef GOLDEN_IMAGE
-            fp = red_open("VOL0:/application_image.bin", RED_O_RDONLY);
-            if (fp == -1) {
-                ex2_log("Update binary open failure %d", red_errno);
-                status = -1;
-                break;
-            }
-            REDSTAT file_info;
-            int res = red_fstat(fp, &file_info);
-            if (res == -1) {
-                ex2_log("STAT failure on update binary %d", red_errno);
-                status = -1;
-                break;
-            }
-            image_info app_info = priv_eeprom_get_app_info();
-            if (!BLInternalFlashStartAddrCheck(app_info.addr, (uint32_t)file_info.st_size)) {
-                ex2_log("Flash addr invalid");
-                status = -1;
-                break;
-            }
-
-            uint8_t oReturnCheck = 0;
-            oReturnCheck = priv_Fapi_BlockErase(app_info.addr, (uint32_t)file_info.st_size);
-            if (oReturnCheck) {
-                ex2_log("could not erase block");
-                status = -1;
-                break;
-            }
-            uint32_t flash_destination = app_info.addr;
-            uint32_t flash_size = get_buffer(&buf); // returns the size
-            if (flash_size == 0) {
-                ex2_log("Buffer get failure");
+            if (!upload_complete(UPLOAD_TARGET_IMAGE)) {
+                ex2_log("FAILED Attempt to flash an image that is still being uploaded");
                 status = -1;
                 break;
             }
-            int32_t bytes_read;
-            bytes_read = red_read(fp, buf, flash_size);
-            if (bytes_read < flash_size) {
-                flash_size = bytes_read;
-            }
-            oReturnCheck = priv_Fapi_BlockProgram(1, flash_destination, (unsigned long)buf, flash_size);
-            if (oReturnCheck) {
-                ex2_log("Failed to write to block");
-                status = -1;
+            status = flash_application(conn, packet);
+            if (status == 0) {
                 break;
             }
-            flash_destination += flash_size;
-
-            status = 0;
+            // the progress made is reported along with the failure
+            memcpy(&packet->data[STATUS_BYTE], &status, sizeof(int8_t));
+            shutdown_eeprom();
+            return SATR_OK;
 #else
             ex2_log("FAILED Attempt to flash from non golden image");
             status = -1;
@@ -150,14 +365,17 @@ SAT_returnState updater_app(csp_packet_t *packet) {
 
         case SET_APP_ADDRESS:
 #ifdef GOLDEN_IMAGE
-            hex_dump(&packet->data, 20);
-            int new_address = 0;
-            memcpy(&new_address, &packet->data[IN_DATA_BYTE], sizeof(uint32_t));
-            image_info addr_info = priv_eeprom_get_app_info();
-            addr_info.addr = new_address;
-            priv_eeprom_set_app_info(addr_info);
-            set_packet_length(packet, sizeof(int8_t) + 1);
-            status = 0;
+            {
+                hex_dump(&packet->data, 20);
+                int new_address = 0;
+                memcpy(&new_address, &packet->data[IN_DATA_BYTE], sizeof(uint32_t));
+                image_info addr_info = priv_eeprom_get_app_info();
+                addr_info.addr = new_address;
+                priv_eeprom_set_app_info(addr_info);
+                red_unlink(APP_CRC_FILE);
+                set_packet_length(packet, sizeof(int8_t) + 1);
+                status = 0;
+            }
 #else
             status = -1;
             ex2_log("FAILED attempt to set application addr from non golden image");
@@ -166,13 +384,15 @@ SAT_returnState updater_app(csp_packet_t *packet) {
 
         case SET_APP_CRC:
 #ifdef GOLDEN_IMAGE
-            uint16_t crc = 0;
-            memcpy(&crc, &packet->data[IN_DATA_BYTE], sizeof(uint16_t));
-            image_info crc_info = priv_eeprom_get_app_info();
-            crc_info.crc = crc;
-            priv_eeprom_set_app_info(crc_info);
-            set_packet_length(packet, sizeof(int8_t) + 1);
-            status = 0;
+            {
+                uint16_t crc = 0;
+                memcpy(&crc, &packet->data[IN_DATA_BYTE], sizeof(uint16_t));
+                image_info crc_info = priv_eeprom_get_app_info();
+                crc_info.crc = crc;
+                priv_eeprom_set_app_info(crc_info);
+                set_packet_length(packet, sizeof(int8_t) + 1);
+                status = 0;
+            }
 #else
             status = -1;
             ex2_log("FAILED attempt to set application crc from non golden image");
@@ -181,11 +401,14 @@ SAT_returnState updater_app(csp_packet_t *packet) {
 
         case ERASE_APP:
 #ifdef GOLDEN_IMAGE
-            image_info erase_info = priv_eeprom_get_app_info();
-            erase_info.exists = 0;
-            priv_eeprom_set_app_info(erase_info);
-            set_packet_length(packet, sizeof(int8_t) + 1);
-            status = 0;
+            {
+                image_info erase_info = priv_eeprom_get_app_info();
+                erase_info.exists = 0;
+                priv_eeprom_set_app_info(erase_info);
+                red_unlink(APP_CRC_FILE);
+                set_packet_length(packet, sizeof(int8_t) + 1);
+                status = 0;
+            }
 #else
             status = -1;
             ex2_log("FAILED attempt to erase application from non golden image");
@@ -193,13 +416,14 @@ SAT_returnState updater_app(csp_packet_t *packet) {
             break;
 
         case VERIFY_APPLICATION_IMAGE:
-            if (priv_verify_application() != true) {
-                status = -1;
+            status = verify_application(packet);
+            if (status == 0) {
                 break;
             }
-            set_packet_length(packet, sizeof(int8_t) + 1);
-            status = 0;
-            break;
+            // the bad block is reported along with the failure
+            memcpy(&packet->data[STATUS_BYTE], &status, sizeof(int8_t));
+            shutdown_eeprom();
+            return SATR_OK;
 
         case VERIFY_GOLDEN_IMAGE:
             if (priv_verify_golden() != true) {
@@ -210,6 +434,34 @@ SAT_returnState updater_app(csp_packet_t *packet) {
             status = 0;
             break;
 
+        case UPLOAD_START:
+            status = upload_start(packet);
+            break;
+
+        case UPLOAD_CHUNK:
+            status = upload_chunk(packet);
+            break;
+
+        case UPLOAD_MISSING:
+            status = upload_missing(packet);
+            break;
+
+        case UPLOAD_STATUS:
+            status = upload_status(packet);
+            break;
+
+        case APPLY_PATCH:
+            status = apply_patch(packet, &svc_wdt_counter);
+            break;
+
+        case GET_BLOCK_CRCS:
+            status = image_crc_get(packet);
+            break;
+
+        case UPLOAD_DISCARD_BLOCK:
+            status = upload_discard_block(packet);
+            break;
+
         default:
             ex2_log("No such subservice\n");
             shutdown_eeprom();
@@ -255,7 +507,12 @@ void updater_service(void *param) {
         svc_wdt_counter++;
 
         while ((packet = csp_read(conn, 50)) != NULL) {
-            if (updater_app(packet) != SATR_OK) {
+            svc_dispatch_t dispatch;
+            svc_dispatch_begin(&dispatch, TC_UPDATER_SERVICE, packet);
+            SAT_returnState state = updater_app(conn, packet);
+            svc_dispatch_end(&dispatch, state);
+
+            if (state != SATR_OK) {
                 // something went wrong, this shouldn't happen
                 csp_buffer_free(packet);
             } else {
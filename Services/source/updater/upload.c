@@ -0,0 +1,505 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file upload.c
+ * @date 2022-03-14
+ */
+
+#include "updater/upload.h"
+#include "updater/image_crc.h"
+#include "updater/updater.h"
+#include "redposix.h"
+#include "util/service_utilities.h"
+#include "util/crc16.h"
+#include <csp/csp_endian.h>
+#include <string.h>
+
+#define UPLOAD_MAGIC 0x55504C44 // "UPLD"
+/* Bytes of a finished block read back at a time to work out its CRC */
+#define UPLOAD_READ_BACK_SIZE 256
+
+/* Head of the state file, followed by the bitmap. It never leaves the OBC so it is in host order */
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint32_t image_size;
+    uint16_t chunk_size;
+    uint16_t chunks;
+    uint16_t image_crc;
+    uint8_t target;
+} upload_header_t;
+
+static upload_header_t upload = {0};
+static uint8_t received[UPLOAD_MAX_CHUNKS / 8];
+static uint16_t received_count = 0;
+static uint8_t state_loaded = 0;
+static uint8_t read_back[UPLOAD_READ_BACK_SIZE];
+
+static inline const char *prv_target_file(void) {
+    return (upload.target == UPLOAD_TARGET_PATCH) ? UPDATER_PATCH_FILE : UPDATER_IMAGE_FILE;
+}
+
+static inline uint8_t prv_has_chunk(uint16_t seq) { return received[seq >> 3] & (1 << (seq & 7)); }
+
+static uint16_t prv_chunk_length(uint16_t seq) {
+    uint32_t offset = (uint32_t)seq * upload.chunk_size;
+    uint32_t left = upload.image_size - offset;
+    return (left < upload.chunk_size) ? (uint16_t)left : upload.chunk_size;
+}
+
+/**
+ * @brief
+ *      Pick up the upload in progress from the state file, once per boot
+ */
+static void prv_load_state(void) {
+    int32_t fd;
+    uint16_t i;
+
+    if (state_loaded) {
+        return;
+    }
+    state_loaded = 1;
+    memset(&upload, 0, sizeof(upload));
+    received_count = 0;
+
+    fd = red_open(UPLOAD_STATE_FILE, RED_O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    if (red_read(fd, &upload, sizeof(upload)) != sizeof(upload) || upload.magic != UPLOAD_MAGIC ||
+        upload.chunks == 0 || upload.chunks > UPLOAD_MAX_CHUNKS || upload.target > UPLOAD_TARGET_PATCH ||
+        red_read(fd, received, (upload.chunks + 7) / 8) != (upload.chunks + 7) / 8) {
+        memset(&upload, 0, sizeof(upload));
+        red_close(fd);
+        return;
+    }
+    red_close(fd);
+
+    for (i = 0; i < upload.chunks; i++) {
+        if (prv_has_chunk(i)) {
+            received_count++;
+        }
+    }
+}
+
+/**
+ * @brief
+ *      Write a new state file with an empty bitmap
+ */
+static int8_t prv_reset_state(void) {
+    int32_t fd;
+    uint32_t bitmap_len = (upload.chunks + 7) / 8;
+    int8_t status = 0;
+
+    memset(received, 0, sizeof(received));
+    received_count = 0;
+
+    fd = red_open(UPLOAD_STATE_FILE, RED_O_CREAT | RED_O_TRUNC | RED_O_WRONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (red_write(fd, &upload, sizeof(upload)) != sizeof(upload) ||
+        red_write(fd, received, bitmap_len) != (int32_t)bitmap_len) {
+        status = -1;
+    }
+    red_close(fd);
+
+    // start the file over too so a smaller one doesn't keep the old tail
+    fd = red_open(prv_target_file(), RED_O_CREAT | RED_O_TRUNC | RED_O_WRONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    red_close(fd);
+
+    if (upload.target == UPLOAD_TARGET_IMAGE) {
+        image_crc_table_t *table = image_crc_work_table();
+        if (image_crc_reset(table, upload.image_size) != 0 || image_crc_save(table, IMAGE_CRC_FILE) != 0) {
+            status = -1;
+        }
+    }
+    return status;
+}
+
+/**
+ * @brief
+ *      Record a chunk as received, persisting only the bitmap byte it is in
+ */
+static int8_t prv_mark_chunk(uint16_t seq) {
+    int32_t fd;
+    int8_t status = 0;
+
+    received[seq >> 3] |= 1 << (seq & 7);
+    received_count++;
+
+    fd = red_open(UPLOAD_STATE_FILE, RED_O_WRONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (red_lseek(fd, sizeof(upload) + (seq >> 3), RED_SEEK_SET) < 0 ||
+        red_write(fd, &received[seq >> 3], 1) != 1) {
+        status = -1;
+    }
+    red_close(fd);
+    return status;
+}
+
+/**
+ * @brief
+ *      Whether every chunk overlapping a block of the image is in
+ */
+static uint8_t prv_block_received(uint32_t block) {
+    uint32_t seq = block * IMAGE_CRC_BLOCK_SIZE / upload.chunk_size;
+    uint32_t last = ((block + 1) * IMAGE_CRC_BLOCK_SIZE - 1) / upload.chunk_size;
+
+    if (last >= upload.chunks) {
+        last = upload.chunks - 1;
+    }
+    for (; seq <= last; seq++) {
+        if (!prv_has_chunk(seq)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief
+ *      Record the CRC of a block of the image file once all of it is in
+ * @details
+ *      The block is read back from the file system, so the table is of what
+ *      was stored rather than what was sent
+ */
+static int8_t prv_finish_block(int32_t fd, uint32_t block) {
+    uint32_t offset = block * IMAGE_CRC_BLOCK_SIZE;
+    uint32_t left = upload.image_size - offset;
+    uint16_t crc = CRC16_INIT;
+    int32_t got;
+
+    if (left > IMAGE_CRC_BLOCK_SIZE) {
+        left = IMAGE_CRC_BLOCK_SIZE;
+    }
+    if (red_lseek(fd, offset, RED_SEEK_SET) < 0) {
+        return -1;
+    }
+    while (left > 0) {
+        got = red_read(fd, read_back, (left < UPLOAD_READ_BACK_SIZE) ? left : UPLOAD_READ_BACK_SIZE);
+        if (got <= 0) {
+            return -1;
+        }
+        crc = crc16_update(crc, read_back, (uint32_t)got);
+        left -= (uint32_t)got;
+    }
+    return image_crc_save_block(IMAGE_CRC_FILE, (uint16_t)block, crc);
+}
+
+/**
+ * @brief
+ *      Check the image against the CRC given at the start, from the block CRCs
+ */
+static void prv_check_image(void) {
+    image_crc_table_t *table = image_crc_work_table();
+    uint16_t crc;
+
+    if (image_crc_load(table, IMAGE_CRC_FILE) != 0) {
+        ex2_log("Upload finished without a block CRC table");
+        return;
+    }
+    crc = image_crc_total(table);
+    if (crc != upload.image_crc) {
+        ex2_log("Uploaded image CRC %04x, expected %04x", crc, upload.image_crc);
+    }
+}
+
+/**
+ * @brief
+ *      Start a new upload or resume the one in progress
+ * @param packet
+ *      Request, replaced by the number of chunks and how many are already received
+ * @return int8_t
+ *      0 on success, -1 if the upload is too big or the state couldn't be written
+ */
+int8_t upload_start(csp_packet_t *packet) {
+    uint32_t image_size;
+    uint16_t chunk_size, image_crc, chunks;
+    uint16_t reply;
+    uint8_t target = UPLOAD_TARGET_IMAGE;
+
+    if (packet->length < IN_DATA_BYTE + sizeof(uint32_t) + 2 * sizeof(uint16_t)) {
+        return -1;
+    }
+    cnv8_32(&packet->data[IN_DATA_BYTE], &image_size);
+    memcpy(&chunk_size, &packet->data[IN_DATA_BYTE + 4], sizeof(uint16_t));
+    memcpy(&image_crc, &packet->data[IN_DATA_BYTE + 6], sizeof(uint16_t));
+    image_size = csp_ntoh32(image_size);
+    chunk_size = csp_ntoh16(chunk_size);
+    image_crc = csp_ntoh16(image_crc);
+    if (packet->length > IN_DATA_BYTE + 8) {
+        target = packet->data[IN_DATA_BYTE + 8];
+    }
+
+    if (image_size == 0 || chunk_size == 0 || chunk_size > csp_buffer_data_size() - UPLOAD_CHUNK_DATA_BYTE ||
+        (image_size + chunk_size - 1) / chunk_size > UPLOAD_MAX_CHUNKS || target > UPLOAD_TARGET_PATCH) {
+        ex2_log("Upload of %u bytes in %u byte chunks refused", image_size, chunk_size);
+        return -1;
+    }
+    chunks = (uint16_t)((image_size + chunk_size - 1) / chunk_size);
+
+    prv_load_state();
+    if (upload.magic != UPLOAD_MAGIC || upload.image_size != image_size || upload.chunk_size != chunk_size ||
+        upload.image_crc != image_crc || upload.target != target) {
+        upload.magic = UPLOAD_MAGIC;
+        upload.image_size = image_size;
+        upload.chunk_size = chunk_size;
+        upload.chunks = chunks;
+        upload.image_crc = image_crc;
+        upload.target = target;
+        if (prv_reset_state() != 0) {
+            upload.magic = 0;
+            return -1;
+        }
+    }
+
+    reply = csp_hton16(upload.chunks);
+    memcpy(&packet->data[OUT_DATA_BYTE], &reply, sizeof(uint16_t));
+    reply = csp_hton16(received_count);
+    memcpy(&packet->data[OUT_DATA_BYTE + 2], &reply, sizeof(uint16_t));
+    set_packet_length(packet, sizeof(int8_t) + 2 * sizeof(uint16_t) + 1);
+    return 0;
+}
+
+/**
+ * @brief
+ *      Write one chunk of the image at its place in the image file
+ * @details
+ *      A chunk already received is acknowledged without being written again,
+ *      so repeats from an overlapping pass cost no flash wear
+ * @param packet
+ *      Request, replaced by the sequence number and how many chunks are received
+ * @return int8_t
+ *      0 on success, -1 if no upload is in progress, the chunk is out of
+ *      range or the wrong length, or it couldn't be written
+ */
+int8_t upload_chunk(csp_packet_t *packet) {
+    uint16_t seq, reply;
+    uint32_t len, block;
+    int32_t fd;
+
+    prv_load_state();
+    if (upload.magic != UPLOAD_MAGIC || packet->length < UPLOAD_CHUNK_DATA_BYTE) {
+        return -1;
+    }
+    memcpy(&seq, &packet->data[IN_DATA_BYTE], sizeof(uint16_t));
+    seq = csp_ntoh16(seq);
+    len = packet->length - UPLOAD_CHUNK_DATA_BYTE;
+    if (seq >= upload.chunks || len != prv_chunk_length(seq)) {
+        return -1;
+    }
+
+    if (!prv_has_chunk(seq)) {
+        fd = red_open(prv_target_file(), RED_O_WRONLY);
+        if (fd < 0) {
+            return -1;
+        }
+        if (red_lseek(fd, (int64_t)seq * upload.chunk_size, RED_SEEK_SET) < 0 ||
+            red_write(fd, &packet->data[UPLOAD_CHUNK_DATA_BYTE], len) != (int32_t)len) {
+            red_close(fd);
+            return -1;
+        }
+        red_close(fd);
+        // the data is written before the bit, so a reset in between only costs a resend
+        if (prv_mark_chunk(seq) != 0) {
+            return -1;
+        }
+
+        if (upload.target == UPLOAD_TARGET_IMAGE) {
+            fd = red_open(UPDATER_IMAGE_FILE, RED_O_RDONLY);
+            if (fd < 0) {
+                return -1;
+            }
+            for (block = (uint32_t)seq * upload.chunk_size / IMAGE_CRC_BLOCK_SIZE;
+                 block <= ((uint32_t)seq * upload.chunk_size + len - 1) / IMAGE_CRC_BLOCK_SIZE; block++) {
+                if (prv_block_received(block) && prv_finish_block(fd, block) != 0) {
+                    ex2_log("Upload block %u CRC failure %d", block, red_errno);
+                }
+            }
+            red_close(fd);
+            if (received_count == upload.chunks) {
+                prv_check_image();
+            }
+        }
+    }
+
+    reply = csp_hton16(seq);
+    memcpy(&packet->data[OUT_DATA_BYTE], &reply, sizeof(uint16_t));
+    reply = csp_hton16(received_count);
+    memcpy(&packet->data[OUT_DATA_BYTE + 2], &reply, sizeof(uint16_t));
+    set_packet_length(packet, sizeof(int8_t) + 2 * sizeof(uint16_t) + 1);
+    return 0;
+}
+
+/**
+ * @brief
+ *      List the missing chunks as (first, count) ranges
+ * @details
+ *      As many ranges as fit in one packet are sent. If there are more, the
+ *      reply says where to look from in the next request
+ * @param packet
+ *      Request, replaced by where to look from next and the ranges
+ * @return int8_t
+ *      0 on success, -1 if no upload is in progress
+ */
+int8_t upload_missing(csp_packet_t *packet) {
+    uint16_t seq = 0, first, count, next = UPLOAD_NO_MORE;
+    uint32_t out = OUT_DATA_BYTE + sizeof(uint16_t);
+    uint32_t max = csp_buffer_data_size() - 2 * sizeof(uint16_t);
+
+    prv_load_state();
+    if (upload.magic != UPLOAD_MAGIC) {
+        return -1;
+    }
+    if (packet->length >= IN_DATA_BYTE + sizeof(uint16_t)) {
+        memcpy(&seq, &packet->data[IN_DATA_BYTE], sizeof(uint16_t));
+        seq = csp_ntoh16(seq);
+    }
+
+    while (seq < upload.chunks) {
+        // whole bytes of received chunks are skipped at once
+        if ((seq & 7) == 0 && received[seq >> 3] == 0xFF) {
+            seq += 8;
+            continue;
+        }
+        if (prv_has_chunk(seq)) {
+            seq++;
+            continue;
+        }
+        if (out > max) {
+            next = seq;
+            break;
+        }
+        first = seq;
+        while (seq < upload.chunks && !prv_has_chunk(seq)) {
+            seq++;
+        }
+        count = seq - first;
+        first = csp_hton16(first);
+        count = csp_hton16(count);
+        memcpy(&packet->data[out], &first, sizeof(uint16_t));
+        memcpy(&packet->data[out + 2], &count, sizeof(uint16_t));
+        out += 2 * sizeof(uint16_t);
+    }
+
+    next = csp_hton16(next);
+    memcpy(&packet->data[OUT_DATA_BYTE], &next, sizeof(uint16_t));
+    set_packet_length(packet, out);
+    return 0;
+}
+
+/**
+ * @brief
+ *      Forget the chunks of a block of the image so they are uploaded again
+ * @details
+ *      For a block whose CRC (see image_crc.h) doesn't match the ground's
+ *      copy of the image. The chunks then show up in UPLOAD_MISSING
+ * @param packet
+ *      Request, replaced by the first chunk forgotten and how many
+ * @return int8_t
+ *      0 on success, -1 if no image upload is in progress, the block is out
+ *      of range or the bitmap couldn't be written
+ */
+int8_t upload_discard_block(csp_packet_t *packet) {
+    uint16_t block, reply;
+    uint32_t first, last, seq;
+    int32_t fd;
+    int8_t status = 0;
+
+    prv_load_state();
+    if (upload.magic != UPLOAD_MAGIC || upload.target != UPLOAD_TARGET_IMAGE ||
+        packet->length < IN_DATA_BYTE + sizeof(uint16_t)) {
+        return -1;
+    }
+    memcpy(&block, &packet->data[IN_DATA_BYTE], sizeof(uint16_t));
+    block = csp_ntoh16(block);
+    first = (uint32_t)block * IMAGE_CRC_BLOCK_SIZE / upload.chunk_size;
+    if (first >= upload.chunks) {
+        return -1;
+    }
+    last = ((uint32_t)(block + 1) * IMAGE_CRC_BLOCK_SIZE - 1) / upload.chunk_size;
+    if (last >= upload.chunks) {
+        last = upload.chunks - 1;
+    }
+
+    for (seq = first; seq <= last; seq++) {
+        if (prv_has_chunk(seq)) {
+            received[seq >> 3] &= ~(1 << (seq & 7));
+            received_count--;
+        }
+    }
+    fd = red_open(UPLOAD_STATE_FILE, RED_O_WRONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (red_lseek(fd, sizeof(upload) + (first >> 3), RED_SEEK_SET) < 0 ||
+        red_write(fd, &received[first >> 3], (last >> 3) - (first >> 3) + 1) !=
+            (int32_t)((last >> 3) - (first >> 3) + 1)) {
+        status = -1;
+    }
+    red_close(fd);
+
+    reply = csp_hton16((uint16_t)first);
+    memcpy(&packet->data[OUT_DATA_BYTE], &reply, sizeof(uint16_t));
+    reply = csp_hton16((uint16_t)(last - first + 1));
+    memcpy(&packet->data[OUT_DATA_BYTE + 2], &reply, sizeof(uint16_t));
+    set_packet_length(packet, sizeof(int8_t) + 2 * sizeof(uint16_t) + 1);
+    return status;
+}
+
+/**
+ * @brief
+ *      Report the upload in progress
+ * @param packet
+ *      Request, replaced by the size, chunking, progress, CRC and target of the upload
+ * @return int8_t
+ *      0 on success, -1 if no upload is in progress
+ */
+int8_t upload_status(csp_packet_t *packet) {
+    uint32_t image_size;
+    uint16_t fields[4];
+
+    prv_load_state();
+    if (upload.magic != UPLOAD_MAGIC) {
+        return -1;
+    }
+    image_size = csp_hton32(upload.image_size);
+    fields[0] = csp_hton16(upload.chunk_size);
+    fields[1] = csp_hton16(upload.chunks);
+    fields[2] = csp_hton16(received_count);
+    fields[3] = csp_hton16(upload.image_crc);
+    memcpy(&packet->data[OUT_DATA_BYTE], &image_size, sizeof(uint32_t));
+    memcpy(&packet->data[OUT_DATA_BYTE + sizeof(uint32_t)], fields, sizeof(fields));
+    packet->data[OUT_DATA_BYTE + sizeof(uint32_t) + sizeof(fields)] = upload.target;
+    set_packet_length(packet, sizeof(int8_t) + sizeof(uint32_t) + sizeof(fields) + sizeof(uint8_t) + 1);
+    return 0;
+}
+
+/**
+ * @brief
+ *      Whether an uploaded file may be used
+ * @param target
+ *      the file to check
+ * @return uint8_t
+ *      1 unless an upload to the file is in progress and still has chunks missing
+ */
+uint8_t upload_complete(upload_target_t target) {
+    prv_load_state();
+    return upload.magic != UPLOAD_MAGIC || upload.target != target || received_count == upload.chunks;
+}
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file service_stats.c
+ * @date 2022-03-14
+ */
+#include "util/service_stats.h"
+
+#include <FreeRTOS.h>
+#include <os_task.h>
+#include <string.h>
+
+/* Statically allocated so that instrumentation never touches the heap */
+static svc_stats_entry_t stats_table[SVC_STATS_MAX_ENTRIES];
+static uint8_t stats_used[SVC_STATS_MAX_ENTRIES];
+static uint16_t stats_entries = 0;
+
+static svc_trace_begin_t trace_begin = NULL;
+static svc_trace_end_t trace_end = NULL;
+
+/**
+ * @brief
+ *      Find the histogram bucket for a duration
+ * @param elapsed
+ *      Duration in timer units
+ * @return uint8_t
+ *      floor(log2(elapsed)) + 1, capped to the last bucket. 0 if elapsed is 0
+ */
+static uint8_t prv_get_bucket(uint32_t elapsed) {
+    uint8_t bucket = 0;
+    while (elapsed != 0 && bucket < SVC_STATS_HIST_BUCKETS - 1) {
+        elapsed >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/**
+ * @brief
+ *      Find or claim the table slot for a (service, subtype) pair
+ * @attention
+ *      Must be called from within a critical section
+ * @return svc_stats_entry_t *
+ *      The slot, or NULL if the table is full
+ */
+static svc_stats_entry_t *prv_get_entry(uint8_t service, uint8_t subtype) {
+    uint16_t key = ((uint16_t)service << 8) | subtype;
+    uint16_t slot = (key * 31) & (SVC_STATS_MAX_ENTRIES - 1);
+    uint16_t probes;
+
+    for (probes = 0; probes < SVC_STATS_MAX_ENTRIES; probes++) {
+        if (!stats_used[slot]) {
+            stats_used[slot] = 1;
+            stats_table[slot].service = service;
+            stats_table[slot].subtype = subtype;
+            stats_entries++;
+            return &stats_table[slot];
+        }
+        if (stats_table[slot].service == service && stats_table[slot].subtype == subtype) {
+            return &stats_table[slot];
+        }
+        slot = (slot + 1) & (SVC_STATS_MAX_ENTRIES - 1);
+    }
+    return NULL;
+}
+
+/**
+ * @brief
+ *      Mark the start of a service handler
+ * @details
+ *      Called by each service right before its packet is handed to the
+ *      subservice switch. The subtype is saved now since many handlers
+ *      reuse or free the packet
+ * @param dispatch
+ *      Filled in with the state needed by svc_dispatch_end
+ * @param service
+ *      CSP port the packet was received on
+ * @param packet
+ *      The incoming packet
+ */
+void svc_dispatch_begin(svc_dispatch_t *dispatch, uint8_t service, const csp_packet_t *packet) {
+    dispatch->service = service;
+    dispatch->subtype = (packet->length > SUBSERVICE_BYTE) ? (uint8_t)packet->data[SUBSERVICE_BYTE] : 0;
+    dispatch->trace_id = (trace_begin != NULL) ? trace_begin(service, packet) : 0;
+    dispatch->start = SVC_STATS_TIMESTAMP();
+}
+
+/**
+ * @brief
+ *      Mark the end of a service handler and record its latency
+ * @param dispatch
+ *      The state filled in by svc_dispatch_begin
+ * @param result
+ *      Return state of the handler. Anything but SATR_OK counts as an error
+ */
+void svc_dispatch_end(const svc_dispatch_t *dispatch, SAT_returnState result) {
+    uint32_t elapsed = SVC_STATS_TIMESTAMP() - dispatch->start;
+    uint8_t bucket = prv_get_bucket(elapsed);
+    svc_stats_entry_t *entry;
+
+    taskENTER_CRITICAL();
+    entry = prv_get_entry(dispatch->service, dispatch->subtype);
+    if (entry != NULL) {
+        entry->calls++;
+        if (result != SATR_OK) {
+            entry->errors++;
+        }
+        entry->total_time += elapsed;
+        if (elapsed > entry->max_time) {
+            entry->max_time = elapsed;
+        }
+        if (entry->histogram[bucket] != UINT16_MAX) {
+            entry->histogram[bucket]++;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    if (trace_end != NULL) {
+        trace_end(dispatch->trace_id, dispatch->service, dispatch->subtype, result);
+    }
+}
+
+/**
+ * @brief
+ *      Number of (service, subtype) pairs seen since the last reset
+ */
+uint16_t svc_stats_count(void) { return stats_entries; }
+
+/**
+ * @brief
+ *      Copy a page of the statistics table
+ * @param first
+ *      Index of the first populated entry to copy
+ * @param entries
+ *      Output array
+ * @param max_entries
+ *      Size of the output array
+ * @return uint16_t
+ *      Number of entries copied
+ */
+uint16_t svc_stats_get(uint16_t first, svc_stats_entry_t *entries, uint16_t max_entries) {
+    uint16_t found = 0;
+    uint16_t copied = 0;
+    uint16_t slot;
+
+    for (slot = 0; slot < SVC_STATS_MAX_ENTRIES && copied < max_entries; slot++) {
+        if (!stats_used[slot]) {
+            continue;
+        }
+        if (found++ < first) {
+            continue;
+        }
+        taskENTER_CRITICAL();
+        entries[copied] = stats_table[slot];
+        taskEXIT_CRITICAL();
+        copied++;
+    }
+    return copied;
+}
+
+/**
+ * @brief
+ *      Clear all statistics
+ */
+void svc_stats_reset(void) {
+    taskENTER_CRITICAL();
+    memset(stats_table, 0, sizeof(stats_table));
+    memset(stats_used, 0, sizeof(stats_used));
+    stats_entries = 0;
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief
+ *      Install observers called around every dispatch
+ * @details
+ *      Not meant for flight, where tracing costs more than it is worth. The
+ *      simulator uses this to record packet traces
+ * @param begin
+ *      Called before each handler, or NULL
+ * @param end
+ *      Called after each handler, or NULL
+ */
+void svc_stats_set_trace(svc_trace_begin_t begin, svc_trace_end_t end) {
+    trace_begin = begin;
+    trace_end = end;
+}
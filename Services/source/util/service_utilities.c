@@ -25,9 +25,6 @@
 #include <stdio.h>
 #include <string.h>
 
-#pragma WEAK(ex2_log)
-void ex2_log(const char *format, ...) { return; }
-
 /**
  * @brief
  *      Set the size of the CSP packet
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file staging_pool.c
+ * @date 2022-03-14
+ */
+
+#include "util/staging_pool.h"
+#include "util/service_utilities.h"
+#include <os_semphr.h>
+#include <os_task.h>
+
+/* A token is the block index + 1 in the low bits and a count of loans above */
+#define STAGING_INDEX_BITS 4
+#define STAGING_INDEX_MASK ((1 << STAGING_INDEX_BITS) - 1)
+
+static uint8_t blocks[STAGING_BLOCK_COUNT][STAGING_BLOCK_SIZE] __attribute__((aligned(STAGING_BLOCK_ALIGN)));
+static staging_token_t tokens[STAGING_BLOCK_COUNT];
+static staging_owner_t owners[STAGING_BLOCK_COUNT];
+static uint16_t loans = 0;
+static SemaphoreHandle_t available = NULL;
+
+/**
+ * @brief
+ *      Create the count of free blocks. Call before any service starts
+ * @return SAT_returnState
+ *      SATR_OK, or SATR_ERROR if the semaphore couldn't be created
+ */
+SAT_returnState staging_pool_init(void) {
+    if (available == NULL) {
+        available = xSemaphoreCreateCounting(STAGING_BLOCK_COUNT, STAGING_BLOCK_COUNT);
+        if (available == NULL) {
+            return SATR_ERROR;
+        }
+    }
+    return SATR_OK;
+}
+
+/**
+ * @brief
+ *      Borrow a block
+ * @param owner
+ *      who is borrowing it, for staging_owner
+ * @param timeout
+ *      ticks to wait for a block to be returned if none is free
+ * @return staging_token_t
+ *      the token for the block, or STAGING_NO_TOKEN if none was free in time
+ */
+staging_token_t staging_get(staging_owner_t owner, TickType_t timeout) {
+    staging_token_t token = STAGING_NO_TOKEN;
+    uint8_t i;
+
+    if (available == NULL || xSemaphoreTake(available, timeout) != pdTRUE) {
+        return STAGING_NO_TOKEN;
+    }
+    taskENTER_CRITICAL();
+    for (i = 0; i < STAGING_BLOCK_COUNT; i++) {
+        if (tokens[i] == STAGING_NO_TOKEN) {
+            loans++;
+            token = (staging_token_t)(loans << STAGING_INDEX_BITS) | (i + 1);
+            tokens[i] = token;
+            owners[i] = owner;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL();
+    return token;
+}
+
+static int prv_index(staging_token_t token) {
+    int i = (token & STAGING_INDEX_MASK) - 1;
+    if (i < 0 || i >= STAGING_BLOCK_COUNT || tokens[i] != token) {
+        return -1;
+    }
+    return i;
+}
+
+/**
+ * @return uint8_t*
+ *      the block's STAGING_BLOCK_SIZE bytes, or NULL if the token isn't
+ *      the block's current one
+ */
+uint8_t *staging_data(staging_token_t token) {
+    int i = prv_index(token);
+    return (i < 0) ? NULL : blocks[i];
+}
+
+/**
+ * @brief
+ *      Return a block. Returning a token twice, or STAGING_NO_TOKEN, does nothing
+ */
+void staging_put(staging_token_t token) {
+    uint8_t returned = 0;
+    int i;
+
+    if (token == STAGING_NO_TOKEN) {
+        return;
+    }
+    taskENTER_CRITICAL();
+    i = prv_index(token);
+    if (i >= 0) {
+        tokens[i] = STAGING_NO_TOKEN;
+        owners[i] = STAGING_FREE;
+        returned = 1;
+    }
+    taskEXIT_CRITICAL();
+    if (returned) {
+        xSemaphoreGive(available);
+    } else {
+        ex2_log("Staging block %04x returned twice", token);
+    }
+}
+
+staging_owner_t staging_owner(uint8_t block) {
+    return (block < STAGING_BLOCK_COUNT) ? owners[block] : STAGING_FREE;
+}
@@ -0,0 +1,601 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file bench.c
+ * @date 2022-03-14
+ *
+ * Micro-benchmarks of the service hot paths, built for the host by
+ * `make bench`. Each benchmark runs for at least the minimum time and
+ * reports nanoseconds, bytes allocated and allocations per operation.
+ * Allocations are FreeRTOS heap blocks plus CSP buffers, counted at full
+ * buffer size since that is what they take from the pool.
+ */
+#define _GNU_SOURCE
+
+#include <csp/csp.h>
+#include <csp/csp_endian.h>
+#include <redposix.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "diagnostics/diagnostics_service.h"
+#include "housekeeping/housekeeping_service.h"
+#include "logger/binlog.h"
+#include "logger/log_buffer.h"
+#include "logger/log_query.h"
+#include "logger/logger_service.h"
+#include "services.h"
+#include "time_management/time_management_service.h"
+#include "util/service_stats.h"
+#include "util/service_utilities.h"
+#include "util/staging_pool.h"
+
+#define BENCH_DEFAULT_MIN_TIME_MS 200
+#define BENCH_MAX_ITERATIONS 100000000U
+#define HK_BENCH_RECORDS 64     // records in the housekeeping file read back
+#define HK_BENCH_MAX_FILES 20160 // default MAX_FILES
+#define HK_BENCH_PERIOD 30       // seconds between housekeeping records
+#define HK_BENCH_EPOCH 1640995200
+#define BENCH_QUERIES 1024 // must be a power of 2
+#define LOG_BENCH_LINES 400      // lines in the syslog searched, one in LOG_BENCH_ERROR_EVERY an error
+#define LOG_BENCH_ERROR_EVERY 25
+
+/* Housekeeping internals that are not exported by its header */
+extern uint32_t timestamps[];
+extern uint16_t current_file;
+Result dynamic_timestamp_array_handler(uint16_t num_items);
+SAT_returnState hk_service_app(csp_conn_t *conn, csp_packet_t *packet);
+SAT_returnState time_management_app(csp_packet_t *packet);
+
+typedef struct {
+    const char *name;
+    void (*setup)(void); // run once before the benchmark, not timed
+    void (*run)(uint32_t iterations);
+} bench_t;
+
+static volatile uint32_t sink;
+static All_systems_housekeeping hk;
+static All_systems_housekeeping hk_read;
+static uint32_t queries[BENCH_QUERIES];
+static csp_conn_t *conn = NULL;
+static csp_packet_t *request = NULL;
+
+static uint64_t prv_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/* Deterministic so that runs can be compared */
+static uint32_t prv_random(void) {
+    static uint32_t state = 2463534242U;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+/* --------------------------------------------------------- conversions */
+
+static void bench_cnv32_8(uint32_t n) {
+    uint8_t out[4];
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        cnv32_8(i, out);
+        sink += out[0];
+    }
+}
+
+static void bench_cnv8_32(uint32_t n) {
+    uint8_t in[4] = {0x12, 0x34, 0x56, 0x78};
+    uint32_t out;
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        in[0] = (uint8_t)i;
+        cnv8_32(in, &out);
+        sink += out;
+    }
+}
+
+static void bench_cnv16_8(uint32_t n) {
+    uint8_t out[2];
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        cnv16_8((uint16_t)i, out);
+        sink += out[0];
+    }
+}
+
+static void bench_cnv8_16(uint32_t n) {
+    uint8_t in[2] = {0x12, 0x34};
+    uint16_t out;
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        in[0] = (uint8_t)i;
+        cnv8_16(in, &out);
+        sink += out;
+    }
+}
+
+static void bench_cnvF_8(uint32_t n) {
+    uint8_t out[4];
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        cnvF_8((float)i, out);
+        sink += out[3];
+    }
+}
+
+static void bench_cnv8_F(uint32_t n) {
+    uint8_t in[4] = {0x3f, 0x80, 0x00, 0x00};
+    float out;
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        in[3] = (uint8_t)i;
+        cnv8_F(in, &out);
+        sink += (uint32_t)out;
+    }
+}
+
+static void bench_cnvD_8(uint32_t n) {
+    uint8_t out[8];
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        cnvD_8((double)i, out);
+        sink += out[7];
+    }
+}
+
+static void bench_cnv8_D(uint32_t n) {
+    uint8_t in[8] = {0x3f, 0xf0, 0, 0, 0, 0, 0, 0};
+    double out;
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        in[7] = (uint8_t)i;
+        cnv8_D(in, &out);
+        sink += (uint32_t)out;
+    }
+}
+
+/* --------------------------------------------------------- housekeeping */
+
+static void setup_hk_record(void) {
+    uint8_t *bytes = (uint8_t *)&hk;
+    size_t i;
+    for (i = 0; i < sizeof(hk); i++) {
+        bytes[i] = (uint8_t)prv_random();
+    }
+    hk.hk_timeorder.final = 0;
+    hk.hk_timeorder.UNIXtimestamp = HK_BENCH_EPOCH;
+    hk.hk_timeorder.dataPosition = 1;
+}
+
+static void setup_hk_file(void) {
+    uint16_t file;
+    setup_hk_record();
+    bench_fs_reset();
+    for (file = 1; file <= HK_BENCH_RECORDS; file++) {
+        write_hk_to_file(HK_ARCHIVE_FILE, file, &hk);
+    }
+}
+
+static void bench_convert_hk_endianness(uint32_t n) {
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        convert_hk_endianness(&hk);
+    }
+}
+
+static void bench_write_hk_to_file(uint32_t n) {
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        write_hk_to_file(HK_ARCHIVE_FILE, (uint16_t)(i % HK_BENCH_RECORDS) + 1, &hk);
+    }
+}
+
+static void bench_read_hk_from_file(uint32_t n) {
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        read_hk_from_file(HK_ARCHIVE_FILE, (uint16_t)(i % HK_BENCH_RECORDS) + 1, &hk_read);
+    }
+}
+
+static void setup_populate(void) {
+    bench_fs_reset();
+    current_file = 1;
+}
+
+static void bench_populate_and_store_hk_data(uint32_t n) {
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        populate_and_store_hk_data();
+    }
+}
+
+/**
+ * @brief
+ *      Fill the timestamp index as if the service had been recording for
+ *      a number of periods, and pick lookups of times that were recorded
+ * @param recorded
+ *      Number of records written. Past HK_BENCH_MAX_FILES the storage has
+ *      wrapped around and the oldest records were overwritten
+ */
+static void prv_setup_timestamps(uint32_t recorded) {
+    uint32_t kept = (recorded < HK_BENCH_MAX_FILES) ? recorded : HK_BENCH_MAX_FILES;
+    uint32_t first = recorded - kept; // index of the oldest record kept
+    uint32_t record;
+    uint32_t i;
+
+    dynamic_timestamp_array_handler(HK_BENCH_MAX_FILES);
+    for (i = 1; i <= HK_BENCH_MAX_FILES; i++) {
+        timestamps[i] = 0;
+    }
+    for (record = first; record < recorded; record++) {
+        timestamps[(record % HK_BENCH_MAX_FILES) + 1] = HK_BENCH_EPOCH + record * HK_BENCH_PERIOD;
+    }
+    current_file = (uint16_t)(recorded % HK_BENCH_MAX_FILES) + 1;
+
+    for (i = 0; i < BENCH_QUERIES; i++) {
+        record = first + prv_random() % kept;
+        queries[i] = HK_BENCH_EPOCH + record * HK_BENCH_PERIOD + prv_random() % HK_BENCH_PERIOD;
+    }
+}
+
+static void setup_timestamps_filling(void) { prv_setup_timestamps(HK_BENCH_MAX_FILES / 2); }
+
+static void setup_timestamps_wrapped(void) { prv_setup_timestamps(HK_BENCH_MAX_FILES + HK_BENCH_MAX_FILES / 3); }
+
+static void bench_get_file_id_from_timestamp(uint32_t n) {
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        sink += get_file_id_from_timestamp(queries[i & (BENCH_QUERIES - 1)]);
+    }
+}
+
+/* ------------------------------------------------------------- dispatch */
+
+/**
+ * @brief
+ *      Open the loopback connection and take the request packet which the
+ *      dispatch benchmarks send back and forth
+ */
+static void prv_setup_request(uint8_t port) {
+    if (conn == NULL) {
+        conn = csp_connect(CSP_PRIO_NORM, GND_APP_ID, port, 0, CSP_O_RDP);
+    }
+    if (request == NULL) {
+        request = csp_buffer_get(csp_buffer_data_size());
+    }
+    if (conn == NULL || request == NULL) {
+        fprintf(stderr, "out of CSP resources\n");
+        exit(1);
+    }
+}
+
+/* Take back the reply to the last request, which becomes the next request */
+static void prv_take_reply(void) {
+    request = csp_read(conn, 0);
+    if (request == NULL) {
+        fprintf(stderr, "request was not answered\n");
+        exit(1);
+    }
+}
+
+static void setup_hk_request(void) {
+    setup_hk_file();
+    current_file = HK_BENCH_RECORDS + 1;
+    prv_setup_request(TC_HOUSEKEEPING_SERVICE);
+}
+
+static void bench_hk_get_max_files(uint32_t n) {
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        request->data[SUBSERVICE_BYTE] = GET_MAX_FILES;
+        request->length = 1;
+        hk_service_app(conn, request);
+        prv_take_reply();
+    }
+}
+
+/* One record, most recent first, as the ground asks for it */
+static void bench_hk_get_hk(uint32_t n) {
+    uint16_t args[4] = {1, 0, 0, 0}; // limit, before_id, before_time
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        request->data[SUBSERVICE_BYTE] = GET_HK;
+        memcpy(&request->data[IN_DATA_BYTE], args, sizeof(args));
+        request->length = 1 + sizeof(args);
+        hk_service_app(conn, request);
+        prv_take_reply();
+    }
+}
+
+static void setup_time_request(void) { prv_setup_request(TC_TIME_MANAGEMENT_SERVICE); }
+
+static void bench_time_get(uint32_t n) {
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        request->data[SUBSERVICE_BYTE] = GET_TIME;
+        request->length = 1;
+        time_management_app(request);
+    }
+}
+
+static void bench_time_set(uint32_t n) {
+    uint32_t now = csp_hton32(HK_BENCH_EPOCH);
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        request->data[SUBSERVICE_BYTE] = SET_TIME;
+        memcpy(&request->data[IN_DATA_BYTE], &now, sizeof(now));
+        request->length = 1 + sizeof(now);
+        time_management_app(request);
+    }
+}
+
+static void setup_diag_request(void) {
+    svc_dispatch_t dispatch;
+    unsigned subtype;
+
+    prv_setup_request(TC_DIAGNOSTICS_SERVICE);
+    // a table with a realistic number of services in it
+    request->length = 1;
+    for (subtype = 0; subtype < 24; subtype++) {
+        request->data[SUBSERVICE_BYTE] = (uint8_t)subtype;
+        svc_dispatch_begin(&dispatch, (uint8_t)(subtype % 8) + TC_TIME_MANAGEMENT_SERVICE, request);
+        svc_dispatch_end(&dispatch, SATR_OK);
+    }
+}
+
+static void bench_diag_get_svc_stats(uint32_t n) {
+    uint16_t first = 0;
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        request->data[SUBSERVICE_BYTE] = GET_SVC_STATS;
+        memcpy(&request->data[IN_DATA_BYTE], &first, sizeof(first));
+        request->length = 1 + sizeof(first);
+        diagnostics_service_app(request);
+    }
+}
+
+static void bench_diag_get_resource_stats(uint32_t n) {
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        request->data[SUBSERVICE_BYTE] = GET_RESOURCE_STATS;
+        request->data[IN_DATA_BYTE] = 0;
+        request->length = 2;
+        diagnostics_service_app(request);
+    }
+}
+
+static void bench_diag_get_response_stats(uint32_t n) {
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        request->data[SUBSERVICE_BYTE] = GET_RESPONSE_STATS;
+        request->length = 1;
+        diagnostics_service_app(request);
+    }
+}
+
+/* The instrumentation every service pays around each handler */
+static void bench_svc_dispatch(uint32_t n) {
+    svc_dispatch_t dispatch;
+    uint32_t i;
+    request->length = 1;
+    for (i = 0; i < n; i++) {
+        request->data[SUBSERVICE_BYTE] = (uint8_t)(i & 7);
+        svc_dispatch_begin(&dispatch, TC_HOUSEKEEPING_SERVICE, request);
+        svc_dispatch_end(&dispatch, SATR_OK);
+    }
+}
+
+/* ----------------------------------------------------------------- logging */
+
+static void setup_binlog(void) {
+    bench_fs_reset();
+    binlog_init();
+}
+
+/* Includes writing the records out each time a buffer fills, which the flush task does on board */
+static void bench_binlog(uint32_t n) {
+    const uint32_t per_buffer = BINLOG_BUFFER_SIZE / (BINLOG_HEADER_SIZE + sizeof(uint32_t));
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        binlog(LOG_HK_LOST, i);
+        if (i % per_buffer == per_buffer - 1) {
+            binlog_flush_full();
+        }
+    }
+    binlog_flush();
+}
+
+static void setup_log_buffer(void) {
+    static uint8_t started = 0;
+    bench_fs_reset();
+    if (!started) {
+        start_log_flush_task();
+        started = 1;
+    }
+}
+
+/* Includes draining the ring to the file each time it fills, which the flush task does on board */
+static void bench_ex2_log(uint32_t n) {
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        ex2_log("%u written to disk\n", i);
+        if ((i & (LOG_RING_SLOTS - 1)) == LOG_RING_SLOTS - 1) {
+            log_buffer_flush();
+        }
+    }
+    log_buffer_flush();
+}
+
+static void setup_log_query(void) {
+    char line[LOG_LINE_MAX];
+    int32_t file;
+    uint32_t i;
+    int len;
+
+    bench_fs_reset();
+    file = red_open("VOL0:/syslog.log", RED_O_WRONLY | RED_O_CREAT);
+    for (i = 0; i < LOG_BENCH_LINES; i++) {
+        len = snprintf(line, sizeof(line), "%u %c housekeeping file %u written to disk\n", HK_BENCH_EPOCH + i,
+                       (i % LOG_BENCH_ERROR_EVERY == 0) ? 'E' : 'I', i);
+        red_write(file, line, len);
+    }
+    red_close(file);
+    prv_setup_request(TC_LOGGER_SERVICE);
+}
+
+/* The errors in a 400 line syslog, as an operator would ask for them */
+static void bench_log_query_errors(uint32_t n) {
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        request->data[SUBSERVICE_BYTE] = QUERY_LOG;
+        memset(&request->data[IN_DATA_BYTE], 0, LOG_QUERY_MATCH_BYTE - IN_DATA_BYTE);
+        request->data[LOG_QUERY_SOURCE_BYTE] = LOG_QUERY_TEXT;
+        request->data[LOG_QUERY_LEVEL_BYTE] = LOG_ERROR;
+        request->data[LOG_QUERY_ID_BYTE] = 0xFF;
+        request->data[LOG_QUERY_ID_BYTE + 1] = 0xFF;
+        request->length = LOG_QUERY_MATCH_BYTE;
+        logger_service_app(conn, request);
+        prv_take_reply();
+        while (request->data[LOG_QUERY_FINAL_BYTE] == 0) {
+            csp_buffer_free(request);
+            prv_take_reply();
+        }
+    }
+}
+
+/* Just the formatting a text log line costs, for comparison */
+static void bench_log_snprintf(uint32_t n) {
+    char line[128];
+    uint32_t i;
+    for (i = 0; i < n; i++) {
+        sink += snprintf(line, sizeof(line), "%u written to disk", i);
+    }
+}
+
+static const bench_t benchmarks[] = {
+    {"cnv32_8", NULL, bench_cnv32_8},
+    {"cnv8_32", NULL, bench_cnv8_32},
+    {"cnv16_8", NULL, bench_cnv16_8},
+    {"cnv8_16", NULL, bench_cnv8_16},
+    {"cnvF_8", NULL, bench_cnvF_8},
+    {"cnv8_F", NULL, bench_cnv8_F},
+    {"cnvD_8", NULL, bench_cnvD_8},
+    {"cnv8_D", NULL, bench_cnv8_D},
+    {"hk/convert_hk_endianness", setup_hk_record, bench_convert_hk_endianness},
+    {"hk/write_hk_to_file", setup_hk_file, bench_write_hk_to_file},
+    {"hk/read_hk_from_file", setup_hk_file, bench_read_hk_from_file},
+    {"hk/populate_and_store_hk_data", setup_populate, bench_populate_and_store_hk_data},
+    {"hk/get_file_id_from_timestamp/filling", setup_timestamps_filling, bench_get_file_id_from_timestamp},
+    {"hk/get_file_id_from_timestamp/wrapped", setup_timestamps_wrapped, bench_get_file_id_from_timestamp},
+    {"dispatch/hk/GET_MAX_FILES", setup_hk_request, bench_hk_get_max_files},
+    {"dispatch/hk/GET_HK", setup_hk_request, bench_hk_get_hk},
+    {"dispatch/time/GET_TIME", setup_time_request, bench_time_get},
+    {"dispatch/time/SET_TIME", setup_time_request, bench_time_set},
+    {"dispatch/diag/GET_SVC_STATS", setup_diag_request, bench_diag_get_svc_stats},
+    {"dispatch/diag/GET_RESOURCE_STATS", setup_diag_request, bench_diag_get_resource_stats},
+    {"dispatch/diag/GET_RESPONSE_STATS", setup_diag_request, bench_diag_get_response_stats},
+    {"dispatch/svc_dispatch_begin_end", setup_diag_request, bench_svc_dispatch},
+    {"log/binlog", setup_binlog, bench_binlog},
+    {"log/ex2_log", setup_log_buffer, bench_ex2_log},
+    {"log/snprintf", NULL, bench_log_snprintf},
+    {"log/query/errors", setup_log_query, bench_log_query_errors},
+};
+
+static void prv_alloc_usage(uint64_t *bytes, uint64_t *allocs) {
+    uint64_t heap_bytes, heap_allocs, csp_bytes, csp_allocs;
+    bench_heap_usage(&heap_bytes, &heap_allocs);
+    bench_csp_usage(&csp_bytes, &csp_allocs);
+    *bytes = heap_bytes + csp_bytes;
+    *allocs = heap_allocs + csp_allocs;
+}
+
+/**
+ * @brief
+ *      Run a benchmark with more and more iterations until one run lasts
+ *      the minimum time, and report that run
+ */
+static void prv_run(const bench_t *bench, uint64_t min_time_ns) {
+    uint64_t bytes_before, allocs_before, bytes_after, allocs_after;
+    uint64_t start, elapsed;
+    uint64_t iterations = 1;
+
+    if (bench->setup != NULL) {
+        bench->setup();
+    }
+    for (;;) {
+        prv_alloc_usage(&bytes_before, &allocs_before);
+        start = prv_now_ns();
+        bench->run((uint32_t)iterations);
+        elapsed = prv_now_ns() - start;
+        prv_alloc_usage(&bytes_after, &allocs_after);
+
+        if (elapsed >= min_time_ns || iterations >= BENCH_MAX_ITERATIONS) {
+            break;
+        }
+        // aim 20% past the minimum, growing at most 100x so a slow first run doesn't overshoot
+        uint64_t next = (elapsed == 0) ? iterations * 100 : iterations * min_time_ns * 6 / 5 / elapsed;
+        if (next > iterations * 100) {
+            next = iterations * 100;
+        }
+        iterations = (next > iterations) ? next : iterations + 1;
+        if (iterations > BENCH_MAX_ITERATIONS) {
+            iterations = BENCH_MAX_ITERATIONS;
+        }
+    }
+
+    printf("%-42s %10llu %12.1f %10.1f %10.2f\n", bench->name, (unsigned long long)iterations,
+           (double)elapsed / iterations, (double)(bytes_after - bytes_before) / iterations,
+           (double)(allocs_after - allocs_before) / iterations);
+}
+
+static void prv_usage(const char *name) {
+    fprintf(stderr, "usage: %s [-t min ms per benchmark] [name filter]\n", name);
+}
+
+int main(int argc, char **argv) {
+    uint64_t min_time_ns = BENCH_DEFAULT_MIN_TIME_MS * 1000000ULL;
+    const char *filter = NULL;
+    unsigned i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:")) != -1) {
+        switch (opt) {
+        case 't':
+            min_time_ns = strtoull(optarg, NULL, 10) * 1000000ULL;
+            break;
+        default:
+            prv_usage(argv[0]);
+            return -1;
+        }
+    }
+    if (optind < argc) {
+        filter = argv[optind];
+    }
+
+    staging_pool_init();
+    printf("%-42s %10s %12s %10s %10s\n", "benchmark", "iterations", "ns/op", "B/op", "allocs/op");
+    for (i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        if (filter == NULL || strstr(benchmarks[i].name, filter) != NULL) {
+            prv_run(&benchmarks[i], min_time_ns);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file bench.h
+ * @date 2022-03-14
+ *
+ * Hooks into the host stand-ins used by the benchmark suite
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+/* Everything allocated from the FreeRTOS heap since start up */
+void bench_heap_usage(uint64_t *bytes, uint64_t *allocs);
+
+/* Every CSP buffer taken from the pool since start up, counted at full buffer size */
+void bench_csp_usage(uint64_t *bytes, uint64_t *allocs);
+
+/* Delete every file of the RAM volume */
+void bench_fs_reset(void);
+
+#endif /* BENCH_H */
@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file csp_shim.c
+ * @date 2022-03-14
+ *
+ * The parts of libcsp used by the services. Buffers come from a fixed pool
+ * as in libcsp, so running out shows up the same way. There is no router:
+ * a connection is a loopback queue, so a benchmark hands a request to a
+ * service and reads the replies back from the same connection.
+ */
+#define _GNU_SOURCE
+
+#include <FreeRTOS.h>
+#include <csp/csp.h>
+#include <csp/csp_endian.h>
+#include <os_task.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+#define CSP_BUFFER_SIZE (sizeof(csp_packet_t) + CSP_BUFFER_DATA_SIZE)
+
+struct csp_conn_s {
+    csp_id_t idin;
+    csp_id_t idout;
+    csp_packet_t *queue[CSP_CONN_QUEUE_LENGTH];
+    uint8_t head;
+    uint8_t count;
+};
+
+struct csp_socket_s {
+    uint32_t opts;
+    uint8_t port;
+};
+
+static uint8_t buffer_pool[CSP_BUFFER_COUNT][CSP_BUFFER_SIZE] __attribute__((aligned(8)));
+static void *buffer_free_list[CSP_BUFFER_COUNT];
+static int buffers_free = -1;
+static uint64_t buffer_allocs = 0;
+
+static void prv_buffer_init(void) {
+    int i;
+    for (i = 0; i < CSP_BUFFER_COUNT; i++) {
+        buffer_free_list[i] = buffer_pool[i];
+    }
+    buffers_free = CSP_BUFFER_COUNT;
+}
+
+/* ---------------------------------------------------------------- buffers */
+
+void *csp_buffer_get(size_t size) {
+    void *buffer = NULL;
+
+    if (size > CSP_BUFFER_DATA_SIZE) {
+        return NULL;
+    }
+    taskENTER_CRITICAL();
+    if (buffers_free < 0) {
+        prv_buffer_init();
+    }
+    if (buffers_free > 0) {
+        buffer = buffer_free_list[--buffers_free];
+        buffer_allocs++;
+    }
+    taskEXIT_CRITICAL();
+    return buffer;
+}
+
+void csp_buffer_free(void *packet) {
+    if (packet == NULL) {
+        return;
+    }
+    taskENTER_CRITICAL();
+    buffer_free_list[buffers_free++] = packet;
+    taskEXIT_CRITICAL();
+}
+
+void *csp_buffer_clone(void *buffer) {
+    csp_packet_t *packet = buffer;
+    csp_packet_t *clone = csp_buffer_get(packet->length);
+    if (clone != NULL) {
+        memcpy(clone, packet, sizeof(csp_packet_t) + packet->length);
+    }
+    return clone;
+}
+
+int csp_buffer_remaining(void) { return (buffers_free < 0) ? CSP_BUFFER_COUNT : buffers_free; }
+
+int csp_buffer_size(void) { return CSP_BUFFER_SIZE; }
+
+int csp_buffer_data_size(void) { return CSP_BUFFER_DATA_SIZE; }
+
+void bench_csp_usage(uint64_t *bytes, uint64_t *allocs) {
+    taskENTER_CRITICAL();
+    *allocs = buffer_allocs;
+    *bytes = buffer_allocs * CSP_BUFFER_SIZE;
+    taskEXIT_CRITICAL();
+}
+
+/* ------------------------------------------------------------ connections */
+
+csp_socket_t *csp_socket(uint32_t opts) {
+    csp_socket_t *socket = calloc(1, sizeof(*socket));
+    if (socket != NULL) {
+        socket->opts = opts;
+    }
+    return socket;
+}
+
+int csp_bind(csp_socket_t *socket, uint8_t port) {
+    socket->port = port;
+    return CSP_ERR_NONE;
+}
+
+int csp_listen(csp_socket_t *socket, size_t backlog) { return CSP_ERR_NONE; }
+
+/* Nothing ever connects from outside, so a server just sees timeouts */
+csp_conn_t *csp_accept(csp_socket_t *socket, uint32_t timeout) {
+    vTaskDelay((timeout == CSP_MAX_TIMEOUT) ? portMAX_DELAY : pdMS_TO_TICKS(timeout));
+    return NULL;
+}
+
+csp_conn_t *csp_connect(uint8_t prio, uint8_t dst, uint8_t dst_port, uint32_t timeout, uint32_t opts) {
+    csp_conn_t *conn = calloc(1, sizeof(*conn));
+    if (conn == NULL) {
+        return NULL;
+    }
+    conn->idout.pri = prio;
+    conn->idout.dst = dst;
+    conn->idout.dport = dst_port;
+    conn->idin.src = dst;
+    conn->idin.sport = dst_port;
+    return conn;
+}
+
+int csp_close(csp_conn_t *conn) {
+    if (conn == NULL) {
+        return CSP_ERR_NONE;
+    }
+    while (conn->count != 0) {
+        csp_buffer_free(conn->queue[conn->head]);
+        conn->head = (conn->head + 1) % CSP_CONN_QUEUE_LENGTH;
+        conn->count--;
+    }
+    free(conn);
+    return CSP_ERR_NONE;
+}
+
+csp_packet_t *csp_read(csp_conn_t *conn, uint32_t timeout) {
+    csp_packet_t *packet;
+
+    if (conn == NULL || conn->count == 0) {
+        return NULL;
+    }
+    packet = conn->queue[conn->head];
+    conn->head = (conn->head + 1) % CSP_CONN_QUEUE_LENGTH;
+    conn->count--;
+    return packet;
+}
+
+/**
+ * @brief
+ *      Send a packet, which becomes the next one read from the connection
+ * @return int
+ *      1 if the packet was consumed, 0 if the connection is backed up and
+ *      the packet still belongs to the caller
+ */
+int csp_send(csp_conn_t *conn, csp_packet_t *packet, uint32_t timeout) {
+    if (conn == NULL || packet == NULL || conn->count == CSP_CONN_QUEUE_LENGTH) {
+        return 0;
+    }
+    packet->id.ext = conn->idout.ext;
+    conn->queue[(conn->head + conn->count) % CSP_CONN_QUEUE_LENGTH] = packet;
+    conn->count++;
+    return 1;
+}
+
+int csp_conn_dport(csp_conn_t *conn) { return conn->idin.dport; }
+
+int csp_conn_sport(csp_conn_t *conn) { return conn->idin.sport; }
+
+int csp_conn_dst(csp_conn_t *conn) { return conn->idin.dst; }
+
+int csp_conn_src(csp_conn_t *conn) { return conn->idin.src; }
+
+void csp_service_handler(csp_conn_t *conn, csp_packet_t *packet) { csp_buffer_free(packet); }
+
+/* ---------------------------------------------------------------- endian */
+
+/* The host is little endian, like the OBC */
+uint16_t csp_hton16(uint16_t h16) { return __builtin_bswap16(h16); }
+uint16_t csp_ntoh16(uint16_t n16) { return __builtin_bswap16(n16); }
+uint32_t csp_hton32(uint32_t h32) { return __builtin_bswap32(h32); }
+uint32_t csp_ntoh32(uint32_t n32) { return __builtin_bswap32(n32); }
+uint64_t csp_hton64(uint64_t h64) { return __builtin_bswap64(h64); }
+uint64_t csp_ntoh64(uint64_t n64) { return __builtin_bswap64(n64); }
+uint16_t csp_htobe16(uint16_t h16) { return __builtin_bswap16(h16); }
+uint16_t csp_htole16(uint16_t h16) { return h16; }
+uint16_t csp_betoh16(uint16_t be16) { return __builtin_bswap16(be16); }
+uint16_t csp_letoh16(uint16_t le16) { return le16; }
+uint32_t csp_htobe32(uint32_t h32) { return __builtin_bswap32(h32); }
+uint32_t csp_htole32(uint32_t h32) { return h32; }
+uint32_t csp_betoh32(uint32_t be32) { return __builtin_bswap32(be32); }
+uint32_t csp_letoh32(uint32_t le32) { return le32; }
+uint64_t csp_htobe64(uint64_t h64) { return __builtin_bswap64(h64); }
+uint64_t csp_htole64(uint64_t h64) { return h64; }
+uint64_t csp_betoh64(uint64_t be64) { return __builtin_bswap64(be64); }
+uint64_t csp_letoh64(uint64_t le64) { return le64; }
+
+float csp_htonflt(float f) {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    u = csp_hton32(u);
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+float csp_ntohflt(float f) { return csp_htonflt(f); }
+
+double csp_htondbl(double d) {
+    uint64_t u;
+    memcpy(&u, &d, sizeof(u));
+    u = csp_hton64(u);
+    memcpy(&d, &u, sizeof(d));
+    return d;
+}
+
+double csp_ntohdbl(double d) { return csp_htondbl(d); }
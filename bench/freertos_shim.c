@@ -0,0 +1,447 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file freertos_shim.c
+ * @date 2022-03-14
+ *
+ * The parts of the FreeRTOS API used by the services, over pthreads. Every
+ * task is a thread, critical sections and scheduler suspension share one
+ * recursive mutex, and queues and semaphores are a mutex and a condition
+ * variable. The heap is malloc limited to configTOTAL_HEAP_SIZE, with every
+ * allocation counted for the benchmarks.
+ */
+#define _GNU_SOURCE
+
+#include <FreeRTOS.h>
+#include <os_semphr.h>
+#include <os_task.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+#define SHIM_MAX_TASKS 32
+#define SHIM_TASK_NAME_LEN 16
+#define HEAP_HEADER_SIZE 16 // keeps allocations aligned like malloc
+
+typedef struct {
+    pthread_t thread;
+    char name[SHIM_TASK_NAME_LEN];
+    UBaseType_t number;
+    UBaseType_t priority;
+    uint16_t stack_depth;
+    TaskFunction_t function;
+    void *param;
+    uint32_t notify_count;
+    pthread_mutex_t notify_lock;
+    pthread_cond_t notified;
+} shim_task_t;
+
+struct QueueDefinition {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    UBaseType_t length;
+    UBaseType_t item_size; // 0 for semaphores
+    UBaseType_t count;
+    UBaseType_t head;
+    uint8_t *storage;
+};
+
+static pthread_mutex_t critical_lock;
+static pthread_once_t shim_once = PTHREAD_ONCE_INIT;
+static struct timespec boot_time;
+
+static shim_task_t tasks[SHIM_MAX_TASKS];
+static UBaseType_t task_count = 0;
+static __thread shim_task_t *current_task = NULL;
+
+static size_t heap_in_use = 0;
+static size_t heap_min_free = configTOTAL_HEAP_SIZE;
+static size_t heap_allocs = 0;
+static size_t heap_frees = 0;
+static uint64_t heap_bytes_total = 0;
+
+static void prv_shim_init(void) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&critical_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    clock_gettime(CLOCK_MONOTONIC, &boot_time);
+}
+
+static void prv_cond_init(pthread_cond_t *cond) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/**
+ * @brief
+ *      Wait on a condition for at most a number of ticks
+ * @return int
+ *      0 if signalled, non zero on timeout
+ */
+static int prv_cond_wait_ticks(pthread_cond_t *cond, pthread_mutex_t *lock, TickType_t ticks) {
+    struct timespec deadline;
+
+    if (ticks == portMAX_DELAY) {
+        return pthread_cond_wait(cond, lock);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += (long)(ticks % configTICK_RATE_HZ) * (1000000000L / configTICK_RATE_HZ);
+    deadline.tv_sec += ticks / configTICK_RATE_HZ + deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+    return pthread_cond_timedwait(cond, lock, &deadline);
+}
+
+/* ------------------------------------------------------------------ heap */
+
+void *pvPortMalloc(size_t xSize) {
+    uint8_t *block = NULL;
+
+    pthread_once(&shim_once, prv_shim_init);
+    vPortEnterCritical();
+    if (xSize != 0 && heap_in_use + xSize <= configTOTAL_HEAP_SIZE) {
+        block = malloc(HEAP_HEADER_SIZE + xSize);
+    }
+    if (block != NULL) {
+        memcpy(block, &xSize, sizeof(xSize));
+        heap_in_use += xSize;
+        if (configTOTAL_HEAP_SIZE - heap_in_use < heap_min_free) {
+            heap_min_free = configTOTAL_HEAP_SIZE - heap_in_use;
+        }
+        heap_allocs++;
+        heap_bytes_total += xSize;
+        block += HEAP_HEADER_SIZE;
+    }
+    vPortExitCritical();
+    return block;
+}
+
+void vPortFree(void *pv) {
+    uint8_t *block = pv;
+    size_t size;
+
+    if (block == NULL) {
+        return;
+    }
+    block -= HEAP_HEADER_SIZE;
+    memcpy(&size, block, sizeof(size));
+    vPortEnterCritical();
+    heap_in_use -= size;
+    heap_frees++;
+    vPortExitCritical();
+    free(block);
+}
+
+size_t xPortGetFreeHeapSize(void) { return configTOTAL_HEAP_SIZE - heap_in_use; }
+
+size_t xPortGetMinimumEverFreeHeapSize(void) { return heap_min_free; }
+
+void vPortGetHeapStats(HeapStats_t *pxHeapStats) {
+    memset(pxHeapStats, 0, sizeof(*pxHeapStats));
+    pxHeapStats->xAvailableHeapSpaceInBytes = xPortGetFreeHeapSize();
+    // malloc does not fragment the notional heap
+    pxHeapStats->xSizeOfLargestFreeBlockInBytes = pxHeapStats->xAvailableHeapSpaceInBytes;
+    pxHeapStats->xSizeOfSmallestFreeBlockInBytes = pxHeapStats->xAvailableHeapSpaceInBytes;
+    pxHeapStats->xNumberOfFreeBlocks = 1;
+    pxHeapStats->xMinimumEverFreeBytesRemaining = heap_min_free;
+    pxHeapStats->xNumberOfSuccessfulAllocations = heap_allocs;
+    pxHeapStats->xNumberOfSuccessfulFrees = heap_frees;
+}
+
+/**
+ * @brief
+ *      Bytes and number of allocations made from the heap since start up
+ */
+void bench_heap_usage(uint64_t *bytes, uint64_t *allocs) {
+    vPortEnterCritical();
+    *bytes = heap_bytes_total;
+    *allocs = heap_allocs;
+    vPortExitCritical();
+}
+
+/* ------------------------------------------------------------- scheduler */
+
+void vPortEnterCritical(void) {
+    pthread_once(&shim_once, prv_shim_init);
+    pthread_mutex_lock(&critical_lock);
+}
+
+void vPortExitCritical(void) { pthread_mutex_unlock(&critical_lock); }
+
+void vTaskSuspendAll(void) { vPortEnterCritical(); }
+
+BaseType_t xTaskResumeAll(void) {
+    vPortExitCritical();
+    return pdFALSE;
+}
+
+TickType_t xTaskGetTickCount(void) {
+    struct timespec now;
+
+    pthread_once(&shim_once, prv_shim_init);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (TickType_t)((now.tv_sec - boot_time.tv_sec) * configTICK_RATE_HZ +
+                        (now.tv_nsec - boot_time.tv_nsec) / (1000000000L / configTICK_RATE_HZ));
+}
+
+void vTaskDelay(const TickType_t xTicksToDelay) {
+    struct timespec delay;
+    delay.tv_sec = xTicksToDelay / configTICK_RATE_HZ;
+    delay.tv_nsec = (long)(xTicksToDelay % configTICK_RATE_HZ) * (1000000000L / configTICK_RATE_HZ);
+    nanosleep(&delay, NULL);
+}
+
+/**
+ * @brief
+ *      Claim a task record. The thread which first calls into the shim
+ *      without having been created by xTaskCreate gets one too
+ */
+static shim_task_t *prv_new_task(const char *name, UBaseType_t priority, uint16_t stack_depth) {
+    shim_task_t *task = NULL;
+
+    vPortEnterCritical();
+    if (task_count < SHIM_MAX_TASKS) {
+        task = &tasks[task_count];
+        memset(task, 0, sizeof(*task));
+        strncpy(task->name, name, SHIM_TASK_NAME_LEN - 1);
+        task->number = ++task_count;
+        task->priority = priority;
+        task->stack_depth = stack_depth;
+        pthread_mutex_init(&task->notify_lock, NULL);
+        prv_cond_init(&task->notified);
+    }
+    vPortExitCritical();
+    return task;
+}
+
+static shim_task_t *prv_current_task(void) {
+    if (current_task == NULL) {
+        current_task = prv_new_task("main", tskIDLE_PRIORITY, configMINIMAL_STACK_SIZE);
+    }
+    return current_task;
+}
+
+static void *prv_task_entry(void *param) {
+    shim_task_t *task = param;
+    current_task = task;
+    task->function(task->param);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char *const pcName, const uint16_t usStackDepth,
+                       void *const pvParameters, UBaseType_t uxPriority, TaskHandle_t *const pxCreatedTask) {
+    shim_task_t *task = prv_new_task(pcName, uxPriority, usStackDepth);
+
+    if (task == NULL) {
+        return pdFAIL;
+    }
+    task->function = pxTaskCode;
+    task->param = pvParameters;
+    if (pthread_create(&task->thread, NULL, prv_task_entry, task) != 0) {
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    if (pxCreatedTask != NULL) {
+        *pxCreatedTask = task;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete) {
+    if (xTaskToDelete == NULL || xTaskToDelete == current_task) {
+        pthread_exit(NULL);
+    }
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) { return prv_current_task(); }
+
+char *pcTaskGetName(TaskHandle_t xTaskToQuery) {
+    shim_task_t *task = (xTaskToQuery != NULL) ? xTaskToQuery : prv_current_task();
+    return task->name;
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void) { return task_count; }
+
+/* Stacks are the host's, so every task reports all of its stack unused */
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t xTask) {
+    shim_task_t *task = (xTask != NULL) ? xTask : prv_current_task();
+    return task->stack_depth;
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *const pxTaskStatusArray, const UBaseType_t uxArraySize,
+                                 uint32_t *const pulTotalRunTime) {
+    UBaseType_t i;
+
+    prv_current_task();
+    if (uxArraySize < task_count) {
+        return 0;
+    }
+    for (i = 0; i < task_count; i++) {
+        memset(&pxTaskStatusArray[i], 0, sizeof(TaskStatus_t));
+        pxTaskStatusArray[i].xHandle = &tasks[i];
+        pxTaskStatusArray[i].pcTaskName = tasks[i].name;
+        pxTaskStatusArray[i].xTaskNumber = tasks[i].number;
+        pxTaskStatusArray[i].eCurrentState = (&tasks[i] == current_task) ? eRunning : eBlocked;
+        pxTaskStatusArray[i].uxCurrentPriority = tasks[i].priority;
+        pxTaskStatusArray[i].uxBasePriority = tasks[i].priority;
+        pxTaskStatusArray[i].usStackHighWaterMark = tasks[i].stack_depth;
+    }
+    if (pulTotalRunTime != NULL) {
+        *pulTotalRunTime = 0;
+    }
+    return task_count;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify) {
+    shim_task_t *task = xTaskToNotify;
+
+    if (task == NULL) {
+        return pdFAIL;
+    }
+    pthread_mutex_lock(&task->notify_lock);
+    task->notify_count++;
+    pthread_cond_signal(&task->notified);
+    pthread_mutex_unlock(&task->notify_lock);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait) {
+    shim_task_t *task = prv_current_task();
+    uint32_t count;
+
+    pthread_mutex_lock(&task->notify_lock);
+    while (task->notify_count == 0 && xTicksToWait != 0) {
+        if (prv_cond_wait_ticks(&task->notified, &task->notify_lock, xTicksToWait) != 0) {
+            break;
+        }
+    }
+    count = task->notify_count;
+    if (count != 0) {
+        task->notify_count = (xClearCountOnExit != pdFALSE) ? 0 : count - 1;
+    }
+    pthread_mutex_unlock(&task->notify_lock);
+    return count;
+}
+
+/* ---------------------------------------------------- queues, semaphores */
+
+static QueueHandle_t prv_queue_create(UBaseType_t length, UBaseType_t item_size, UBaseType_t initial_count) {
+    QueueHandle_t queue = calloc(1, sizeof(*queue));
+
+    if (queue == NULL) {
+        return NULL;
+    }
+    if (item_size != 0) {
+        queue->storage = malloc(length * item_size);
+        if (queue->storage == NULL) {
+            free(queue);
+            return NULL;
+        }
+    }
+    pthread_mutex_init(&queue->lock, NULL);
+    prv_cond_init(&queue->changed);
+    queue->length = length;
+    queue->item_size = item_size;
+    queue->count = initial_count;
+    return queue;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize) {
+    return prv_queue_create(uxQueueLength, uxItemSize, 0);
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait) {
+    BaseType_t result = pdFAIL;
+
+    pthread_mutex_lock(&xQueue->lock);
+    while (xQueue->count == xQueue->length && xTicksToWait != 0) {
+        if (prv_cond_wait_ticks(&xQueue->changed, &xQueue->lock, xTicksToWait) != 0) {
+            break;
+        }
+    }
+    if (xQueue->count < xQueue->length) {
+        if (xQueue->item_size != 0 && pvItemToQueue != NULL) {
+            UBaseType_t tail = (xQueue->head + xQueue->count) % xQueue->length;
+            memcpy(&xQueue->storage[tail * xQueue->item_size], pvItemToQueue, xQueue->item_size);
+        }
+        xQueue->count++;
+        pthread_cond_broadcast(&xQueue->changed);
+        result = pdPASS;
+    }
+    pthread_mutex_unlock(&xQueue->lock);
+    return result;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait) {
+    BaseType_t result = pdFAIL;
+
+    pthread_mutex_lock(&xQueue->lock);
+    while (xQueue->count == 0 && xTicksToWait != 0) {
+        if (prv_cond_wait_ticks(&xQueue->changed, &xQueue->lock, xTicksToWait) != 0) {
+            break;
+        }
+    }
+    if (xQueue->count != 0) {
+        if (xQueue->item_size != 0 && pvBuffer != NULL) {
+            memcpy(pvBuffer, &xQueue->storage[xQueue->head * xQueue->item_size], xQueue->item_size);
+            xQueue->head = (xQueue->head + 1) % xQueue->length;
+        }
+        xQueue->count--;
+        pthread_cond_broadcast(&xQueue->changed);
+        result = pdPASS;
+    }
+    pthread_mutex_unlock(&xQueue->lock);
+    return result;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue) {
+    UBaseType_t count;
+    pthread_mutex_lock(&xQueue->lock);
+    count = xQueue->count;
+    pthread_mutex_unlock(&xQueue->lock);
+    return count;
+}
+
+void vQueueDelete(QueueHandle_t xQueue) {
+    pthread_mutex_destroy(&xQueue->lock);
+    pthread_cond_destroy(&xQueue->changed);
+    free(xQueue->storage);
+    free(xQueue);
+}
+
+/* Mutexes have no priority inheritance, which only matters on a real scheduler */
+SemaphoreHandle_t xSemaphoreCreateMutex(void) { return prv_queue_create(1, 0, 1); }
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) { return prv_queue_create(1, 0, 0); }
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount) {
+    return prv_queue_create(uxMaxCount, 0, uxInitialCount);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime) {
+    return xQueueReceive(xSemaphore, NULL, xBlockTime);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore) { return xQueueSendToBack(xSemaphore, NULL, 0); }
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t xSemaphore) { return uxQueueMessagesWaiting(xSemaphore); }
+
+void vSemaphoreDelete(SemaphoreHandle_t xSemaphore) { vQueueDelete(xSemaphore); }
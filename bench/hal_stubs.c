@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file hal_stubs.c
+ * @date 2022-03-14
+ *
+ * The OBC and driver functions the benchmarked services call. The
+ * housekeeping byte order converters do the same per field work as the
+ * drivers' so that convert_hk_endianness is measured honestly.
+ */
+#define _GNU_SOURCE
+
+#include <csp/csp_endian.h>
+#include <time.h>
+
+#include "eps.h"
+#include "housekeeping_athena.h"
+#include "logger/logger.h"
+#include "nmea_service.h"
+#include "rtcmk.h"
+#include "sband.h"
+#include "skytraq_gps.h"
+#include "task_manager/task_manager.h"
+#include "uhf.h"
+
+static uint32_t rtc_offset = 0;
+static uint32_t logger_file_size = 32 * 1024;
+static char logger_file[] = "VOL0:/syslog.log";
+static char logger_old_file[] = "VOL0:/syslog_old.log";
+
+void ex2_register(TaskHandle_t task, taskFunctions funcs) {}
+
+int RTCMK_SetUnix(uint32_t unix_time) {
+    rtc_offset = unix_time - (uint32_t)time(NULL);
+    return 0;
+}
+
+int RTCMK_GetUnix(uint32_t *unix_time) {
+    *unix_time = (uint32_t)time(NULL) + rtc_offset;
+    return 0;
+}
+
+int8_t set_logger_file_size(uint32_t file_size) {
+    logger_file_size = file_size;
+    return 0;
+}
+
+int8_t get_logger_file_size(uint32_t *file_size) {
+    *file_size = logger_file_size;
+    return 0;
+}
+
+char *get_logger_file(void) { return logger_file; }
+
+char *get_logger_old_file(void) { return logger_old_file; }
+
+bool gps_get_utc_time(time_t *utc_time) { return false; }
+
+void NMEA_service(void *param) {
+    for (;;) {
+        vTaskDelay(portMAX_DELAY);
+    }
+}
+
+uint32_t nmea_get_wdt_counter(void) { return 0; }
+
+int Athena_hk_convert_endianness(athena_housekeeping *athena_hk) {
+    int i;
+    for (i = 0; i < ATHENA_TEMP_ARRAY_SIZE; i++) {
+        athena_hk->temparray[i] = (long)csp_hton32((uint32_t)athena_hk->temparray[i]);
+    }
+    athena_hk->boot_cnt = csp_hton16(athena_hk->boot_cnt);
+    athena_hk->OBC_uptime = csp_hton16(athena_hk->OBC_uptime);
+    athena_hk->cmds_received = csp_hton16(athena_hk->cmds_received);
+    athena_hk->pckts_uncovered_by_FEC = csp_hton16(athena_hk->pckts_uncovered_by_FEC);
+    return 0;
+}
+
+void prv_instantaneous_telemetry_letoh(eps_instantaneous_telemetry_t *telembuf) {
+    int i;
+    telembuf->uptimeInS = csp_letoh32(telembuf->uptimeInS);
+    telembuf->bootCnt = csp_letoh32(telembuf->bootCnt);
+    telembuf->wdt_gs_time_left = csp_letoh32(telembuf->wdt_gs_time_left);
+    telembuf->wdt_gs_counter = csp_letoh32(telembuf->wdt_gs_counter);
+    for (i = 0; i < 4; i++) {
+        telembuf->mpptConverterVoltage[i] = csp_letoh16(telembuf->mpptConverterVoltage[i]);
+    }
+    for (i = 0; i < 8; i++) {
+        telembuf->curSolarPanels[i] = csp_letoh16(telembuf->curSolarPanels[i]);
+        telembuf->OutputConverterVoltage[i] = csp_letoh16(telembuf->OutputConverterVoltage[i]);
+    }
+    telembuf->vBatt = csp_letoh16(telembuf->vBatt);
+    telembuf->curSolar = csp_letoh16(telembuf->curSolar);
+    telembuf->curBattIn = csp_letoh16(telembuf->curBattIn);
+    telembuf->curBattOut = csp_letoh16(telembuf->curBattOut);
+    for (i = 0; i < 18; i++) {
+        telembuf->curOutput[i] = csp_letoh16(telembuf->curOutput[i]);
+        telembuf->outputOnDelta[i] = csp_letoh16(telembuf->outputOnDelta[i]);
+        telembuf->outputOffDelta[i] = csp_letoh16(telembuf->outputOffDelta[i]);
+    }
+    for (i = 0; i < 2; i++) {
+        telembuf->AOcurOutput[i] = csp_letoh16(telembuf->AOcurOutput[i]);
+    }
+    telembuf->outputStatus = csp_letoh32(telembuf->outputStatus);
+    telembuf->outputFaultStatus = csp_letoh32(telembuf->outputFaultStatus);
+    telembuf->protectedOutputAccessCnt = csp_letoh16(telembuf->protectedOutputAccessCnt);
+    telembuf->PingWdt_toggles = csp_letoh16(telembuf->PingWdt_toggles);
+}
+
+int UHF_convert_endianness(UHF_housekeeping *uhf_hk) {
+    uhf_hk->freq = csp_hton32(uhf_hk->freq);
+    uhf_hk->pipe_t = csp_hton32(uhf_hk->pipe_t);
+    uhf_hk->beacon_t = csp_hton32(uhf_hk->beacon_t);
+    uhf_hk->audio_t = csp_hton32(uhf_hk->audio_t);
+    uhf_hk->uptime = csp_hton32(uhf_hk->uptime);
+    uhf_hk->pckts_out = csp_hton32(uhf_hk->pckts_out);
+    uhf_hk->pckts_in = csp_hton32(uhf_hk->pckts_in);
+    uhf_hk->pckts_in_crc16 = csp_hton32(uhf_hk->pckts_in_crc16);
+    uhf_hk->temperature = csp_htonflt(uhf_hk->temperature);
+    return 0;
+}
+
+int HAL_S_hk_convert_endianness(Sband_Housekeeping *sband_hk) {
+    sband_hk->Output_Power = csp_htonflt(sband_hk->Output_Power);
+    sband_hk->PA_Temp = csp_htonflt(sband_hk->PA_Temp);
+    sband_hk->Top_Temp = csp_htonflt(sband_hk->Top_Temp);
+    sband_hk->Bottom_Temp = csp_htonflt(sband_hk->Bottom_Temp);
+    sband_hk->Bat_Current = csp_htonflt(sband_hk->Bat_Current);
+    sband_hk->Bat_Voltage = csp_htonflt(sband_hk->Bat_Voltage);
+    sband_hk->PA_Current = csp_htonflt(sband_hk->PA_Current);
+    sband_hk->PA_Voltage = csp_htonflt(sband_hk->PA_Voltage);
+    return 0;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file adcs.h
+ * @date 2022-03-14
+ *
+ * Host stand-in for the ADCS driver. Only the housekeeping record is needed
+ */
+
+#ifndef ADCS_H
+#define ADCS_H
+
+#include <stdint.h>
+
+typedef struct __attribute__((packed)) {
+    float Estimated_Angular_Rate_X;
+    float Estimated_Angular_Rate_Y;
+    float Estimated_Angular_Rate_Z;
+    float Estimated_Angular_Angle_X;
+    float Estimated_Angular_Angle_Y;
+    float Estimated_Angular_Angle_Z;
+    float Sat_Position_ECI_X;
+    float Sat_Position_ECI_Y;
+    float Sat_Position_ECI_Z;
+    float Sat_Velocity_ECI_X;
+    float Sat_Velocity_ECI_Y;
+    float Sat_Velocity_ECI_Z;
+    float Sat_Position_LLH_X;
+    float Sat_Position_LLH_Y;
+    float Sat_Position_LLH_Z;
+    float ECEF_Position_X;
+    float ECEF_Position_Y;
+    float ECEF_Position_Z;
+    float Coarse_Sun_Vector_X;
+    float Coarse_Sun_Vector_Y;
+    float Coarse_Sun_Vector_Z;
+    float Fine_Sun_Vector_X;
+    float Fine_Sun_Vector_Y;
+    float Fine_Sun_Vector_Z;
+    float Nadir_Vector_X;
+    float Nadir_Vector_Y;
+    float Nadir_Vector_Z;
+    float Wheel_Speed_X;
+    float Wheel_Speed_Y;
+    float Wheel_Speed_Z;
+    float Mag_Field_Vector_X;
+    float Mag_Field_Vector_Y;
+    float Mag_Field_Vector_Z;
+    float Comm_Status;
+    float Wheel1_Current;
+    float Wheel2_Current;
+    float Wheel3_Current;
+    float CubeSense1_Current;
+    float CubeSense2_Current;
+    float CubeControl_Current3v3;
+    float CubeControl_Current5v0;
+    float CubeStar_Current;
+    float CubeStar_Temp;
+    float Magnetorquer_Current;
+    float MCU_Temp;
+    float Rate_Sensor_Temp_X;
+    float Rate_Sensor_Temp_Y;
+    float Rate_Sensor_Temp_Z;
+} ADCS_HouseKeeping;
+
+#endif /* ADCS_H */
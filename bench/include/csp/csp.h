@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file csp.h
+ * @date 2022-03-14
+ *
+ * Host stand-in for libcsp 1.x, implemented by bench/csp_shim.c. Packets
+ * come from a fixed pool like the real buffer allocator, and every
+ * connection is a loopback: what is sent on it is read back from it.
+ */
+
+#ifndef CSP_H
+#define CSP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CSP_PADDING_BYTES 8
+#define CSP_BUFFER_DATA_SIZE 1024 // large enough for a whole housekeeping record
+#define CSP_BUFFER_COUNT 64
+#define CSP_CONN_QUEUE_LENGTH 16
+
+#define CSP_ANY 255
+#define CSP_MAX_TIMEOUT 0xffffffff
+#define CSP_BROADCAST_ADDR 31
+#define CSP_NO_VIA_ADDRESS 0xFF
+
+#define CSP_PRIO_CRITICAL 0
+#define CSP_PRIO_HIGH 1
+#define CSP_PRIO_NORM 2
+#define CSP_PRIO_LOW 3
+
+#define CSP_SO_NONE 0x0000
+#define CSP_SO_RDPREQ 0x0001
+#define CSP_O_NONE CSP_SO_NONE
+#define CSP_O_RDP CSP_SO_RDPREQ
+
+#define CSP_ERR_NONE 0
+#define CSP_ERR_NOMEM -1
+#define CSP_ERR_INVAL -2
+#define CSP_ERR_TIMEDOUT -3
+#define CSP_ERR_USED -4
+#define CSP_ERR_NOTSUP -5
+#define CSP_ERR_BUSY -6
+
+typedef union {
+    uint32_t ext;
+    struct __attribute__((__packed__)) {
+        unsigned int flags : 8;
+        unsigned int sport : 6;
+        unsigned int dport : 6;
+        unsigned int dst : 5;
+        unsigned int src : 5;
+        unsigned int pri : 2;
+    };
+} csp_id_t;
+
+typedef struct {
+    uint8_t padding[CSP_PADDING_BYTES];
+    uint16_t length;
+    csp_id_t id;
+    union {
+        uint8_t data[0];
+        uint16_t data16[0];
+        uint32_t data32[0];
+    };
+} __attribute__((__packed__)) csp_packet_t;
+
+typedef struct csp_conn_s csp_conn_t;
+typedef struct csp_socket_s csp_socket_t;
+
+void *csp_buffer_get(size_t size);
+void csp_buffer_free(void *packet);
+void *csp_buffer_clone(void *buffer);
+int csp_buffer_remaining(void);
+int csp_buffer_size(void);
+int csp_buffer_data_size(void);
+
+csp_socket_t *csp_socket(uint32_t opts);
+int csp_bind(csp_socket_t *socket, uint8_t port);
+int csp_listen(csp_socket_t *socket, size_t backlog);
+csp_conn_t *csp_accept(csp_socket_t *socket, uint32_t timeout);
+csp_conn_t *csp_connect(uint8_t prio, uint8_t dst, uint8_t dst_port, uint32_t timeout, uint32_t opts);
+int csp_close(csp_conn_t *conn);
+csp_packet_t *csp_read(csp_conn_t *conn, uint32_t timeout);
+int csp_send(csp_conn_t *conn, csp_packet_t *packet, uint32_t timeout);
+int csp_conn_dport(csp_conn_t *conn);
+int csp_conn_sport(csp_conn_t *conn);
+int csp_conn_dst(csp_conn_t *conn);
+int csp_conn_src(csp_conn_t *conn);
+void csp_service_handler(csp_conn_t *conn, csp_packet_t *packet);
+
+#define csp_log_error(format, ...)
+#define csp_log_warn(format, ...)
+#define csp_log_info(format, ...)
+
+#endif /* CSP_H */
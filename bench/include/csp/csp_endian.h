@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file csp_endian.h
+ * @date 2022-03-14
+ */
+
+#ifndef CSP_ENDIAN_H
+#define CSP_ENDIAN_H
+
+#include <stdint.h>
+
+uint16_t csp_hton16(uint16_t h16);
+uint16_t csp_ntoh16(uint16_t n16);
+uint32_t csp_hton32(uint32_t h32);
+uint32_t csp_ntoh32(uint32_t n32);
+uint64_t csp_hton64(uint64_t h64);
+uint64_t csp_ntoh64(uint64_t n64);
+uint16_t csp_htobe16(uint16_t h16);
+uint16_t csp_htole16(uint16_t h16);
+uint16_t csp_betoh16(uint16_t be16);
+uint16_t csp_letoh16(uint16_t le16);
+uint32_t csp_htobe32(uint32_t h32);
+uint32_t csp_htole32(uint32_t h32);
+uint32_t csp_betoh32(uint32_t be32);
+uint32_t csp_letoh32(uint32_t le32);
+uint64_t csp_htobe64(uint64_t h64);
+uint64_t csp_htole64(uint64_t h64);
+uint64_t csp_betoh64(uint64_t be64);
+uint64_t csp_letoh64(uint64_t le64);
+float csp_htonflt(float f);
+float csp_ntohflt(float f);
+double csp_htondbl(double d);
+double csp_ntohdbl(double d);
+
+#endif /* CSP_ENDIAN_H */
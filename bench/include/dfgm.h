@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file dfgm.h
+ * @date 2022-03-14
+ */
+
+#ifndef DFGM_H
+#define DFGM_H
+
+typedef struct __attribute__((packed)) {
+    float coreVoltage;
+    float sensorTemp;
+    float refTemp;
+    float boardTemp;
+    float posRailVoltage;
+    float inputVoltage;
+    float refVoltage;
+    float inputCurrent;
+    float reserved1;
+    float reserved2;
+    float reserved3;
+    float reserved4;
+} DFGM_Housekeeping;
+
+#endif /* DFGM_H */
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file eps.h
+ * @date 2022-03-14
+ *
+ * Host stand-in for the EPS driver. Only the telemetry records are needed
+ */
+
+#ifndef EPS_H
+#define EPS_H
+
+#include <stdint.h>
+
+typedef struct __attribute__((packed)) {
+    uint8_t cmd;
+    int8_t status;
+    double timestampInS;
+    uint32_t uptimeInS;
+    uint32_t bootCnt;
+    uint32_t wdt_gs_time_left;
+    uint32_t wdt_gs_counter;
+    uint16_t mpptConverterVoltage[4];
+    uint16_t curSolarPanels[8];
+    uint16_t vBatt;
+    uint16_t curSolar;
+    uint16_t curBattIn;
+    uint16_t curBattOut;
+    uint16_t curOutput[18];
+    uint16_t AOcurOutput[2];
+    uint16_t OutputConverterVoltage[8];
+    uint8_t outputConverterState;
+    uint32_t outputStatus;
+    uint32_t outputFaultStatus;
+    uint16_t protectedOutputAccessCnt;
+    uint16_t outputOnDelta[18];
+    uint16_t outputOffDelta[18];
+    uint8_t outputFaultCnt[18];
+    int8_t temp[14];
+    uint8_t battMode;
+    uint8_t mpptMode;
+    uint8_t batHeaterMode;
+    uint8_t batHeaterState;
+    uint16_t PingWdt_toggles;
+    uint8_t PingWdt_turnOffs;
+} eps_instantaneous_telemetry_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t cmd;
+    int8_t status;
+    double timestampInS;
+    uint32_t last_reset_reason_reg;
+    uint32_t bootCnt;
+    uint8_t FallbackConfigUsed;
+    uint8_t rtcInit;
+    uint8_t rtcClkSourceLSE;
+    uint8_t flashAppInit;
+    int8_t Fram4kPartitionInit;
+    int8_t Fram520kPartitionInit;
+    int8_t intFlashPartitionInit;
+    int8_t fsInit;
+    int8_t ftInit;
+    int8_t supervisorInit;
+    int8_t uart1App;
+    int8_t uart2App;
+    int8_t tmp107Init;
+} eps_startup_telemetry_t;
+
+void prv_instantaneous_telemetry_letoh(eps_instantaneous_telemetry_t *telembuf);
+
+#endif /* EPS_H */
@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file housekeeping_athena.h
+ * @date 2022-03-14
+ */
+
+#ifndef HOUSEKEEPING_ATHENA_H
+#define HOUSEKEEPING_ATHENA_H
+
+#include <stdint.h>
+
+#define ATHENA_TEMP_ARRAY_SIZE 2
+
+typedef struct __attribute__((packed)) {
+    long temparray[ATHENA_TEMP_ARRAY_SIZE];
+    uint16_t boot_cnt;
+    uint8_t OBC_mode;
+    uint16_t OBC_uptime;
+    uint8_t solar_panel_supply_curr;
+    uint8_t OBC_software_ver;
+    uint16_t cmds_received;
+    uint16_t pckts_uncovered_by_FEC;
+} athena_housekeeping;
+
+int Athena_hk_convert_endianness(athena_housekeeping *athena_hk);
+
+#endif /* HOUSEKEEPING_ATHENA_H */
@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file housekeeping_charon.h
+ * @date 2022-03-14
+ */
+
+#ifndef HOUSEKEEPING_CHARON_H
+#define HOUSEKEEPING_CHARON_H
+
+#include <stdint.h>
+
+#define CHARON_TEMP_ARRAY_SIZE 8
+
+typedef struct __attribute__((packed)) {
+    uint8_t crc;
+    int8_t temparray[CHARON_TEMP_ARRAY_SIZE];
+} charon_housekeeping;
+
+#endif /* HOUSEKEEPING_CHARON_H */
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file hyperion.h
+ * @date 2022-03-14
+ */
+
+#ifndef HYPERION_H
+#define HYPERION_H
+
+typedef struct __attribute__((packed)) {
+    float Nadir_Temp1;
+    float Port_Temp1;
+    float Port_Temp2;
+    float Port_Temp3;
+    float Port_Temp_Adc;
+    float Port_Dep_Temp1;
+    float Port_Dep_Temp2;
+    float Port_Dep_Temp3;
+    float Port_Dep_Temp_Adc;
+    float Star_Temp1;
+    float Star_Temp2;
+    float Star_Temp3;
+    float Star_Temp_Adc;
+    float Star_Dep_Temp1;
+    float Star_Dep_Temp2;
+    float Star_Dep_Temp3;
+    float Star_Dep_Temp_Adc;
+    float Zenith_Temp1;
+    float Zenith_Temp2;
+    float Zenith_Temp3;
+    float Zenith_Temp_Adc;
+    float Nadir_Pd1;
+    float Port_Pd1;
+    float Port_Pd2;
+    float Port_Pd3;
+    float Port_Dep_Pd1;
+    float Port_Dep_Pd2;
+    float Port_Dep_Pd3;
+    float Star_Pd1;
+    float Star_Pd2;
+    float Star_Pd3;
+    float Star_Dep_Pd1;
+    float Star_Dep_Pd2;
+    float Star_Dep_Pd3;
+    float Zenith_Pd1;
+    float Zenith_Pd2;
+    float Zenith_Pd3;
+    float Port_Voltage;
+    float Port_Dep_Voltage;
+    float Star_Voltage;
+    float Star_Dep_Voltage;
+    float Zenith_Voltage;
+    float Port_Current;
+    float Port_Dep_Current;
+    float Star_Current;
+    float Star_Dep_Current;
+    float Zenith_Current;
+} Hyperion_HouseKeeping;
+
+#endif /* HYPERION_H */
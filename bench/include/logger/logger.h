@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file logger.h
+ * @date 2022-03-14
+ */
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdint.h>
+
+int8_t set_logger_file_size(uint32_t file_size);
+int8_t get_logger_file_size(uint32_t *file_size);
+char *get_logger_file(void);
+char *get_logger_old_file(void);
+
+#endif /* LOGGER_H */
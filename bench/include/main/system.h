@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file system.h
+ * @date 2022-03-14
+ *
+ * Host stand-in for the OBC's system definitions
+ */
+
+#ifndef SYSTEM_H
+#define SYSTEM_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "os_task.h"
+
+#define SYSTEM_APP_ID _OBC_APP_ID_
+
+#define NORMAL_SERVICE_PRIO (tskIDLE_PRIORITY + 1)
+#define STATE_TASK_PRIO (tskIDLE_PRIORITY + 2)
+
+#define ONE_SECOND pdMS_TO_TICKS(1000)
+#define DELAY_WAIT_INTERVAL ONE_SECOND
+
+typedef enum {
+    SATR_PKT_ILLEGAL_APPID = 0,
+    SATR_PKT_ILLEGAL_SUBSERVICE,
+    SATR_OK,
+    SATR_ERROR,
+    SATR_RETURN_FROM_TASK,
+    SATR_BUFFER_ERR,
+    SATR_LAST
+} SAT_returnState;
+
+#endif /* SYSTEM_H */
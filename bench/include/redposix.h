@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file redposix.h
+ * @date 2022-03-14
+ *
+ * Host stand-in for the Reliance Edge POSIX-like API, implemented by
+ * bench/redposix_ram.c as a single RAM volume. Flag and error values match
+ * Reliance Edge.
+ */
+
+#ifndef REDPOSIX_H
+#define REDPOSIX_H
+
+#include <stdint.h>
+
+#define RED_O_RDONLY 0x00000001U
+#define RED_O_WRONLY 0x00000002U
+#define RED_O_RDWR 0x00000004U
+#define RED_O_APPEND 0x00000008U
+#define RED_O_CREAT 0x00000010U
+#define RED_O_EXCL 0x00000020U
+#define RED_O_TRUNC 0x00000040U
+
+#define RED_EPERM 1
+#define RED_ENOENT 2
+#define RED_EIO 5
+#define RED_EBADF 9
+#define RED_ENOMEM 12
+#define RED_EBUSY 16
+#define RED_EEXIST 17
+#define RED_EINVAL 22
+#define RED_EMFILE 24
+#define RED_EFBIG 27
+#define RED_ENOSPC 28
+#define RED_ENAMETOOLONG 36
+
+typedef enum { RED_SEEK_SET = 0, RED_SEEK_CUR = 1, RED_SEEK_END = 2 } REDWHENCE;
+
+typedef struct {
+    uint32_t st_dev;
+    uint32_t st_ino;
+    uint16_t st_mode;
+    uint16_t st_nlink;
+    uint64_t st_size;
+    uint32_t st_blocks;
+} REDSTAT;
+
+int32_t *red_errnoptr(void);
+#define red_errno (*red_errnoptr())
+
+int32_t red_init(void);
+int32_t red_format(const char *pszVolume);
+int32_t red_mount(const char *pszVolume);
+int32_t red_umount(const char *pszVolume);
+int32_t red_open(const char *pszPath, uint32_t ulOpenMode);
+int32_t red_close(int32_t iFildes);
+int32_t red_unlink(const char *pszPath);
+int32_t red_rename(const char *pszOldPath, const char *pszNewPath);
+int32_t red_read(int32_t iFildes, void *pBuffer, uint32_t ulLength);
+int32_t red_write(int32_t iFildes, const void *pBuffer, uint32_t ulLength);
+int64_t red_lseek(int32_t iFildes, int64_t llOffset, REDWHENCE whence);
+int32_t red_fstat(int32_t iFildes, REDSTAT *pStat);
+int32_t red_ftruncate(int32_t iFildes, uint64_t ullSize);
+int32_t red_fsync(int32_t iFildes);
+int32_t red_transact(const char *pszVolume);
+
+#endif /* REDPOSIX_H */
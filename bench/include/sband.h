@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file sband.h
+ * @date 2022-03-14
+ */
+
+#ifndef SBAND_H
+#define SBAND_H
+
+#include <stdint.h>
+
+typedef struct __attribute__((packed)) {
+    float Output_Power;
+    float PA_Temp;
+    float Top_Temp;
+    float Bottom_Temp;
+    float Bat_Current;
+    float Bat_Voltage;
+    float PA_Current;
+    float PA_Voltage;
+} Sband_Housekeeping;
+
+int HAL_S_hk_convert_endianness(Sband_Housekeeping *sband_hk);
+
+#endif /* SBAND_H */
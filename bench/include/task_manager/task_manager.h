@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file task_manager.h
+ * @date 2022-03-14
+ */
+
+#ifndef TASK_MANAGER_H
+#define TASK_MANAGER_H
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "os_task.h"
+
+typedef struct {
+    uint32_t (*getCounterFunction)(void);
+} taskFunctions;
+
+void ex2_register(TaskHandle_t task, taskFunctions funcs);
+
+#endif /* TASK_MANAGER_H */
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file uhf.h
+ * @date 2022-03-14
+ */
+
+#ifndef UHF_H
+#define UHF_H
+
+#include <stdint.h>
+
+#define SCW_LEN 12
+
+typedef struct __attribute__((packed)) {
+    uint32_t freq;
+    uint32_t pipe_t;
+    uint32_t beacon_t;
+    uint32_t audio_t;
+    uint32_t uptime;
+    uint32_t pckts_out;
+    uint32_t pckts_in;
+    uint32_t pckts_in_crc16;
+    float temperature;
+    uint8_t scw[SCW_LEN];
+} UHF_housekeeping;
+
+int UHF_convert_endianness(UHF_housekeeping *uhf_hk);
+
+#endif /* UHF_H */
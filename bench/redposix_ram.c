@@ -0,0 +1,332 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file redposix_ram.c
+ * @date 2022-03-14
+ *
+ * Reliance Edge's POSIX-like API over files kept in RAM. There are no
+ * directories: a path, volume prefix included, is just the name of a file.
+ * Errors are reported through red_errno with the codes Reliance Edge uses,
+ * so the services take the same error paths they would on the OBC.
+ */
+#define _GNU_SOURCE
+
+#include <redposix.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+#define RAM_FS_MAX_FILES 32
+#define RAM_FS_MAX_HANDLES 16
+#define RAM_FS_PATH_MAX 64
+#define RAM_FS_MAX_FILE_SIZE (64UL * 1024 * 1024)
+
+typedef struct {
+    char path[RAM_FS_PATH_MAX];
+    uint8_t *data;
+    uint64_t size;
+    uint64_t capacity;
+    uint32_t open_count;
+    uint8_t used;
+} ram_file_t;
+
+typedef struct {
+    ram_file_t *file;
+    uint64_t offset;
+    uint32_t mode;
+} ram_handle_t;
+
+static ram_file_t files[RAM_FS_MAX_FILES];
+static ram_handle_t handles[RAM_FS_MAX_HANDLES];
+static int32_t ram_errno = 0;
+
+int32_t *red_errnoptr(void) { return &ram_errno; }
+
+static int32_t prv_fail(int32_t error) {
+    ram_errno = error;
+    return -1;
+}
+
+static ram_file_t *prv_find(const char *path) {
+    int i;
+    for (i = 0; i < RAM_FS_MAX_FILES; i++) {
+        if (files[i].used && strcmp(files[i].path, path) == 0) {
+            return &files[i];
+        }
+    }
+    return NULL;
+}
+
+static ram_handle_t *prv_handle(int32_t fildes) {
+    if (fildes < 0 || fildes >= RAM_FS_MAX_HANDLES || handles[fildes].file == NULL) {
+        return NULL;
+    }
+    return &handles[fildes];
+}
+
+/**
+ * @brief
+ *      Make room for a file to hold size bytes. New space reads as zeros
+ */
+static int32_t prv_reserve(ram_file_t *file, uint64_t size) {
+    uint64_t capacity = file->capacity ? file->capacity : 512;
+    uint8_t *data;
+
+    if (size <= file->capacity) {
+        return 0;
+    }
+    if (size > RAM_FS_MAX_FILE_SIZE) {
+        return prv_fail(RED_EFBIG);
+    }
+    while (capacity < size) {
+        capacity *= 2;
+    }
+    data = realloc(file->data, capacity);
+    if (data == NULL) {
+        return prv_fail(RED_ENOSPC);
+    }
+    memset(&data[file->capacity], 0, capacity - file->capacity);
+    file->data = data;
+    file->capacity = capacity;
+    return 0;
+}
+
+int32_t red_init(void) { return 0; }
+
+int32_t red_format(const char *pszVolume) {
+    bench_fs_reset();
+    return 0;
+}
+
+int32_t red_mount(const char *pszVolume) { return 0; }
+
+int32_t red_umount(const char *pszVolume) { return 0; }
+
+int32_t red_transact(const char *pszVolume) { return 0; }
+
+int32_t red_open(const char *pszPath, uint32_t ulOpenMode) {
+    uint32_t access = ulOpenMode & (RED_O_RDONLY | RED_O_WRONLY | RED_O_RDWR);
+    ram_file_t *file;
+    int32_t fildes;
+    int i;
+
+    if (pszPath == NULL || (access != RED_O_RDONLY && access != RED_O_WRONLY && access != RED_O_RDWR)) {
+        return prv_fail(RED_EINVAL);
+    }
+    if (strlen(pszPath) >= RAM_FS_PATH_MAX) {
+        return prv_fail(RED_ENAMETOOLONG);
+    }
+    for (fildes = 0; fildes < RAM_FS_MAX_HANDLES; fildes++) {
+        if (handles[fildes].file == NULL) {
+            break;
+        }
+    }
+    if (fildes == RAM_FS_MAX_HANDLES) {
+        return prv_fail(RED_EMFILE);
+    }
+
+    file = prv_find(pszPath);
+    if (file != NULL && (ulOpenMode & RED_O_CREAT) && (ulOpenMode & RED_O_EXCL)) {
+        return prv_fail(RED_EEXIST);
+    }
+    if (file == NULL) {
+        if (!(ulOpenMode & RED_O_CREAT)) {
+            return prv_fail(RED_ENOENT);
+        }
+        for (i = 0; i < RAM_FS_MAX_FILES && files[i].used; i++) {
+        }
+        if (i == RAM_FS_MAX_FILES) {
+            return prv_fail(RED_ENOSPC);
+        }
+        file = &files[i];
+        memset(file, 0, sizeof(*file));
+        strcpy(file->path, pszPath);
+        file->used = 1;
+    }
+    if ((ulOpenMode & RED_O_TRUNC) && access != RED_O_RDONLY && file->size != 0) {
+        memset(file->data, 0, file->size); // a later write past the end must not expose old data
+        file->size = 0;
+    }
+
+    file->open_count++;
+    handles[fildes].file = file;
+    handles[fildes].offset = 0;
+    handles[fildes].mode = ulOpenMode;
+    return fildes;
+}
+
+int32_t red_close(int32_t iFildes) {
+    ram_handle_t *handle = prv_handle(iFildes);
+    if (handle == NULL) {
+        return prv_fail(RED_EBADF);
+    }
+    handle->file->open_count--;
+    handle->file = NULL;
+    return 0;
+}
+
+/* Open handles keep working on an unlinked file in Reliance Edge, which isn't needed here */
+int32_t red_unlink(const char *pszPath) {
+    ram_file_t *file = prv_find(pszPath);
+    if (file == NULL) {
+        return prv_fail(RED_ENOENT);
+    }
+    if (file->open_count != 0) {
+        return prv_fail(RED_EBUSY);
+    }
+    free(file->data);
+    memset(file, 0, sizeof(*file));
+    return 0;
+}
+
+int32_t red_rename(const char *pszOldPath, const char *pszNewPath) {
+    ram_file_t *file = prv_find(pszOldPath);
+    ram_file_t *target = prv_find(pszNewPath);
+
+    if (file == NULL) {
+        return prv_fail(RED_ENOENT);
+    }
+    if (strlen(pszNewPath) >= RAM_FS_PATH_MAX) {
+        return prv_fail(RED_ENAMETOOLONG);
+    }
+    if (target == file) {
+        return 0;
+    }
+    if (target != NULL) {
+        if (target->open_count != 0) {
+            return prv_fail(RED_EBUSY);
+        }
+        free(target->data);
+        memset(target, 0, sizeof(*target));
+    }
+    strcpy(file->path, pszNewPath);
+    return 0;
+}
+
+int32_t red_read(int32_t iFildes, void *pBuffer, uint32_t ulLength) {
+    ram_handle_t *handle = prv_handle(iFildes);
+    uint64_t available;
+
+    if (handle == NULL || (handle->mode & RED_O_WRONLY)) {
+        return prv_fail(RED_EBADF);
+    }
+    if (pBuffer == NULL) {
+        return prv_fail(RED_EINVAL);
+    }
+    available = (handle->offset < handle->file->size) ? handle->file->size - handle->offset : 0;
+    if (ulLength > available) {
+        ulLength = (uint32_t)available;
+    }
+    memcpy(pBuffer, &handle->file->data[handle->offset], ulLength);
+    handle->offset += ulLength;
+    return (int32_t)ulLength;
+}
+
+int32_t red_write(int32_t iFildes, const void *pBuffer, uint32_t ulLength) {
+    ram_handle_t *handle = prv_handle(iFildes);
+    ram_file_t *file;
+
+    if (handle == NULL || (handle->mode & RED_O_RDONLY)) {
+        return prv_fail(RED_EBADF);
+    }
+    if (pBuffer == NULL) {
+        return prv_fail(RED_EINVAL);
+    }
+    file = handle->file;
+    if (handle->mode & RED_O_APPEND) {
+        handle->offset = file->size;
+    }
+    if (prv_reserve(file, handle->offset + ulLength) != 0) {
+        return -1;
+    }
+    memcpy(&file->data[handle->offset], pBuffer, ulLength);
+    handle->offset += ulLength;
+    if (handle->offset > file->size) {
+        file->size = handle->offset;
+    }
+    return (int32_t)ulLength;
+}
+
+int64_t red_lseek(int32_t iFildes, int64_t llOffset, REDWHENCE whence) {
+    ram_handle_t *handle = prv_handle(iFildes);
+    int64_t offset;
+
+    if (handle == NULL) {
+        return prv_fail(RED_EBADF);
+    }
+    switch (whence) {
+    case RED_SEEK_SET:
+        offset = llOffset;
+        break;
+    case RED_SEEK_CUR:
+        offset = (int64_t)handle->offset + llOffset;
+        break;
+    case RED_SEEK_END:
+        offset = (int64_t)handle->file->size + llOffset;
+        break;
+    default:
+        return prv_fail(RED_EINVAL);
+    }
+    if (offset < 0) {
+        return prv_fail(RED_EINVAL);
+    }
+    handle->offset = (uint64_t)offset;
+    return offset;
+}
+
+int32_t red_fstat(int32_t iFildes, REDSTAT *pStat) {
+    ram_handle_t *handle = prv_handle(iFildes);
+    if (handle == NULL) {
+        return prv_fail(RED_EBADF);
+    }
+    memset(pStat, 0, sizeof(*pStat));
+    pStat->st_ino = (uint32_t)(handle->file - files) + 2;
+    pStat->st_nlink = 1;
+    pStat->st_size = handle->file->size;
+    pStat->st_blocks = (uint32_t)((handle->file->size + 511) / 512);
+    return 0;
+}
+
+int32_t red_ftruncate(int32_t iFildes, uint64_t ullSize) {
+    ram_handle_t *handle = prv_handle(iFildes);
+    ram_file_t *file;
+
+    if (handle == NULL || (handle->mode & RED_O_RDONLY)) {
+        return prv_fail(RED_EBADF);
+    }
+    file = handle->file;
+    if (ullSize > file->size) {
+        if (prv_reserve(file, ullSize) != 0) {
+            return -1;
+        }
+    } else if (file->data != NULL) {
+        memset(&file->data[ullSize], 0, file->size - ullSize);
+    }
+    file->size = ullSize;
+    return 0;
+}
+
+int32_t red_fsync(int32_t iFildes) { return (prv_handle(iFildes) == NULL) ? prv_fail(RED_EBADF) : 0; }
+
+void bench_fs_reset(void) {
+    int i;
+    for (i = 0; i < RAM_FS_MAX_HANDLES; i++) {
+        handles[i].file = NULL;
+    }
+    for (i = 0; i < RAM_FS_MAX_FILES; i++) {
+        free(files[i].data);
+        memset(&files[i], 0, sizeof(files[i]));
+    }
+}
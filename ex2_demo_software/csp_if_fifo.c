@@ -0,0 +1,430 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file csp_if_fifo.c
+ * @date 2022-03-14
+ *
+ * CSP interface over a pair of named pipes, used to link the simulated
+ * satellite to the ground. Reception runs in a pthread that blocks in
+ * poll(), as libcsp's zmqhub driver receives, so a packet is handed to the
+ * router as soon as it arrives. The simulator and the ground tools both link
+ * the posix build of libcsp, whose buffer and queue calls may be made from
+ * any pthread.
+ */
+#define _GNU_SOURCE
+
+#include "csp_if_fifo.h"
+
+#include <csp/csp_interface.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Room for several full frames so a burst can be taken in one read */
+#define FIFO_RX_BUF_SIZE (8 * (CSP_FIFO_HEADER_SIZE + CSP_FIFO_MTU))
+
+static int tx_channel = -1;
+static int rx_channel = -1;
+static pthread_t rx_thread;
+static pthread_t tx_thread;
+
+/* Packets waiting for the tx thread, in order */
+static csp_packet_t *tx_batch[CSP_FIFO_TX_BATCH];
+static int tx_batch_count = 0;
+static struct timespec tx_batch_start; // when the first packet of the batch was queued
+static pthread_mutex_t tx_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tx_ready;
+static pthread_cond_t tx_space;
+
+static csp_fifo_tx_stats_t tx_stats;
+static pthread_mutex_t tx_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static csp_fifo_rx_stats_t rx_stats;
+static pthread_mutex_t rx_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int csp_fifo_tx(const csp_route_t *ifroute, csp_packet_t *packet);
+
+static csp_iface_t csp_if_fifo = {
+    .name = "fifo",
+    .nexthop = csp_fifo_tx,
+    .mtu = CSP_FIFO_MTU,
+};
+
+static uint64_t prv_elapsed_ns(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec - start->tv_sec) * 1000000000ULL + (uint64_t)now.tv_nsec -
+           (uint64_t)start->tv_nsec;
+}
+
+/**
+ * @brief
+ *      writev() every byte of iov, continuing after short writes
+ * @return int
+ *      0 on success, -1 if the write failed
+ */
+static int prv_writev_all(int fd, struct iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t written = writev(fd, iov, iovcnt);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        while (iovcnt > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief
+ *      Write a batch of packets with one writev() and free them
+ * @param packets
+ *      Packets in the order they were sent
+ * @param count
+ *      Number of packets
+ * @param start
+ *      When the first packet was queued
+ */
+static void prv_flush(csp_packet_t **packets, int count, const struct timespec *start) {
+    struct iovec iov[CSP_FIFO_TX_BATCH];
+    struct timespec write_start;
+    uint32_t bytes = 0;
+    int failed;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        iov[i].iov_base = &packets[i]->length;
+        iov[i].iov_len = packets[i]->length + CSP_FIFO_HEADER_SIZE;
+        bytes += iov[i].iov_len;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &write_start);
+    failed = prv_writev_all(tx_channel, iov, count);
+    uint64_t write_ns = prv_elapsed_ns(&write_start);
+    uint64_t latency_ns = prv_elapsed_ns(start);
+    if (failed) {
+        printf("Failed to write frame\r\n");
+        csp_if_fifo.tx_error += count;
+    }
+
+    for (i = 0; i < count; i++) {
+        csp_buffer_free(packets[i]);
+    }
+
+    pthread_mutex_lock(&tx_stats_lock);
+    if (failed) {
+        tx_stats.write_errors += count;
+    } else {
+        tx_stats.packets += count;
+        tx_stats.bytes += bytes;
+    }
+    tx_stats.flushes++;
+    tx_stats.flush_latency_total_ns += latency_ns;
+    if (latency_ns > tx_stats.flush_latency_max_ns) {
+        tx_stats.flush_latency_max_ns = latency_ns;
+    }
+    tx_stats.write_total_ns += write_ns;
+    tx_stats.batch_hist[count]++;
+    pthread_mutex_unlock(&tx_stats_lock);
+}
+
+static int csp_fifo_tx(const csp_route_t *ifroute, csp_packet_t *packet) {
+    if (CSP_FIFO_TX_WINDOW_US == 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        prv_flush(&packet, 1, &now);
+        return CSP_ERR_NONE;
+    }
+
+    pthread_mutex_lock(&tx_lock);
+    while (tx_batch_count == CSP_FIFO_TX_BATCH) {
+        pthread_cond_wait(&tx_space, &tx_lock);
+    }
+    if (tx_batch_count == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &tx_batch_start);
+    }
+    tx_batch[tx_batch_count++] = packet;
+    if (tx_batch_count == 1 || tx_batch_count == CSP_FIFO_TX_BATCH) {
+        pthread_cond_signal(&tx_ready);
+    }
+    pthread_mutex_unlock(&tx_lock);
+    return CSP_ERR_NONE;
+}
+
+/**
+ * @brief
+ *      Wait for a batch to fill or its window to close, then write it
+ */
+static void *prv_fifo_tx_thread(void *param) {
+    csp_packet_t *packets[CSP_FIFO_TX_BATCH];
+    struct timespec start;
+    struct timespec deadline;
+    int count;
+
+    for (;;) {
+        pthread_mutex_lock(&tx_lock);
+        while (tx_batch_count == 0) {
+            pthread_cond_wait(&tx_ready, &tx_lock);
+        }
+
+        deadline = tx_batch_start;
+        deadline.tv_nsec += (long)CSP_FIFO_TX_WINDOW_US * 1000;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        while (tx_batch_count < CSP_FIFO_TX_BATCH) {
+            if (pthread_cond_timedwait(&tx_ready, &tx_lock, &deadline) == ETIMEDOUT) {
+                break;
+            }
+        }
+
+        count = tx_batch_count;
+        start = tx_batch_start;
+        memcpy(packets, tx_batch, count * sizeof(csp_packet_t *));
+        tx_batch_count = 0;
+        pthread_cond_broadcast(&tx_space);
+        pthread_mutex_unlock(&tx_lock);
+
+        prv_flush(packets, count, &start);
+    }
+    return NULL;
+}
+
+static void prv_record_latency(uint64_t latency_ns, uint16_t length) {
+    uint64_t us = latency_ns / 1000;
+    uint8_t bucket = 0;
+    while (us != 0 && bucket < CSP_FIFO_LATENCY_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+
+    pthread_mutex_lock(&rx_stats_lock);
+    rx_stats.packets++;
+    rx_stats.bytes += length;
+    rx_stats.latency_total_ns += latency_ns;
+    if (latency_ns > rx_stats.latency_max_ns) {
+        rx_stats.latency_max_ns = latency_ns;
+    }
+    rx_stats.latency_hist[bucket]++;
+    pthread_mutex_unlock(&rx_stats_lock);
+}
+
+/**
+ * @brief
+ *      Hand every complete frame in the buffer to CSP
+ * @param buf
+ *      Bytes read from the FIFO, starting on a frame boundary
+ * @param len
+ *      Number of bytes in buf
+ * @param arrival
+ *      When poll() reported the data, used for the ingress latency
+ * @return size_t
+ *      Number of bytes consumed. The rest is the start of an incomplete frame
+ */
+static size_t prv_parse_frames(const uint8_t *buf, size_t len, const struct timespec *arrival) {
+    size_t used = 0;
+
+    while (len - used >= CSP_FIFO_HEADER_SIZE) {
+        uint16_t length;
+        memcpy(&length, &buf[used], sizeof(length));
+
+        if (length > CSP_FIFO_MTU) {
+            // no way to find the next frame boundary, drop what we have
+            pthread_mutex_lock(&rx_stats_lock);
+            rx_stats.bad_frames++;
+            pthread_mutex_unlock(&rx_stats_lock);
+            csp_if_fifo.frame++;
+            return len;
+        }
+        if (len - used < CSP_FIFO_HEADER_SIZE + length) {
+            break;
+        }
+
+        csp_packet_t *packet = csp_buffer_get(length);
+        if (packet == NULL) {
+            pthread_mutex_lock(&rx_stats_lock);
+            rx_stats.no_buffer++;
+            pthread_mutex_unlock(&rx_stats_lock);
+            csp_if_fifo.rx_error++;
+        } else {
+            memcpy(&packet->length, &buf[used], CSP_FIFO_HEADER_SIZE + length);
+            csp_qfifo_write(packet, &csp_if_fifo, NULL);
+            prv_record_latency(prv_elapsed_ns(arrival), length);
+        }
+        used += CSP_FIFO_HEADER_SIZE + length;
+    }
+    return used;
+}
+
+/* Total of packets received and sent, to tell whether there are new stats to print */
+static uint32_t prv_packet_total(void) {
+    csp_fifo_rx_stats_t rx;
+    csp_fifo_tx_stats_t tx;
+
+    csp_fifo_get_rx_stats(&rx);
+    csp_fifo_get_tx_stats(&tx);
+    return rx.packets + tx.packets;
+}
+
+static void *prv_fifo_rx_thread(void *param) {
+    static uint8_t buf[FIFO_RX_BUF_SIZE];
+    size_t len = 0;
+    struct pollfd pfd = {.fd = rx_channel, .events = POLLIN};
+    struct timespec arrival;
+    int timeout = (CSP_FIFO_STATS_INTERVAL > 0) ? CSP_FIFO_STATS_INTERVAL * 1000 : -1;
+    uint32_t reported = 0;
+    uint32_t total;
+
+    for (;;) {
+        int ready = poll(&pfd, 1, timeout);
+        if (ready < 0) {
+            if (errno != EINTR) {
+                perror("fifo rx poll");
+            }
+            continue;
+        }
+        if (ready == 0) {
+            total = prv_packet_total();
+            if (total != reported) {
+                reported = total;
+                csp_fifo_print_stats();
+            }
+            continue;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &arrival);
+
+        ssize_t got = read(rx_channel, &buf[len], sizeof(buf) - len);
+        if (got <= 0) {
+            continue;
+        }
+        pthread_mutex_lock(&rx_stats_lock);
+        rx_stats.reads++;
+        pthread_mutex_unlock(&rx_stats_lock);
+
+        len += got;
+        size_t used = prv_parse_frames(buf, len, &arrival);
+        memmove(buf, &buf[used], len - used);
+        len -= used;
+    }
+    return NULL;
+}
+
+/**
+ * @brief
+ *      Open the FIFO pair and start receiving
+ * @param tx_channel_name
+ *      FIFO the satellite writes to
+ * @param rx_channel_name
+ *      FIFO the satellite reads from
+ * @param iface
+ *      Set to the interface to route through
+ * @return int
+ *      CSP_ERR_NONE on success
+ */
+int csp_fifo_init(const char *tx_channel_name, const char *rx_channel_name, csp_iface_t **iface) {
+    tx_channel = open(tx_channel_name, O_RDWR);
+    if (tx_channel < 0) {
+        printf("Failed to open TX channel\r\n");
+        return CSP_ERR_DRIVER;
+    }
+
+    rx_channel = open(rx_channel_name, O_RDWR);
+    if (rx_channel < 0) {
+        printf("Failed to open RX channel\r\n");
+        return CSP_ERR_DRIVER;
+    }
+
+    // batch deadlines are taken from CLOCK_MONOTONIC
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&tx_ready, &cond_attr);
+    pthread_cond_init(&tx_space, NULL);
+    pthread_condattr_destroy(&cond_attr);
+
+    if (CSP_FIFO_TX_WINDOW_US != 0 && pthread_create(&tx_thread, NULL, prv_fifo_tx_thread, NULL) != 0) {
+        printf("Failed to start FIFO TX thread\r\n");
+        return CSP_ERR_NOMEM;
+    }
+
+    if (pthread_create(&rx_thread, NULL, prv_fifo_rx_thread, NULL) != 0) {
+        printf("Failed to start FIFO RX thread\r\n");
+        return CSP_ERR_NOMEM;
+    }
+
+    csp_iflist_add(&csp_if_fifo);
+    *iface = &csp_if_fifo;
+    return CSP_ERR_NONE;
+}
+
+void csp_fifo_get_rx_stats(csp_fifo_rx_stats_t *stats) {
+    pthread_mutex_lock(&rx_stats_lock);
+    *stats = rx_stats;
+    pthread_mutex_unlock(&rx_stats_lock);
+}
+
+void csp_fifo_get_tx_stats(csp_fifo_tx_stats_t *stats) {
+    pthread_mutex_lock(&tx_stats_lock);
+    *stats = tx_stats;
+    pthread_mutex_unlock(&tx_stats_lock);
+}
+
+void csp_fifo_print_stats(void) {
+    csp_fifo_rx_stats_t stats;
+    csp_fifo_tx_stats_t tx;
+    int i;
+
+    csp_fifo_get_rx_stats(&stats);
+    printf("FIFO RX: %u packets, %u bytes in %u reads, %u bad frames, %u without buffer\r\n", stats.packets,
+           stats.bytes, stats.reads, stats.bad_frames, stats.no_buffer);
+    if (stats.packets != 0) {
+        printf("FIFO RX latency: avg %llu ns, max %llu ns\r\n",
+               (unsigned long long)(stats.latency_total_ns / stats.packets),
+               (unsigned long long)stats.latency_max_ns);
+    }
+    for (i = 0; i < CSP_FIFO_LATENCY_BUCKETS; i++) {
+        if (stats.latency_hist[i] != 0) {
+            printf("  < %6lu us: %u\r\n", 1UL << i, stats.latency_hist[i]);
+        }
+    }
+
+    csp_fifo_get_tx_stats(&tx);
+    printf("FIFO TX: %u packets, %u bytes in %u writes, %u lost\r\n", tx.packets, tx.bytes, tx.flushes,
+           tx.write_errors);
+    if (tx.flushes != 0) {
+        printf("FIFO TX flush latency: avg %llu ns, max %llu ns, avg write %llu ns\r\n",
+               (unsigned long long)(tx.flush_latency_total_ns / tx.flushes),
+               (unsigned long long)tx.flush_latency_max_ns, (unsigned long long)(tx.write_total_ns / tx.flushes));
+    }
+    for (i = 1; i <= CSP_FIFO_TX_BATCH; i++) {
+        if (tx.batch_hist[i] != 0) {
+            printf("  %2d packets: %u\r\n", i, tx.batch_hist[i]);
+        }
+    }
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file csp_if_fifo.h
+ * @date 2022-03-14
+ */
+
+#ifndef CSP_IF_FIFO_H
+#define CSP_IF_FIFO_H
+
+#include <csp/csp.h>
+#include <stdint.h>
+
+/*
+ * A frame on the FIFO is the length, id and data of a csp_packet_t exactly as
+ * they are laid out in memory. Both ends run on the same host so the length
+ * is in host byte order
+ */
+#define CSP_FIFO_HEADER_SIZE (sizeof(uint16_t) + sizeof(uint32_t))
+#define CSP_FIFO_MTU 250
+#define CSP_FIFO_LATENCY_BUCKETS 16
+
+/* Print the receive statistics this often, in seconds, while packets are arriving. 0 to disable */
+#ifndef CSP_FIFO_STATS_INTERVAL
+#define CSP_FIFO_STATS_INTERVAL 0
+#endif
+
+/*
+ * Outgoing packets are collected for up to CSP_FIFO_TX_WINDOW_US microseconds,
+ * or until CSP_FIFO_TX_BATCH are waiting, and written with a single writev().
+ * A window of 0 writes every packet as it is sent
+ */
+#ifndef CSP_FIFO_TX_BATCH
+#define CSP_FIFO_TX_BATCH 16
+#endif
+#ifndef CSP_FIFO_TX_WINDOW_US
+#define CSP_FIFO_TX_WINDOW_US 1000
+#endif
+
+typedef struct {
+    uint32_t packets;
+    uint32_t bytes;
+    uint32_t flushes;       // writev() calls
+    uint32_t write_errors;  // packets lost to a failed write
+    uint64_t flush_latency_total_ns; // first packet of a batch queued to batch written
+    uint64_t flush_latency_max_ns;
+    uint64_t write_total_ns; // time spent in writev()
+    uint32_t batch_hist[CSP_FIFO_TX_BATCH + 1]; // flushes by number of packets
+} csp_fifo_tx_stats_t;
+
+typedef struct {
+    uint32_t packets;
+    uint32_t bytes;
+    uint32_t reads;      // read() calls, packets / reads is the frames per wakeup
+    uint32_t bad_frames; // frames with an impossible length, the stream is resynchronised by discarding
+    uint32_t no_buffer;  // frames dropped because CSP had no free buffer
+    uint64_t latency_total_ns;
+    uint64_t latency_max_ns;
+    /* Bucket i counts packets with ingress latency in [2^(i-1), 2^i) microseconds */
+    uint32_t latency_hist[CSP_FIFO_LATENCY_BUCKETS];
+} csp_fifo_rx_stats_t;
+
+int csp_fifo_init(const char *tx_channel_name, const char *rx_channel_name, csp_iface_t **iface);
+
+void csp_fifo_get_rx_stats(csp_fifo_rx_stats_t *stats);
+
+void csp_fifo_get_tx_stats(csp_fifo_tx_stats_t *stats);
+
+void csp_fifo_print_stats(void);
+
+#endif /* CSP_IF_FIFO_H */
@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file csp_if_shm.c
+ * @date 2022-03-14
+ *
+ * CSP interface over a pair of single producer, single consumer rings in
+ * POSIX shared memory. Records use the same framing as csp_if_fifo (the
+ * length, id and data of a csp_packet_t). A packet is copied once into the
+ * ring on transmit and once out of it into a CSP buffer on receive. The
+ * receiver only sleeps, on a futex doorbell, when its ring is empty, and the
+ * sender only makes a syscall when the receiver is asleep.
+ *
+ * Any task may send, so senders in a process take tx_lock to stay the ring's
+ * single producer. Each end records its pid in the rings; a ring whose other
+ * end is not running holds nothing but an earlier run's leftovers and is
+ * emptied when it is opened, so start the two ends one after the other.
+ */
+#define _GNU_SOURCE
+
+#include "csp_if_shm.h"
+
+#include <csp/csp_interface.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if (CSP_SHM_RING_SIZE & (CSP_SHM_RING_SIZE - 1)) != 0
+#error "CSP_SHM_RING_SIZE must be a power of 2"
+#endif
+
+#define SHM_HEADER_SIZE (sizeof(uint16_t) + sizeof(uint32_t))
+#define SHM_MAGIC 0x45583253 // "EX2S"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t size;
+    int32_t producer; // pid of each end, 0 until it opens the ring
+    int32_t consumer;
+    /* Producer and consumer indexes on separate cache lines, both free running */
+    uint32_t head __attribute__((aligned(64)));
+    uint32_t tail __attribute__((aligned(64)));
+    uint32_t doorbell __attribute__((aligned(64))); // futex word, bumped to wake the consumer
+    uint32_t sleeping;                               // consumer is (about to be) waiting on the doorbell
+    uint8_t data[CSP_SHM_RING_SIZE] __attribute__((aligned(64)));
+} shm_ring_t;
+
+static shm_ring_t *tx_ring;
+static shm_ring_t *rx_ring;
+static pthread_t rx_thread;
+static pthread_mutex_t tx_lock = PTHREAD_MUTEX_INITIALIZER;
+static csp_shm_stats_t shm_stats;
+
+static int csp_shm_tx(const csp_route_t *ifroute, csp_packet_t *packet);
+
+static csp_iface_t csp_if_shm = {
+    .name = "shm",
+    .nexthop = csp_shm_tx,
+    .mtu = CSP_SHM_MTU,
+};
+
+static void prv_futex_wait(uint32_t *addr, uint32_t val) {
+    syscall(SYS_futex, addr, FUTEX_WAIT, val, NULL, NULL, 0);
+}
+
+static void prv_futex_wake(uint32_t *addr) { syscall(SYS_futex, addr, FUTEX_WAKE, 1, NULL, NULL, 0); }
+
+/**
+ * @brief
+ *      Copy into the ring at a free running index, wrapping as needed
+ */
+static void prv_ring_write(shm_ring_t *ring, uint32_t index, const void *src, uint32_t len) {
+    uint32_t offset = index & (CSP_SHM_RING_SIZE - 1);
+    uint32_t first = CSP_SHM_RING_SIZE - offset;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(&ring->data[offset], src, first);
+    memcpy(&ring->data[0], (const uint8_t *)src + first, len - first);
+}
+
+/**
+ * @brief
+ *      Copy out of the ring at a free running index, wrapping as needed
+ */
+static void prv_ring_read(const shm_ring_t *ring, uint32_t index, void *dst, uint32_t len) {
+    uint32_t offset = index & (CSP_SHM_RING_SIZE - 1);
+    uint32_t first = CSP_SHM_RING_SIZE - offset;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(dst, &ring->data[offset], first);
+    memcpy((uint8_t *)dst + first, &ring->data[0], len - first);
+}
+
+static int csp_shm_tx(const csp_route_t *ifroute, csp_packet_t *packet) {
+    uint32_t len = SHM_HEADER_SIZE + packet->length;
+    uint32_t head;
+    uint32_t tail;
+
+    pthread_mutex_lock(&tx_lock);
+    head = tx_ring->head; // only this side writes head, under tx_lock
+    tail = __atomic_load_n(&tx_ring->tail, __ATOMIC_ACQUIRE);
+    if (CSP_SHM_RING_SIZE - (head - tail) < len) {
+        pthread_mutex_unlock(&tx_lock);
+        __atomic_fetch_add(&shm_stats.tx_full, 1, __ATOMIC_RELAXED);
+        csp_if_shm.tx_error++;
+        csp_buffer_free(packet);
+        return CSP_ERR_NONE;
+    }
+
+    prv_ring_write(tx_ring, head, &packet->length, len);
+    __atomic_store_n(&tx_ring->head, head + len, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&tx_ring->sleeping, __ATOMIC_SEQ_CST)) {
+        __atomic_fetch_add(&tx_ring->doorbell, 1, __ATOMIC_SEQ_CST);
+        prv_futex_wake(&tx_ring->doorbell);
+    }
+    pthread_mutex_unlock(&tx_lock);
+
+    __atomic_fetch_add(&shm_stats.tx_packets, 1, __ATOMIC_RELAXED);
+    csp_buffer_free(packet);
+    return CSP_ERR_NONE;
+}
+
+/**
+ * @brief
+ *      Block until the rx ring has data
+ */
+static void prv_wait_for_data(uint32_t tail) {
+    __atomic_store_n(&rx_ring->sleeping, 1, __ATOMIC_SEQ_CST);
+    uint32_t bell = __atomic_load_n(&rx_ring->doorbell, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&rx_ring->head, __ATOMIC_SEQ_CST) == tail) {
+        __atomic_fetch_add(&shm_stats.rx_wakeups, 1, __ATOMIC_RELAXED);
+        prv_futex_wait(&rx_ring->doorbell, bell);
+    }
+    __atomic_store_n(&rx_ring->sleeping, 0, __ATOMIC_SEQ_CST);
+}
+
+static void *prv_shm_rx_thread(void *param) {
+    uint32_t tail = rx_ring->tail; // only this side writes tail
+
+    for (;;) {
+        uint32_t head = __atomic_load_n(&rx_ring->head, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            prv_wait_for_data(tail);
+            continue;
+        }
+
+        while (tail != head) {
+            uint16_t length;
+            prv_ring_read(rx_ring, tail, &length, sizeof(length));
+
+            csp_packet_t *packet = csp_buffer_get(length);
+            if (packet == NULL) {
+                __atomic_fetch_add(&shm_stats.rx_no_buffer, 1, __ATOMIC_RELAXED);
+                csp_if_shm.rx_error++;
+            } else {
+                prv_ring_read(rx_ring, tail, &packet->length, SHM_HEADER_SIZE + length);
+                csp_qfifo_write(packet, &csp_if_shm, NULL);
+                __atomic_fetch_add(&shm_stats.rx_packets, 1, __ATOMIC_RELAXED);
+            }
+            tail += SHM_HEADER_SIZE + length;
+        }
+        // release the space in one go rather than per record
+        __atomic_store_n(&rx_ring->tail, tail, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+static bool prv_running(int32_t pid) { return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM); }
+
+/**
+ * @brief
+ *      Map a ring, creating it if neither end has yet
+ * @details
+ *      If the other end isn't running the ring is emptied. If it is, the
+ *      ring must have been made with the same size as this end's
+ * @param producer
+ *      true if this end writes to the ring
+ * @return shm_ring_t *
+ *      The ring or NULL on failure
+ */
+static shm_ring_t *prv_open_ring(const char *name, bool producer) {
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0666);
+    if (fd < 0) {
+        perror(name);
+        return NULL;
+    }
+    // a new object is zero filled, which is an empty ring
+    if (ftruncate(fd, sizeof(shm_ring_t)) < 0) {
+        perror(name);
+        close(fd);
+        return NULL;
+    }
+    shm_ring_t *ring = mmap(NULL, sizeof(shm_ring_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ring == MAP_FAILED) {
+        perror(name);
+        return NULL;
+    }
+
+    int32_t *self = producer ? &ring->producer : &ring->consumer;
+    int32_t peer = __atomic_load_n(producer ? &ring->consumer : &ring->producer, __ATOMIC_SEQ_CST);
+    if (!prv_running(peer)) {
+        // anything in the ring is left from an earlier run
+        ring->head = 0;
+        ring->tail = 0;
+        ring->doorbell = 0;
+        ring->sleeping = 0;
+        ring->size = CSP_SHM_RING_SIZE;
+        __atomic_store_n(&ring->magic, SHM_MAGIC, __ATOMIC_SEQ_CST);
+    } else if (__atomic_load_n(&ring->magic, __ATOMIC_SEQ_CST) != SHM_MAGIC) {
+        printf("%s is not a CSP ring\r\n", name);
+        munmap(ring, sizeof(shm_ring_t));
+        return NULL;
+    } else if (ring->size != CSP_SHM_RING_SIZE) {
+        printf("%s holds %u bytes of packets but this end was built for %u\r\n", name, ring->size,
+               (uint32_t)CSP_SHM_RING_SIZE);
+        munmap(ring, sizeof(shm_ring_t));
+        return NULL;
+    }
+    __atomic_store_n(self, (int32_t)getpid(), __ATOMIC_SEQ_CST);
+    return ring;
+}
+
+/**
+ * @brief
+ *      Map the ring pair and start receiving
+ * @param tx_ring_name
+ *      Shared memory object this end writes to
+ * @param rx_ring_name
+ *      Shared memory object this end reads from
+ * @param iface
+ *      Set to the interface to route through
+ * @return int
+ *      CSP_ERR_NONE on success
+ */
+int csp_shm_init(const char *tx_ring_name, const char *rx_ring_name, csp_iface_t **iface) {
+    tx_ring = prv_open_ring(tx_ring_name, true);
+    rx_ring = prv_open_ring(rx_ring_name, false);
+    if (tx_ring == NULL || rx_ring == NULL) {
+        return CSP_ERR_DRIVER;
+    }
+
+    if (pthread_create(&rx_thread, NULL, prv_shm_rx_thread, NULL) != 0) {
+        printf("Failed to start shared memory RX thread\r\n");
+        return CSP_ERR_NOMEM;
+    }
+
+    csp_iflist_add(&csp_if_shm);
+    *iface = &csp_if_shm;
+    return CSP_ERR_NONE;
+}
+
+void csp_shm_get_stats(csp_shm_stats_t *stats) {
+    stats->tx_packets = __atomic_load_n(&shm_stats.tx_packets, __ATOMIC_RELAXED);
+    stats->tx_full = __atomic_load_n(&shm_stats.tx_full, __ATOMIC_RELAXED);
+    stats->rx_packets = __atomic_load_n(&shm_stats.rx_packets, __ATOMIC_RELAXED);
+    stats->rx_wakeups = __atomic_load_n(&shm_stats.rx_wakeups, __ATOMIC_RELAXED);
+    stats->rx_no_buffer = __atomic_load_n(&shm_stats.rx_no_buffer, __ATOMIC_RELAXED);
+}
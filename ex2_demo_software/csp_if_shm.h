@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file csp_if_shm.h
+ * @date 2022-03-14
+ */
+
+#ifndef CSP_IF_SHM_H
+#define CSP_IF_SHM_H
+
+#include <csp/csp.h>
+#include <stdint.h>
+
+/* Default ring names, the ground opens them the other way around */
+#define CSP_SHM_SAT_TO_GROUND "/ex2_sat_to_ground"
+#define CSP_SHM_GROUND_TO_SAT "/ex2_ground_to_sat"
+
+/* Bytes of packet data in each ring. Must be a power of 2 and the same on both ends */
+#ifndef CSP_SHM_RING_SIZE
+#define CSP_SHM_RING_SIZE (1 << 20)
+#endif
+
+#define CSP_SHM_MTU 256
+
+typedef struct {
+    uint32_t tx_packets;
+    uint32_t tx_full;   // packets dropped because the peer is not keeping up
+    uint32_t rx_packets;
+    uint32_t rx_wakeups; // times the receiver had to sleep on the doorbell
+    uint32_t rx_no_buffer;
+} csp_shm_stats_t;
+
+int csp_shm_init(const char *tx_ring_name, const char *rx_ring_name, csp_iface_t **iface);
+
+void csp_shm_get_stats(csp_shm_stats_t *stats);
+
+#endif /* CSP_IF_SHM_H */
@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file csp_if_zmqbatch.c
+ * @date 2022-03-14
+ *
+ * CSP interface to csp's zmqproxy that sends several frames per ZMQ message.
+ * Every part of a message is an ordinary zmqhub frame (next hop address,
+ * CSP id in network order, data) and all parts share the same next hop, so
+ * the proxy's topic filter still works on the first part and a node using
+ * the stock zmqhub interface receives each part as a separate frame.
+ */
+#define _GNU_SOURCE
+
+#include "csp_if_zmqbatch.h"
+
+#include <csp/csp_endian.h>
+#include <csp/csp_interface.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <zmq.h>
+
+#define ZMQ_FRAME_HEADER_SIZE (sizeof(uint8_t) + sizeof(uint32_t))
+
+typedef struct {
+    csp_packet_t *packet;
+    uint8_t via;
+} zmq_pending_t;
+
+static void *context;
+static void *publisher;
+static void *subscriber;
+static pthread_t rx_thread;
+static pthread_t tx_thread;
+
+static zmq_pending_t tx_pending[CSP_ZMQBATCH_MAX];
+static int tx_pending_count = 0;
+static struct timespec tx_pending_start;
+static pthread_mutex_t tx_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tx_ready;
+static pthread_cond_t tx_space;
+
+static csp_zmqbatch_stats_t zmq_stats;
+
+static int csp_zmqbatch_tx(const csp_route_t *ifroute, csp_packet_t *packet);
+
+static csp_iface_t csp_if_zmqbatch = {
+    .name = "zmqbatch",
+    .nexthop = csp_zmqbatch_tx,
+    .mtu = CSP_ZMQBATCH_MTU,
+};
+
+static int csp_zmqbatch_tx(const csp_route_t *ifroute, csp_packet_t *packet) {
+    uint8_t via = (ifroute->via != CSP_NO_VIA_ADDRESS) ? ifroute->via : packet->id.dst;
+
+    pthread_mutex_lock(&tx_lock);
+    while (tx_pending_count == CSP_ZMQBATCH_MAX) {
+        pthread_cond_wait(&tx_space, &tx_lock);
+    }
+    if (tx_pending_count == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &tx_pending_start);
+    }
+    tx_pending[tx_pending_count].packet = packet;
+    tx_pending[tx_pending_count].via = via;
+    tx_pending_count++;
+    if (tx_pending_count == 1 || tx_pending_count == CSP_ZMQBATCH_MAX) {
+        pthread_cond_signal(&tx_ready);
+    }
+    pthread_mutex_unlock(&tx_lock);
+    return CSP_ERR_NONE;
+}
+
+/**
+ * @brief
+ *      Send one frame as a part of a multipart message
+ * @param more
+ *      Whether more parts of the same message follow
+ */
+static void prv_send_frame(csp_packet_t *packet, uint8_t via, int more) {
+    uint8_t frame[ZMQ_FRAME_HEADER_SIZE + CSP_ZMQBATCH_MTU];
+    uint32_t id = csp_hton32(packet->id.ext);
+
+    frame[0] = via;
+    memcpy(&frame[1], &id, sizeof(id));
+    memcpy(&frame[ZMQ_FRAME_HEADER_SIZE], packet->data, packet->length);
+    if (zmq_send(publisher, frame, ZMQ_FRAME_HEADER_SIZE + packet->length, more ? ZMQ_SNDMORE : 0) < 0) {
+        __atomic_fetch_add(&zmq_stats.tx_errors, 1, __ATOMIC_RELAXED);
+        csp_if_zmqbatch.tx_error++;
+    }
+}
+
+/**
+ * @brief
+ *      Send a batch as one multipart message per next hop, keeping the
+ *      order of frames to each hop
+ */
+static void prv_flush(zmq_pending_t *pending, int count) {
+    int sent = 0;
+    int i, j;
+
+    for (i = 0; i < count; i++) {
+        if (pending[i].packet == NULL) {
+            continue;
+        }
+        uint8_t via = pending[i].via;
+        int last = i;
+        for (j = i + 1; j < count; j++) {
+            if (pending[j].packet != NULL && pending[j].via == via) {
+                last = j;
+            }
+        }
+        for (j = i; j <= last; j++) {
+            if (pending[j].packet == NULL || pending[j].via != via) {
+                continue;
+            }
+            prv_send_frame(pending[j].packet, via, j != last);
+            csp_buffer_free(pending[j].packet);
+            pending[j].packet = NULL;
+            sent++;
+        }
+        __atomic_fetch_add(&zmq_stats.tx_messages, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_add(&zmq_stats.tx_frames, sent, __ATOMIC_RELAXED);
+}
+
+static void *prv_zmq_tx_thread(void *param) {
+    zmq_pending_t pending[CSP_ZMQBATCH_MAX];
+    struct timespec deadline;
+    int count;
+
+    for (;;) {
+        pthread_mutex_lock(&tx_lock);
+        while (tx_pending_count == 0) {
+            pthread_cond_wait(&tx_ready, &tx_lock);
+        }
+
+        deadline = tx_pending_start;
+        deadline.tv_nsec += (long)CSP_ZMQBATCH_WINDOW_US * 1000;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        while (tx_pending_count < CSP_ZMQBATCH_MAX) {
+            if (pthread_cond_timedwait(&tx_ready, &tx_lock, &deadline) == ETIMEDOUT) {
+                break;
+            }
+        }
+
+        count = tx_pending_count;
+        memcpy(pending, tx_pending, count * sizeof(zmq_pending_t));
+        tx_pending_count = 0;
+        pthread_cond_broadcast(&tx_space);
+        pthread_mutex_unlock(&tx_lock);
+
+        prv_flush(pending, count);
+    }
+    return NULL;
+}
+
+static void *prv_zmq_rx_thread(void *param) {
+    zmq_msg_t msg;
+    zmq_msg_init(&msg);
+
+    for (;;) {
+        // each part of a multipart message arrives as its own frame
+        if (zmq_msg_recv(&msg, subscriber, 0) < 0) {
+            continue;
+        }
+        size_t size = zmq_msg_size(&msg);
+        if (size < ZMQ_FRAME_HEADER_SIZE || size > ZMQ_FRAME_HEADER_SIZE + CSP_ZMQBATCH_MTU) {
+            __atomic_fetch_add(&zmq_stats.rx_errors, 1, __ATOMIC_RELAXED);
+            csp_if_zmqbatch.rx_error++;
+            continue;
+        }
+
+        csp_packet_t *packet = csp_buffer_get(size - ZMQ_FRAME_HEADER_SIZE);
+        if (packet == NULL) {
+            __atomic_fetch_add(&zmq_stats.rx_errors, 1, __ATOMIC_RELAXED);
+            csp_if_zmqbatch.rx_error++;
+            continue;
+        }
+        const uint8_t *frame = zmq_msg_data(&msg);
+        uint32_t id;
+        memcpy(&id, &frame[1], sizeof(id));
+        packet->id.ext = csp_ntoh32(id);
+        packet->length = size - ZMQ_FRAME_HEADER_SIZE;
+        memcpy(packet->data, &frame[ZMQ_FRAME_HEADER_SIZE], packet->length);
+        csp_qfifo_write(packet, &csp_if_zmqbatch, NULL);
+        __atomic_fetch_add(&zmq_stats.rx_frames, 1, __ATOMIC_RELAXED);
+    }
+    zmq_msg_close(&msg);
+    return NULL;
+}
+
+/**
+ * @brief
+ *      Connect to a zmqproxy and start the batching interface
+ * @param addr
+ *      CSP address of this node, used to subscribe to its frames
+ * @param host
+ *      Host running the zmqproxy
+ * @param iface
+ *      Set to the interface to route through
+ * @return int
+ *      CSP_ERR_NONE on success
+ */
+int csp_zmqbatch_init(uint8_t addr, const char *host, csp_iface_t **iface) {
+    char endpoint[100];
+    uint8_t topics[] = {addr, CSP_BROADCAST_ADDR};
+    unsigned i;
+
+    context = zmq_ctx_new();
+    publisher = zmq_socket(context, ZMQ_PUB);
+    subscriber = zmq_socket(context, ZMQ_SUB);
+    if (context == NULL || publisher == NULL || subscriber == NULL) {
+        return CSP_ERR_NOMEM;
+    }
+
+    snprintf(endpoint, sizeof(endpoint), "tcp://%s:%u", host, CSP_ZMQBATCH_PUBLISH_PORT);
+    if (zmq_connect(publisher, endpoint) < 0) {
+        printf("Failed to connect to %s\r\n", endpoint);
+        return CSP_ERR_DRIVER;
+    }
+    snprintf(endpoint, sizeof(endpoint), "tcp://%s:%u", host, CSP_ZMQBATCH_SUBSCRIBE_PORT);
+    if (zmq_connect(subscriber, endpoint) < 0) {
+        printf("Failed to connect to %s\r\n", endpoint);
+        return CSP_ERR_DRIVER;
+    }
+    for (i = 0; i < sizeof(topics); i++) {
+        zmq_setsockopt(subscriber, ZMQ_SUBSCRIBE, &topics[i], sizeof(topics[i]));
+    }
+
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&tx_ready, &cond_attr);
+    pthread_cond_init(&tx_space, NULL);
+    pthread_condattr_destroy(&cond_attr);
+
+    if (pthread_create(&rx_thread, NULL, prv_zmq_rx_thread, NULL) != 0 ||
+        pthread_create(&tx_thread, NULL, prv_zmq_tx_thread, NULL) != 0) {
+        printf("Failed to start ZMQ threads\r\n");
+        return CSP_ERR_NOMEM;
+    }
+
+    csp_iflist_add(&csp_if_zmqbatch);
+    *iface = &csp_if_zmqbatch;
+    return CSP_ERR_NONE;
+}
+
+void csp_zmqbatch_get_stats(csp_zmqbatch_stats_t *stats) {
+    stats->tx_frames = __atomic_load_n(&zmq_stats.tx_frames, __ATOMIC_RELAXED);
+    stats->tx_messages = __atomic_load_n(&zmq_stats.tx_messages, __ATOMIC_RELAXED);
+    stats->tx_errors = __atomic_load_n(&zmq_stats.tx_errors, __ATOMIC_RELAXED);
+    stats->rx_frames = __atomic_load_n(&zmq_stats.rx_frames, __ATOMIC_RELAXED);
+    stats->rx_errors = __atomic_load_n(&zmq_stats.rx_errors, __ATOMIC_RELAXED);
+}
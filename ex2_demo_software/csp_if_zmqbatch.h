@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file csp_if_zmqbatch.h
+ * @date 2022-03-14
+ */
+
+#ifndef CSP_IF_ZMQBATCH_H
+#define CSP_IF_ZMQBATCH_H
+
+#include <csp/csp.h>
+#include <stdint.h>
+
+/* Ports of csp's zmqproxy. Nodes publish to the first and subscribe to the second */
+#define CSP_ZMQBATCH_PUBLISH_PORT 6000
+#define CSP_ZMQBATCH_SUBSCRIBE_PORT 6001
+
+/*
+ * Frames to the same next hop sent within CSP_ZMQBATCH_WINDOW_US of each
+ * other, up to CSP_ZMQBATCH_MAX of them, go out as one multipart message
+ */
+#ifndef CSP_ZMQBATCH_MAX
+#define CSP_ZMQBATCH_MAX 16
+#endif
+#ifndef CSP_ZMQBATCH_WINDOW_US
+#define CSP_ZMQBATCH_WINDOW_US 1000
+#endif
+
+#define CSP_ZMQBATCH_MTU 256
+
+typedef struct {
+    uint32_t tx_frames;
+    uint32_t tx_messages; // tx_frames / tx_messages is the average batch
+    uint32_t tx_errors;
+    uint32_t rx_frames;
+    uint32_t rx_errors;
+} csp_zmqbatch_stats_t;
+
+int csp_zmqbatch_init(uint8_t addr, const char *host, csp_iface_t **iface);
+
+void csp_zmqbatch_get_stats(csp_zmqbatch_stats_t *stats);
+
+#endif /* CSP_IF_ZMQBATCH_H */
@@ -0,0 +1,444 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file loadgen.c
+ * @date 2022-03-14
+ *
+ * Ground side load generator for the simulated satellite. Sends a weighted
+ * mix of telecommands at a fixed rate over the same transports as the demo
+ * and reports end-to-end latency percentiles, throughput and failures per
+ * command.
+ *
+ * usage: loadgen [-t fifo|shm|zmq|zmqbatch] [-H zmq host] [-d dest] [-r rate]
+ *                [-s seconds] [-c workers] [-m name:weight,...] [-o results.csv]
+ *
+ * Latency is measured from when a command was scheduled to be sent, not from
+ * when a worker got around to sending it, so a stalled satellite shows up as
+ * latency rather than as a lower send rate.
+ */
+#define _GNU_SOURCE
+
+#include <csp/csp.h>
+#include <csp/csp_endian.h>
+#include <csp/interfaces/csp_if_zmqhub.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "communication_service.h"
+#include "csp_if_fifo.h"
+#include "csp_if_shm.h"
+#include "csp_if_zmqbatch.h"
+#include "logger/logger_service.h"
+#include "services.h"
+#include "time_management_service.h"
+
+#define LOADGEN_MAX_WORKERS 64
+#define LOADGEN_CONNECT_TIMEOUT 1000 // ms
+#define LOADGEN_REPLY_TIMEOUT 5000   // ms
+#define LOADGEN_HK_GET 0             // GET_HK in housekeeping_service.h
+
+typedef enum {
+    REPLY_SINGLE,   // one packet, status byte 0 on success
+    REPLY_HK,       // packets until the hk_time_and_order final flag is clear
+    REPLY_CLI,      // packets until the more data flag in the status byte is clear
+} reply_kind_t;
+
+typedef struct {
+    const char *name;
+    uint8_t port;
+    uint8_t subtype;
+    reply_kind_t reply;
+    uint16_t (*build)(csp_packet_t *packet); // fills IN_DATA_BYTE onwards, returns its length
+    unsigned weight;
+
+    /* results, protected by results_lock */
+    uint32_t *latency_us;
+    uint32_t latency_count;
+    uint32_t latency_size;
+    uint32_t sent;
+    uint32_t failures;
+    uint64_t rx_bytes;
+} loadgen_cmd_t;
+
+static uint16_t prv_build_none(csp_packet_t *packet) { return 0; }
+
+static uint16_t prv_build_set_time(csp_packet_t *packet) {
+    uint32_t now = csp_hton32((uint32_t)time(NULL));
+    memcpy(&packet->data[IN_DATA_BYTE], &now, sizeof(now));
+    return sizeof(now);
+}
+
+static uint16_t prv_build_get_hk(csp_packet_t *packet) {
+    uint16_t limit = 1, before_id = 0;
+    uint32_t before_time = 0;
+    memcpy(&packet->data[IN_DATA_BYTE], &limit, sizeof(limit));
+    memcpy(&packet->data[IN_DATA_BYTE + 2], &before_id, sizeof(before_id));
+    memcpy(&packet->data[IN_DATA_BYTE + 4], &before_time, sizeof(before_time));
+    return sizeof(limit) + sizeof(before_id) + sizeof(before_time);
+}
+
+static uint16_t prv_build_cli(csp_packet_t *packet) {
+    static const char command[] = "help";
+    packet->data[IN_DATA_BYTE] = sizeof(command) - 1;
+    memcpy(&packet->data[IN_DATA_BYTE + 1], command, sizeof(command) - 1);
+    return 1 + sizeof(command) - 1;
+}
+
+static loadgen_cmd_t commands[] = {
+    {"time_get", TC_TIME_MANAGEMENT_SERVICE, GET_TIME, REPLY_SINGLE, prv_build_none, 4},
+    {"time_set", TC_TIME_MANAGEMENT_SERVICE, SET_TIME, REPLY_SINGLE, prv_build_set_time, 1},
+    {"comms_temp", TC_COMMUNICATION_SERVICE, S_GET_TEMP, REPLY_SINGLE, prv_build_none, 2},
+    {"comms_freq", TC_COMMUNICATION_SERVICE, S_GET_FREQ, REPLY_SINGLE, prv_build_none, 2},
+    {"comms_status", TC_COMMUNICATION_SERVICE, S_GET_FULL_STATUS, REPLY_SINGLE, prv_build_none, 1},
+    {"hk", TC_HOUSEKEEPING_SERVICE, LOADGEN_HK_GET, REPLY_HK, prv_build_get_hk, 1},
+    {"cli", TC_CLI_SERVICE, 0, REPLY_CLI, prv_build_cli, 1},
+    {"log_get", TC_LOGGER_SERVICE, GET_FILE, REPLY_SINGLE, prv_build_none, 1},
+};
+#define NUM_COMMANDS (sizeof(commands) / sizeof(commands[0]))
+
+static pthread_mutex_t results_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint8_t dest = DEMO_APP_ID;
+static double rate = 10.0; // commands per second, all workers together
+static unsigned duration = 10;
+static unsigned workers = 4;
+static struct timespec run_start;
+
+static uint64_t prv_ns(const struct timespec *t) { return (uint64_t)t->tv_sec * 1000000000ULL + t->tv_nsec; }
+
+static uint64_t prv_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return prv_ns(&now);
+}
+
+/**
+ * @brief
+ *      Pick a command according to the weights
+ */
+static loadgen_cmd_t *prv_pick(unsigned *seed) {
+    unsigned total = 0;
+    unsigned i;
+    for (i = 0; i < NUM_COMMANDS; i++) {
+        total += commands[i].weight;
+    }
+    unsigned pick = rand_r(seed) % total;
+    for (i = 0; i < NUM_COMMANDS; i++) {
+        if (pick < commands[i].weight) {
+            return &commands[i];
+        }
+        pick -= commands[i].weight;
+    }
+    return &commands[0];
+}
+
+static void prv_record(loadgen_cmd_t *cmd, int ok, uint64_t latency_ns, uint32_t rx_bytes) {
+    pthread_mutex_lock(&results_lock);
+    cmd->sent++;
+    cmd->rx_bytes += rx_bytes;
+    if (!ok) {
+        cmd->failures++;
+    } else {
+        if (cmd->latency_count == cmd->latency_size) {
+            cmd->latency_size = cmd->latency_size ? cmd->latency_size * 2 : 1024;
+            cmd->latency_us = realloc(cmd->latency_us, cmd->latency_size * sizeof(uint32_t));
+        }
+        cmd->latency_us[cmd->latency_count++] = (uint32_t)(latency_ns / 1000);
+    }
+    pthread_mutex_unlock(&results_lock);
+}
+
+/**
+ * @brief
+ *      Send one command and wait for all of its reply packets
+ * @param rx_bytes
+ *      Set to the number of reply bytes received
+ * @return int
+ *      1 if the command succeeded
+ */
+static int prv_run_command(const loadgen_cmd_t *cmd, uint32_t *rx_bytes) {
+    int ok = 0;
+    *rx_bytes = 0;
+
+    csp_conn_t *conn = csp_connect(CSP_PRIO_NORM, dest, cmd->port, LOADGEN_CONNECT_TIMEOUT, CSP_O_RDP);
+    if (conn == NULL) {
+        return 0;
+    }
+    csp_packet_t *packet = csp_buffer_get(csp_buffer_data_size());
+    if (packet == NULL) {
+        csp_close(conn);
+        return 0;
+    }
+    packet->data[SUBSERVICE_BYTE] = cmd->subtype;
+    packet->length = 1 + cmd->build(packet);
+    if (!csp_send(conn, packet, LOADGEN_CONNECT_TIMEOUT)) {
+        csp_buffer_free(packet);
+        csp_close(conn);
+        return 0;
+    }
+
+    for (;;) {
+        csp_packet_t *reply = csp_read(conn, LOADGEN_REPLY_TIMEOUT);
+        if (reply == NULL) {
+            // a reply that stops part way is a failure, even after good packets
+            ok = 0;
+            break;
+        }
+        *rx_bytes += reply->length;
+        int8_t status = (int8_t)reply->data[STATUS_BYTE];
+        int done = 1;
+        switch (cmd->reply) {
+        case REPLY_SINGLE:
+            ok = (status == 0);
+            break;
+        case REPLY_HK:
+            // status, then the hk record which starts with the final flag. The
+            // service sets final while more records follow, so the last has it clear
+            ok = (status == 0);
+            done = !ok || reply->length <= OUT_DATA_BYTE || reply->data[OUT_DATA_BYTE] == 0;
+            break;
+        case REPLY_CLI:
+            ok = 1;
+            done = (status == 0);
+            break;
+        }
+        csp_buffer_free(reply);
+        if (done) {
+            break;
+        }
+    }
+    csp_close(conn);
+    return ok;
+}
+
+static void *prv_worker(void *param) {
+    unsigned id = (unsigned)(uintptr_t)param;
+    unsigned seed = id * 7919 + 1;
+    uint64_t period_ns = (uint64_t)(1e9 * workers / rate);
+    uint64_t start_ns = prv_ns(&run_start) + period_ns * id / workers; // stagger the workers
+    uint64_t end_ns = prv_ns(&run_start) + (uint64_t)duration * 1000000000ULL;
+    uint64_t scheduled;
+
+    for (scheduled = start_ns; scheduled < end_ns; scheduled += period_ns) {
+        uint64_t now = prv_now_ns();
+        if (now < scheduled) {
+            struct timespec wake = {.tv_sec = scheduled / 1000000000ULL, .tv_nsec = scheduled % 1000000000ULL};
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+        }
+        loadgen_cmd_t *cmd = prv_pick(&seed);
+        uint32_t rx_bytes;
+        int ok = prv_run_command(cmd, &rx_bytes);
+        prv_record(cmd, ok, prv_now_ns() - scheduled, rx_bytes);
+    }
+    return NULL;
+}
+
+static int prv_cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t prv_percentile(const loadgen_cmd_t *cmd, unsigned pct) {
+    if (cmd->latency_count == 0) {
+        return 0;
+    }
+    uint32_t index = (uint32_t)(((uint64_t)cmd->latency_count * pct + 99) / 100);
+    return cmd->latency_us[index ? index - 1 : 0];
+}
+
+static void prv_report(double elapsed_s, const char *csv_name) {
+    FILE *csv = NULL;
+    uint32_t total = 0, total_failures = 0;
+    unsigned i;
+
+    if (csv_name != NULL) {
+        csv = fopen(csv_name, "w");
+        if (csv == NULL) {
+            perror(csv_name);
+        } else {
+            fprintf(csv, "command,sent,failures,per_s,p50_us,p90_us,p99_us,max_us,rx_bytes\n");
+        }
+    }
+
+    printf("%-13s %7s %6s %8s %9s %9s %9s %9s\n", "command", "sent", "fail", "per s", "p50 us", "p90 us",
+           "p99 us", "max us");
+    for (i = 0; i < NUM_COMMANDS; i++) {
+        loadgen_cmd_t *cmd = &commands[i];
+        if (cmd->sent == 0) {
+            continue;
+        }
+        qsort(cmd->latency_us, cmd->latency_count, sizeof(uint32_t), prv_cmp_u32);
+        double per_s = (cmd->sent - cmd->failures) / elapsed_s;
+        printf("%-13s %7u %6u %8.1f %9u %9u %9u %9u\n", cmd->name, cmd->sent, cmd->failures, per_s,
+               prv_percentile(cmd, 50), prv_percentile(cmd, 90), prv_percentile(cmd, 99),
+               prv_percentile(cmd, 100));
+        if (csv != NULL) {
+            fprintf(csv, "%s,%u,%u,%.1f,%u,%u,%u,%u,%llu\n", cmd->name, cmd->sent, cmd->failures, per_s,
+                    prv_percentile(cmd, 50), prv_percentile(cmd, 90), prv_percentile(cmd, 99),
+                    prv_percentile(cmd, 100), (unsigned long long)cmd->rx_bytes);
+        }
+        total += cmd->sent;
+        total_failures += cmd->failures;
+    }
+    printf("%u commands, %u failed, %.1f completed per second over %.1f s\n", total, total_failures,
+           (total - total_failures) / elapsed_s, elapsed_s);
+    if (csv != NULL) {
+        fclose(csv);
+    }
+}
+
+/**
+ * @brief
+ *      Apply a command mix like "time_get:4,hk:1". Commands left out get no weight
+ * @return int
+ *      0 on success
+ */
+static int prv_parse_mix(char *mix) {
+    unsigned i;
+    for (i = 0; i < NUM_COMMANDS; i++) {
+        commands[i].weight = 0;
+    }
+    for (char *item = strtok(mix, ","); item != NULL; item = strtok(NULL, ",")) {
+        char *colon = strchr(item, ':');
+        unsigned weight = 1;
+        if (colon != NULL) {
+            *colon = '\0';
+            weight = (unsigned)atoi(colon + 1);
+        }
+        for (i = 0; i < NUM_COMMANDS; i++) {
+            if (strcmp(item, commands[i].name) == 0) {
+                commands[i].weight = weight;
+                break;
+            }
+        }
+        if (i == NUM_COMMANDS) {
+            fprintf(stderr, "unknown command %s\n", item);
+            return -1;
+        }
+    }
+    for (i = 0; i < NUM_COMMANDS; i++) {
+        if (commands[i].weight != 0) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static void prv_usage(const char *name) {
+    unsigned i;
+    fprintf(stderr,
+            "usage: %s [-t fifo|shm|zmq|zmqbatch] [-H zmq host] [-d dest] [-r rate] [-s seconds] [-c workers]\n"
+            "          [-m name:weight,...] [-o results.csv]\ncommands:",
+            name);
+    for (i = 0; i < NUM_COMMANDS; i++) {
+        fprintf(stderr, " %s", commands[i].name);
+    }
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv) {
+    const char *transport = "fifo";
+    const char *zmq_host = "localhost";
+    const char *csv_name = NULL;
+    pthread_t threads[LOADGEN_MAX_WORKERS];
+    int opt;
+    unsigned i;
+
+    while ((opt = getopt(argc, argv, "t:H:d:r:s:c:m:o:")) != -1) {
+        switch (opt) {
+        case 't':
+            transport = optarg;
+            break;
+        case 'H':
+            zmq_host = optarg;
+            break;
+        case 'd':
+            dest = (uint8_t)atoi(optarg);
+            break;
+        case 'r':
+            rate = atof(optarg);
+            break;
+        case 's':
+            duration = (unsigned)atoi(optarg);
+            break;
+        case 'c':
+            workers = (unsigned)atoi(optarg);
+            break;
+        case 'm':
+            if (prv_parse_mix(optarg) != 0) {
+                prv_usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'o':
+            csv_name = optarg;
+            break;
+        default:
+            prv_usage(argv[0]);
+            return -1;
+        }
+    }
+    if (rate <= 0 || workers == 0 || workers > LOADGEN_MAX_WORKERS) {
+        prv_usage(argv[0]);
+        return -1;
+    }
+
+    csp_conf_t csp_conf;
+    csp_conf_get_defaults(&csp_conf);
+    csp_conf.address = GND_APP_ID;
+    csp_conf.conn_max = LOADGEN_MAX_WORKERS + 4;
+    if (csp_init(&csp_conf) != CSP_ERR_NONE) {
+        fprintf(stderr, "csp_init() failed\n");
+        return -1;
+    }
+
+    // the ground end of each link, so rx and tx are swapped relative to the satellite
+    csp_iface_t *iface = NULL;
+    int error;
+    if (strcmp(transport, "fifo") == 0) {
+        error = csp_fifo_init("/datavolume1/ground_to_sat", "/datavolume1/sat_to_ground", &iface);
+    } else if (strcmp(transport, "shm") == 0) {
+        error = csp_shm_init(CSP_SHM_GROUND_TO_SAT, CSP_SHM_SAT_TO_GROUND, &iface);
+    } else if (strcmp(transport, "zmq") == 0) {
+        error = csp_zmqhub_init(GND_APP_ID, zmq_host, 0, &iface);
+    } else if (strcmp(transport, "zmqbatch") == 0) {
+        error = csp_zmqbatch_init(GND_APP_ID, zmq_host, &iface);
+    } else {
+        prv_usage(argv[0]);
+        return -1;
+    }
+    if (error != CSP_ERR_NONE) {
+        fprintf(stderr, "failed to start %s interface, error: %d\n", transport, error);
+        return -1;
+    }
+    csp_rtable_set(CSP_DEFAULT_ROUTE, 0, iface, CSP_NO_VIA_ADDRESS);
+    csp_route_start_task(0, 0);
+
+    printf("%s: %.1f commands/s to %u for %u s with %u workers\n", transport, rate, dest, duration, workers);
+    clock_gettime(CLOCK_MONOTONIC, &run_start);
+    for (i = 0; i < workers; i++) {
+        pthread_create(&threads[i], NULL, prv_worker, (void *)(uintptr_t)i);
+    }
+    for (i = 0; i < workers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    prv_report((prv_now_ns() - prv_ns(&run_start)) / 1e9, csv_name);
+    return 0;
+}
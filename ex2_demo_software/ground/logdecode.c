@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file logdecode.c
+ * @date 2022-03-14
+ *
+ * Renders binary logs (see binlog_format.h) downlinked from syslog.bin or
+ * syslog_old.bin as text, one "<unix_ts> <L> <message>" line per record.
+ * The formats come from log_messages.def, so this must be built from the
+ * same dictionary as the flight software, or a newer one.
+ *
+ * usage: logdecode [file...]
+ *
+ * Reads standard input if no file is given.
+ */
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "logger/binlog_format.h"
+
+#define LOG_MSG(name, level, nargs, format) format,
+static const char *const msg_format[LOG_MSG_COUNT] = {
+#include "logger/log_messages.def"
+};
+#undef LOG_MSG
+
+static const char level_letter[] = {'D', 'I', 'W', 'E'};
+
+static uint32_t prv_get32(const uint8_t *from) {
+    return ((uint32_t)from[0] << 24) | ((uint32_t)from[1] << 16) | ((uint32_t)from[2] << 8) | from[3];
+}
+
+/**
+ * @brief
+ *      Print every record in a binary log
+ * @return int
+ *      0, or 1 if the log ends part way through a record
+ */
+static int prv_decode(FILE *in, const char *name) {
+    uint8_t header[BINLOG_HEADER_SIZE];
+    uint8_t data[UINT8_MAX * sizeof(uint32_t)];
+    uint32_t args[BINLOG_MAX_ARGS] = {0};
+    uint16_t id;
+    uint8_t nargs;
+    uint8_t level;
+    uint32_t timestamp;
+    int i;
+
+    while (fread(header, sizeof(header), 1, in) == 1) {
+        id = ((uint16_t)header[0] << 8) | header[1];
+        nargs = header[2];
+        level = header[3];
+        timestamp = prv_get32(&header[4]);
+        if (nargs != 0 && fread(data, nargs * sizeof(uint32_t), 1, in) != 1) {
+            fprintf(stderr, "%s: truncated record\n", name);
+            return 1;
+        }
+        for (i = 0; i < BINLOG_MAX_ARGS; i++) {
+            args[i] = (i < nargs) ? prv_get32(&data[i * sizeof(uint32_t)]) : 0;
+        }
+
+        printf("%u %c ", timestamp, (level < sizeof(level_letter)) ? level_letter[level] : '?');
+        if (id < LOG_MSG_COUNT) {
+            // the format uses at most BINLOG_MAX_ARGS of these
+            printf(msg_format[id], args[0], args[1], args[2], args[3], args[4], args[5]);
+        } else {
+            printf("unknown message %u", id);
+            for (i = 0; i < nargs; i++) {
+                printf(" 0x%08x", prv_get32(&data[i * sizeof(uint32_t)]));
+            }
+        }
+        printf("\n");
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int status = 0;
+    int i;
+
+    if (argc < 2) {
+        return prv_decode(stdin, "stdin");
+    }
+    for (i = 1; i < argc; i++) {
+        FILE *in = fopen(argv[i], "rb");
+        if (in == NULL) {
+            perror(argv[i]);
+            status = 1;
+            continue;
+        }
+        status |= prv_decode(in, argv[i]);
+        fclose(in);
+    }
+    return status;
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file makepatch.c
+ * @date 2022-03-14
+ *
+ * Makes a patch (see patch.h) that turns the installed application image
+ * into a new one, for upload with UPLOAD_TARGET_PATCH and APPLY_PATCH.
+ *
+ * usage: makepatch <installed image> <new image> <patch>
+ *
+ * Matching is greedy: at each point of the new image the longest of the
+ * match continuing the previous copy and the last place the next
+ * PATCH_HASH_LEN bytes were seen in the installed image is copied, if it
+ * is long enough to be cheaper than adding the bytes.
+ */
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/crc16.h"
+
+/* Must match patch.h */
+#define PATCH_MAGIC 0x45584450
+#define PATCH_OP_COPY 0
+#define PATCH_OP_ADD 1
+
+#define PATCH_HASH_LEN 8
+#define PATCH_HASH_BITS 20
+/* A copy takes 9 bytes of patch; shorter matches are added instead */
+#define PATCH_MIN_COPY 12
+
+typedef struct {
+    uint8_t *data;
+    uint32_t size;
+} image_t;
+
+static int prv_load(const char *path, image_t *image) {
+    FILE *in = fopen(path, "rb");
+    long size;
+
+    if (in == NULL || fseek(in, 0, SEEK_END) != 0 || (size = ftell(in)) < 0 || fseek(in, 0, SEEK_SET) != 0) {
+        perror(path);
+        return 1;
+    }
+    image->size = (uint32_t)size;
+    image->data = malloc(size ? size : 1);
+    if (image->data == NULL || fread(image->data, 1, size, in) != (size_t)size) {
+        perror(path);
+        fclose(in);
+        return 1;
+    }
+    fclose(in);
+    return 0;
+}
+
+static uint32_t prv_hash(const uint8_t *data) {
+    uint64_t v;
+    memcpy(&v, data, sizeof(v));
+    return (uint32_t)((v * 0x9E3779B97F4A7C15ULL) >> (64 - PATCH_HASH_BITS));
+}
+
+static void prv_put32(FILE *out, uint32_t value) {
+    uint8_t be[4] = {value >> 24, value >> 16, value >> 8, value};
+    fwrite(be, sizeof(be), 1, out);
+}
+
+static void prv_put16(FILE *out, uint16_t value) {
+    uint8_t be[2] = {value >> 8, value};
+    fwrite(be, sizeof(be), 1, out);
+}
+
+static void prv_add(FILE *out, const uint8_t *data, uint32_t len) {
+    if (len == 0) {
+        return;
+    }
+    fputc(PATCH_OP_ADD, out);
+    prv_put32(out, len);
+    fwrite(data, 1, len, out);
+}
+
+static uint32_t prv_match(const image_t *source, uint32_t from, const image_t *target, uint32_t at) {
+    uint32_t len = 0;
+    while (from + len < source->size && at + len < target->size &&
+           source->data[from + len] == target->data[at + len]) {
+        len++;
+    }
+    return len;
+}
+
+int main(int argc, char **argv) {
+    image_t source, target;
+    uint32_t *last_seen;
+    uint32_t at = 0, add_from = 0, next_source = 0;
+    uint32_t i, copied = 0, added = 0;
+    FILE *out;
+
+    if (argc != 4) {
+        fprintf(stderr, "usage: %s <installed image> <new image> <patch>\n", argv[0]);
+        return 2;
+    }
+    if (prv_load(argv[1], &source) || prv_load(argv[2], &target)) {
+        return 1;
+    }
+    out = fopen(argv[3], "wb");
+    last_seen = malloc(sizeof(uint32_t) << PATCH_HASH_BITS);
+    if (out == NULL || last_seen == NULL) {
+        perror(argv[3]);
+        return 1;
+    }
+    memset(last_seen, 0xFF, sizeof(uint32_t) << PATCH_HASH_BITS);
+    for (i = 0; i + PATCH_HASH_LEN <= source.size; i++) {
+        last_seen[prv_hash(&source.data[i])] = i;
+    }
+
+    prv_put32(out, PATCH_MAGIC);
+    prv_put32(out, source.size);
+    prv_put16(out, crc16_update(CRC16_INIT, source.data, source.size));
+    prv_put32(out, target.size);
+    prv_put16(out, crc16_update(CRC16_INIT, target.data, target.size));
+
+    while (at < target.size) {
+        uint32_t from = next_source, len = prv_match(&source, next_source, &target, at);
+        if (at + PATCH_HASH_LEN <= target.size) {
+            uint32_t seen = last_seen[prv_hash(&target.data[at])];
+            uint32_t seen_len = (seen == UINT32_MAX) ? 0 : prv_match(&source, seen, &target, at);
+            if (seen_len > len) {
+                from = seen;
+                len = seen_len;
+            }
+        }
+        if (len < PATCH_MIN_COPY) {
+            at++;
+            continue;
+        }
+        prv_add(out, &target.data[add_from], at - add_from);
+        added += at - add_from;
+        fputc(PATCH_OP_COPY, out);
+        prv_put32(out, from);
+        prv_put32(out, len);
+        copied += len;
+        at += len;
+        add_from = at;
+        next_source = from + len;
+    }
+    prv_add(out, &target.data[add_from], at - add_from);
+    added += at - add_from;
+
+    printf("%u bytes copied, %u added, patch is %ld bytes\n", copied, added, ftell(out));
+    if (fclose(out) != 0) {
+        perror(argv[3]);
+        return 1;
+    }
+    return 0;
+}
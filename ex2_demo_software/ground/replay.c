@@ -0,0 +1,382 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file replay.c
+ * @date 2022-03-14
+ *
+ * Replays packet traces recorded by the simulator (see trace.h) and
+ * compares the service times of two traces.
+ *
+ * usage: replay [-t fifo|shm|zmq|zmqbatch] [-H zmq host] [-d dest] [-x speed] [-c workers] trace
+ *        replay -C baseline current
+ *
+ * A typical regression check records a trace on the baseline build, replays
+ * it into each build under test while that build records its own trace, and
+ * compares the two. Speed 2 replays twice as fast as recorded, 0 as fast as
+ * possible.
+ */
+#define _GNU_SOURCE
+
+#include <csp/csp.h>
+#include <csp/interfaces/csp_if_zmqhub.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "csp_if_fifo.h"
+#include "csp_if_shm.h"
+#include "csp_if_zmqbatch.h"
+#include "services.h"
+#include "trace.h"
+
+#define REPLAY_MAX_WORKERS 64
+#define REPLAY_CONNECT_TIMEOUT 1000 // ms
+#define REPLAY_FIRST_REPLY_TIMEOUT 5000
+#define REPLAY_NEXT_REPLY_TIMEOUT 200 // ms, replies stop being collected after this quiet period
+
+typedef struct {
+    trace_record_t record;
+    uint8_t *data;
+} loaded_record_t;
+
+typedef struct {
+    loaded_record_t *records;
+    size_t count;
+} trace_t;
+
+/* Service times of one (service, subtype) in one trace */
+typedef struct {
+    uint64_t *times_ns;
+    size_t count;
+    size_t size;
+} times_t;
+
+static trace_t replay_trace;
+static size_t next_record = 0; // shared by the workers
+static uint8_t dest = DEMO_APP_ID;
+static double speed = 1.0;
+static uint64_t start_ns;
+static uint32_t sent = 0, failed = 0;
+static uint64_t max_lag_ns = 0;
+static pthread_mutex_t replay_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t prv_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * @brief
+ *      Read a whole trace into memory
+ * @return int
+ *      0 on success
+ */
+static int prv_load(const char *path, trace_t *trace) {
+    trace_file_header_t header;
+    size_t size = 0;
+    FILE *file = fopen(path, "rb");
+
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != TRACE_MAGIC ||
+        header.version != TRACE_VERSION) {
+        fprintf(stderr, "%s is not a version %d trace\n", path, TRACE_VERSION);
+        fclose(file);
+        return -1;
+    }
+
+    trace->records = NULL;
+    trace->count = 0;
+    for (;;) {
+        loaded_record_t loaded;
+        if (fread(&loaded.record, sizeof(loaded.record), 1, file) != 1) {
+            break;
+        }
+        loaded.data = NULL;
+        if (loaded.record.length != 0) {
+            loaded.data = malloc(loaded.record.length);
+            if (fread(loaded.data, loaded.record.length, 1, file) != 1) {
+                free(loaded.data);
+                break; // the simulator was stopped mid record
+            }
+        }
+        if (trace->count == size) {
+            size = size ? size * 2 : 4096;
+            trace->records = realloc(trace->records, size * sizeof(loaded_record_t));
+        }
+        trace->records[trace->count++] = loaded;
+    }
+    fclose(file);
+    return 0;
+}
+
+/**
+ * @brief
+ *      Send a recorded request and collect its replies
+ * @return int
+ *      1 if at least one reply arrived
+ */
+static int prv_send_request(const loaded_record_t *loaded) {
+    csp_conn_t *conn =
+        csp_connect(CSP_PRIO_NORM, dest, loaded->record.service, REPLAY_CONNECT_TIMEOUT, CSP_O_RDP);
+    if (conn == NULL) {
+        return 0;
+    }
+    csp_packet_t *packet = csp_buffer_get(loaded->record.length);
+    if (packet == NULL) {
+        csp_close(conn);
+        return 0;
+    }
+    memcpy(packet->data, loaded->data, loaded->record.length);
+    packet->length = loaded->record.length;
+    if (!csp_send(conn, packet, REPLAY_CONNECT_TIMEOUT)) {
+        csp_buffer_free(packet);
+        csp_close(conn);
+        return 0;
+    }
+
+    int replies = 0;
+    csp_packet_t *reply;
+    while ((reply = csp_read(conn, replies ? REPLAY_NEXT_REPLY_TIMEOUT : REPLAY_FIRST_REPLY_TIMEOUT)) != NULL) {
+        csp_buffer_free(reply);
+        replies++;
+    }
+    csp_close(conn);
+    return replies != 0;
+}
+
+static void *prv_worker(void *param) {
+    uint64_t first_ns = replay_trace.records[0].record.timestamp_ns;
+
+    for (;;) {
+        size_t index = __atomic_fetch_add(&next_record, 1, __ATOMIC_RELAXED);
+        if (index >= replay_trace.count) {
+            break;
+        }
+        const loaded_record_t *loaded = &replay_trace.records[index];
+        if (loaded->record.type != TRACE_IN) {
+            continue;
+        }
+
+        uint64_t due = start_ns;
+        if (speed > 0) {
+            due += (uint64_t)((loaded->record.timestamp_ns - first_ns) / speed);
+        }
+        uint64_t now = prv_now_ns();
+        if (now < due) {
+            struct timespec wake = {.tv_sec = due / 1000000000ULL, .tv_nsec = due % 1000000000ULL};
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+            now = due;
+        }
+
+        int ok = prv_send_request(loaded);
+        pthread_mutex_lock(&replay_lock);
+        sent++;
+        failed += !ok;
+        if (now - due > max_lag_ns) {
+            max_lag_ns = now - due;
+        }
+        pthread_mutex_unlock(&replay_lock);
+    }
+    return NULL;
+}
+
+static void prv_add_time(times_t *times, uint64_t ns) {
+    if (times->count == times->size) {
+        times->size = times->size ? times->size * 2 : 64;
+        times->times_ns = realloc(times->times_ns, times->size * sizeof(uint64_t));
+    }
+    times->times_ns[times->count++] = ns;
+}
+
+static int prv_cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief
+ *      Pair every TRACE_IN with its TRACE_DONE and sort the service times
+ *      by (service, subtype)
+ * @param times
+ *      MAX_SERVICES * MAX_SUBTYPES entries, indexed by service * MAX_SUBTYPES + subtype
+ */
+static void prv_service_times(const trace_t *trace, times_t *times) {
+    size_t i, j;
+    for (i = 0; i < trace->count; i++) {
+        const trace_record_t *done = &trace->records[i].record;
+        if (done->type != TRACE_DONE) {
+            continue;
+        }
+        // the request is recent, so search backwards
+        for (j = i; j-- > 0;) {
+            const trace_record_t *in = &trace->records[j].record;
+            if (in->type == TRACE_IN && in->id == done->id) {
+                prv_add_time(&times[(done->service % MAX_SERVICES) * MAX_SUBTYPES + done->subtype],
+                             done->timestamp_ns - in->timestamp_ns);
+                break;
+            }
+        }
+    }
+    for (i = 0; i < MAX_SERVICES * MAX_SUBTYPES; i++) {
+        qsort(times[i].times_ns, times[i].count, sizeof(uint64_t), prv_cmp_u64);
+    }
+}
+
+static uint64_t prv_percentile(const times_t *times, unsigned pct) {
+    if (times->count == 0) {
+        return 0;
+    }
+    size_t index = (times->count * pct + 99) / 100;
+    return times->times_ns[index ? index - 1 : 0];
+}
+
+static double prv_delta(uint64_t base, uint64_t current) {
+    return base ? 100.0 * ((double)current - (double)base) / (double)base : 0.0;
+}
+
+static int prv_compare(const char *baseline_path, const char *current_path) {
+    trace_t baseline, current;
+    times_t *base_times = calloc(MAX_SERVICES * MAX_SUBTYPES, sizeof(times_t));
+    times_t *cur_times = calloc(MAX_SERVICES * MAX_SUBTYPES, sizeof(times_t));
+    int i;
+
+    if (prv_load(baseline_path, &baseline) != 0 || prv_load(current_path, &current) != 0) {
+        return -1;
+    }
+    prv_service_times(&baseline, base_times);
+    prv_service_times(&current, cur_times);
+
+    printf("%4s %4s %7s %7s %11s %11s %8s %11s %11s %8s\n", "port", "sub", "n base", "n cur", "p50 base us",
+           "p50 cur us", "delta", "p99 base us", "p99 cur us", "delta");
+    for (i = 0; i < MAX_SERVICES * MAX_SUBTYPES; i++) {
+        const times_t *b = &base_times[i], *c = &cur_times[i];
+        if (b->count == 0 && c->count == 0) {
+            continue;
+        }
+        uint64_t b50 = prv_percentile(b, 50), c50 = prv_percentile(c, 50);
+        uint64_t b99 = prv_percentile(b, 99), c99 = prv_percentile(c, 99);
+        printf("%4d %4d %7zu %7zu %11.1f %11.1f %+7.1f%% %11.1f %11.1f %+7.1f%%\n", i / MAX_SUBTYPES,
+               i % MAX_SUBTYPES, b->count, c->count, b50 / 1e3, c50 / 1e3, prv_delta(b50, c50), b99 / 1e3,
+               c99 / 1e3, prv_delta(b99, c99));
+    }
+    return 0;
+}
+
+static void prv_usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [-t fifo|shm|zmq|zmqbatch] [-H zmq host] [-d dest] [-x speed] [-c workers] trace\n"
+            "       %s -C baseline current\n",
+            name, name);
+}
+
+int main(int argc, char **argv) {
+    const char *transport = "fifo";
+    const char *zmq_host = "localhost";
+    unsigned workers = 4;
+    int compare = 0;
+    pthread_t threads[REPLAY_MAX_WORKERS];
+    int opt;
+    unsigned i;
+
+    while ((opt = getopt(argc, argv, "t:H:d:x:c:C")) != -1) {
+        switch (opt) {
+        case 't':
+            transport = optarg;
+            break;
+        case 'H':
+            zmq_host = optarg;
+            break;
+        case 'd':
+            dest = (uint8_t)atoi(optarg);
+            break;
+        case 'x':
+            speed = atof(optarg);
+            break;
+        case 'c':
+            workers = (unsigned)atoi(optarg);
+            break;
+        case 'C':
+            compare = 1;
+            break;
+        default:
+            prv_usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (compare) {
+        if (argc - optind != 2) {
+            prv_usage(argv[0]);
+            return -1;
+        }
+        return prv_compare(argv[optind], argv[optind + 1]);
+    }
+
+    if (argc - optind != 1 || workers == 0 || workers > REPLAY_MAX_WORKERS) {
+        prv_usage(argv[0]);
+        return -1;
+    }
+    if (prv_load(argv[optind], &replay_trace) != 0 || replay_trace.count == 0) {
+        return -1;
+    }
+
+    csp_conf_t csp_conf;
+    csp_conf_get_defaults(&csp_conf);
+    csp_conf.address = GND_APP_ID;
+    csp_conf.conn_max = REPLAY_MAX_WORKERS + 4;
+    if (csp_init(&csp_conf) != CSP_ERR_NONE) {
+        fprintf(stderr, "csp_init() failed\n");
+        return -1;
+    }
+
+    csp_iface_t *iface = NULL;
+    int error;
+    if (strcmp(transport, "fifo") == 0) {
+        error = csp_fifo_init("/datavolume1/ground_to_sat", "/datavolume1/sat_to_ground", &iface);
+    } else if (strcmp(transport, "shm") == 0) {
+        error = csp_shm_init(CSP_SHM_GROUND_TO_SAT, CSP_SHM_SAT_TO_GROUND, &iface);
+    } else if (strcmp(transport, "zmq") == 0) {
+        error = csp_zmqhub_init(GND_APP_ID, zmq_host, 0, &iface);
+    } else if (strcmp(transport, "zmqbatch") == 0) {
+        error = csp_zmqbatch_init(GND_APP_ID, zmq_host, &iface);
+    } else {
+        prv_usage(argv[0]);
+        return -1;
+    }
+    if (error != CSP_ERR_NONE) {
+        fprintf(stderr, "failed to start %s interface, error: %d\n", transport, error);
+        return -1;
+    }
+    csp_rtable_set(CSP_DEFAULT_ROUTE, 0, iface, CSP_NO_VIA_ADDRESS);
+    csp_route_start_task(0, 0);
+
+    start_ns = prv_now_ns();
+    for (i = 0; i < workers; i++) {
+        pthread_create(&threads[i], NULL, prv_worker, NULL);
+    }
+    for (i = 0; i < workers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    printf("replayed %u requests in %.1f s, %u without reply, sent up to %.1f ms late\n", sent,
+           (prv_now_ns() - start_ns) / 1e9, failed, max_lag_ns / 1e6);
+    return 0;
+}
@@ -30,9 +30,13 @@
 #include <unistd.h>
 
 #include "communication_service.h"
+#include "csp_if_fifo.h"
+#include "csp_if_shm.h"
+#include "csp_if_zmqbatch.h"
 #include "services.h"
 #include "system.h" // platform definitions
 #include "time_management_service.h"
+#include "trace.h"
 #include <fcntl.h>
 
 #include <pthread.h>
@@ -46,43 +50,9 @@
  *  - Start the FreeRTOS sceduler
  */
 
-/* FIFO INTERFACE */
-pthread_t rx_thread;
-int rx_channel, tx_channel;
-#define BUF_SIZE 250
-
-int csp_fifo_tx(const csp_route_t *ifroute, csp_packet_t *packet);
 void vAssertCalled(unsigned long ulLine, const char *const pcFileName);
 
-csp_iface_t csp_if_fifo = {
-    .name = "fifo",
-    .nexthop = csp_fifo_tx,
-    .mtu = BUF_SIZE,
-};
-
-int csp_fifo_tx(const csp_route_t *ifroute, csp_packet_t *packet) {
-    /* Write packet to fifo */
-    if (write(tx_channel, &packet->length, packet->length + sizeof(uint32_t) + sizeof(uint16_t)) < 0)
-        printf("Failed to write frame\r\n");
-    csp_buffer_free(packet);
-    return CSP_ERR_NONE;
-}
-
-void fifo_rx(void *parameters) {
-    csp_packet_t *buf = csp_buffer_get(BUF_SIZE);
-    /* Wait for packet on fifo */
-    for (;;) {
-        while (read(rx_channel, &buf->length, BUF_SIZE) > 0) {
-            csp_qfifo_write(buf, &csp_if_fifo, NULL);
-            buf = csp_buffer_get(BUF_SIZE);
-        }
-        vTaskDelay(500);
-    }
-    return NULL;
-}
-/** FIFO INTERFACE ENDS **/
-
-static inline SAT_returnState init_zmq();
+static inline SAT_returnState init_zmq(const char *host, csp_iface_t **iface);
 
 int main(int argc, char **argv) {
     ex2_log("-- starting command demo --\n");
@@ -109,21 +79,40 @@ int main(int argc, char **argv) {
         return -1;
     }
 
-    tx_channel = open(tx_channel_name, O_RDWR);
-    if (tx_channel < 0) {
-        printf("Failed to open TX channel\r\n");
+    /*
+     * Link to the ground: "fifo" (default) or "shm", or to other nodes
+     * through a zmqproxy: "zmq" or "zmqbatch", optionally followed by the
+     * proxy host
+     */
+    const char *transport = (argc > 1) ? argv[1] : "fifo";
+    const char *zmq_host = (argc > 2) ? argv[2] : "localhost";
+    csp_iface_t *default_iface = NULL;
+    if (strcmp(transport, "shm") == 0) {
+        error = csp_shm_init(CSP_SHM_SAT_TO_GROUND, CSP_SHM_GROUND_TO_SAT, &default_iface);
+    } else if (strcmp(transport, "fifo") == 0) {
+        error = csp_fifo_init(tx_channel_name, rx_channel_name, &default_iface);
+    } else if (strcmp(transport, "zmq") == 0) {
+        error = (init_zmq(zmq_host, &default_iface) == SATR_OK) ? CSP_ERR_NONE : CSP_ERR_DRIVER;
+    } else if (strcmp(transport, "zmqbatch") == 0) {
+        error = csp_zmqbatch_init(my_address, zmq_host, &default_iface);
+    } else {
+        printf("usage: %s [fifo|shm|zmq|zmqbatch] [zmq host]\r\n", argv[0]);
         return -1;
     }
-
-    rx_channel = open(rx_channel_name, O_RDWR);
-    if (rx_channel < 0) {
-        printf("Failed to open RX channel\r\n");
+    if (error != CSP_ERR_NONE) {
+        ex2_log("Failed to start %s interface, error: %d\n", transport, error);
         return -1;
     }
-    xTaskCreate((TaskFunction_t)fifo_rx, "fifo rx", 128, NULL, configMAX_PRIORITIES - 1, NULL);
+    /* Set EX2_TRACE to a file name to record a packet trace for ground/replay */
+    const char *trace_path = getenv("EX2_TRACE");
+    if (trace_path != NULL && trace_open(trace_path) == 0) {
+        trace_wrap_iface(default_iface);
+        ex2_log("Tracing to %s\n", trace_path);
+    }
+
     ex2_log("Running at %d\n", my_address);
     /* Set default route and start router & server */
-    csp_route_set(CSP_DEFAULT_ROUTE, &csp_if_fifo, CSP_NODE_MAC);
+    csp_route_set(CSP_DEFAULT_ROUTE, default_iface, CSP_NODE_MAC);
 
     csp_route_start_task(0, 0);
     // csp_route_set(16, &csp_if_fifo, CSP_NODE_MAC);
@@ -154,19 +143,21 @@ int main(int argc, char **argv) {
 
 /**
  * @brief
- * 		initialize zmq interface, and configure the routing table
+ * 		initialize zmq interface
  * @details
- * 		start the localhost zmq server and add it to the default route
- * with no VIA address
+ * 		connect to the zmqproxy on host. The caller adds the interface
+ * to the default route
+ * @param host
+ * 		host running the zmqproxy
+ * @param iface
+ * 		set to the new interface
  */
-static inline SAT_returnState init_zmq() {
-    csp_iface_t *default_iface = NULL;
-    int error = csp_zmqhub_init(csp_get_address(), "localhost", 0, &default_iface);
+static inline SAT_returnState init_zmq(const char *host, csp_iface_t **iface) {
+    int error = csp_zmqhub_init(csp_get_address(), host, 0, iface);
     if (error != CSP_ERR_NONE) {
-        ex2_log("failed to add ZMQ interface [%s], error: %d", "localhost", error);
+        ex2_log("failed to add ZMQ interface [%s], error: %d", host, error);
         return SATR_ERROR;
     }
-    csp_rtable_set(CSP_DEFAULT_ROUTE, 0, default_iface, CSP_NO_VIA_ADDRESS);
     return SATR_OK;
 }
 
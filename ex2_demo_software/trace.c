@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file trace.c
+ * @date 2022-03-14
+ *
+ * Records every request dispatched to a service, its completion, and every
+ * packet the satellite sends into a trace file for ground/replay.
+ */
+#define _GNU_SOURCE
+
+#include "trace.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "util/service_stats.h"
+
+#define TRACE_FLUSH_INTERVAL_NS 1000000000ULL
+
+static FILE *trace_file = NULL;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t next_id = 1;
+static uint64_t last_flush_ns = 0;
+
+/* The interface whose transmissions are being traced, and its real transmit */
+static csp_iface_t *traced_iface = NULL;
+static int (*traced_nexthop)(const csp_route_t *ifroute, csp_packet_t *packet);
+
+static uint64_t prv_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * @brief
+ *      Append one record and its data to the trace
+ * @param record
+ *      Record with everything but the timestamp filled in
+ * @param data
+ *      record->length bytes of packet data
+ */
+static void prv_write(trace_record_t *record, const void *data) {
+    pthread_mutex_lock(&trace_lock);
+    record->timestamp_ns = prv_now_ns();
+    fwrite(record, sizeof(*record), 1, trace_file);
+    if (record->length != 0) {
+        fwrite(data, record->length, 1, trace_file);
+    }
+    // flush now and then so a killed simulator still leaves a usable trace
+    if (record->timestamp_ns - last_flush_ns > TRACE_FLUSH_INTERVAL_NS) {
+        fflush(trace_file);
+        last_flush_ns = record->timestamp_ns;
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+static uint32_t prv_trace_begin(uint8_t service, const csp_packet_t *packet) {
+    trace_record_t record = {0};
+    record.type = TRACE_IN;
+    record.service = service;
+    record.subtype = (packet->length > SUBSERVICE_BYTE) ? packet->data[SUBSERVICE_BYTE] : 0;
+    record.id = __atomic_fetch_add(&next_id, 1, __ATOMIC_RELAXED);
+    record.csp_id = packet->id.ext;
+    record.length = packet->length;
+    prv_write(&record, packet->data);
+    return record.id;
+}
+
+static void prv_trace_end(uint32_t trace_id, uint8_t service, uint8_t subtype, SAT_returnState result) {
+    trace_record_t record = {0};
+    record.type = TRACE_DONE;
+    record.service = service;
+    record.subtype = subtype;
+    record.result = (int8_t)result;
+    record.id = trace_id;
+    prv_write(&record, NULL);
+}
+
+static int prv_traced_nexthop(const csp_route_t *ifroute, csp_packet_t *packet) {
+    trace_record_t record = {0};
+    record.type = TRACE_OUT;
+    record.service = packet->id.sport;
+    record.subtype = (packet->length > SUBSERVICE_BYTE) ? packet->data[SUBSERVICE_BYTE] : 0;
+    record.csp_id = packet->id.ext;
+    record.length = packet->length;
+    prv_write(&record, packet->data);
+    return traced_nexthop(ifroute, packet);
+}
+
+/**
+ * @brief
+ *      Start tracing every service dispatch into a file
+ * @param path
+ *      Trace file, replaced if it exists
+ * @return int
+ *      0 on success
+ */
+int trace_open(const char *path) {
+    trace_file_header_t header = {.magic = TRACE_MAGIC, .version = TRACE_VERSION};
+
+    trace_file = fopen(path, "wb");
+    if (trace_file == NULL) {
+        perror(path);
+        return -1;
+    }
+    fwrite(&header, sizeof(header), 1, trace_file);
+    svc_stats_set_trace(prv_trace_begin, prv_trace_end);
+    return 0;
+}
+
+/**
+ * @brief
+ *      Also trace every packet sent through an interface
+ * @param iface
+ *      The interface, usually the link to the ground. Only one can be traced
+ */
+void trace_wrap_iface(csp_iface_t *iface) {
+    if (trace_file == NULL || traced_iface != NULL) {
+        return;
+    }
+    traced_iface = iface;
+    traced_nexthop = iface->nexthop;
+    iface->nexthop = prv_traced_nexthop;
+}
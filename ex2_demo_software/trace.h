@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2022  University of Alberta
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+/**
+ * @file trace.h
+ * @date 2022-03-14
+ *
+ * Binary packet trace of the simulated satellite. The file is a
+ * trace_file_header_t followed by trace_record_t records, each followed by
+ * `length` bytes of packet data. Everything is in host byte order since
+ * traces are written and read on the same machine.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <csp/csp.h>
+#include <stdint.h>
+
+#define TRACE_MAGIC 0x54325845 // "EX2T"
+#define TRACE_VERSION 1
+
+typedef enum {
+    TRACE_IN = 0,   // request handed to a service
+    TRACE_DONE = 1, // service handler returned
+    TRACE_OUT = 2,  // packet sent by the satellite
+} trace_record_type_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+} trace_file_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t type;
+    uint8_t service; // CSP port
+    uint8_t subtype;
+    int8_t result;         // SAT_returnState of a TRACE_DONE
+    uint32_t id;           // pairs a TRACE_IN with its TRACE_DONE
+    uint64_t timestamp_ns; // CLOCK_MONOTONIC
+    uint32_t csp_id;       // CSP header of a TRACE_IN or TRACE_OUT packet
+    uint16_t length;       // bytes of packet data that follow
+} trace_record_t;
+
+int trace_open(const char *path);
+
+void trace_wrap_iface(csp_iface_t *iface);
+
+#endif /* TRACE_H */